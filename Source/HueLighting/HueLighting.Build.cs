@@ -29,6 +29,8 @@ public class HueLighting : ModuleRules
 				"Json", 
 				"JsonUtilities", 
 				"Sockets",
+				"MovieScene",
+				"NetCore",
 				// ... add other public dependencies that you statically link with here ...
 			}
 			);
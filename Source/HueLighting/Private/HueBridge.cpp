@@ -4,26 +4,93 @@ Copyright (c) 2022 Scott Tongue all rights reversed
 */
 
 #include "HueBridge.h"
+#include "HueGradientLamp.h"
 
 #include "HttpModule.h"
+#include "HttpManager.h"
 #include "JsonObjectConverter.h"
 #include "Interfaces/IHttpResponse.h"
+#include "Algo/MaxElement.h"
+#include "Misc/CoreDelegates.h"
 #include "Misc/FileHelper.h"
 
+namespace HueAmbient
+{
+	//Bridge timers count in whole seconds and at most a day
+	FString FormatTimer(double Seconds)
+	{
+		const int32 Total = FMath::Clamp(FMath::RoundToInt(Seconds), 1, 86399);
+		return FString::Printf(TEXT("PT%02d:%02d:%02d"), Total / 3600, (Total / 60) % 60, Total % 60);
+	}
+}
 
 // Sets default values
 AHueBridge::AHueBridge()
 {
- 	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
-	PrimaryActorTick.bCanEverTick = false;
-
+ 	// Set this actor to call Tick() every frame, the send scheduler hands out request slots from here
+	PrimaryActorTick.bCanEverTick = true;
+	Scheduler = MakeShared<FHueSendScheduler>(SendRate, SchedulePolicy);
+	EffectRunner = MakeShared<FHueEffectRunner>(EffectRate);
+	RefreshTransport();
 }
 
 // Called when the game starts or when spawned
 void AHueBridge::BeginPlay()
 {
 	Super::BeginPlay();
-	
+	Scheduler->SetSendRate(SendRate);
+	Scheduler->SetPolicy(SchedulePolicy);
+	Scheduler->SetAgeWeight(ScheduleAgeWeight);
+	EffectRunner->SetRate(EffectRate);
+	RefreshTransport();
+	EndFrameHandle = FCoreDelegates::OnEndFrame.AddUObject(this, &AHueBridge::OnEndFrame);
+	if(bUseCommandBroker)
+	{
+		StartCommandBroker();
+	}
+	if(bEnableDmxInput)
+	{
+		StartDmxInput();
+	}
+	if(bEnableSensors)
+	{
+		StartSensors();
+	}
+}
+
+void AHueBridge::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	FCoreDelegates::OnEndFrame.Remove(EndFrameHandle);
+	//Nothing will answer the operations still waiting, let their listeners go
+	QueuedOperations.Empty();
+	for (const EHueBridgeOperation Operation : ActiveOperations.Array())
+	{
+		FinishOperation(Operation, EHueOperationResult::Unreachable);
+	}
+	if(BridgeDiscovery.IsValid())
+	{
+		BridgeDiscovery->Cancel();
+		BridgeDiscovery.Reset();
+	}
+	bDiscoverLampsAfterBridge = false;
+	//Put the room back the way we found it, only the process that owns the bridge does it
+	EffectRunner->StopAll();
+	StopDmxInput();
+	StopSensors();
+	if(bRestoreSnapshotOnEndPlay && SessionSnapshot.bValid && OwnsBridgeConnection())
+	{
+		RestoreSessionSnapshot();
+		WaitForRestore(RestoreTimeBudget);
+	}
+	//Release the broker port straight away so another process can take over
+	bBrokerRequested = false;
+	bBrokerReadPending = false;
+	CommandBroker.Reset();
+	if(ConfigStore.IsValid())
+	{
+		ConfigStore->Flush();
+	}
+	Super::EndPlay(EndPlayReason);
 }
 
 
@@ -33,443 +100,2752 @@ void AHueBridge::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 
-}
-
-/**
- * @brief Callback for HUE API Response for discover of all lights connected to the Hue Bridge
- * @param Request Signature for callback 
- * @param Response Signature for callback 
- * @param bWasSuccessful  Signature for callback 
- */
-void AHueBridge::OnResponseReceivedDiscover(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful)
-{
-	//Get Respond as string of data and if there is any Error in the string break out early
-	const FString Data  = Response->GetContentAsString();
-	if(Data.Contains(TEXT("Error")))
+	if(EffectRunner->IsPlaying())
 	{
-		UE_LOG(LogTemp, Warning, TEXT("%s"),*Data);
-		UE_LOG(LogTemp, Warning, TEXT("USER DOES NOT EXIST!"));
-		bInUse = false;
-		UserConfiguredCorrectly(false);
-		return;
+		TickEffects();
 	}
 
-	//Deserilize the Json object 
-	TSharedPtr<FJsonObject> ResponseObj;
-	const TSharedRef<TJsonReader<>> JsonReader = TJsonReaderFactory<>::Create(Data);
-
-	if(! FJsonSerializer::Deserialize(JsonReader, ResponseObj))
+	if(DmxLoopback.IsValid())
 	{
-		UE_LOG(LogTemp, Warning, TEXT("FAILED TO Deserialize Find Lights Responds"));
+		DmxLoopback->Tick(FPlatformTime::Seconds());
 	}
-	else
+	if(DmxReceiver.IsValid())
 	{
-		//Setup a Tmap of all keys and Json data
-		TMap<FString, TSharedPtr<FJsonValue>> JsonValues = ResponseObj->Values;
-	
-		int32 KeyCounter = 1;
-		//Setup URL path for Device; 
-		const FString URL = TEXT("http://")+
-			HueBridgeConfig.HostName +
-			TEXT("/api/") + HueBridgeConfig.UserName +
-			TEXT("/lights");
-		FString Device;
-		for (const auto& Element : JsonValues)
+		TickDmx();
+	}
+	if(SensorPoller.IsValid())
+	{
+		TickSensors();
+	}
+	if(ConfigStore.IsValid())
+	{
+		ConfigStore->Tick();
+	}
+
+	if(CommandBroker.IsValid())
+	{
+		TickCommandBroker();
+		if(!CommandBroker->IsOwner())
 		{
+			return;
+		}
+	}
 
-			FString FieldName = Element.Key;
+	//Frames hold every send until they are committed
+	if(FrameDepth > 0 || bAutoCommitFrames)
+	{
+		return;
+	}
 
-			const TSharedPtr<FJsonValue> FieldValue = Element.Value;
+	SendScheduled(FPlatformTime::Seconds());
+}
 
-			//Check if the field is Lamp
-			if(FieldName.Compare(TYPE))
-			{
-				//Complete URL path to hue bridge for hue lamp
-				Device = URL + TEXT("/") + FString::FromInt(KeyCounter) + STATE;
-				UE_LOG(LogTemp,Warning, TEXT("%s"), *Device);
-			}
-			//Setup the Name of the Lamp
-			if(FieldName.Compare(NAME))
-			{
-				FString LampName;
-				GetStringName(FieldValue->AsObject(),NAME, LampName);
-				TObjectPtr<AHueLamp> Lamp = GetWorld()->SpawnActor<AHueLamp>();
-				Lamp->SetupLamp(Device, FString::FromInt(KeyCounter), LampName);
-				HueLamps.Add(LampName, Lamp);
-				UE_LOG(LogTemp,Warning, TEXT("%s"), *LampName);
-				KeyCounter++;
-			}
-		
+/**
+ * @brief Hand out this tick's send slots, largest visible error first :: Internal Call
+ * @param Now Current time in seconds
+ */
+void AHueBridge::SendScheduled(double Now)
+{
+	Scheduler->Tick(Now, ScheduledThisTick);
+	for (const int32 Slot : ScheduledThisTick)
+	{
+		if(AHueLamp* Lamp = ScheduledLamps[Slot].Get())
+		{
+			Lamp->SendDesiredState();
 		}
 	}
-	
-	bInUse = false;
-	FoundDiscoverableLights.Broadcast();
 }
 
-
 /**
- * @brief Callback for HUE API Response for New user Setup
+ * @brief Callback for HUE API Response for discover of all lights connected to the Hue Bridge
  * @param Request Signature for callback 
  * @param Response Signature for callback 
- * @param bWasSuccessful Signature for callback 
+ * @param bWasSuccessful  Signature for callback 
  */
-void AHueBridge::OnResponseReceivedNewUser(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful)
+void AHueBridge::OnResponseReceivedDiscover(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful)
 {
-	//Get Respond as string of data and if there is any Error in the string break out early
-	FString Data = Response->GetContentAsString();
-	if(Data.Contains(TEXT("Error")))
+	//Transport only parses a light list, a rejected user comes back as an error the transport can't read
+	if(!bWasSuccessful || !Response.IsValid())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Hue bridge %s didn't answer the light discovery"), *HueBridgeConfig.HostName);
+		FinishOperation(EHueBridgeOperation::Discover, EHueOperationResult::Unreachable);
+		return;
+	}
+	const FString Data = Response->GetContentAsString();
+	TArray<FHueLightRecord> Lights;
+	if(!Transport->ParseLights(Data, Lights))
 	{
 		UE_LOG(LogTemp, Warning, TEXT("%s"),*Data);
 		UE_LOG(LogTemp, Warning, TEXT("USER DOES NOT EXIST!"));
-		bInUse = false;
 		UserConfiguredCorrectly(false);
+		FinishOperation(EHueBridgeOperation::Discover, EHueOperationResult::Rejected);
 		return;
 	}
-
-	int32 index = Data.Find(USERNAME)+11;
-	Data = Data.RightChop(index);
-	Data = Data.LeftChop(4);
-	HueBridgeConfig.UserName = Data;
-	UE_LOG(LogTemp, Warning, TEXT("USER: %s Created"), *HueBridgeConfig.UserName);
-	bInUse = false;
-	UserConfiguredCorrectly(true);
-	//Deserilize the Json object JSON OBJECT FAIL TO Deserialize so chopping the string instead
-	
-
-	/*TSharedPtr<FJsonObject> ResponseObj = MakeShareable(new FJsonObject);
-//	const TSharedRef<TJsonReader<>> JsonReader = TJsonReaderFactory<>::Create(Response->GetContentAsString());
-	
-	if(! FJsonSerializer::Deserialize(JsonReader, ResponseObj))
+	if(CommandBroker.IsValid())
 	{
-		UE_LOG(LogTemp, Warning, TEXT("FAILED TO Deserialize NEWUSER RESPOND!"));
-		
+		CommandBroker->Publish(Lights);
 	}
-	else
-	{
-		//Setup a Tmap of all keys and Json data
-		TMap<FString, TSharedPtr<FJsonValue>> JsonValues = ResponseObj->Values;
-		for (const auto& Element : JsonValues)
-		{
-			FString FieldName = Element.Key;
-
-			const TSharedPtr<FJsonValue> FieldValue = Element.Value;
+	OnLampsDiscovered(Lights);
+}
 
-			//Find our Username field and setup the user name properly 
-			if(FieldName.Compare(USERNAME))
-			{
-				FString UserName;
-				GetStringName(FieldValue->AsObject(),USERNAME, UserName);
-				HueBridgeConfig.UserName = UserName;
-				UE_LOG(LogTemp, Warning, TEXT("USER: %s Created"), *HueBridgeConfig.UserName);
-				bInUse = false;
-				UserConfiguredCorrectly(true);
-				return;
-			}
-		}
+/**
+ * @brief Spawn and fill lamps from a discovery, read from the bridge or handed over by the broker owner :: Internal Call
+ * @param Lights Every light the bridge reported
+ */
+void AHueBridge::OnLampsDiscovered(const TArray<FHueLightRecord>& Lights)
+{
+	bLampsDiscovered = true;
+	UpdateLamps(Lights, true);
+	if(bCaptureSnapshotOnDiscover && !SessionSnapshot.bValid)
+	{
+		BuildSnapshot(Lights, SessionSnapshot);
+		SnapshotCaptured.Broadcast(SessionSnapshot);
 	}
-	UE_LOG(LogTemp, Warning, TEXT(" User Couldnt be Created please press link on Hue Hub!!"));
-	bInUse = false;
-	UserConfiguredCorrectly(false);
-	*/
-	
-
-    
 	
-/*	 if(FString UserName; ResponseObj->TryGetStringField(USERNAME,UserName ))
+	if(bCompileScenesOnDiscover)
 	{
-		UE_LOG(LogTemp, Warning, TEXT("FOUND:: %s"),*UserName)
-		HueBridgeConfig.UserName = UserName;
-		
-	} */
-	
-	
+		CompileAllScenes();
+	}
+	if(!GetWorldTimerManager().IsTimerActive(StateRefreshTimer))
+	{
+		SetStateRefreshInterval(StateRefreshInterval);
+	}
+	FoundDiscoverableLights.Broadcast();
+	FinishOperation(EHueBridgeOperation::Discover, EHueOperationResult::Succeeded);
 }
 
+
 /**
- * @brief Callback for HUE API Response for if user exist yet or not on huebridge
+ * @brief Callback for HUE API Response for the periodic bulk state refresh of every lamp
  * @param Request Signature for callback 
  * @param Response Signature for callback 
  * @param bWasSuccessful Signature for callback 
  */
-void AHueBridge::OnResponseReceivedUserExist(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful)
+void AHueBridge::OnResponseReceivedStateRefresh(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful)
 {
-	FString Data = Response->GetContentAsString();
-	if(Data.Contains(HueBridgeConfig.UserName))
+	if(!bWasSuccessful || !Response.IsValid())
 	{
-		bUserExist = true;
+		FinishOperation(EHueBridgeOperation::RefreshState, EHueOperationResult::Unreachable);
+		return;
 	}
-	else
+	TArray<FHueLightRecord> Lights;
+	const bool bParsed = Transport->ParseLights(Response->GetContentAsString(), Lights);
+	if(bParsed)
 	{
-		bUserExist = false;
+		if(CommandBroker.IsValid())
+		{
+			CommandBroker->Publish(Lights);
+		}
+		UpdateLamps(Lights, false);
 	}
-
-	HasUserBeenConfigured.Broadcast(bUserExist);
+	FinishOperation(EHueBridgeOperation::RefreshState, bParsed ? EHueOperationResult::Succeeded : EHueOperationResult::Rejected);
 }
 
-
 /**
- * @brief Check to see if we are making Rest API call to the hue bridge to prevent flooding the hue bridge
- * @return Returns false if we aren't busy making a REST Call
+ * @brief Callback for HUE API Response for the connectivity read ahead of a bulk light read
+ * @param Request Signature for callback 
+ * @param Response Signature for callback 
+ * @param bWasSuccessful Signature for callback 
+ * @param Operation Discover or RefreshState waiting on the light read
  */
-bool AHueBridge::CheckIfBusy()
+void AHueBridge::OnResponseReceivedConnectivity(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful, EHueBridgeOperation Operation)
 {
-	if(bInUse)
+	//A failed read keeps the last known reachability, the lights are read either way
+	if(bWasSuccessful && Response.IsValid())
 	{
-		PleaseWaitingForBridgeRespond();
-		RequestsBusy.Broadcast();
-		return true;
+		Transport->ParseConnectivity(Response->GetContentAsString());
 	}
-	return false;
-}
-
-
-/**
- * @brief  Converts JasonObject data to Lightinfo Struct
- * @param JsonObject Jsonobject to be used FJsonObject
- * @param LightInfoOut Flightinfo struct out param to be filled FLightInfo
- */
-void  AHueBridge::GetLightInfo(TSharedPtr<FJsonObject> JsonObject,  FLightInfo& LightInfoOut)
-{
-	LightInfoOut.Name = JsonObject->GetStringField("LightName");
-	LightInfoOut.bUseLight = JsonObject->GetBoolField("bUseLight");
-}
-
-/**
- * @brief Converts JasonObject data to a string 
- * @param JsonObject 
- * @param Field Name of json field to used as a string
- * @param NameOut String that is used for Out param to be filled
- */
-void AHueBridge::GetStringName(TSharedPtr<FJsonObject> JsonObject, const FString& Field, FString& NameOut)
-{
-	NameOut = JsonObject->GetStringField(Field);
-}
-
-/**
- * @brief Set if our user has been configured properly, use to broadcast for UI elements 
- * @param Value Bool if used is configured properly
- */
-void AHueBridge::UserConfiguredCorrectly(bool Value)
-{
-	bUserExist = Value;
-	HasUserBeenConfigured.Broadcast(bUserExist);
+	ReadLights(Operation, false);
 }
 
 /**
- * @brief Creates REST API call to the Hue bridge too find all lamp connected to the bridge. User needs to be created
- * in order to find all lamps 
+ * @brief Callback for HUE API Response for the bulk sensor read
+ * @param Request Signature for callback 
+ * @param Response Signature for callback 
+ * @param bWasSuccessful Signature for callback 
  */
-void AHueBridge::DiscoverLamps()
+void AHueBridge::OnResponseReceivedSensors(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful)
 {
-	if(CheckIfBusy())
+	if(!SensorPoller.IsValid())
 	{
 		return;
 	}
-	//Setup HTTP REST CALL and Completed Request Delegate 
-	const TSharedRef<IHttpRequest> Request = HTTPHandler->Get().CreateRequest();
-	Request->OnProcessRequestComplete().BindUObject(this, &AHueBridge::OnResponseReceivedDiscover);
-	const FString URL = TEXT("http://")+
-		HueBridgeConfig.HostName +
-		TEXT("/api/") + HueBridgeConfig.UserName +
-		TEXT("/lights");
-
-	//Fill out JSON DATA
-	TSharedRef<FJsonObject> RequestOBJ = MakeShared<FJsonObject>();
-	//RequestOBJ->SetStringField(TEXT("devicetype"), HueBridgeConfig.AppName);
-
-	//Serialize Data
-	FString RequestBody;
-	const TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&RequestBody);
-	FJsonSerializer::Serialize(RequestOBJ, Writer);
-	
-	Request->SetURL(URL);
-	Request->SetVerb(VERB_GET);
-	Request->SetHeader("Content-Type", TEXT("application/json"));
-	//Request->SetContentAsString(RequestBody);
-	Request->ProcessRequest();
-	bInUse = true;
+	TArray<FHueSensorState> Sensors;
+	if(!bWasSuccessful || !Response.IsValid() || !Transport->ParseSensors(Response->GetContentAsString(), Sensors))
+	{
+		SensorPoller->MarkPollFailed(FPlatformTime::Seconds());
+		return;
+	}
+	SensorPoller->MergePoll(Sensors, FPlatformTime::Seconds(), ChangedSensors);
+	BroadcastSensorChanges();
 }
 
 /**
- * @brief Setups a timer to create to ask the user to press the hue bridge link button
+ * @brief Event stream got more data, merge every complete line that arrived since the last call
+ * @param Request Signature for callback 
+ * @param BytesSent Signature for callback 
+ * @param BytesReceived Signature for callback 
  */
-void AHueBridge::HueBridgeSetupTimer()
+void AHueBridge::OnEventStreamProgress(FHttpRequestPtr Request, int32 BytesSent, int32 BytesReceived)
 {
-	if(GetWorldTimerManager().IsTimerActive(LinkBridgeTimer))
+	const FHttpResponsePtr Response = Request.IsValid() ? Request->GetResponse() : nullptr;
+	if(!SensorPoller.IsValid() || Request != EventStream || !Response.IsValid())
 	{
-		UE_LOG(LogTemp, Warning, TEXT("Hue Bridge Link already being requested"));	
 		return;
 	}
-	GetWorld()->GetTimerManager().ClearTimer(LinkBridgeTimer);
-	GetWorld()->GetTimerManager().SetTimer(LinkBridgeTimer, this, &AHueBridge::SetupNewUser,DelayTimerForBridgePress, false);
-	RequestUser.Broadcast(DelayTimerForBridgePress);
-	HueBringTimerStarted_Implementation(DelayTimerForBridgePress);
-	
+	const TArray<uint8>& Content = Response->GetContent();
+	int32 End = Content.Num();
+	while(End > EventStreamOffset && Content[End - 1] != '\n')
+	{
+		--End;
+	}
+	if(End <= EventStreamOffset)
+	{
+		return;
+	}
+	const FUTF8ToTCHAR Converted(reinterpret_cast<const ANSICHAR*>(Content.GetData() + EventStreamOffset), End - EventStreamOffset);
+	EventStreamOffset = End;
+	TArray<FHueSensorState> Events;
+	if(Transport->ParseEvents(FString(Converted.Length(), Converted.Get()), Events))
+	{
+		SensorPoller->MergeEvents(Events, FPlatformTime::Seconds(), ChangedSensors);
+		BroadcastSensorChanges();
+	}
+	//The response keeps every event it ever got, start over before it grows without end
+	if(EventStreamOffset > 1024 * 1024)
+	{
+		StartEventStream();
+	}
 }
 
 /**
- * @brief Creates REST API call to the Hue bridge to create a new user
+ * @brief Callback for the event stream closing, polls go back to full speed until it is open again
+ * @param Request Signature for callback 
+ * @param Response Signature for callback 
+ * @param bWasSuccessful Signature for callback 
  */
-void AHueBridge::SetupNewUser()
+void AHueBridge::OnResponseReceivedEventStream(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful)
 {
-	GetWorld()->GetTimerManager().ClearTimer(LinkBridgeTimer);
-	if(CheckIfBusy())
+	if(Request != EventStream || !SensorPoller.IsValid())
 	{
 		return;
 	}
-	
-	//Setup HTTP REST CALL and Completed Request Delegate 
-	const TSharedRef<IHttpRequest> Request = HTTPHandler->Get().CreateRequest();
-	Request->OnProcessRequestComplete().BindUObject(this, &AHueBridge::OnResponseReceivedNewUser);
-	const FString URL = TEXT("http://") +
-		HueBridgeConfig.HostName +
-		TEXT("/api");
-	
-	//Fill out JSON DATA
-	TSharedRef<FJsonObject> RequestOBJ = MakeShared<FJsonObject>();
-	RequestOBJ->SetStringField(TEXT("devicetype"), HueBridgeConfig.AppName);
-
-	//Serialize Data
-	FString RequestBody;
-	const TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&RequestBody);
-	FJsonSerializer::Serialize(RequestOBJ, Writer);
-
-	Request->SetURL(URL); 
-	Request->SetVerb(VERB_POST);
-	Request->SetHeader("Content-Type", TEXT("application/json"));
-	Request->SetContentAsString(RequestBody);
-	Request->ProcessRequest();
-	bInUse = true;
-	
-	
+	EventStream.Reset();
+	SensorPoller->SetStreaming(false);
+	EventStreamRetryTime = FPlatformTime::Seconds() + 5.0;
 }
 
 /**
- * @brief Save Hue bridge config out to Json file
+ * @brief Callback for HUE API Response for a snapshot of every lamp
+ * @param Request Signature for callback 
+ * @param Response Signature for callback 
+ * @param bWasSuccessful Signature for callback 
  */
-void AHueBridge::SaveConfig()
+void AHueBridge::OnResponseReceivedSnapshot(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful)
 {
-	SaveWarning.Broadcast();
-	for (const auto&  Element: HueLamps)
+	TArray<FHueLightRecord> Lights;
+	if(!bWasSuccessful || !Response.IsValid() || !Transport->ParseLights(Response->GetContentAsString(), Lights))
 	{
- 
-		FLightUse Light;
-		Light.LightName = Element.Key;
-		Light.bUseLight = HueLamps[Element.Key]->LampToBeUsed();
-		HueBridgeConfig.Lights.Add(Light);
+		UE_LOG(LogTemp, Warning, TEXT("Hue snapshot failed"));
+		return;
 	}
-
-	//Write Data out to file in JSON format 
-	FString JsonData;
-	FJsonObjectConverter::UStructToJsonObjectString(HueBridgeConfig, JsonData);
-	FFileHelper::SaveStringToFile(*JsonData, *(FPaths::ProjectContentDir()+CONFIG_FILE));
-	UE_LOG(LogTemp, Warning, TEXT("HueConfig SAVED!"));
-	
+	UpdateLamps(Lights, false);
+	BuildSnapshot(Lights, SessionSnapshot);
+	SnapshotCaptured.Broadcast(SessionSnapshot);
 }
 
 /**
- * @brief Load Hue Bridge config from json file
+ * @brief Callback for HUE API Response for the temporary restore scene, recalls it once it exists. If the bridge
+ * wouldn't make the scene its lamps are written one by one instead
+ * @param Request Signature for callback 
+ * @param Response Signature for callback 
+ * @param bWasSuccessful Signature for callback 
+ * @param Id Restore the scene belongs to, a newer restore has taken over if it doesn't match
  */
-void AHueBridge::LoadConfig()
+void AHueBridge::OnResponseReceivedRestoreScene(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful, int32 Id)
 {
-
-	//Load in Data from JSON file
-	FString JsonData;
-	FFileHelper::LoadFileToString(JsonData, *(FPaths::ProjectContentDir()+CONFIG_FILE));
-	const TSharedRef<TJsonReader<TCHAR>> JsonReader = TJsonReaderFactory<TCHAR>::Create(JsonData);
-	TSharedPtr<FJsonObject> JsonObject = MakeShareable(new FJsonObject());
-
-	if(FJsonSerializer::Deserialize(JsonReader,JsonObject) && JsonObject.IsValid())
+	FString SceneId;
+	const bool bCreated = bWasSuccessful && Response.IsValid() && Transport->ParseCreatedId(Response->GetContentAsString(), SceneId);
+	if(Id != RestoreId)
 	{
-		//Setup our Config Data
-		HueBridgeConfig.HostName = JsonObject->GetStringField("HostName");
-		HueBridgeConfig.UserName = JsonObject->GetStringField("UserName");
-		TArray<TSharedPtr<FJsonValue>> LightsJson =  JsonObject->GetArrayField("Lights");
-		
-		//Setup all our Hue Lamps
-		DiscoverLamps();
-		for (const auto& Element : LightsJson)
+		if(bCreated)
+		{
+			Transport->CreateDeleteScene(SceneId)->ProcessRequest();
+		}
+		return;
+	}
+	if(bCreated)
+	{
+		//The recall sets these lamps, nothing for the scheduler to send
+		for (const auto& Element : RestoreSceneStates)
 		{
-			FLightInfo Info;
-			GetLightInfo(Element->AsObject(), Info);
-			if(HueLamps.Contains(Info.Name))
+			const TWeakObjectPtr<AHueLamp>* Lamp = LampsByKey.Find(Element.Key);
+			if(Lamp && Lamp->IsValid())
 			{
-				HueLamps[Info.Name]->UseLampLight(Info.bUseLight);
+				(*Lamp)->MarkStateFromBridge(Element.Value);
 			}
 		}
-	
-		UE_LOG(LogTemp, Warning, TEXT("HueConfig LOADED!"));	
+		const TSharedRef<IHttpRequest> Recall = Transport->CreateRecallScene(SceneId);
+		Recall->OnProcessRequestComplete().BindUObject(this, &AHueBridge::OnResponseReceivedRestore, SceneId, Id);
+		Recall->ProcessRequest();
+		Scheduler->Spend(FPlatformTime::Seconds(), 1);
+		RestoreRequestsInFlight++;
+		LastRestore.Requests++;
 	}
 	else
 	{
-		UE_LOG(LogTemp, Warning, TEXT("HueConfig Not Found Creating New Save Config"));	
-		SaveConfig();
+		UE_LOG(LogTemp, Warning, TEXT("Hue restore scene not created, queueing %d lamps on their own"), RestoreSceneStates.Num());
+		for (const auto& Element : RestoreSceneStates)
+		{
+			const TWeakObjectPtr<AHueLamp>* Lamp = LampsByKey.Find(Element.Key);
+			//A lamp that turns the state down never answers, it can't hold the restore open
+			if(Lamp && Lamp->IsValid() && (*Lamp)->ApplyState(Element.Value))
+			{
+				RestoreLamps.Add(*Lamp, Element.Value);
+				RestoreRequestsInFlight++;
+				LastRestore.Requests++;
+			}
+		}
 	}
+	RestoreSceneStates.Empty();
+	FinishRestoreRequest(Id);
 }
 
 /**
- * @brief Get a pointer to a Hue Lamp from our TMap of Lamps
- * @param LampName const String name of lamp to get
- * @return Point to our Hue Lamp
+ * @brief Callback for HUE API Response for a restore write or the restore scene recall
+ * @param Request Signature for callback 
+ * @param Response Signature for callback 
+ * @param bWasSuccessful Signature for callback 
+ * @param SceneId Temporary scene that was recalled
+ * @param Id Restore the recall belongs to
  */
-AHueLamp* AHueBridge::GetLamp(const FString& LampName)
+void AHueBridge::OnResponseReceivedRestore(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful, FString SceneId, int32 Id)
 {
-	if(HueLamps.Contains(LampName))
+	//The scene is marked recycle so the bridge cleans it up if this delete never makes it out
+	if(!SceneId.IsEmpty())
 	{
-		return HueLamps[LampName];
+		Transport->CreateDeleteScene(SceneId)->ProcessRequest();
 	}
-	return nullptr;
-	
+	FinishRestoreRequest(Id);
 }
 
 /**
- * @brief Creates REST API call to the Hue bridge to see if user already exists
- * @return True if Hue user exist
+ * @brief Callback for HUE API Response for New user Setup
+ * @param Request Signature for callback 
+ * @param Response Signature for callback 
+ * @param bWasSuccessful Signature for callback 
  */
-bool AHueBridge::DoesHueUserExist()
+void AHueBridge::OnResponseReceivedNewUser(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful)
 {
-	//Setup HTTP REST CALL and Completed Request Delegate 
-	const TSharedRef<IHttpRequest> Request = HTTPHandler->Get().CreateRequest();
-	Request->OnProcessRequestComplete().BindUObject(this, &AHueBridge::OnResponseReceivedNewUser);
-	const FString URL = TEXT("http://") +
-		HueBridgeConfig.HostName +
-		TEXT("/api/");
-	
-	//Fill out JSON DATA
-	TSharedRef<FJsonObject> RequestOBJ = MakeShared<FJsonObject>();
-	RequestOBJ->SetStringField(TEXT("devicetype"), HueBridgeConfig.AppName);
-
-	//Serialize Data
-	FString RequestBody;
-	const TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&RequestBody);
-	FJsonSerializer::Serialize(RequestOBJ, Writer);
-
-	Request->SetURL(URL);
-	Request->SetVerb(VERB_POST);
-	Request->SetHeader("Content-Type", TEXT("application/json"));
-	Request->SetContentAsString(RequestBody);
-	Request->ProcessRequest();
-	bInUse = true;
-	return bUserExist;
+	if(!bWasSuccessful || !Response.IsValid())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Hue bridge %s didn't answer the user creation"), *HueBridgeConfig.HostName);
+		FinishOperation(EHueBridgeOperation::CreateUser, EHueOperationResult::Unreachable);
+		return;
+	}
+	//Get Respond as string of data and if there is any Error in the string break out early
+	FString Data = Response->GetContentAsString();
+	if(Data.IsEmpty() || Data.Contains(TEXT("Error")))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("%s"),*Data);
+		UE_LOG(LogTemp, Warning, TEXT("USER DOES NOT EXIST!"));
+		UserConfiguredCorrectly(false);
+		FinishOperation(EHueBridgeOperation::CreateUser, EHueOperationResult::Rejected);
+		return;
+	}
+
+	FString UserName;
+	if(!Transport->ParseCreatedUser(Data, UserName))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("%s"),*Data);
+		UE_LOG(LogTemp, Warning, TEXT(" User Couldnt be Created please press link on Hue Hub!!"));
+		UserConfiguredCorrectly(false);
+		FinishOperation(EHueBridgeOperation::CreateUser, EHueOperationResult::Rejected);
+		return;
+	}
+	HueBridgeConfig.UserName = UserName;
+	RefreshTransport();
+	UE_LOG(LogTemp, Warning, TEXT("USER: %s Created"), *HueBridgeConfig.UserName);
+	UserConfiguredCorrectly(true);
+	FinishOperation(EHueBridgeOperation::CreateUser, EHueOperationResult::Succeeded);
+}
+
+/**
+ * @brief Callback for HUE API Response for if user exist yet or not on huebridge
+ * @param Request Signature for callback 
+ * @param Response Signature for callback 
+ * @param bWasSuccessful Signature for callback 
+ */
+void AHueBridge::OnResponseReceivedUserExist(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful)
+{
+	//No answer says nothing about the user, keep the last known result
+	if(!bWasSuccessful || !Response.IsValid())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Hue bridge %s didn't answer the user check"), *HueBridgeConfig.HostName);
+		FinishOperation(EHueBridgeOperation::CheckUser, EHueOperationResult::Unreachable);
+		return;
+	}
+	//An unknown user gets an unauthorized error instead of the light list
+	TArray<FHueLightRecord> Lights;
+	const bool bExists = Transport->ParseLights(Response->GetContentAsString(), Lights);
+	if(bExists)
+	{
+		UpdateLamps(Lights, false);
+	}
+	UserConfiguredCorrectly(bExists);
+	FinishOperation(EHueBridgeOperation::CheckUser, bExists ? EHueOperationResult::Succeeded : EHueOperationResult::Rejected);
+}
+
+
+/**
+ * @brief Callback for HUE API Response for a new bridge side scene, caches the scene id in the config
+ * @param Request Signature for callback 
+ * @param Response Signature for callback 
+ * @param bWasSuccessful Signature for callback 
+ * @param SceneName Name of the scene that was compiled
+ * @param DefinitionHash Crc of the scene definition that was compiled
+ */
+void AHueBridge::OnResponseReceivedCreateScene(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful, FString SceneName, int32 DefinitionHash)
+{
+	if(!bWasSuccessful || !Response.IsValid())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Scene %s failed to reach the Hue Bridge"), *SceneName);
+		return;
+	}
+
+	const FString Data = Response->GetContentAsString();
+	FString SceneId;
+	if(!Transport->ParseCreatedId(Data, SceneId))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Scene %s not created: %s"), *SceneName, *Data);
+		return;
+	}
+
+	FHueSceneConfig* SceneConfig = FindSceneConfig(SceneName);
+	if(!SceneConfig)
+	{
+		SceneConfig = &HueBridgeConfig.Scenes.AddDefaulted_GetRef();
+		SceneConfig->SceneName = SceneName;
+	}
+	SceneConfig->SceneId = SceneId;
+	SceneConfig->DefinitionHash = DefinitionHash;
+	UE_LOG(LogTemp, Warning, TEXT("Scene %s compiled as %s"), *SceneName, *SceneId);
+}
+
+/**
+ * @brief Callback for HUE API Response for the scene of one ambient program step
+ * @param Request Signature for callback 
+ * @param Response Signature for callback 
+ * @param bWasSuccessful Signature for callback 
+ * @param ProgramName Program being installed
+ * @param Step Step the scene belongs to
+ */
+void AHueBridge::OnResponseReceivedAmbientScene(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful, FString ProgramName, int32 Step)
+{
+	FHueAmbientInstall* Install = AmbientInstalls.Find(ProgramName);
+	if(!Install)
+	{
+		return;
+	}
+	FString SceneId;
+	if(bWasSuccessful && Response.IsValid() && Transport->ParseCreatedId(Response->GetContentAsString(), SceneId))
+	{
+		Install->Config.SceneIds[Step] = SceneId;
+	}
+	else
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Ambient program %s step %d scene not created"), *ProgramName, Step);
+		Install->bFailed = true;
+	}
+	if(--Install->Pending == 0)
+	{
+		if(Install->bFailed)
+		{
+			FinishAmbientInstall(ProgramName);
+		}
+		else
+		{
+			StartAmbientSchedules(ProgramName);
+		}
+	}
+}
+
+/**
+ * @brief Callback for HUE API Response for an ambient program schedule. A looping step that waits disabled gets
+ * the one shot timer that enables it at the step's offset, next to the one shot recall made with it
+ * @param Request Signature for callback 
+ * @param Response Signature for callback 
+ * @param bWasSuccessful Signature for callback 
+ * @param ProgramName Program being installed
+ * @param Step Step the schedule recalls
+ * @param bStarter True for the one shot timers that start a looping step
+ */
+void AHueBridge::OnResponseReceivedAmbientSchedule(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful, FString ProgramName, int32 Step, bool bStarter)
+{
+	FHueAmbientInstall* Install = AmbientInstalls.Find(ProgramName);
+	if(!Install)
+	{
+		return;
+	}
+	FString ScheduleId;
+	if(bWasSuccessful && Response.IsValid() && Transport->ParseCreatedId(Response->GetContentAsString(), ScheduleId))
+	{
+		Install->Config.ScheduleIds.Add(ScheduleId);
+		if(!bStarter && Install->Config.bLoop && Step > 0 && !Install->bFailed)
+		{
+			FHueScheduleCommand Command;
+			Command.EnableScheduleId = ScheduleId;
+			const TSharedRef<IHttpRequest> Starter = Transport->CreateCreateSchedule(FString::Printf(TEXT("%s %d start"), *ProgramName, Step),
+				Command, HueAmbient::FormatTimer(Install->Offsets[Step]), true, true);
+			Starter->OnProcessRequestComplete().BindUObject(this, &AHueBridge::OnResponseReceivedAmbientSchedule, ProgramName, Step, true);
+			Starter->ProcessRequest();
+			Install->Pending++;
+		}
+	}
+	else
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Ambient program %s step %d schedule not created"), *ProgramName, Step);
+		Install->bFailed = true;
+	}
+	if(--Install->Pending == 0)
+	{
+		FinishAmbientInstall(ProgramName);
+	}
+}
+
+/**
+ * @brief Callback for HUE API Response for a scene recall, the whole switch is a single request
+ * @param Request Signature for callback 
+ * @param Response Signature for callback 
+ * @param bWasSuccessful Signature for callback 
+ */
+void AHueBridge::OnResponseReceivedRecallScene(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful, int32 SwitchId)
+{
+	//A newer switch started while this recall was on the way, its stats aren't ours to finish
+	if(SwitchId != SceneSwitchId)
+	{
+		return;
+	}
+	if(Response.IsValid() && Response->GetContentAsString().Contains(TEXT("error")))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Scene %s recall failed: %s"), *LastSceneSwitch.SceneName, *Response->GetContentAsString());
+	}
+	FinishSceneSwitch();
+}
+
+/**
+ * @brief Native callback from lamps when the bridge answered their state request, used to time lamp by lamp switches
+ * @param Lamp Lamp that got its answer
+ */
+void AHueBridge::OnLampStateAcknowledged(AHueLamp* Lamp)
+{
+	//Only the answer to the restore state counts, a change already on the way when the restore started doesn't
+	const FHueLampState* RestoreState = RestoreLamps.Find(Lamp);
+	if(RestoreState && Lamp->GetLastSentState() == *RestoreState)
+	{
+		RestoreLamps.Remove(Lamp);
+		FinishRestoreRequest(RestoreId);
+	}
+
+	NoteSwitchAcknowledged(Lamp);
+
+	const double Now = FPlatformTime::Seconds();
+	for (int32 Index = 0; Index < FrameTransactions.Num(); ++Index)
+	{
+		FHueFrameTransaction& Transaction = FrameTransactions[Index];
+		if(Transaction.Waiting.Remove(Lamp) == 0)
+		{
+			continue;
+		}
+		if(Transaction.FirstAck <= 0.0)
+		{
+			Transaction.FirstAck = Now;
+		}
+		Transaction.LastAck = Now;
+		if(Transaction.Waiting.Num() == 0)
+		{
+			FinishFrameTransaction(Index);
+		}
+		break;
+	}
+}
+
+/**
+ * @brief Native callback from lamps when a state request leaves for the bridge, used to count lamp by lamp switches
+ * @param Lamp Lamp that sent
+ */
+void AHueBridge::OnLampStateSent(AHueLamp* Lamp)
+{
+	NoteSwitchSent(Lamp, Lamp->GetLastSentState(), 1);
+}
+
+/**
+ * @brief Callback for HUE API Response for a frame sent as one group action
+ * @param Request Signature for callback 
+ * @param Response Signature for callback 
+ * @param bWasSuccessful Signature for callback 
+ * @param FrameId Frame the group action belongs to
+ */
+void AHueBridge::OnResponseReceivedFrameGroup(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful, int32 FrameId)
+{
+	const int32 Index = FrameTransactions.IndexOfByPredicate([FrameId](const FHueFrameTransaction& Transaction)
+	{
+		return Transaction.Id == FrameId;
+	});
+	if(Index == INDEX_NONE)
+	{
+		return;
+	}
+	FHueFrameTransaction& Transaction = FrameTransactions[Index];
+	const bool bAccepted = bWasSuccessful && Response.IsValid() && EHttpResponseCodes::IsOk(Response->GetResponseCode())
+		&& Transport->ParseActionSucceeded(Response->GetContentAsString());
+	for (const int32 Slot : Transaction.GroupSlots)
+	{
+		AHueLamp* Lamp = ScheduledLamps.IsValidIndex(Slot) ? ScheduledLamps[Slot].Get() : nullptr;
+		if(!Lamp)
+		{
+			continue;
+		}
+		Scheduler->SetBusy(Slot, false);
+		NoteSwitchAcknowledged(Lamp);
+		//A failed group leaves its lamps dirty, the scheduler sends them one by one
+		if(!bAccepted)
+		{
+			continue;
+		}
+		//Lamps changed again while the group was out keep the newer change
+		if(Scheduler->GetDesired(Slot) == Transaction.GroupState)
+		{
+			Lamp->MarkStateFromBridge(Transaction.GroupState);
+		}
+		else
+		{
+			Scheduler->SyncSent(Slot, Transaction.GroupState);
+		}
+	}
+	if(!bAccepted)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Hue frame group action failed, sending its %d lamps one by one"), Transaction.GroupSlots.Num());
+	}
+	Transaction.FirstAck = Transaction.LastAck = FPlatformTime::Seconds();
+	FinishFrameTransaction(Index);
+}
+
+/**
+ * @brief Callback for automatic bridge discovery
+ * @param bFound True if a bridge answered within the time budget
+ * @param Host Host of the bridge that was found
+ */
+void AHueBridge::OnBridgeDiscoveryFinished(bool bFound, const FString& Host)
+{
+	if(bFound)
+	{
+		if(HueBridgeConfig.HostName != Host)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Hue Bridge moved from %s to %s"), *HueBridgeConfig.HostName, *Host);
+		}
+		//Id first, the host change rekeys the broker and the id is what processes on this bridge share
+		if(BridgeDiscovery.IsValid())
+		{
+			HueBridgeConfig.BridgeId = BridgeDiscovery->GetBridgeId();
+		}
+		SetHostName(Host);
+	}
+	else
+	{
+		UE_LOG(LogTemp, Warning, TEXT("No Hue Bridge found within %.1f seconds"), DiscoverySettings.TimeBudget);
+	}
+	//Only the discovery that asked for lamps chains into them, a failed one takes the request with it
+	const bool bDiscoverLamps = bFound && bDiscoverLampsAfterBridge;
+	bDiscoverLampsAfterBridge = false;
+	BridgeDiscovered.Broadcast(bFound, Host);
+
+	if(bDiscoverLamps)
+	{
+		DiscoverLamps();
+	}
+}
+
+/**
+ * @brief Check to see if the same operation is already waiting on the hue bridge, other operations don't block it
+ * @param Operation Operation about to be started
+ * @return Returns false if the operation isn't waiting on the bridge
+ */
+bool AHueBridge::CheckIfBusy(EHueBridgeOperation Operation)
+{
+	if(ActiveOperations.Contains(Operation))
+	{
+		PleaseWaitingForBridgeRespond();
+		RequestsBusy.Broadcast();
+		return true;
+	}
+	return false;
+}
+
+/**
+ * @brief Claim one of the bridge's operation slots. Without a free slot the operation is queued and started when
+ * another one finishes :: Internal Call
+ * @param Operation Operation about to send its request
+ * @return True if the request may go out now
+ */
+bool AHueBridge::BeginOperation(EHueBridgeOperation Operation)
+{
+	//A second call joins the one already waiting on the bridge
+	if(CheckIfBusy(Operation))
+	{
+		return false;
+	}
+	if(ActiveOperations.Num() >= MaxConcurrentOperations)
+	{
+		QueuedOperations.AddUnique(Operation);
+		return false;
+	}
+	QueuedOperations.Remove(Operation);
+	ActiveOperations.Add(Operation);
+	return true;
+}
+
+/**
+ * @brief Release an operation's slot, tell whoever waits on it and start the next queued operation :: Internal Call
+ * @param Operation Operation that was answered
+ * @param Result How the bridge answered, if it did
+ */
+void AHueBridge::FinishOperation(EHueBridgeOperation Operation, EHueOperationResult Result)
+{
+	ActiveOperations.Remove(Operation);
+	OperationFinished.Broadcast(Operation, Result);
+	if(QueuedOperations.Num() > 0 && ActiveOperations.Num() < MaxConcurrentOperations)
+	{
+		StartOperation(QueuedOperations[0]);
+	}
+}
+
+/**
+ * @brief Start a bridge operation, an operation that is already running is joined instead of sent twice
+ * @param Operation Operation to start
+ */
+void AHueBridge::StartOperation(EHueBridgeOperation Operation)
+{
+	switch(Operation)
+	{
+	case EHueBridgeOperation::Discover:
+		DiscoverLamps();
+		break;
+	case EHueBridgeOperation::CreateUser:
+		SetupNewUser();
+		break;
+	case EHueBridgeOperation::CheckUser:
+		CheckHueUser();
+		break;
+	case EHueBridgeOperation::RefreshState:
+		RefreshLampStates();
+		break;
+	}
+}
+
+
+/**
+ * @brief  Converts JasonObject data to Lightinfo Struct
+ * @param JsonObject Jsonobject to be used FJsonObject
+ * @param LightInfoOut Flightinfo struct out param to be filled FLightInfo
+ */
+void  AHueBridge::GetLightInfo(TSharedPtr<FJsonObject> JsonObject,  FLightInfo& LightInfoOut)
+{
+	LightInfoOut.Name = JsonObject->GetStringField("LightName");
+	LightInfoOut.bUseLight = JsonObject->GetBoolField("bUseLight");
+}
+
+/**
+ * @brief Converts JasonObject data to a string 
+ * @param JsonObject 
+ * @param Field Name of json field to used as a string
+ * @param NameOut String that is used for Out param to be filled
+ */
+void AHueBridge::GetStringName(TSharedPtr<FJsonObject> JsonObject, const FString& Field, FString& NameOut)
+{
+	NameOut = JsonObject->GetStringField(Field);
+}
+
+/**
+ * @brief Set if our user has been configured properly, use to broadcast for UI elements 
+ * @param Value Bool if used is configured properly
+ */
+void AHueBridge::UserConfiguredCorrectly(bool Value)
+{
+	bUserExist = Value;
+	HasUserBeenConfigured.Broadcast(bUserExist);
+}
+
+/**
+ * @brief Feed the colors of the last finished effect batch into the lamps, they go out through the scheduler
+ */
+void AHueBridge::TickEffects()
+{
+	EffectRunner->Tick(FPlatformTime::Seconds(), EffectOutputs);
+	for (const FHueEffectOutput& Output : EffectOutputs)
+	{
+		AHueLamp* Lamp = ScheduledLamps.IsValidIndex(Output.Slot) ? ScheduledLamps[Output.Slot].Get() : nullptr;
+		if(Lamp)
+		{
+			Lamp->ApplyState(FHueLampState::FromLinearColor(Output.Color));
+		}
+	}
+}
+
+/**
+ * @brief Run the patch for every universe that changed since the last tick, lamps only get a new desired state and
+ * the scheduler still decides what reaches the bridge
+ */
+void AHueBridge::TickDmx()
+{
+	DmxReceiver->Tick(FPlatformTime::Seconds(), DmxChangedUniverses);
+	if(DmxChangedUniverses.Num() == 0)
+	{
+		return;
+	}
+	if(DmxPatchLamps.Num() != DmxPatch.Num())
+	{
+		ResolveDmxPatch();
+	}
+	for (int32 Index = 0; Index < DmxPatch.Num(); ++Index)
+	{
+		const FHueDmxPatch& Patch = DmxPatch[Index];
+		AHueLamp* Lamp = DmxPatchLamps[Index].Get();
+		if(!Lamp || !DmxChangedUniverses.Contains(Patch.Universe))
+		{
+			continue;
+		}
+		Lamp->ApplyState(Patch.Evaluate(DmxReceiver->GetUniverse(Patch.Universe)));
+	}
+}
+
+/**
+ * @brief Send the next sensor read when it is due and keep the event stream open. Only the broker owner reads
+ * sensors, clients get every change relayed in TickCommandBroker
+ */
+void AHueBridge::TickSensors()
+{
+	if(!OwnsBridgeConnection())
+	{
+		//Handed over to another owner, its stream covers the bridge now
+		if(EventStream.IsValid())
+		{
+			const TSharedPtr<IHttpRequest> OldStream = EventStream;
+			EventStream.Reset();
+			OldStream->CancelRequest();
+			SensorPoller->SetStreaming(false);
+		}
+		return;
+	}
+	const double Now = FPlatformTime::Seconds();
+	//Sensors need a user the bridge took, a discovery proves it whether it came from LoadConfig or a user check
+	if(HueBridgeConfig.UserName.IsEmpty() || !bLampsDiscovered)
+	{
+		return;
+	}
+	if(bUseEventStream && !EventStream.IsValid() && Now >= EventStreamRetryTime)
+	{
+		StartEventStream();
+	}
+	if(!SensorPoller->IsPollDue(Now))
+	{
+		return;
+	}
+	const TSharedRef<IHttpRequest> Request = Transport->CreateGetSensors();
+	Request->OnProcessRequestComplete().BindUObject(this, &AHueBridge::OnResponseReceivedSensors);
+	SensorPoller->MarkPollSent(Now);
+	Request->ProcessRequest();
+}
+
+/**
+ * @brief Open the event stream, or reopen it to drop what the old one has buffered :: Internal Call
+ */
+void AHueBridge::StartEventStream()
+{
+	if(EventStream.IsValid())
+	{
+		const TSharedPtr<IHttpRequest> OldStream = EventStream;
+		EventStream.Reset();
+		OldStream->CancelRequest();
+	}
+	EventStreamOffset = 0;
+	EventStreamRetryTime = FPlatformTime::Seconds() + 5.0;
+	EventStream = Transport->CreateEventStream();
+	SensorPoller->SetStreaming(EventStream.IsValid());
+	if(!EventStream.IsValid())
+	{
+		return;
+	}
+	EventStream->OnRequestProgress().BindUObject(this, &AHueBridge::OnEventStreamProgress);
+	EventStream->OnProcessRequestComplete().BindUObject(this, &AHueBridge::OnResponseReceivedEventStream);
+	EventStream->ProcessRequest();
+}
+
+/**
+ * @brief Fire both sensor delegates for every change the last merge found, a broker owner relays them to its
+ * clients as well :: Internal Call
+ */
+void AHueBridge::BroadcastSensorChanges()
+{
+	if(CommandBroker.IsValid() && CommandBroker->IsOwner())
+	{
+		CommandBroker->PublishSensors(ChangedSensors, true);
+	}
+	for (const FHueSensorState& Sensor : ChangedSensors)
+	{
+		OnSensorChanged.Broadcast(Sensor);
+		SensorChanged.Broadcast(Sensor);
+	}
+	ChangedSensors.Reset();
+}
+
+/**
+ * @brief Look up the lamp of every patch entry once so the DMX tick doesn't search by name :: Internal Call
+ */
+void AHueBridge::ResolveDmxPatch()
+{
+	DmxPatchLamps.Reset(DmxPatch.Num());
+	for (const FHueDmxPatch& Patch : DmxPatch)
+	{
+		DmxPatchLamps.Add(GetLamp(Patch.LampName));
+	}
+}
+
+/**
+ * @brief Add a lamp to the bridge, its requests now go through the bridge's send scheduler
+ * @param Lamp Lamp to add
+ */
+void AHueBridge::RegisterLamp(AHueLamp* Lamp)
+{
+	Lamp->OnStateAcknowledged.AddUObject(this, &AHueBridge::OnLampStateAcknowledged);
+	Lamp->OnStateSent.AddUObject(this, &AHueBridge::OnLampStateSent);
+	Lamp->SetScheduler(Scheduler, Scheduler->AddSlot(Lamp->GetImportance()));
+	ScheduledLamps.Add(Lamp);
+	LampsByKey.Add(Lamp->GetDeviceKey(), Lamp);
+	HueLamps.Add(Lamp->GetLampName(), Lamp);
+}
+
+/**
+ * @brief Owner merges states submitted by other processes into its lamps, clients forward their changed lamps
+ * to the owner instead of sending them to the bridge
+ */
+void AHueBridge::TickCommandBroker()
+{
+	const double Now = FPlatformTime::Seconds();
+	CommandBroker->Tick(Now, BrokerCommands);
+	if(CommandBroker->IsOwner())
+	{
+		//We took over while the old owner still owed us lights, nobody will send them now
+		if(bBrokerReadPending)
+		{
+			FinishBrokerRead(false);
+		}
+		//States the old owner never confirmed are still dirty, our own scheduler sends them now
+		TArray<int32> Unconfirmed;
+		UnconfirmedSubmits.GetKeys(Unconfirmed);
+		for (const int32 Slot : Unconfirmed)
+		{
+			ReleaseBrokerSubmit(Slot);
+		}
+		for (const FHueBrokerCommand& Command : BrokerCommands)
+		{
+			const TWeakObjectPtr<AHueLamp>* Lamp = LampsByKey.Find(Command.LightId);
+			if(Lamp && Lamp->IsValid())
+			{
+				(*Lamp)->ApplyState(Command.State);
+				CommandBroker->Confirm(Command);
+			}
+		}
+		//Clients asked for lights, the answer is published when our own read comes back
+		if(CommandBroker->ConsumeReadRequest())
+		{
+			//Sensors are known already, clients get the table straight away
+			if(SensorPoller.IsValid())
+			{
+				TArray<FHueSensorState> Sensors;
+				SensorPoller->GetSensors().GenerateValueArray(Sensors);
+				CommandBroker->PublishSensors(Sensors, false);
+			}
+			if(HueLamps.Num() == 0)
+			{
+				DiscoverLamps();
+			}
+			else
+			{
+				RefreshLampStates();
+			}
+		}
+		return;
+	}
+
+	//Every list the owner publishes is fresh state, whoever asked for it
+	if(CommandBroker->ConsumeLights(BrokerLights))
+	{
+		if(bBrokerReadPending && ActiveOperations.Contains(EHueBridgeOperation::Discover))
+		{
+			OnLampsDiscovered(BrokerLights);
+		}
+		else
+		{
+			UpdateLamps(BrokerLights, false);
+		}
+		if(bBrokerReadPending)
+		{
+			FinishBrokerRead(true);
+		}
+	}
+	else if(bBrokerReadPending && Now - BrokerReadTime > BrokerReadTimeout)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Hue broker owner didn't answer a light read within %.1f seconds"), BrokerReadTimeout);
+		FinishBrokerRead(false);
+	}
+
+	//Sensors the owner read or streamed, dropped unless this process started sensors
+	if(CommandBroker->ConsumeSensors(BrokerSensors) && SensorPoller.IsValid())
+	{
+		for (const FHueBrokerSensor& Sensor : BrokerSensors)
+		{
+			SensorPoller->MergeRelayed({ Sensor.State }, Sensor.bChanged, Now, ChangedSensors);
+			BroadcastSensorChanges();
+		}
+	}
+
+	//A state only counts as sent once the owner confirms it took it
+	CommandBroker->ConsumeConfirmed(BrokerCommands);
+	for (const FHueBrokerCommand& Command : BrokerCommands)
+	{
+		const TWeakObjectPtr<AHueLamp>* Found = LampsByKey.Find(Command.LightId);
+		AHueLamp* Lamp = Found ? Found->Get() : nullptr;
+		const int32 Slot = Lamp ? ScheduledLamps.IndexOfByKey(Lamp) : INDEX_NONE;
+		const FHueBrokerSubmit* Submit = UnconfirmedSubmits.Find(Slot);
+		if(!Submit || Submit->State != Command.State)
+		{
+			continue;
+		}
+		//A newer state stays dirty behind the confirmed one
+		if(Scheduler->GetDesired(Slot) == Command.State)
+		{
+			Lamp->MarkStateFromBridge(Command.State);
+		}
+		else
+		{
+			Scheduler->SyncSent(Slot, Command.State);
+		}
+		ReleaseBrokerSubmit(Slot);
+		//The owner sends it, as far as this process can tell it is answered once the owner has it
+		NoteSwitchAcknowledged(Lamp);
+	}
+	//Lost on the way or the owner went away, the slot is still dirty and goes out again
+	TArray<int32> Expired;
+	for (const TPair<int32, FHueBrokerSubmit>& Pair : UnconfirmedSubmits)
+	{
+		if(Now - Pair.Value.SentTime > BrokerConfirmTimeout)
+		{
+			Expired.Add(Pair.Key);
+		}
+	}
+	for (const int32 Slot : Expired)
+	{
+		ReleaseBrokerSubmit(Slot);
+	}
+
+	//Frames hold a client's changes just like the owner's, CommitHueFrame submits them
+	if(FrameDepth == 0)
+	{
+		SubmitToBroker(Now);
+	}
+}
+
+/**
+ * @brief Client only, hand every dirty lamp to the broker owner, they stay busy until it confirms them :: Internal Call
+ * @param Now Current time in seconds
+ */
+void AHueBridge::SubmitToBroker(double Now)
+{
+	for (int32 Slot = 0; Slot < ScheduledLamps.Num(); ++Slot)
+	{
+		AHueLamp* Lamp = ScheduledLamps[Slot].Get();
+		if(!Lamp || !Scheduler->IsDirty(Slot) || Scheduler->IsBusy(Slot))
+		{
+			continue;
+		}
+		const FHueLampState Desired = Scheduler->GetDesired(Slot);
+		if(CommandBroker->Submit(Lamp->GetDeviceKey(), Desired))
+		{
+			Scheduler->SetBusy(Slot, true);
+			UnconfirmedSubmits.Add(Slot, { Desired, Now });
+			NoteSwitchSent(Lamp, Desired, 1);
+		}
+	}
+}
+
+/**
+ * @brief Stop holding a submitted slot, a lamp held for its reconnect stays out of the scheduler :: Internal Call
+ * @param Slot Scheduler slot of the submitted lamp
+ */
+void AHueBridge::ReleaseBrokerSubmit(int32 Slot)
+{
+	UnconfirmedSubmits.Remove(Slot);
+	AHueLamp* Lamp = ScheduledLamps.IsValidIndex(Slot) ? ScheduledLamps[Slot].Get() : nullptr;
+	if(Lamp && Lamp->IsReachable())
+	{
+		Scheduler->SetBusy(Slot, false);
+	}
+}
+
+/**
+ * @brief Fill every lamp's state from a single bulk light read, lamps are keyed by their name
+ * @param Lights Every light the bridge reported
+ * @param bSpawnMissing Spawn lamps that we don't know about yet, only done on discovery
+ */
+void AHueBridge::UpdateLamps(const TArray<FHueLightRecord>& Lights, bool bSpawnMissing)
+{
+	BridgeLightCount = Lights.Num();
+	for (const FHueLightRecord& Light : Lights)
+	{
+		if(Light.Name.IsEmpty())
+		{
+			continue;
+		}
+
+		AHueLamp* Lamp = GetLamp(Light.Name);
+		if(!Lamp)
+		{
+			if(!bSpawnMissing)
+			{
+				continue;
+			}
+			//Strips with several color points get a lamp that sends the whole gradient in one request
+			const TSubclassOf<AHueLamp> LampClass = Light.GradientPoints > 0 ? AHueGradientLamp::StaticClass() : AHueLamp::StaticClass();
+			Lamp = GetWorld()->SpawnActor<AHueLamp>(LampClass);
+			Lamp->SetupLamp(Transport, Light.ResourceId, Light.Name);
+			RegisterLamp(Lamp);
+			ApplyLightUse(Lamp);
+			UE_LOG(LogTemp,Warning, TEXT("%s"), *Light.Name);
+		}
+		if(AHueGradientLamp* GradientLamp = Cast<AHueGradientLamp>(Lamp))
+		{
+			if(Light.GradientPoints > 0)
+			{
+				GradientLamp->SetPointCount(Light.GradientPoints);
+			}
+		}
+
+		if(Light.bHasState)
+		{
+			Lamp->ApplyBridgeState(Light.State, Light.bReachable);
+		}
+	}
+	if(bSpawnMissing)
+	{
+		ResolveDmxPatch();
+	}
+}
+
+/**
+ * @brief Creates REST API call for every lamp's state in one request, replaces polling lamps one at a time
+ */
+void AHueBridge::RefreshLampStates()
+{
+	if(HueLamps.Num() == 0)
+	{
+		QueuedOperations.Remove(EHueBridgeOperation::RefreshState);
+		OperationFinished.Broadcast(EHueBridgeOperation::RefreshState, EHueOperationResult::Rejected);
+		return;
+	}
+	//The refresh timer just skips a beat while the last refresh is out
+	if(ActiveOperations.Contains(EHueBridgeOperation::RefreshState))
+	{
+		return;
+	}
+	if(!BeginOperation(EHueBridgeOperation::RefreshState))
+	{
+		return;
+	}
+	if(!OwnsBridgeConnection())
+	{
+		RequestBrokerRead(EHueBridgeOperation::RefreshState);
+		return;
+	}
+	ReadLights(EHueBridgeOperation::RefreshState);
+}
+
+/**
+ * @brief Bulk light read for discovery or a state refresh. Apis that keep reachability apart from the light read
+ * have it read first so the lights come back with it :: Internal Call
+ * @param Operation Discover or RefreshState, already begun by the caller
+ * @param bReadConnectivity False once the connectivity read is done
+ */
+void AHueBridge::ReadLights(EHueBridgeOperation Operation, bool bReadConnectivity)
+{
+	const TSharedPtr<IHttpRequest> Connectivity = bReadConnectivity ? Transport->CreateGetConnectivity() : nullptr;
+	if(Connectivity.IsValid())
+	{
+		Connectivity->OnProcessRequestComplete().BindUObject(this, &AHueBridge::OnResponseReceivedConnectivity, Operation);
+		Connectivity->ProcessRequest();
+		return;
+	}
+	const TSharedRef<IHttpRequest> Request = Transport->CreateGetLights();
+	if(Operation == EHueBridgeOperation::Discover)
+	{
+		Request->OnProcessRequestComplete().BindUObject(this, &AHueBridge::OnResponseReceivedDiscover);
+	}
+	else
+	{
+		Request->OnProcessRequestComplete().BindUObject(this, &AHueBridge::OnResponseReceivedStateRefresh);
+	}
+	Request->ProcessRequest();
+}
+
+/**
+ * @brief Start or stop the bulk state refresh timer
+ * @param Interval Seconds between refreshes, 0 or less turns refreshing off
+ */
+void AHueBridge::SetStateRefreshInterval(float Interval)
+{
+	StateRefreshInterval = Interval;
+	GetWorldTimerManager().ClearTimer(StateRefreshTimer);
+	if(StateRefreshInterval > 0.0f)
+	{
+		GetWorldTimerManager().SetTimer(StateRefreshTimer, this, &AHueBridge::RefreshLampStates, StateRefreshInterval, true);
+	}
+}
+
+/**
+ * @brief Rebuild the transport for the current host, user and api version and hand it to every lamp :: Internal Call
+ */
+void AHueBridge::RefreshTransport()
+{
+	Transport = IHueTransport::Create(HueBridgeConfig.ApiVersion, HueBridgeConfig.HostName, HueBridgeConfig.UserName);
+	//A new host or user hasn't been read with yet
+	bLampsDiscovered = false;
+	for (const auto& Element : HueLamps)
+	{
+		if(Element.Value)
+		{
+			Element.Value->SetTransport(Transport);
+		}
+	}
+	RefreshCommandBroker();
+}
+
+/**
+ * @brief Point the bridge at a new host
+ * @param Host Host name or ip of the Hue bridge
+ */
+void AHueBridge::SetHostName(const FString& Host)
+{
+	HueBridgeConfig.HostName = Host;
+	RefreshTransport();
+}
+
+/**
+ * @brief Switch the api the bridge is talked to with. Lamp ids differ between versions so lamps are discovered again
+ * @param Version Api version to use
+ */
+void AHueBridge::SetApiVersion(EHueApiVersion Version)
+{
+	if(HueBridgeConfig.ApiVersion == Version)
+	{
+		return;
+	}
+	HueBridgeConfig.ApiVersion = Version;
+	RefreshTransport();
+	if(HueLamps.Num() > 0)
+	{
+		ClearOutLights();
+		DiscoverLamps();
+	}
+}
+
+/**
+ * @brief Crc of a scene definition along with the bridge it is compiled for, sorted so map order doesn't matter
+ * @param Definition Scene definition to hash
+ * @return int32 hash stored in the config
+ */
+int32 AHueBridge::HashSceneDefinition(const FHueSceneDefinition& Definition) const
+{
+	TArray<FString> Names;
+	Definition.LampStates.GetKeys(Names);
+	Names.Sort();
+
+	FString Key = HueBridgeConfig.HostName + HueBridgeConfig.UserName + FString::FromInt(Definition.TransitionTime);
+	for (const FString& Name : Names)
+	{
+		const FHueLampState& State = Definition.LampStates[Name];
+		const AHueLamp* Lamp = HueLamps.Contains(Name) ? HueLamps[Name].Get() : nullptr;
+		Key += FString::Printf(TEXT("|%s:%s:%d:%d:%d:%d"), *Name, Lamp ? *Lamp->GetDeviceKey() : TEXT(""),
+			State.bOn, State.Hue, State.Saturation, State.Brightness);
+	}
+	return static_cast<int32>(FCrc::StrCrc32(*Key));
+}
+
+/**
+ * @brief Find the cached bridge scene for a scene name
+ * @param SceneName Name of the scene
+ * @return Pointer into the config or nullptr
+ */
+FHueSceneConfig* AHueBridge::FindSceneConfig(const FString& SceneName)
+{
+	return HueBridgeConfig.Scenes.FindByPredicate([&SceneName](const FHueSceneConfig& Scene)
+	{
+		return Scene.SceneName == SceneName;
+	});
+}
+
+/**
+ * @brief Find the installed schedules of an ambient program
+ * @param ProgramName Name of the program
+ * @return Pointer into the config or nullptr
+ */
+FHueScheduleConfig* AHueBridge::FindScheduleConfig(const FString& ProgramName)
+{
+	return HueBridgeConfig.Schedules.FindByPredicate([&ProgramName](const FHueScheduleConfig& Schedule)
+	{
+		return Schedule.ProgramName == ProgramName;
+	});
+}
+
+/**
+ * @brief Crc of an ambient program, every step hashes like a scene with its hold time added
+ * @param Program Program to hash
+ * @return int32 hash
+ */
+int32 AHueBridge::HashAmbientProgram(const FHueAmbientProgram& Program) const
+{
+	FString Key = Program.bLoop ? TEXT("loop") : TEXT("once");
+	for (const FHueAmbientStep& Step : Program.Steps)
+	{
+		FHueSceneDefinition Definition;
+		Definition.LampStates = Step.LampStates;
+		Definition.TransitionTime = FMath::RoundToInt(Step.FadeSeconds * 10.0f);
+		Key += FString::Printf(TEXT("|%d:%d"), HashSceneDefinition(Definition), FMath::RoundToInt(Step.HoldSeconds));
+	}
+	return static_cast<int32>(FCrc::StrCrc32(*Key));
+}
+
+/**
+ * @brief Fill a snapshot from a bulk light read :: Internal Call
+ * @param Lights Every light the bridge reported
+ * @param SnapshotOut Snapshot keyed by light id, a renamed lamp is still found
+ */
+void AHueBridge::BuildSnapshot(const TArray<FHueLightRecord>& Lights, FHueRoomSnapshot& SnapshotOut) const
+{
+	SnapshotOut.LampStates.Empty();
+	for (const FHueLightRecord& Light : Lights)
+	{
+		if(Light.bHasState && !Light.ResourceId.IsEmpty())
+		{
+			SnapshotOut.LampStates.Add(Light.ResourceId, Light.State);
+		}
+	}
+	SnapshotOut.CapturedAt = FDateTime::Now();
+	SnapshotOut.bValid = SnapshotOut.LampStates.Num() > 0;
+}
+
+/**
+ * @brief One restore request was answered, the restore is done when the last one is :: Internal Call
+ * @param Id Restore the request belonged to, answers for an older restore are dropped
+ */
+void AHueBridge::FinishRestoreRequest(int32 Id)
+{
+	if(Id != RestoreId || --RestoreRequestsInFlight > 0)
+	{
+		return;
+	}
+	RestoreRequestsInFlight = 0;
+	RestoreLamps.Empty();
+	LastRestore.LatencyMs = static_cast<float>((FPlatformTime::Seconds() - RestoreStartTime) * 1000.0);
+	LastRestore.bCompleted = true;
+	UE_LOG(LogTemp, Log, TEXT("Hue restore of %d lamps took %d requests in %.1fms"), LastRestore.Lamps, LastRestore.Requests, LastRestore.LatencyMs);
+	SnapshotRestored.Broadcast(LastRestore);
+}
+
+/**
+ * @brief Pump the http manager until the restore is answered or the budget runs out, for shutdown where the
+ * engine won't tick again :: Internal Call
+ * @param Budget Seconds to wait at most
+ */
+void AHueBridge::WaitForRestore(float Budget)
+{
+	const double EndTime = FPlatformTime::Seconds() + Budget;
+	double LastTime = FPlatformTime::Seconds();
+	while(RestoreRequestsInFlight > 0 && FPlatformTime::Seconds() < EndTime)
+	{
+		const double Now = FPlatformTime::Seconds();
+		//Restored lamps wait in the scheduler like any other change
+		SendScheduled(Now);
+		FHttpModule::Get().GetHttpManager().Tick(static_cast<float>(Now - LastTime));
+		LastTime = Now;
+		FPlatformProcess::Sleep(0.005f);
+	}
+	if(RestoreRequestsInFlight > 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Hue restore ran out of its %.1fs budget with %d requests unanswered"), Budget, RestoreRequestsInFlight);
+	}
+}
+
+/**
+ * @brief Record how long the last scene switch took and broadcast it
+ */
+void AHueBridge::FinishSceneSwitch()
+{
+	QueuedSwitchLamps.Empty();
+	PendingSwitchLamps.Empty();
+	//Nothing left for the bridge, e.g. every lamp already showed the scene
+	LastSceneSwitch.LatencyMs = SceneSwitchStartTime > 0.0 ? static_cast<float>((FPlatformTime::Seconds() - SceneSwitchStartTime) * 1000.0) : 0.0f;
+	UE_LOG(LogTemp, Log, TEXT("Scene %s switched with %d requests in %.1fms (%s)"), *LastSceneSwitch.SceneName,
+		LastSceneSwitch.Requests, LastSceneSwitch.LatencyMs, LastSceneSwitch.bUsedBridgeScene ? TEXT("bridge scene") : TEXT("lamp by lamp"));
+	SceneSwitched.Broadcast(LastSceneSwitch);
+}
+
+/**
+ * @brief A lamp of a lamp by lamp switch left for the bridge. The switch is timed from the first lamp that leaves, not
+ * from when the states were queued :: Internal Call
+ * @param Lamp Lamp that was sent
+ * @param State State that left, a lamp changed again before its turn never sent the scene's state
+ * @param Requests Requests it took, 0 when it shares a request with other lamps
+ * @return True if the lamp was part of the switch and sent the switch's state
+ */
+bool AHueBridge::NoteSwitchSent(AHueLamp* Lamp, const FHueLampState& State, int32 Requests)
+{
+	const FHueLampState* Queued = QueuedSwitchLamps.Find(Lamp);
+	if(!Queued)
+	{
+		return false;
+	}
+	const bool bSceneState = *Queued == State;
+	QueuedSwitchLamps.Remove(Lamp);
+	if(bSceneState)
+	{
+		if(SceneSwitchStartTime <= 0.0)
+		{
+			SceneSwitchStartTime = FPlatformTime::Seconds();
+		}
+		LastSceneSwitch.Requests += Requests;
+		PendingSwitchLamps.Add(Lamp);
+	}
+	else if(QueuedSwitchLamps.Num() == 0 && PendingSwitchLamps.Num() == 0)
+	{
+		FinishSceneSwitch();
+	}
+	return bSceneState;
+}
+
+/**
+ * @brief The bridge answered a lamp, the switch is done once every sent lamp is answered and none is left queued :: Internal Call
+ * @param Lamp Lamp that got its answer
+ */
+void AHueBridge::NoteSwitchAcknowledged(AHueLamp* Lamp)
+{
+	if(PendingSwitchLamps.Remove(Lamp) > 0 && PendingSwitchLamps.Num() == 0 && QueuedSwitchLamps.Num() == 0)
+	{
+		FinishSceneSwitch();
+	}
+}
+
+/**
+ * @brief Creates REST API call to the Hue bridge too find all lamp connected to the bridge. User needs to be created
+ * in order to find all lamps 
+ */
+void AHueBridge::DiscoverLamps()
+{
+	if(!BeginOperation(EHueBridgeOperation::Discover))
+	{
+		return;
+	}
+	//Clients read through the owner so the bridge sees one reader however many processes share it
+	if(!OwnsBridgeConnection())
+	{
+		RequestBrokerRead(EHueBridgeOperation::Discover);
+		return;
+	}
+	ReadLights(EHueBridgeOperation::Discover);
+}
+
+/**
+ * @brief Look for the Hue bridge on the local network without blocking, the cached host is checked first.
+ * BridgeDiscovered fires with the result and the host name is updated when a bridge is found
+ */
+void AHueBridge::AutoDiscoverBridge()
+{
+	if(BridgeDiscovery.IsValid() && BridgeDiscovery->IsRunning())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Hue Bridge discovery already running"));
+		return;
+	}
+	BridgeDiscovery = MakeShared<FHueBridgeDiscovery>(DiscoverySettings);
+	BridgeDiscovery->Start(HueBridgeConfig.HostName, FOnHueBridgeDiscoveryFinished::CreateUObject(this, &AHueBridge::OnBridgeDiscoveryFinished));
+}
+
+/**
+ * @brief Setups a timer to create to ask the user to press the hue bridge link button
+ */
+void AHueBridge::HueBridgeSetupTimer()
+{
+	if(GetWorldTimerManager().IsTimerActive(LinkBridgeTimer))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Hue Bridge Link already being requested"));	
+		return;
+	}
+	GetWorld()->GetTimerManager().ClearTimer(LinkBridgeTimer);
+	GetWorld()->GetTimerManager().SetTimer(LinkBridgeTimer, this, &AHueBridge::SetupNewUser,DelayTimerForBridgePress, false);
+	RequestUser.Broadcast(DelayTimerForBridgePress);
+	HueBringTimerStarted_Implementation(DelayTimerForBridgePress);
+	
+}
+
+/**
+ * @brief Creates REST API call to the Hue bridge to create a new user
+ */
+void AHueBridge::SetupNewUser()
+{
+	GetWorld()->GetTimerManager().ClearTimer(LinkBridgeTimer);
+	if(!BeginOperation(EHueBridgeOperation::CreateUser))
+	{
+		return;
+	}
+	
+	//Setup HTTP REST CALL and Completed Request Delegate 
+	const TSharedRef<IHttpRequest> Request = Transport->CreateCreateUser(HueBridgeConfig.AppName);
+	Request->OnProcessRequestComplete().BindUObject(this, &AHueBridge::OnResponseReceivedNewUser);
+	Request->ProcessRequest();
+}
+
+/**
+ * @brief Save Hue bridge config out to Json file, the file is written on a worker
+ */
+void AHueBridge::SaveConfig()
+{
+	SaveWarning.Broadcast();
+	//Lamps not discovered this session keep their entries, the ones we have replace theirs
+	for (const auto&  Element: HueLamps)
+	{
+		FLightUse Light;
+		Light.LightName = Element.Key;
+		Light.LightId = Element.Value->GetDeviceKey();
+		Light.bUseLight = Element.Value->LampToBeUsed();
+		HueBridgeConfig.Lights.Add(Light);
+	}
+	FHueConfigStore::DedupeLights(HueBridgeConfig.Lights);
+
+	GetConfigStore().Save(HueBridgeConfig, bUseConfigCache);
+	UE_LOG(LogTemp, Warning, TEXT("HueConfig SAVED!"));
+	
+}
+
+/**
+ * @brief Load Hue Bridge config from json file, or from its binary cache while the json hasn't changed
+ */
+void AHueBridge::LoadConfig()
+{
+	//A save still being written is newer than what is on disk, the store hands that back without waiting on it
+	FHueConfigStore& Store = GetConfigStore();
+	FHueBridgeConfig Loaded;
+	if(Store.Load(Loaded, bUseConfigCache))
+	{
+		HueBridgeConfig = MoveTemp(Loaded);
+		//Older saves added every lamp again each time
+		FHueConfigStore::DedupeLights(HueBridgeConfig.Lights);
+		RefreshTransport();
+		
+		//Setup all our Hue Lamps, find the bridge first if it might have moved
+		if(bAutoDiscoverBridge)
+		{
+			bDiscoverLampsAfterBridge = true;
+			AutoDiscoverBridge();
+		}
+		else
+		{
+			DiscoverLamps();
+		}
+		//Lamps discovered later get theirs when they are spawned
+		for (const auto& Element : HueLamps)
+		{
+			ApplyLightUse(Element.Value);
+		}
+	
+		UE_LOG(LogTemp, Warning, TEXT("HueConfig LOADED!"));	
+	}
+	else
+	{
+		UE_LOG(LogTemp, Warning, TEXT("HueConfig Not Found Creating New Save Config"));	
+		SaveConfig();
+	}
+}
+
+FHueConfigStore& AHueBridge::GetConfigStore()
+{
+	if(!ConfigStore.IsValid())
+	{
+		ConfigStore = MakeShared<FHueConfigStore>(FPaths::ProjectContentDir() + CONFIG_FILE);
+	}
+	return *ConfigStore;
+}
+
+/**
+ * @brief Give a lamp the use flag saved for it, by id or else by name. The name covers entries saved before ids were
+ * and entries saved under the other api version, whose ids differ. A name match takes the lamp's id so the next save
+ * replaces the entry instead of adding a second one :: Internal Call
+ * @param Lamp Lamp to set up
+ */
+void AHueBridge::ApplyLightUse(AHueLamp* Lamp)
+{
+	FLightUse* Saved = HueBridgeConfig.Lights.FindByPredicate([Lamp](const FLightUse& Light)
+	{
+		return !Light.LightId.IsEmpty() && Light.LightId == Lamp->GetDeviceKey();
+	});
+	if(!Saved)
+	{
+		Saved = HueBridgeConfig.Lights.FindByPredicate([Lamp](const FLightUse& Light)
+		{
+			return Light.LightName == Lamp->GetLampName();
+		});
+		if(Saved)
+		{
+			Saved->LightId = Lamp->GetDeviceKey();
+		}
+	}
+	if(Saved)
+	{
+		Lamp->UseLampLight(Saved->bUseLight);
+	}
+}
+
+/**
+ * @brief Get a pointer to a Hue Lamp from our TMap of Lamps
+ * @param LampName const String name of lamp to get
+ * @return Point to our Hue Lamp
+ */
+AHueLamp* AHueBridge::GetLamp(const FString& LampName)
+{
+	if(HueLamps.Contains(LampName))
+	{
+		return HueLamps[LampName];
+	}
+	return nullptr;
 	
 }
 
 /**
- * @brief Clear out all hue Lamps
+ * @brief Creates REST API call to the Hue bridge to see if user already exists. The answer comes back through
+ * HasUserBeenConfigured, IsUserConfigured holds it afterwards. A bridge that doesn't answer leaves both alone
+ */
+void AHueBridge::CheckHueUser()
+{
+	if(!BeginOperation(EHueBridgeOperation::CheckUser))
+	{
+		return;
+	}
+	//Only a known user may read the light list
+	const TSharedRef<IHttpRequest> Request = Transport->CreateGetLights();
+	Request->OnProcessRequestComplete().BindUObject(this, &AHueBridge::OnResponseReceivedUserExist);
+	Request->ProcessRequest();
+}
+
+/**
+ * @brief Kept for Blueprints made before the check went async, starts a check and returns the last known answer
+ * @return Returns true if the last finished check or user creation found the user
+ */
+bool AHueBridge::DoesHueUserExist()
+{
+	CheckHueUser();
+	return bUserExist;
+}
+
+/**
+ * @brief Clear out all hue Lamps
+ */
+void AHueBridge::ClearOutLights()
+{
+	for (const auto&  Element: HueLamps)
+	{
+		FString Key = Element.Key;
+		if(HueLamps.Contains(Key))
+		{
+			AHueLamp* Lamp = GetLamp(Key);
+			Lamp->Delete();
+		}
+	}
+	HueLamps.Empty();
+	ScheduledLamps.Empty();
+	LampsByKey.Empty();
+	UnconfirmedSubmits.Empty();
+	FrameTransactions.Empty();
+	DmxPatchLamps.Empty();
+	EffectRunner->StopAll();
+	Scheduler->Reset();
+}
+
+/**
+ * @brief Compile a scene definition into a bridge side scene. Does nothing if the cached scene was built from the same
+ * definition, otherwise the old bridge scene is removed and replaced. Lamps must have been discovered first
+ * @param SceneName Name of the scene in SceneDefinitions
+ */
+void AHueBridge::CompileScene(const FString& SceneName)
+{
+	const FHueSceneDefinition* Definition = SceneDefinitions.Find(SceneName);
+	if(!Definition)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("No scene definition named %s"), *SceneName);
+		return;
+	}
+
+	const int32 DefinitionHash = HashSceneDefinition(*Definition);
+	const FHueSceneConfig* SceneConfig = FindSceneConfig(SceneName);
+	if(SceneConfig && !SceneConfig->SceneId.IsEmpty())
+	{
+		if(SceneConfig->DefinitionHash == DefinitionHash)
+		{
+			return;
+		}
+
+		//Definition changed, drop the stale bridge scene so they don't pile up on the bridge
+		Transport->CreateDeleteScene(SceneConfig->SceneId)->ProcessRequest();
+	}
+
+	//Key every state by the id the transport addresses the lamp with, one recall then sets every lamp
+	TMap<FString, FHueLampState> LightStates;
+	for (const auto& Element : Definition->LampStates)
+	{
+		const AHueLamp* Lamp = GetLamp(Element.Key);
+		if(!Lamp)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Scene %s skipping unknown lamp %s"), *SceneName, *Element.Key);
+			continue;
+		}
+		LightStates.Add(Lamp->GetDeviceKey(), Element.Value);
+	}
+
+	if(LightStates.Num() == 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Scene %s has no discovered lamps, discover lamps before compiling scenes"), *SceneName);
+		return;
+	}
+
+	const TSharedRef<IHttpRequest> Request = Transport->CreateCreateScene(SceneName, LightStates, Definition->TransitionTime);
+	Request->OnProcessRequestComplete().BindUObject(this, &AHueBridge::OnResponseReceivedCreateScene, SceneName, DefinitionHash);
+	Request->ProcessRequest();
+}
+
+/**
+ * @brief Compile every scene definition, only scenes whose definition changed reach the bridge
+ */
+void AHueBridge::CompileAllScenes()
+{
+	for (const auto& Element : SceneDefinitions)
+	{
+		CompileScene(Element.Key);
+	}
+}
+
+/**
+ * @brief Switch the whole room to a compiled scene with a single group action
+ * @param SceneName Name of the scene
+ * @return False if the scene hasn't been compiled on the bridge yet
+ */
+bool AHueBridge::RecallScene(const FString& SceneName)
+{
+	const FHueSceneConfig* SceneConfig = FindSceneConfig(SceneName);
+	const FHueSceneDefinition* Definition = SceneDefinitions.Find(SceneName);
+	if(!SceneConfig || SceneConfig->SceneId.IsEmpty() || (Definition && SceneConfig->DefinitionHash != HashSceneDefinition(*Definition)))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Scene %s is not compiled"), *SceneName);
+		return false;
+	}
+
+	//Late acks from a lamp by lamp switch still in flight would finish this one
+	PendingSwitchLamps.Empty();
+	QueuedSwitchLamps.Empty();
+	SceneSwitchId++;
+	const TSharedRef<IHttpRequest> Request = Transport->CreateRecallScene(SceneConfig->SceneId);
+	Request->OnProcessRequestComplete().BindUObject(this, &AHueBridge::OnResponseReceivedRecallScene, SceneSwitchId);
+	Request->ProcessRequest();
+
+	LastSceneSwitch = FHueSceneSwitchStats();
+	LastSceneSwitch.SceneName = SceneName;
+	LastSceneSwitch.bUsedBridgeScene = true;
+	LastSceneSwitch.Requests = 1;
+	SceneSwitchStartTime = FPlatformTime::Seconds();
+
+	//Keep our lamps in step with what the bridge is about to show
+	if(Definition)
+	{
+		for (const auto& Element : Definition->LampStates)
+		{
+			if(AHueLamp* Lamp = GetLamp(Element.Key))
+			{
+				Lamp->MarkStateFromBridge(Element.Value);
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Apply a scene definition one request per lamp, the path scenes replace. Kept for comparing switch cost
+ * and as the fallback when a scene hasn't been compiled yet
+ * @param SceneName Name of the scene in SceneDefinitions
+ */
+void AHueBridge::ApplySceneLampByLamp(const FString& SceneName)
+{
+	const FHueSceneDefinition* Definition = SceneDefinitions.Find(SceneName);
+	if(!Definition)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("No scene definition named %s"), *SceneName);
+		return;
+	}
+
+	LastSceneSwitch = FHueSceneSwitchStats();
+	LastSceneSwitch.SceneName = SceneName;
+	//ApplyState only queues on the send scheduler, requests and timing start when the states actually leave
+	SceneSwitchStartTime = 0.0;
+	SceneSwitchId++;
+	PendingSwitchLamps.Empty();
+	QueuedSwitchLamps.Empty();
+	for (const auto& Element : Definition->LampStates)
+	{
+		AHueLamp* Lamp = GetLamp(Element.Key);
+		if(!Lamp)
+		{
+			continue;
+		}
+		QueuedSwitchLamps.Add(Lamp, Element.Value);
+		if(!Lamp->ApplyState(Element.Value))
+		{
+			QueuedSwitchLamps.Remove(Lamp);
+		}
+	}
+
+	if(QueuedSwitchLamps.Num() == 0 && PendingSwitchLamps.Num() == 0)
+	{
+		FinishSceneSwitch();
+	}
+}
+
+/**
+ * @brief Check if a scene has an up to date bridge side scene
+ * @param SceneName Name of the scene
+ * @return True if RecallScene will use a single request
+ */
+bool AHueBridge::IsSceneCompiled(const FString& SceneName)
+{
+	const FHueSceneConfig* SceneConfig = FindSceneConfig(SceneName);
+	const FHueSceneDefinition* Definition = SceneDefinitions.Find(SceneName);
+	return SceneConfig && Definition && !SceneConfig->SceneId.IsEmpty() && SceneConfig->DefinitionHash == HashSceneDefinition(*Definition);
+}
+
+/**
+ * @brief Gather the send path counters of every lamp on this bridge
+ * @return FHueBridgeMetrics totals
+ */
+FHueBridgeMetrics AHueBridge::GetMetrics()
+{
+	FHueBridgeMetrics Metrics;
+	for (const auto& Element : HueLamps)
+	{
+		AHueLamp* Lamp = Element.Value;
+		if(!Lamp)
+		{
+			continue;
+		}
+		Metrics.SuppressedCommands += Lamp->GetSuppressedCommandCount();
+		Metrics.ReconnectFlushes += Lamp->GetReconnectFlushCount();
+		Metrics.PendingOnReconnect += Lamp->HasHeldReconnectState() ? 1 : 0;
+		Metrics.UnreachableLamps += Lamp->IsReachable() ? 0 : 1;
+	}
+	Metrics.TotalVisibleError = Scheduler->GetTotalError();
+	Metrics.bOwnsBridge = OwnsBridgeConnection();
+	if(CommandBroker.IsValid())
+	{
+		Metrics.BrokerSubmitted = CommandBroker->GetSubmittedCount();
+		Metrics.BrokerReceived = CommandBroker->GetReceivedCount();
+	}
+	Metrics.RequestsSent = Transport->GetRequestCount();
+	Metrics.StateLatencyMs = GetStateLatency() * 1000.0f;
+	Metrics.EffectEvaluateMs = EffectRunner->GetLastEvaluateMs();
+	Metrics.EffectLamps = EffectRunner->GetLastEvaluatedLamps();
+	if(DmxReceiver.IsValid())
+	{
+		Metrics.DmxPackets = DmxReceiver->GetReceivedCount();
+		Metrics.DmxDropped = DmxReceiver->GetDroppedCount();
+		Metrics.DmxUniverses = DmxReceiver->GetUniverseCount();
+	}
+	if(SensorPoller.IsValid())
+	{
+		Metrics.SensorLatencyMs = SensorPoller->GetAverageLatencyMs();
+		Metrics.SensorMaxLatencyMs = SensorPoller->GetMaxLatencyMs();
+		Metrics.SensorPollInterval = SensorPoller->GetInterval();
+		Metrics.SensorChanges = SensorPoller->GetChangeCount();
+		Metrics.bSensorStreaming = EventStream.IsValid();
+	}
+	return Metrics;
+}
+
+float AHueBridge::GetStateLatency()
+{
+	float TotalMs = 0.0f;
+	int32 Measured = 0;
+	for (const TWeakObjectPtr<AHueLamp>& Lamp : ScheduledLamps)
+	{
+		if(Lamp.IsValid() && Lamp->GetStateLatencyMs() > 0.0f)
+		{
+			TotalMs += Lamp->GetStateLatencyMs();
+			Measured++;
+		}
+	}
+	return Measured > 0 ? TotalMs / Measured / 1000.0f : 0.0f;
+}
+
+/**
+ * @brief Set how many light state requests a second this bridge may send
+ * @param Rate float requests per second
+ */
+void AHueBridge::SetSendRate(float Rate)
+{
+	SendRate = FMath::Max(Rate, 0.1f);
+	Scheduler->SetSendRate(SendRate);
+}
+
+/**
+ * @brief Join the local command broker, the first process to start it owns the bridge connection.
+ * Processes that don't own it hand their lamp states to the owner and take over if the owner exits. The broker
+ * starts once the config or discovery names a bridge and follows it when it changes
+ */
+void AHueBridge::StartCommandBroker()
+{
+	bBrokerRequested = true;
+	RefreshCommandBroker();
+}
+
+/**
+ * @brief Key the broker to the bridge we talk to, called whenever the host or bridge id may have changed :: Internal Call
+ * The broker waits until the config or discovery gives us a bridge, an empty key would put every process on one owner
+ */
+void AHueBridge::RefreshCommandBroker()
+{
+	if(!bBrokerRequested)
+	{
+		return;
+	}
+	const FString BridgeKey = HueBridgeConfig.BridgeId.IsEmpty() ? HueBridgeConfig.HostName : HueBridgeConfig.BridgeId;
+	if(CommandBroker.IsValid() && CommandBroker->GetBridgeKey() == BridgeKey)
+	{
+		return;
+	}
+	//Lights asked of the old owner won't come, nor will its confirmations
+	if(bBrokerReadPending)
+	{
+		FinishBrokerRead(false);
+	}
+	TArray<int32> Unconfirmed;
+	UnconfirmedSubmits.GetKeys(Unconfirmed);
+	for (const int32 Slot : Unconfirmed)
+	{
+		ReleaseBrokerSubmit(Slot);
+	}
+	CommandBroker.Reset();
+	if(BridgeKey.IsEmpty())
+	{
+		return;
+	}
+	CommandBroker = MakeUnique<FHueCommandBroker>(BrokerPort, BridgeKey);
+	CommandBroker->Start();
+}
+
+/**
+ * @brief Ask the broker owner for the bridge's lights in place of a bridge read :: Internal Call
+ * @param Operation Discover or RefreshState, already begun by the caller. Finished as failed if the request can't be sent
+ */
+void AHueBridge::RequestBrokerRead(EHueBridgeOperation Operation)
+{
+	if(!CommandBroker->RequestRead())
+	{
+		FinishOperation(Operation, EHueOperationResult::Unreachable);
+		return;
+	}
+	//One answer serves both operations, a second request only restarts the wait
+	BrokerReadTime = FPlatformTime::Seconds();
+	bBrokerReadPending = true;
+}
+
+/**
+ * @brief Finish the operations that waited on the broker owner's lights :: Internal Call
+ * @param bSuccess True if the owner answered
+ */
+void AHueBridge::FinishBrokerRead(bool bSuccess)
+{
+	bBrokerReadPending = false;
+	const EHueOperationResult Result = bSuccess ? EHueOperationResult::Succeeded : EHueOperationResult::Unreachable;
+	if(ActiveOperations.Contains(EHueBridgeOperation::Discover))
+	{
+		FinishOperation(EHueBridgeOperation::Discover, Result);
+	}
+	if(ActiveOperations.Contains(EHueBridgeOperation::RefreshState))
+	{
+		FinishOperation(EHueBridgeOperation::RefreshState, Result);
+	}
+}
+
+/**
+ * @brief Check if this process sends to the bridge itself
+ * @return True without a broker or when this process is the broker owner
+ */
+bool AHueBridge::OwnsBridgeConnection()
+{
+	return !CommandBroker.IsValid() || CommandBroker->IsOwner();
+}
+
+/**
+ * @brief Set how the bridge picks the next lamp to send
+ * @param Policy Fifo or PerceptualError
+ */
+void AHueBridge::SetSchedulePolicy(EHueSchedulePolicy Policy)
+{
+	SchedulePolicy = Policy;
+	Scheduler->SetPolicy(SchedulePolicy);
+}
+
+/**
+ * @brief Start recording every lamp state change made on this bridge
+ */
+void AHueBridge::StartScheduleTrace()
+{
+	Scheduler->StartRecording(FPlatformTime::Seconds());
+}
+
+/**
+ * @brief Stop recording lamp state changes
+ * @return Recorded trace, replay it with CompareSchedulePolicies
+ */
+TArray<FHueTraceEvent> AHueBridge::StopScheduleTrace()
+{
+	TArray<FHueTraceEvent> Trace;
+	Scheduler->StopRecording(Trace);
+	return Trace;
+}
+
+/**
+ * @brief Replay a recorded trace with both policies at this bridge's send rate
+ * @param Trace Recorded trace
+ * @param FifoError Visible error integrated over the trace when sending in arrival order
+ * @param PerceptualError Visible error integrated over the trace when sending largest error first
+ */
+void AHueBridge::CompareSchedulePolicies(const TArray<FHueTraceEvent>& Trace, float& FifoError, float& PerceptualError)
+{
+	const int32 NumSlots = FMath::Max(Scheduler->Num(), Trace.Num() > 0 ? 1 + FMath::Max(0, Algo::MaxElementBy(Trace, &FHueTraceEvent::Slot)->Slot) : 0);
+	FifoError = static_cast<float>(FHueSendScheduler::SimulateTrace(Trace, NumSlots, SendRate, EHueSchedulePolicy::Fifo));
+	PerceptualError = static_cast<float>(FHueSendScheduler::SimulateTrace(Trace, NumSlots, SendRate, EHueSchedulePolicy::PerceptualError));
+	UE_LOG(LogTemp, Log, TEXT("Hue schedule replay of %d changes on %d lamps at %.1f/s: FIFO error %.1f, perceptual error %.1f"),
+		Trace.Num(), NumSlots, SendRate, FifoError, PerceptualError);
+}
+
+/**
+ * @brief Put an ambient program on the bridge. Every step becomes a scene that carries its fade, and the bridge's own
+ * timers recall them so the cycle runs without the game sending anything. A looping program that is already installed
+ * unchanged is reused, a changed one replaces the old schedules. Lamps must have been discovered first
+ * @param ProgramName Name of the program in AmbientPrograms
+ * @return False if the program can't be installed
+ */
+bool AHueBridge::InstallAmbientProgram(const FString& ProgramName)
+{
+	const FHueAmbientProgram* Program = AmbientPrograms.Find(ProgramName);
+	if(!Program || Program->Steps.Num() == 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("No ambient program named %s"), *ProgramName);
+		return false;
+	}
+	if(AmbientInstalls.Contains(ProgramName))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Ambient program %s is already being installed"), *ProgramName);
+		return false;
+	}
+
+	const int32 ProgramHash = HashAmbientProgram(*Program);
+	if(const FHueScheduleConfig* Installed = FindScheduleConfig(ProgramName))
+	{
+		//One shot timers are gone once they have fired, only a loop is still running on the bridge
+		if(Installed->bLoop && Program->bLoop && Installed->ProgramHash == ProgramHash)
+		{
+			AmbientProgramInstalled.Broadcast(ProgramName, true);
+			return true;
+		}
+		DeleteFromBridge(*Installed);
+		HueBridgeConfig.Schedules.RemoveAll([&ProgramName](const FHueScheduleConfig& Schedule)
+		{
+			return Schedule.ProgramName == ProgramName;
+		});
+	}
+
+	//Key every step's states by the id the transport addresses the lamp with
+	TArray<TMap<FString, FHueLampState>> StepStates;
+	TArray<double> Offsets;
+	double Offset = 0.0;
+	for (const FHueAmbientStep& Step : Program->Steps)
+	{
+		TMap<FString, FHueLampState>& LightStates = StepStates.AddDefaulted_GetRef();
+		for (const auto& Element : Step.LampStates)
+		{
+			if(const AHueLamp* Lamp = GetLamp(Element.Key))
+			{
+				LightStates.Add(Lamp->GetDeviceKey(), Element.Value);
+			}
+		}
+		if(LightStates.Num() == 0)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Ambient program %s has a step without discovered lamps"), *ProgramName);
+			return false;
+		}
+		Offsets.Add(Offset);
+		Offset += Step.FadeSeconds + Step.HoldSeconds;
+	}
+	const double Span = Program->bLoop ? Offset : Offsets.Last();
+	if((Program->bLoop && Span < 1.0) || Span >= 86400.0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Ambient program %s must last between a second and a day, bridge timers can't count further"), *ProgramName);
+		return false;
+	}
+
+	FHueAmbientInstall& Install = AmbientInstalls.Add(ProgramName);
+	Install.Config.ProgramName = ProgramName;
+	Install.Config.ProgramHash = ProgramHash;
+	Install.Config.bLoop = Program->bLoop;
+	Install.Config.SceneIds.SetNum(StepStates.Num());
+	Install.Offsets = MoveTemp(Offsets);
+	Install.Period = Offset;
+	for (int32 Step = 0; Step < StepStates.Num(); ++Step)
+	{
+		const int32 TransitionTime = FMath::Clamp(FMath::RoundToInt(Program->Steps[Step].FadeSeconds * 10.0f), 0, 65535);
+		const TSharedRef<IHttpRequest> Request = Transport->CreateCreateScene(FString::Printf(TEXT("%s %d"), *ProgramName, Step), StepStates[Step], TransitionTime);
+		Request->OnProcessRequestComplete().BindUObject(this, &AHueBridge::OnResponseReceivedAmbientScene, ProgramName, Step);
+		Request->ProcessRequest();
+		Install.Pending++;
+	}
+	return true;
+}
+
+/**
+ * @brief Every step scene exists, start the first step and make the timers for the rest. A program that runs once
+ * only needs a one shot timer per step. A loop gets one repeating timer per step with the cycle's period, steps after
+ * the first wait disabled until a one shot timer enables them at their offset. Bridge timers start counting when they
+ * are enabled, so those steps also get a one shot recall at their offset or their first cycle would only come a
+ * period late :: Internal Call
+ * @param ProgramName Program being installed
+ */
+void AHueBridge::StartAmbientSchedules(const FString& ProgramName)
+{
+	FHueAmbientInstall& Install = AmbientInstalls[ProgramName];
+	Install.bSchedulesStarted = true;
+	Transport->CreateRecallScene(Install.Config.SceneIds[0])->ProcessRequest();
+
+	const FString Period = TEXT("R/") + HueAmbient::FormatTimer(Install.Period);
+	for (int32 Step = 0; Step < Install.Config.SceneIds.Num(); ++Step)
+	{
+		if(!Install.Config.bLoop && Step == 0)
+		{
+			continue;
+		}
+		FHueScheduleCommand Command;
+		Command.SceneId = Install.Config.SceneIds[Step];
+		const FString Name = FString::Printf(TEXT("%s %d"), *ProgramName, Step);
+		const FString Offset = HueAmbient::FormatTimer(Install.Offsets[Step]);
+		const TSharedRef<IHttpRequest> Request = Install.Config.bLoop ?
+			Transport->CreateCreateSchedule(Name, Command, Period, Step == 0, false) :
+			Transport->CreateCreateSchedule(Name, Command, Offset, true, true);
+		Request->OnProcessRequestComplete().BindUObject(this, &AHueBridge::OnResponseReceivedAmbientSchedule, ProgramName, Step, false);
+		Request->ProcessRequest();
+		Install.Pending++;
+		if(Install.Config.bLoop && Step > 0)
+		{
+			const TSharedRef<IHttpRequest> First = Transport->CreateCreateSchedule(Name + TEXT(" first"), Command, Offset, true, true);
+			First->OnProcessRequestComplete().BindUObject(this, &AHueBridge::OnResponseReceivedAmbientSchedule, ProgramName, Step, true);
+			First->ProcessRequest();
+			Install.Pending++;
+		}
+	}
+	if(Install.Pending == 0)
+	{
+		FinishAmbientInstall(ProgramName);
+	}
+}
+
+/**
+ * @brief Every request of an install has been answered. A failed install is taken off the bridge again, a good one
+ * is kept in the config so a later session can reuse or remove it :: Internal Call
+ * @param ProgramName Program being installed
  */
-void AHueBridge::ClearOutLights()
+void AHueBridge::FinishAmbientInstall(const FString& ProgramName)
 {
-	for (const auto&  Element: HueLamps)
+	FHueAmbientInstall Install;
+	AmbientInstalls.RemoveAndCopyValue(ProgramName, Install);
+	if(Install.bFailed)
 	{
-		FString Key = Element.Key;
-		if(HueLamps.Contains(Key))
+		UE_LOG(LogTemp, Warning, TEXT("Ambient program %s not installed, removing what was created"), *ProgramName);
+		DeleteFromBridge(Install.Config);
+		AmbientProgramInstalled.Broadcast(ProgramName, false);
+		return;
+	}
+	Install.Config.InstalledAt = FDateTime::UtcNow();
+	HueBridgeConfig.Schedules.Add(Install.Config);
+	UE_LOG(LogTemp, Log, TEXT("Ambient program %s installed with %d scenes and %d schedules"), *ProgramName,
+		Install.Config.SceneIds.Num(), Install.Config.ScheduleIds.Num());
+	//The bridge is driving the lamps now, pull in what they show
+	RefreshLampStates();
+	AmbientProgramInstalled.Broadcast(ProgramName, true);
+}
+
+/**
+ * @brief Delete an ambient program's schedules and then its scenes. One shot timers that already fired have deleted
+ * themselves and just answer with an error :: Internal Call
+ * @param Schedule Installed program
+ */
+void AHueBridge::DeleteFromBridge(const FHueScheduleConfig& Schedule)
+{
+	for (const FString& ScheduleId : Schedule.ScheduleIds)
+	{
+		Transport->CreateDeleteSchedule(ScheduleId)->ProcessRequest();
+	}
+	for (const FString& SceneId : Schedule.SceneIds)
+	{
+		if(!SceneId.IsEmpty())
 		{
-			AHueLamp* Lamp = GetLamp(Key);
-			Lamp->Delete();
+			Transport->CreateDeleteScene(SceneId)->ProcessRequest();
 		}
 	}
-	HueLamps.Empty();
+}
+
+/**
+ * @brief Stop an ambient program and take it off the bridge, the lamps stay where the cycle left them
+ * @param ProgramName Name of the program
+ */
+void AHueBridge::CancelAmbientProgram(const FString& ProgramName)
+{
+	//An install still on its way is removed once its last request is answered
+	if(FHueAmbientInstall* Install = AmbientInstalls.Find(ProgramName))
+	{
+		Install->bFailed = true;
+	}
+	const int32 Index = HueBridgeConfig.Schedules.IndexOfByPredicate([&ProgramName](const FHueScheduleConfig& Schedule)
+	{
+		return Schedule.ProgramName == ProgramName;
+	});
+	if(Index == INDEX_NONE)
+	{
+		return;
+	}
+	DeleteFromBridge(HueBridgeConfig.Schedules[Index]);
+	HueBridgeConfig.Schedules.RemoveAt(Index);
+	//The game takes over again from wherever the bridge stopped
+	RefreshLampStates();
+}
+
+void AHueBridge::CancelAllAmbientPrograms()
+{
+	TArray<FString> Names;
+	AmbientInstalls.GetKeys(Names);
+	for (const FHueScheduleConfig& Schedule : HueBridgeConfig.Schedules)
+	{
+		Names.AddUnique(Schedule.ProgramName);
+	}
+	for (const FString& Name : Names)
+	{
+		CancelAmbientProgram(Name);
+	}
+}
+
+/**
+ * @brief Check if an ambient program is on the bridge and matches its current definition
+ * @param ProgramName Name of the program
+ * @return True if installed unchanged
+ */
+bool AHueBridge::IsAmbientProgramInstalled(const FString& ProgramName)
+{
+	const FHueScheduleConfig* Installed = FindScheduleConfig(ProgramName);
+	const FHueAmbientProgram* Program = AmbientPrograms.Find(ProgramName);
+	return Installed && Program && Installed->ProgramHash == HashAmbientProgram(*Program);
+}
+
+/**
+ * @brief Start listening for sACN and Art-Net. sACN joins the multicast group of every patched universe
+ * @return True if at least one protocol is listening
+ */
+bool AHueBridge::StartDmxInput()
+{
+	TArray<int32> Universes;
+	for (const FHueDmxPatch& Patch : DmxPatch)
+	{
+		Universes.AddUnique(Patch.Universe);
+	}
+	DmxReceiver = MakeUnique<FHueDmxReceiver>();
+	if(!DmxReceiver->Start(bListenSacn, bListenArtNet, Universes))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Hue DMX input could not open its ports"));
+		DmxReceiver.Reset();
+		return false;
+	}
+	ResolveDmxPatch();
+	return true;
+}
+
+void AHueBridge::StopDmxInput()
+{
+	DmxLoopback.Reset();
+	DmxReceiver.Reset();
+}
+
+/**
+ * @brief Replace the DMX patch, a running receiver is restarted so it joins the new universes
+ * @param Patch Lamp to channel mapping
+ */
+void AHueBridge::SetDmxPatch(const TArray<FHueDmxPatch>& Patch)
+{
+	DmxPatch = Patch;
+	ResolveDmxPatch();
+	if(DmxReceiver.IsValid())
+	{
+		StartDmxInput();
+	}
+}
+
+/**
+ * @brief Send a color chase to this machine's DMX ports, checks a patch without a console
+ * @param UniverseCount Universes to send, starting at 1
+ * @param Rate Frames a second per universe, desks send 44
+ * @param bArtNet Send Art-Net instead of sACN
+ */
+void AHueBridge::StartDmxLoopback(int32 UniverseCount, float Rate, bool bArtNet)
+{
+	if(!DmxReceiver.IsValid())
+	{
+		StartDmxInput();
+	}
+	DmxLoopback = MakeUnique<FHueDmxLoopbackGenerator>(UniverseCount, Rate, bArtNet);
+}
+
+void AHueBridge::StopDmxLoopback()
+{
+	DmxLoopback.Reset();
+}
+
+/**
+ * @brief Start reading switches and sensors once the user is confirmed. The first read only records them, changes
+ * are broadcast from then on
+ */
+void AHueBridge::StartSensors()
+{
+	StopSensors();
+	SensorPoller = MakeShared<FHueSensorPoller>(SensorFastInterval, SensorSlowInterval, SensorActiveHold);
+	EventStreamRetryTime = 0.0;
+}
+
+void AHueBridge::StopSensors()
+{
+	if(EventStream.IsValid())
+	{
+		const TSharedPtr<IHttpRequest> OldStream = EventStream;
+		EventStream.Reset();
+		OldStream->CancelRequest();
+	}
+	SensorPoller.Reset();
+	ChangedSensors.Reset();
+}
+
+/**
+ * @brief Last known state of every sensor
+ * @return Sensors from the last read, empty until sensors are started and read once
+ */
+TArray<FHueSensorState> AHueBridge::GetSensors()
+{
+	TArray<FHueSensorState> Sensors;
+	if(SensorPoller.IsValid())
+	{
+		SensorPoller->GetSensors().GenerateValueArray(Sensors);
+	}
+	return Sensors;
+}
+
+/**
+ * @brief Find a sensor by the name it has in the Hue app
+ * @param SensorName Sensor to look for
+ * @param SensorOut Last known state of the sensor
+ * @return True if the sensor is known
+ */
+bool AHueBridge::GetSensor(const FString& SensorName, FHueSensorState& SensorOut)
+{
+	if(!SensorPoller.IsValid())
+	{
+		return false;
+	}
+	for (const auto& Element : SensorPoller->GetSensors())
+	{
+		if(Element.Value.Name == SensorName)
+		{
+			SensorOut = Element.Value;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Open a frame, lamp changes are held until the matching CommitHueFrame. Frames nest
+ */
+void AHueBridge::BeginHueFrame()
+{
+	FrameDepth++;
+}
+
+/**
+ * @brief Close a frame, the outermost commit sends every lamp that changed in one burst. A broker client hands them
+ * to the owner instead
+ */
+void AHueBridge::CommitHueFrame()
+{
+	if(FrameDepth == 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("CommitHueFrame without BeginHueFrame"));
+		return;
+	}
+	if(--FrameDepth == 0)
+	{
+		//Clients never talk to the bridge, the owner sends their frame
+		if(OwnsBridgeConnection())
+		{
+			CommitFrame(true);
+		}
+		else
+		{
+			SubmitToBroker(FPlatformTime::Seconds());
+		}
+	}
+}
+
+/**
+ * @brief End of every engine frame, commits the frame's changes when frames are automatic :: Internal Call
+ */
+void AHueBridge::OnEndFrame()
+{
+	if(bAutoCommitFrames && FrameDepth == 0 && OwnsBridgeConnection())
+	{
+		CommitFrame(false);
+	}
+}
+
+/**
+ * @brief Send every lamp that changed since the last commit at once so the changes arrive together. If every lamp
+ * on the bridge goes to the same state the frame is a single group action instead :: Internal Call
+ * @param bForce Send even if the bridge's send budget is spent, explicit commits always go out
+ */
+void AHueBridge::CommitFrame(bool bForce)
+{
+	const double Now = FPlatformTime::Seconds();
+	Scheduler->Burst(Now, bForce, ScheduledThisTick);
+	if(ScheduledThisTick.Num() == 0)
+	{
+		return;
+	}
+
+	FHueFrameTransaction& Transaction = FrameTransactions.AddDefaulted_GetRef();
+	Transaction.Id = NextFrameId++;
+	Transaction.CommitTime = Now;
+	Transaction.Stats.Lamps = ScheduledThisTick.Num();
+
+	//The budget stays charged per lamp, the bridge spends about as long on a group action as on every light in it
+	if(CanSendFrameAsGroup(ScheduledThisTick))
+	{
+		Transaction.GroupState = Scheduler->GetDesired(ScheduledThisTick[0]);
+		Transaction.GroupSlots = ScheduledThisTick;
+		//Held until the bridge answers, the lamps only count as sent if it took the whole action
+		for (const int32 Slot : ScheduledThisTick)
+		{
+			Scheduler->SetBusy(Slot, true);
+		}
+		const int32 TransitionTime = Scheduler->GetDesiredTransition(ScheduledThisTick[0]);
+		const TSharedRef<IHttpRequest> Request = Transport->CreateSetAllLights(FHueLightCommand::FromState(Transaction.GroupState, TransitionTime));
+		Request->OnProcessRequestComplete().BindUObject(this, &AHueBridge::OnResponseReceivedFrameGroup, Transaction.Id);
+		Request->ProcessRequest();
+		Transaction.Stats.Requests = 1;
+		Transaction.Stats.bGroupAction = true;
+
+		//Switch lamps in the group share its one request
+		bool bSwitchRequest = false;
+		for (const int32 Slot : ScheduledThisTick)
+		{
+			if(AHueLamp* Lamp = ScheduledLamps[Slot].Get())
+			{
+				bSwitchRequest |= NoteSwitchSent(Lamp, Transaction.GroupState, 0);
+			}
+		}
+		LastSceneSwitch.Requests += bSwitchRequest ? 1 : 0;
+		return;
+	}
+
+	for (const int32 Slot : ScheduledThisTick)
+	{
+		if(AHueLamp* Lamp = ScheduledLamps[Slot].Get())
+		{
+			Lamp->SendDesiredState();
+			Transaction.Waiting.Add(Lamp);
+		}
+	}
+	Transaction.Stats.Requests = Transaction.Waiting.Num();
+	if(Transaction.Waiting.Num() == 0)
+	{
+		FrameTransactions.Pop();
+	}
+}
+
+/**
+ * @brief Check if a frame covers every lamp on the bridge with one plain color and fade. Group 0 is every light the bridge
+ * has, so this only applies when every light of the last bulk read has a scheduled lamp and all of them are in the
+ * frame. Any unscheduled or unknown light and the frame goes out lamp by lamp :: Internal Call
+ * @param Slots Slots in the frame
+ * @return True if a single group action shows the whole frame
+ */
+bool AHueBridge::CanSendFrameAsGroup(const TArray<int32>& Slots)
+{
+	if(Slots.Num() < 2 || Slots.Num() != ScheduledLamps.Num() || ScheduledLamps.Num() != BridgeLightCount)
+	{
+		return false;
+	}
+	const FHueLampState& State = Scheduler->GetDesired(Slots[0]);
+	const int32 TransitionTime = Scheduler->GetDesiredTransition(Slots[0]);
+	for (const int32 Slot : Slots)
+	{
+		const AHueLamp* Lamp = ScheduledLamps[Slot].Get();
+		if(!Lamp || Lamp->IsA<AHueGradientLamp>() || Scheduler->GetDesired(Slot) != State
+			|| Scheduler->GetDesiredTransition(Slot) != TransitionTime)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Every lamp of a frame was answered, report the skew and drop the transaction :: Internal Call
+ * @param Index Index into FrameTransactions
+ */
+void AHueBridge::FinishFrameTransaction(int32 Index)
+{
+	const FHueFrameTransaction& Transaction = FrameTransactions[Index];
+	LastFrame = Transaction.Stats;
+	LastFrame.SkewMs = static_cast<float>((Transaction.LastAck - Transaction.FirstAck) * 1000.0);
+	LastFrame.LatencyMs = static_cast<float>((Transaction.LastAck - Transaction.CommitTime) * 1000.0);
+	FrameTransactions.RemoveAt(Index);
+	UE_LOG(LogTemp, Log, TEXT("Hue frame of %d lamps in %d requests, skew %.1fms latency %.1fms"),
+		LastFrame.Lamps, LastFrame.Requests, LastFrame.SkewMs, LastFrame.LatencyMs);
+	FrameCommitted.Broadcast(LastFrame);
+}
+
+/**
+ * @brief Take a snapshot of every lamp with one bulk read, SnapshotCaptured fires when it is in
+ */
+void AHueBridge::CaptureSnapshot()
+{
+	const TSharedRef<IHttpRequest> Request = Transport->CreateGetLights();
+	Request->OnProcessRequestComplete().BindUObject(this, &AHueBridge::OnResponseReceivedSnapshot);
+	Request->ProcessRequest();
+}
+
+/**
+ * @brief Put every lamp back to a snapshot with as few requests as possible. Lamps already showing their state are
+ * skipped, lamps that share a state with others go into one temporary scene that is recalled once, every other lamp
+ * is queued on the send scheduler so the restore keeps to the bridge's rate
+ * @param Snapshot Snapshot to restore
+ * @return Requests sent or queued straight away, the scene recall follows once the scene exists
+ */
+int32 AHueBridge::RestoreSnapshot(const FHueRoomSnapshot& Snapshot)
+{
+	if(!Snapshot.bValid)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Hue snapshot is empty, nothing to restore"));
+		return 0;
+	}
+	EffectRunner->StopAll();
+	//Answers still out for an earlier restore don't count against this one
+	RestoreId++;
+	RestoreRequestsInFlight = 0;
+	RestoreLamps.Empty();
+	LastRestore = FHueRestoreStats();
+	RestoreStartTime = FPlatformTime::Seconds();
+	RestoreSceneStates.Empty();
+
+	//Group the lamps that need a change by the state they go back to
+	TArray<TPair<FHueLampState, TArray<AHueLamp*>>> Groups;
+	for (const auto& Element : Snapshot.LampStates)
+	{
+		const TWeakObjectPtr<AHueLamp>* ByKey = LampsByKey.Find(Element.Key);
+		AHueLamp* Lamp = ByKey ? ByKey->Get() : GetLamp(Element.Key);
+		if(!Lamp || !Lamp->IsReachable() || Lamp->GetLastSentState() == Element.Value)
+		{
+			continue;
+		}
+		auto* Group = Groups.FindByPredicate([&Element](const TPair<FHueLampState, TArray<AHueLamp*>>& Entry)
+		{
+			return Entry.Key == Element.Value;
+		});
+		if(!Group)
+		{
+			Group = &Groups.Emplace_GetRef(Element.Value, TArray<AHueLamp*>());
+		}
+		Group->Value.Add(Lamp);
+		LastRestore.Lamps++;
+	}
+
+	TArray<TPair<AHueLamp*, FHueLampState>> SceneLamps;
+	TArray<TPair<AHueLamp*, FHueLampState>> DirectWrites;
+	for (const auto& Group : Groups)
+	{
+		for (AHueLamp* Lamp : Group.Value)
+		{
+			(Group.Value.Num() > 1 ? SceneLamps : DirectWrites).Emplace(Lamp, Group.Key);
+		}
+	}
+
+	//A scene costs a create and a recall, below three lamps writing them directly is just as quick
+	if(SceneLamps.Num() < 3)
+	{
+		DirectWrites.Append(SceneLamps);
+		SceneLamps.Empty();
+	}
+	for (const auto& Entry : SceneLamps)
+	{
+		RestoreSceneStates.Add(Entry.Key->GetDeviceKey(), Entry.Value);
+	}
+
+	if(RestoreSceneStates.Num() > 0)
+	{
+		const TSharedRef<IHttpRequest> Request = Transport->CreateCreateScene(TEXT("Unreal Restore"), RestoreSceneStates, 4, true);
+		Request->OnProcessRequestComplete().BindUObject(this, &AHueBridge::OnResponseReceivedRestoreScene, RestoreId);
+		Request->ProcessRequest();
+		Scheduler->Spend(FPlatformTime::Seconds(), 1);
+		RestoreRequestsInFlight++;
+		LastRestore.Requests++;
+		LastRestore.SceneLamps = RestoreSceneStates.Num();
+	}
+	for (const auto& Write : DirectWrites)
+	{
+		//Only writes the lamp took get an answer to wait for
+		if(!Write.Key->ApplyState(Write.Value))
+		{
+			continue;
+		}
+		RestoreLamps.Add(Write.Key, Write.Value);
+		RestoreRequestsInFlight++;
+		LastRestore.Requests++;
+		LastRestore.DirectLamps++;
+	}
+
+	if(RestoreRequestsInFlight == 0)
+	{
+		//Room already looks like the snapshot
+		RestoreRequestsInFlight = 1;
+		FinishRestoreRequest(RestoreId);
+	}
+	return LastRestore.Requests;
+}
+
+/**
+ * @brief Restore the snapshot taken when lamps were first discovered this session
+ * @return Requests sent straight away
+ */
+int32 AHueBridge::RestoreSessionSnapshot()
+{
+	return RestoreSnapshot(SessionSnapshot);
+}
+
+/**
+ * @brief Play an effect on some lamps, every playing effect is evaluated in one batch on a worker thread
+ * @param LampNames Lamps to play on, their order sets the per lamp phase step
+ * @param Layers Effect layers from bottom to top
+ * @param Duration Seconds to play, 0 plays until stopped
+ * @return Handle for StopEffect, 0 if none of the lamps exist
+ */
+int32 AHueBridge::PlayEffect(const TArray<FString>& LampNames, const TArray<FHueEffectLayer>& Layers, float Duration)
+{
+	TArray<int32> Slots;
+	for (const FString& Name : LampNames)
+	{
+		AHueLamp* Lamp = GetLamp(Name);
+		const int32 Slot = Lamp ? ScheduledLamps.IndexOfByKey(Lamp) : INDEX_NONE;
+		if(Slot != INDEX_NONE)
+		{
+			Slots.Add(Slot);
+		}
+	}
+	if(Slots.Num() == 0 || Layers.Num() == 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Effect not started, no known lamps or no layers"));
+		return 0;
+	}
+	return EffectRunner->Play(Slots, Layers, Duration, FPlatformTime::Seconds());
+}
+
+/**
+ * @brief Play one of the built in effects
+ * @param LampNames Lamps to play on
+ * @param Preset Effect to play
+ * @param Duration Seconds to play, 0 plays until stopped
+ * @return Handle for StopEffect
+ */
+int32 AHueBridge::PlayEffectPreset(const TArray<FString>& LampNames, EHueEffectPreset Preset, float Duration)
+{
+	return PlayEffect(LampNames, GetEffectPreset(Preset), Duration);
+}
+
+void AHueBridge::StopEffect(int32 Handle)
+{
+	EffectRunner->Stop(Handle);
+}
+
+void AHueBridge::StopAllEffects()
+{
+	EffectRunner->StopAll();
+}
+
+/**
+ * @brief Set how many effect batches a second are evaluated
+ * @param Rate float batches per second
+ */
+void AHueBridge::SetEffectRate(float Rate)
+{
+	EffectRate = FMath::Max(Rate, 1.0f);
+	EffectRunner->SetRate(EffectRate);
+}
+
+TArray<FHueEffectLayer> AHueBridge::GetEffectPreset(EHueEffectPreset Preset)
+{
+	TArray<FHueEffectLayer> Layers;
+	FHueEffectRunner::GetPreset(Preset, Layers);
+	return Layers;
+}
+
+/**
+ * @brief Time a batch of the layers on the game thread
+ * @param Layers Layers to evaluate
+ * @param NumLamps Lamps in the batch
+ * @return Microseconds per batch for a thousand lamps
+ */
+float AHueBridge::MeasureEffectCost(const TArray<FHueEffectLayer>& Layers, int32 NumLamps)
+{
+	const double Cost = FHueEffectRunner::MeasureCost(Layers, NumLamps);
+	UE_LOG(LogTemp, Log, TEXT("Hue effect with %d layers: %.2fus per batch per thousand lamps"), Layers.Num(), Cost);
+	return static_cast<float>(Cost);
+}
+
+/**
+ * @brief Time saving and loading a config with NumLamps lamps, in a scratch folder next to the project's saves
+ * @param NumLamps Lamps in the generated config
+ * @param Cycles Saves and loads to average over
+ * @return Average times per cycle and the file sizes
+ */
+FHueConfigBenchmark AHueBridge::BenchmarkConfigStore(int32 NumLamps, int32 Cycles)
+{
+	const FHueConfigBenchmark Result = FHueConfigStore::Benchmark(NumLamps, Cycles);
+	UE_LOG(LogTemp, Log, TEXT("Hue config with %d lamps: %.2fms game thread, %.2fms write, %.2fms json load, %.2fms cache load, %d json bytes, %d cache bytes"),
+		Result.NumLamps, Result.SnapshotMs, Result.WriteMs, Result.JsonLoadMs, Result.CacheLoadMs, Result.JsonBytes, Result.CacheBytes);
+	return Result;
 }
 
 void AHueBridge::PleaseWaitingForBridgeRespond_Implementation()
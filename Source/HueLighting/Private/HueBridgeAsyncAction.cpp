@@ -0,0 +1,91 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueBridgeAsyncAction.h"
+
+UHueBridgeAsyncAction* UHueBridgeAsyncAction::DiscoverLampsAsync(AHueBridge* Bridge)
+{
+	return CreateAction(Bridge, EHueBridgeOperation::Discover);
+}
+
+UHueBridgeAsyncAction* UHueBridgeAsyncAction::CreateUserAsync(AHueBridge* Bridge)
+{
+	return CreateAction(Bridge, EHueBridgeOperation::CreateUser);
+}
+
+UHueBridgeAsyncAction* UHueBridgeAsyncAction::CheckUserAsync(AHueBridge* Bridge)
+{
+	return CreateAction(Bridge, EHueBridgeOperation::CheckUser);
+}
+
+UHueBridgeAsyncAction* UHueBridgeAsyncAction::RefreshStateAsync(AHueBridge* Bridge)
+{
+	return CreateAction(Bridge, EHueBridgeOperation::RefreshState);
+}
+
+/**
+ * @brief Make the node and keep it alive with the bridge's game instance until its operation finishes :: Internal Call
+ * @param Bridge Bridge to run the operation on
+ * @param Operation Operation the node waits on
+ * @return The new action
+ */
+UHueBridgeAsyncAction* UHueBridgeAsyncAction::CreateAction(AHueBridge* Bridge, EHueBridgeOperation Operation)
+{
+	UHueBridgeAsyncAction* Action = NewObject<UHueBridgeAsyncAction>();
+	Action->Bridge = Bridge;
+	Action->Operation = Operation;
+	if(Bridge)
+	{
+		Action->RegisterWithGameInstance(Bridge);
+	}
+	return Action;
+}
+
+/**
+ * @brief Listen for the operation first, then start it so an answer can't slip past
+ */
+void UHueBridgeAsyncAction::Activate()
+{
+	AHueBridge* HueBridge = Bridge.Get();
+	if(!HueBridge)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Hue async action started without a bridge"));
+		Unreachable.Broadcast();
+		SetReadyToDestroy();
+		return;
+	}
+	FinishedHandle = HueBridge->OperationFinished.AddUObject(this, &UHueBridgeAsyncAction::OnOperationFinished);
+	HueBridge->StartOperation(Operation);
+}
+
+/**
+ * @brief Bridge finished an operation, fire the node's pins if it is the one this node waits on
+ * @param FinishedOperation Operation that finished
+ * @param Result How the bridge answered, if it did
+ */
+void UHueBridgeAsyncAction::OnOperationFinished(EHueBridgeOperation FinishedOperation, EHueOperationResult Result)
+{
+	if(FinishedOperation != Operation)
+	{
+		return;
+	}
+	if(AHueBridge* HueBridge = Bridge.Get())
+	{
+		HueBridge->OperationFinished.Remove(FinishedHandle);
+	}
+	switch(Result)
+	{
+	case EHueOperationResult::Succeeded:
+		Completed.Broadcast();
+		break;
+	case EHueOperationResult::Rejected:
+		Failed.Broadcast();
+		break;
+	case EHueOperationResult::Unreachable:
+		Unreachable.Broadcast();
+		break;
+	}
+	SetReadyToDestroy();
+}
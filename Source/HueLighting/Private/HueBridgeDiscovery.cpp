@@ -0,0 +1,407 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueBridgeDiscovery.h"
+#include "HttpModule.h"
+#include "IPAddress.h"
+#include "Sockets.h"
+#include "SocketSubsystem.h"
+#include "Async/Async.h"
+#include "Dom/JsonObject.h"
+#include "Interfaces/IHttpResponse.h"
+#include "Serialization/JsonSerializer.h"
+
+namespace HueDiscovery
+{
+	const TCHAR* SSDP_ADDRESS = TEXT("239.255.255.250");
+	const int32 SSDP_PORT = 1900;
+	const TCHAR* MDNS_ADDRESS = TEXT("224.0.0.251");
+	const int32 MDNS_PORT = 5353;
+
+	const ANSICHAR SSDP_SEARCH[] =
+		"M-SEARCH * HTTP/1.1\r\n"
+		"HOST: 239.255.255.250:1900\r\n"
+		"MAN: \"ssdp:discover\"\r\n"
+		"MX: 1\r\n"
+		"ST: ssdp:all\r\n\r\n";
+
+	/**
+	 * @brief Build a DNS question for _hue._tcp.local PTR with the unicast response bit set so answers come back to our port
+	 * @param PacketOut Bytes to send
+	 */
+	void BuildMdnsQuery(TArray<uint8>& PacketOut)
+	{
+		//Header, id 0, flags 0, one question
+		const uint8 Header[12] = {0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0};
+		PacketOut.Append(Header, 12);
+		for (const ANSICHAR* Label : {"_hue", "_tcp", "local"})
+		{
+			const int32 Length = FCStringAnsi::Strlen(Label);
+			PacketOut.Add(static_cast<uint8>(Length));
+			PacketOut.Append(reinterpret_cast<const uint8*>(Label), Length);
+		}
+		PacketOut.Add(0);
+		//QTYPE PTR, QCLASS IN with the unicast response bit
+		const uint8 Question[4] = {0, 12, 0x80, 1};
+		PacketOut.Append(Question, 4);
+	}
+}
+
+FHueBridgeDiscovery::FHueBridgeDiscovery(const FHueDiscoverySettings& InSettings)
+	: Settings(InSettings)
+{
+}
+
+FHueBridgeDiscovery::~FHueBridgeDiscovery()
+{
+	Cancel();
+}
+
+/**
+ * @brief Start looking for a bridge, OnFinished is called once on the game thread
+ * @param CachedHost Host from the config, probed ahead of everything else
+ * @param InOnFinished Called with the first valid bridge or with false once the time budget runs out
+ */
+void FHueBridgeDiscovery::Start(const FString& CachedHost, FOnHueBridgeDiscoveryFinished InOnFinished)
+{
+	Cancel();
+	OnFinished = InOnFinished;
+	BridgeId.Reset();
+	StartTime = FPlatformTime::Seconds();
+	if(Settings.bProbeSubnet && GetSubnetProbeTime(Settings) > Settings.TimeBudget)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Hue subnet probe needs %.1fs but discovery only has %.1fs, the far end of the subnet won't be probed"),
+			GetSubnetProbeTime(Settings), Settings.TimeBudget);
+	}
+	StopFlag = MakeShared<FThreadSafeBool, ESPMode::ThreadSafe>(false);
+	bRunning = true;
+	TickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateSP(this, &FHueBridgeDiscovery::Tick));
+
+	if(!CachedHost.IsEmpty())
+	{
+		QueueCandidate(CachedHost, true);
+	}
+	if(Settings.bUseMulticast)
+	{
+		StartMulticastSearch();
+	}
+	if(Settings.bProbeSubnet)
+	{
+		QueueSubnet();
+	}
+	PumpProbes();
+}
+
+/**
+ * @brief Stop everything still running without calling OnFinished
+ */
+void FHueBridgeDiscovery::Cancel()
+{
+	if(StopFlag.IsValid())
+	{
+		*StopFlag = true;
+	}
+	if(TickerHandle.IsValid())
+	{
+		FTSTicker::GetCoreTicker().RemoveTicker(TickerHandle);
+		TickerHandle.Reset();
+	}
+	for (const FHttpRequestPtr& Probe : ActiveProbes)
+	{
+		Probe->OnProcessRequestComplete().Unbind();
+		Probe->CancelRequest();
+	}
+	ActiveProbes.Empty();
+	ProbeQueue.Empty();
+	SeenHosts.Empty();
+	bRunning = false;
+}
+
+/**
+ * @brief Core ticker callback, keeps the probe pool full and gives up once the budget is spent
+ * @return False once discovery is done to remove the ticker
+ */
+bool FHueBridgeDiscovery::Tick(float DeltaTime)
+{
+	if(!bRunning)
+	{
+		return false;
+	}
+	if(FPlatformTime::Seconds() - StartTime > Settings.TimeBudget)
+	{
+		TickerHandle.Reset();
+		Finish(false, FString());
+		return false;
+	}
+	PumpProbes();
+	return true;
+}
+
+/**
+ * @brief Add a host to probe, hosts are only ever probed once
+ * @param Host Host name or ip, with an optional port
+ * @param bPriority Put the host at the front of the queue, used for the cached host and multicast answers
+ */
+void FHueBridgeDiscovery::QueueCandidate(const FString& Host, bool bPriority)
+{
+	if(Host.IsEmpty() || SeenHosts.Contains(Host))
+	{
+		return;
+	}
+	SeenHosts.Add(Host);
+	if(bPriority)
+	{
+		ProbeQueue.Insert(Host, 0);
+	}
+	else
+	{
+		ProbeQueue.Add(Host);
+	}
+}
+
+/**
+ * @brief Start queued /api/config probes up to the parallel limit
+ */
+void FHueBridgeDiscovery::PumpProbes()
+{
+	while(bRunning && ProbeQueue.Num() > 0 && ActiveProbes.Num() < FMath::Max(Settings.MaxParallelProbes, 1))
+	{
+		const FString Host = ProbeQueue[0];
+		ProbeQueue.RemoveAt(0, 1, false);
+
+		const TSharedRef<IHttpRequest> Request = FHttpModule::Get().CreateRequest();
+		Request->OnProcessRequestComplete().BindSP(this, &FHueBridgeDiscovery::OnProbeResponse, Host);
+		Request->SetURL(TEXT("http://") + Host + TEXT("/api/config"));
+		Request->SetVerb(TEXT("GET"));
+		Request->SetTimeout(Settings.ProbeTimeout);
+		Request->ProcessRequest();
+		ActiveProbes.Add(Request);
+	}
+}
+
+/**
+ * @brief Callback for a probe, a Hue bridge answers the unauthenticated config call with its bridge id and model
+ * @param Request Signature for callback
+ * @param Response Signature for callback
+ * @param bWasSuccessful Signature for callback
+ * @param Host Host that was probed
+ */
+void FHueBridgeDiscovery::OnProbeResponse(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful, FString Host)
+{
+	ActiveProbes.Remove(Request);
+	if(!bRunning || !bWasSuccessful || !Response.IsValid())
+	{
+		return;
+	}
+
+	FString FoundId;
+	if(ParseConfig(Response->GetContentAsString(), FoundId))
+	{
+		BridgeId = FoundId;
+		UE_LOG(LogTemp, Log, TEXT("Hue Bridge %s found at %s in %.0fms"), *BridgeId, *Host,
+			(FPlatformTime::Seconds() - StartTime) * 1000.0);
+		Finish(true, Host);
+	}
+}
+
+/**
+ * @brief A Hue bridge answers the unauthenticated config call with its bridge id and model, anything else on the
+ * subnet that happens to serve /api/config doesn't have both
+ * @param Json Body of the answer
+ * @param BridgeIdOut Bridge id, only set when the answer is a bridge
+ * @return True if the answer came from a Hue bridge
+ */
+bool FHueBridgeDiscovery::ParseConfig(const FString& Json, FString& BridgeIdOut)
+{
+	TSharedPtr<FJsonObject> ResponseObj;
+	const TSharedRef<TJsonReader<>> JsonReader = TJsonReaderFactory<>::Create(Json);
+	FString Id;
+	FString ModelId;
+	if(!FJsonSerializer::Deserialize(JsonReader, ResponseObj) || !ResponseObj.IsValid() ||
+		!ResponseObj->TryGetStringField(TEXT("bridgeid"), Id) || !ResponseObj->TryGetStringField(TEXT("modelid"), ModelId))
+	{
+		return false;
+	}
+	BridgeIdOut = Id;
+	return true;
+}
+
+/**
+ * @brief Worst case time of a subnet probe, every host waits out the probe timeout
+ * @param Settings Discovery settings
+ * @return Seconds
+ */
+float FHueBridgeDiscovery::GetSubnetProbeTime(const FHueDiscoverySettings& Settings)
+{
+	const int32 Rounds = FMath::DivideAndRoundUp(254, FMath::Max(Settings.MaxParallelProbes, 1));
+	return Rounds * Settings.ProbeTimeout;
+}
+
+/**
+ * @brief Order the /24 outwards from our own address, home routers hand out addresses close together so the bridge
+ * is usually near us. Anything cut off by the time budget is then the far end of the subnet
+ * @param LocalOctet Our last octet, 0 when it isn't known
+ * @param OctetsOut Every host octet from 1 to 254 except ours
+ */
+void FHueBridgeDiscovery::GetSubnetOrder(int32 LocalOctet, TArray<int32>& OctetsOut)
+{
+	OctetsOut.Reset(254);
+	const int32 Center = FMath::Clamp(LocalOctet, 1, 254);
+	if(LocalOctet < 1 || LocalOctet > 254)
+	{
+		OctetsOut.Add(Center);
+	}
+	for (int32 Distance = 1; Distance < 254; ++Distance)
+	{
+		if(Center - Distance >= 1)
+		{
+			OctetsOut.Add(Center - Distance);
+		}
+		if(Center + Distance <= 254)
+		{
+			OctetsOut.Add(Center + Distance);
+		}
+	}
+}
+
+/**
+ * @brief Send SSDP and mDNS searches on the thread pool, anything that answers gets queued for a config probe.
+ * mDNS answers are not parsed, the sender of an answer mentioning _hue is the bridge
+ */
+void FHueBridgeDiscovery::StartMulticastSearch()
+{
+	TWeakPtr<FHueBridgeDiscovery> WeakThis = AsShared();
+	TSharedPtr<FThreadSafeBool, ESPMode::ThreadSafe> Stop = StopFlag;
+	const float Budget = Settings.TimeBudget;
+	const int32 Port = Settings.ProbePort;
+
+	Async(EAsyncExecution::ThreadPool, [WeakThis, Stop, Budget, Port]()
+	{
+		ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+		if(!SocketSubsystem)
+		{
+			return;
+		}
+		FSocket* Socket = SocketSubsystem->CreateSocket(NAME_DGram, TEXT("HueDiscovery"), FNetworkProtocolTypes::IPv4);
+		if(!Socket)
+		{
+			return;
+		}
+		Socket->SetNonBlocking(true);
+
+		bool bValid = false;
+		int32 BytesSent = 0;
+		const TSharedRef<FInternetAddr> SsdpAddr = SocketSubsystem->CreateInternetAddr();
+		SsdpAddr->SetIp(HueDiscovery::SSDP_ADDRESS, bValid);
+		SsdpAddr->SetPort(HueDiscovery::SSDP_PORT);
+		Socket->SendTo(reinterpret_cast<const uint8*>(HueDiscovery::SSDP_SEARCH), sizeof(HueDiscovery::SSDP_SEARCH) - 1, BytesSent, *SsdpAddr);
+
+		TArray<uint8> MdnsQuery;
+		HueDiscovery::BuildMdnsQuery(MdnsQuery);
+		const TSharedRef<FInternetAddr> MdnsAddr = SocketSubsystem->CreateInternetAddr();
+		MdnsAddr->SetIp(HueDiscovery::MDNS_ADDRESS, bValid);
+		MdnsAddr->SetPort(HueDiscovery::MDNS_PORT);
+		Socket->SendTo(MdnsQuery.GetData(), MdnsQuery.Num(), BytesSent, *MdnsAddr);
+
+		const TSharedRef<FInternetAddr> FromAddr = SocketSubsystem->CreateInternetAddr();
+		uint8 Buffer[2048];
+		const double EndTime = FPlatformTime::Seconds() + Budget;
+		while(!*Stop && FPlatformTime::Seconds() < EndTime)
+		{
+			if(!Socket->Wait(ESocketWaitConditions::WaitForRead, FTimespan::FromMilliseconds(50)))
+			{
+				continue;
+			}
+			int32 BytesRead = 0;
+			while(Socket->RecvFrom(Buffer, sizeof(Buffer) - 1, BytesRead, *FromAddr) && BytesRead > 0)
+			{
+				Buffer[BytesRead] = 0;
+				//SSDP answers are text, mDNS labels are plain ascii so a byte search covers both
+				bool bHue = false;
+				for (int32 Index = 0; Index + 3 <= BytesRead && !bHue; ++Index)
+				{
+					bHue = FCStringAnsi::Strnicmp(reinterpret_cast<const ANSICHAR*>(Buffer + Index), "hue", 3) == 0;
+				}
+				if(!bHue)
+				{
+					continue;
+				}
+				FString Host = FromAddr->ToString(false);
+				if(Port > 0)
+				{
+					Host += FString::Printf(TEXT(":%d"), Port);
+				}
+				AsyncTask(ENamedThreads::GameThread, [WeakThis, Host]()
+				{
+					if(const TSharedPtr<FHueBridgeDiscovery> This = WeakThis.Pin())
+					{
+						if(This->bRunning)
+						{
+							This->QueueCandidate(Host, true);
+							This->PumpProbes();
+						}
+					}
+				});
+			}
+		}
+		SocketSubsystem->DestroySocket(Socket);
+	});
+}
+
+/**
+ * @brief Queue every address on the local /24, or on the override subnet, for a config probe. Hosts near ours go first
+ */
+void FHueBridgeDiscovery::QueueSubnet()
+{
+	FString Prefix = Settings.SubnetOverride;
+	FString LocalIp;
+	int32 LocalOctet = 0;
+	if(Prefix.IsEmpty())
+	{
+		ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+		if(!SocketSubsystem)
+		{
+			return;
+		}
+		bool bCanBind = false;
+		LocalIp = SocketSubsystem->GetLocalHostAddr(*GLog, bCanBind)->ToString(false);
+		int32 LastDot;
+		if(!LocalIp.FindLastChar(TEXT('.'), LastDot))
+		{
+			return;
+		}
+		Prefix = LocalIp.Left(LastDot);
+		LocalOctet = FCString::Atoi(*LocalIp.Mid(LastDot + 1));
+	}
+
+	TArray<int32> Octets;
+	GetSubnetOrder(LocalOctet, Octets);
+	const FString PortSuffix = Settings.ProbePort > 0 ? FString::Printf(TEXT(":%d"), Settings.ProbePort) : FString();
+	for (const int32 Octet : Octets)
+	{
+		const FString Ip = FString::Printf(TEXT("%s.%d"), *Prefix, Octet);
+		if(Ip != LocalIp)
+		{
+			QueueCandidate(Ip + PortSuffix, false);
+		}
+	}
+}
+
+/**
+ * @brief Stop all outstanding work and report the result once
+ * @param bFound True if a bridge answered
+ * @param Host Host of the bridge
+ */
+void FHueBridgeDiscovery::Finish(bool bFound, const FString& Host)
+{
+	if(!bRunning)
+	{
+		return;
+	}
+	const FOnHueBridgeDiscoveryFinished Finished = OnFinished;
+	OnFinished.Unbind();
+	Cancel();
+	Finished.ExecuteIfBound(bFound, Host);
+}
@@ -0,0 +1,757 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueCommandBroker.h"
+#include "IPAddress.h"
+#include "Sockets.h"
+#include "SocketSubsystem.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+namespace HueBroker
+{
+	const uint32 MAGIC = 0x48554542; // HUEB
+	const uint8 VERSION = 4;
+	const int32 MAX_PACKET = 256;
+	//Ports above the base port that bridges are spread over
+	const uint32 PORT_SPAN = 64;
+	//Longest id or name a datagram may carry, in UTF-8 bytes
+	const uint8 MAX_STRING = 96;
+	//Seconds a client stays on the publish list after it was last heard from
+	const double CLIENT_TIMEOUT = 30.0;
+	const int32 MAX_CLIENTS = 32;
+	//Sensors a client holds between ticks, a client that never collects them doesn't grow without end
+	const int32 MAX_SENSORS = 1024;
+	//Greetings a client misses in a row before it takes the owner for gone
+	const double OWNER_TIMEOUT_INTERVALS = 4.0;
+
+	enum class EPacket : uint8
+	{
+		State,
+		Read,
+		Light,
+		//Client greets whoever holds the port, carries the full bridge key
+		Hello,
+		//Owner's answer to a greeting, carries the bridge key it owns
+		Welcome,
+		//Owner took a submitted state
+		Confirm,
+		//One sensor the owner read or got from its event stream
+		Sensor
+	};
+
+	void WriteHeader(FArchive& Ar, uint32 Hash, EPacket Type)
+	{
+		uint32 Magic = MAGIC;
+		uint8 Version = VERSION;
+		uint8 TypeByte = static_cast<uint8>(Type);
+		Ar << Magic << Version << Hash << TypeByte;
+	}
+
+	void WriteString(FArchive& Ar, const FString& Value)
+	{
+		const FTCHARToUTF8 Utf8(*Value);
+		uint8 Length = static_cast<uint8>(FMath::Min(Utf8.Length(), static_cast<int32>(MAX_STRING)));
+		Ar << Length;
+		Ar.Serialize(const_cast<ANSICHAR*>(Utf8.Get()), Length);
+	}
+
+	//Length is checked against the cap and what is left of the packet before anything is allocated
+	bool ReadString(FArchive& Ar, FString& ValueOut)
+	{
+		uint8 Length = 0;
+		Ar << Length;
+		if(Ar.IsError() || Length > MAX_STRING || Ar.Tell() + Length > Ar.TotalSize())
+		{
+			Ar.SetError();
+			return false;
+		}
+		ANSICHAR Bytes[MAX_STRING + 1];
+		Ar.Serialize(Bytes, Length);
+		Bytes[Length] = 0;
+		ValueOut = UTF8_TO_TCHAR(Bytes);
+		return !Ar.IsError();
+	}
+
+	void WriteState(FArchive& Ar, const FHueLampState& State)
+	{
+		uint8 bOn = State.bOn ? 1 : 0;
+		uint16 Hue = static_cast<uint16>(FMath::Clamp(State.Hue, 0, 65535));
+		uint8 Sat = static_cast<uint8>(FMath::Clamp(State.Saturation, 0, 254));
+		uint8 Bri = static_cast<uint8>(FMath::Clamp(State.Brightness, 0, 254));
+		Ar << bOn << Hue << Sat << Bri;
+	}
+
+	void WriteSensor(FArchive& Ar, const FHueSensorState& Sensor, bool bChanged)
+	{
+		WriteString(Ar, Sensor.SensorId);
+		WriteString(Ar, Sensor.Name);
+		uint8 Type = static_cast<uint8>(Sensor.Type);
+		int32 ButtonEvent = Sensor.ButtonEvent;
+		uint8 bPresence = Sensor.bPresence ? 1 : 0;
+		int32 LightLevel = Sensor.LightLevel;
+		float Temperature = Sensor.Temperature;
+		int64 Ticks = Sensor.LastUpdated.GetTicks();
+		float LatencyMs = Sensor.LatencyMs;
+		uint8 bChangedByte = bChanged ? 1 : 0;
+		Ar << Type << ButtonEvent << bPresence << LightLevel << Temperature << Ticks << LatencyMs << bChangedByte;
+	}
+
+	bool ReadSensor(FArchive& Ar, FHueSensorState& SensorOut, bool& bChangedOut)
+	{
+		if(!ReadString(Ar, SensorOut.SensorId) || !ReadString(Ar, SensorOut.Name))
+		{
+			return false;
+		}
+		uint8 Type = 0;
+		uint8 bPresence = 0;
+		int64 Ticks = 0;
+		uint8 bChangedByte = 0;
+		Ar << Type << SensorOut.ButtonEvent << bPresence << SensorOut.LightLevel << SensorOut.Temperature << Ticks << SensorOut.LatencyMs << bChangedByte;
+		if(Ar.IsError() || Type > static_cast<uint8>(EHueSensorType::Temperature) || Ticks < 0 || Ticks > FDateTime::MaxValue().GetTicks())
+		{
+			return false;
+		}
+		SensorOut.Type = static_cast<EHueSensorType>(Type);
+		SensorOut.bPresence = bPresence != 0;
+		SensorOut.LastUpdated = FDateTime(Ticks);
+		bChangedOut = bChangedByte != 0;
+		return true;
+	}
+
+	void ReadState(FArchive& Ar, FHueLampState& StateOut)
+	{
+		uint8 bOn = 0;
+		uint16 Hue = 0;
+		uint8 Sat = 0;
+		uint8 Bri = 0;
+		Ar << bOn << Hue << Sat << Bri;
+		StateOut.bOn = bOn != 0;
+		StateOut.Hue = Hue;
+		StateOut.Saturation = FMath::Min<int32>(Sat, 254);
+		StateOut.Brightness = FMath::Min<int32>(Bri, 254);
+	}
+}
+
+FHueCommandBroker::FHueCommandBroker(int32 InBasePort, const FString& InBridgeKey)
+	: BridgeKey(InBridgeKey)
+	, BridgeHash(FCrc::StrCrc32(*InBridgeKey))
+	, BasePort(InBasePort)
+	, Port(GetProbePort(0))
+{
+}
+
+FHueCommandBroker::~FHueCommandBroker()
+{
+	Stop();
+}
+
+/**
+ * @brief Open the broker socket and try to own the bridge
+ * @return True if this process owns the bridge connection
+ */
+bool FHueCommandBroker::Start()
+{
+	Stop();
+	if(!ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM))
+	{
+		return false;
+	}
+	ProbeIndex = 0;
+	return Connect(FPlatformTime::Seconds());
+}
+
+/**
+ * @brief Port a probe step lands on, the bridge's own port first then the ones after it :: Internal Call
+ */
+int32 FHueCommandBroker::GetProbePort(int32 Index) const
+{
+	return BasePort + static_cast<int32>((BridgeHash + static_cast<uint32>(Index)) % HueBroker::PORT_SPAN);
+}
+
+/**
+ * @brief Bind the current probe port, or greet whoever holds it and wait for it to name its bridge :: Internal Call
+ * @param Now Current time in seconds
+ * @return True if this process now owns the bridge connection
+ */
+bool FHueCommandBroker::Connect(double Now)
+{
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	Port = GetProbePort(ProbeIndex);
+	OwnerAddr = SocketSubsystem->CreateInternetAddr();
+	OwnerAddr->SetLoopbackAddress();
+	OwnerAddr->SetPort(Port);
+	LastBindAttempt = Now;
+	bWelcomed = false;
+	if(TryBind())
+	{
+		LastLowerCheck = Now;
+		return true;
+	}
+
+	//Someone else holds the port, keep an unbound socket to greet and submit through
+	if(!Socket)
+	{
+		Socket = SocketSubsystem->CreateSocket(NAME_DGram, TEXT("HueBrokerClient"), FNetworkProtocolTypes::IPv4);
+		if(!Socket)
+		{
+			return false;
+		}
+		Socket->SetNonBlocking(true);
+	}
+	SendHello(*OwnerAddr);
+	UE_LOG(LogTemp, Log, TEXT("Hue broker: port %d is taken, asking its owner if it owns bridge %s"), Port, *BridgeKey);
+	return false;
+}
+
+void FHueCommandBroker::Stop()
+{
+	if(Socket)
+	{
+		Socket->Close();
+		ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(Socket);
+		Socket = nullptr;
+	}
+	bOwner = false;
+	bWelcomed = false;
+	bReadRequested = false;
+	bReadQueued = false;
+	bLightsReady = false;
+	LastWelcomeTime = 0.0;
+	Clients.Empty();
+	IncomingLights.Empty();
+	Confirmed.Empty();
+	ReceivedSensors.Empty();
+}
+
+/**
+ * @brief Bind the broker port, the OS only lets one process hold it :: Internal Call
+ * @return True if the bind worked and this process is now the owner
+ */
+bool FHueCommandBroker::TryBind()
+{
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	FSocket* OwnerSocket = SocketSubsystem->CreateSocket(NAME_DGram, TEXT("HueBrokerOwner"), FNetworkProtocolTypes::IPv4);
+	if(!OwnerSocket)
+	{
+		return false;
+	}
+	OwnerSocket->SetReuseAddr(false);
+	if(!OwnerSocket->Bind(*OwnerAddr))
+	{
+		SocketSubsystem->DestroySocket(OwnerSocket);
+		return false;
+	}
+	OwnerSocket->SetNonBlocking(true);
+
+	if(Socket)
+	{
+		SocketSubsystem->DestroySocket(Socket);
+	}
+	Socket = OwnerSocket;
+	bOwner = true;
+	bWelcomed = false;
+	bReadQueued = false;
+	IncomingLights.Empty();
+	Confirmed.Empty();
+	UE_LOG(LogTemp, Log, TEXT("Hue broker: this process owns bridge %s on port %d"), *BridgeKey, Port);
+	return true;
+}
+
+/**
+ * @brief An owner of the same bridge answered on a port below ours, close ours and become its client :: Internal Call
+ * @param Index Probe step of the port it answered on
+ * @param Now Current time in seconds
+ */
+void FHueCommandBroker::Demote(int32 Index, double Now)
+{
+	UE_LOG(LogTemp, Log, TEXT("Hue broker: bridge %s is also owned on port %d, handing over"), *BridgeKey, GetProbePort(Index));
+	Socket->Close();
+	ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(Socket);
+	Socket = nullptr;
+	bOwner = false;
+	Clients.Empty();
+	ProbeIndex = Index;
+	Connect(Now);
+}
+
+/**
+ * @brief Owner drains every command clients submitted since the last tick, clients collect lights and confirmed
+ * states, greet the owner and take over once it goes quiet
+ * @param Now Current time in seconds
+ * @param CommandsOut Commands for the owner to merge into its lamps
+ */
+void FHueCommandBroker::Tick(double Now, TArray<FHueBrokerCommand>& CommandsOut)
+{
+	CommandsOut.Reset();
+	if(!Socket)
+	{
+		return;
+	}
+
+	if(bOwner)
+	{
+		ReceiveOwner(Now, CommandsOut);
+		CheckLowerPorts(Now);
+		return;
+	}
+
+	ReceiveClient(Now);
+	if(bOwner || Now - LastBindAttempt < FailoverInterval)
+	{
+		return;
+	}
+	LastBindAttempt = Now;
+	if(bWelcomed && Now - LastWelcomeTime <= FailoverInterval * HueBroker::OWNER_TIMEOUT_INTERVALS)
+	{
+		SendHello(*OwnerAddr);
+		return;
+	}
+	//Owner gone, walk the ports again so the bridge's own port is taken first
+	if(bWelcomed)
+	{
+		UE_LOG(LogTemp, Log, TEXT("Hue broker: owner of bridge %s on port %d went quiet"), *BridgeKey, Port);
+		ProbeIndex = 0;
+	}
+	Connect(Now);
+}
+
+/**
+ * @brief An owner that had to move past its bridge's own port greets the ports below it, an owner of the same
+ * bridge there takes over from us :: Internal Call
+ * @param Now Current time in seconds
+ */
+void FHueCommandBroker::CheckLowerPorts(double Now)
+{
+	if(ProbeIndex == 0 || Now - LastLowerCheck < FailoverInterval * HueBroker::OWNER_TIMEOUT_INTERVALS)
+	{
+		return;
+	}
+	LastLowerCheck = Now;
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	const TSharedRef<FInternetAddr> Addr = SocketSubsystem->CreateInternetAddr();
+	Addr->SetLoopbackAddress();
+	for (int32 Index = 0; Index < ProbeIndex; ++Index)
+	{
+		Addr->SetPort(GetProbePort(Index));
+		SendHello(*Addr);
+	}
+}
+
+/**
+ * @brief Read what clients sent, every valid packet keeps its sender on the publish list :: Internal Call
+ */
+void FHueCommandBroker::ReceiveOwner(double Now, TArray<FHueBrokerCommand>& CommandsOut)
+{
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	uint8 Buffer[HueBroker::MAX_PACKET];
+	uint32 PendingSize = 0;
+	while(Socket->HasPendingData(PendingSize))
+	{
+		const TSharedRef<FInternetAddr> Sender = SocketSubsystem->CreateInternetAddr();
+		int32 BytesRead = 0;
+		if(!Socket->RecvFrom(Buffer, sizeof(Buffer), BytesRead, *Sender) || BytesRead <= 0)
+		{
+			break;
+		}
+
+		TArray<uint8> Packet(Buffer, BytesRead);
+		FMemoryReader Reader(Packet);
+		uint32 Magic = 0;
+		uint8 Version = 0;
+		uint32 Hash = 0;
+		uint8 Type = 0;
+		Reader << Magic << Version << Hash << Type;
+		if(Reader.IsError() || Magic != HueBroker::MAGIC || Version != HueBroker::VERSION)
+		{
+			continue;
+		}
+
+		//Every greeting is answered with the bridge we own, a client of another bridge on this port moves on
+		if(Type == static_cast<uint8>(HueBroker::EPacket::Hello))
+		{
+			TArray<uint8> Welcome;
+			FMemoryWriter Writer(Welcome);
+			HueBroker::WriteHeader(Writer, BridgeHash, HueBroker::EPacket::Welcome);
+			HueBroker::WriteString(Writer, BridgeKey);
+			SendPacket(Welcome, *Sender);
+			if(Hash != BridgeHash)
+			{
+				continue;
+			}
+		}
+		//Answer to CheckLowerPorts, the same bridge owned further down wins
+		else if(Type == static_cast<uint8>(HueBroker::EPacket::Welcome))
+		{
+			FString Key;
+			if(!HueBroker::ReadString(Reader, Key) || Key != BridgeKey)
+			{
+				continue;
+			}
+			for (int32 Index = 0; Index < ProbeIndex; ++Index)
+			{
+				if(Sender->GetPort() == GetProbePort(Index))
+				{
+					Demote(Index, Now);
+					return;
+				}
+			}
+			continue;
+		}
+		else if(Hash != BridgeHash)
+		{
+			continue;
+		}
+		else if(Type == static_cast<uint8>(HueBroker::EPacket::State))
+		{
+			FHueBrokerCommand Command;
+			if(!HueBroker::ReadString(Reader, Command.LightId))
+			{
+				continue;
+			}
+			HueBroker::ReadState(Reader, Command.State);
+			if(Reader.IsError())
+			{
+				continue;
+			}
+			Command.Sender = Sender;
+			CommandsOut.Add(MoveTemp(Command));
+			ReceivedCount++;
+		}
+		else if(Type == static_cast<uint8>(HueBroker::EPacket::Read))
+		{
+			bReadRequested = true;
+		}
+		else
+		{
+			continue;
+		}
+		AddClient(Sender, Now);
+	}
+	Clients.RemoveAll([Now](const FClient& Client) { return Now - Client.LastSeen > HueBroker::CLIENT_TIMEOUT; });
+}
+
+/**
+ * @brief Collect the owner's answers, light packets, confirmed states and its greeting. A list is ready once its
+ * last light arrived :: Internal Call
+ * @param Now Current time in seconds
+ */
+void FHueCommandBroker::ReceiveClient(double Now)
+{
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	uint8 Buffer[HueBroker::MAX_PACKET];
+	uint32 PendingSize = 0;
+	while(Socket->HasPendingData(PendingSize))
+	{
+		const TSharedRef<FInternetAddr> Sender = SocketSubsystem->CreateInternetAddr();
+		int32 BytesRead = 0;
+		if(!Socket->RecvFrom(Buffer, sizeof(Buffer), BytesRead, *Sender) || BytesRead <= 0)
+		{
+			break;
+		}
+		//Only the port we are on speaks for the owner
+		if(!Sender->CompareEndpoints(*OwnerAddr))
+		{
+			continue;
+		}
+
+		TArray<uint8> Packet(Buffer, BytesRead);
+		FMemoryReader Reader(Packet);
+		uint32 Magic = 0;
+		uint8 Version = 0;
+		uint32 Hash = 0;
+		uint8 Type = 0;
+		Reader << Magic << Version << Hash << Type;
+		if(Reader.IsError() || Magic != HueBroker::MAGIC || Version != HueBroker::VERSION)
+		{
+			continue;
+		}
+
+		if(Type == static_cast<uint8>(HueBroker::EPacket::Welcome))
+		{
+			FString Key;
+			if(!HueBroker::ReadString(Reader, Key))
+			{
+				continue;
+			}
+			if(Key != BridgeKey)
+			{
+				//Another bridge hashed to this port, try the next one
+				UE_LOG(LogTemp, Log, TEXT("Hue broker: port %d belongs to bridge %s, moving on"), Port, *Key);
+				ProbeIndex = (ProbeIndex + 1) % HueBroker::PORT_SPAN;
+				Connect(Now);
+				return;
+			}
+			if(!bWelcomed)
+			{
+				UE_LOG(LogTemp, Log, TEXT("Hue broker: another process owns bridge %s, submitting through port %d"), *BridgeKey, Port);
+			}
+			bWelcomed = true;
+			LastWelcomeTime = Now;
+			if(bReadQueued)
+			{
+				bReadQueued = false;
+				RequestRead();
+			}
+			continue;
+		}
+		if(Hash != BridgeHash)
+		{
+			continue;
+		}
+		if(Type == static_cast<uint8>(HueBroker::EPacket::Sensor))
+		{
+			FHueBrokerSensor Sensor;
+			if(HueBroker::ReadSensor(Reader, Sensor.State, Sensor.bChanged) && ReceivedSensors.Num() < HueBroker::MAX_SENSORS)
+			{
+				ReceivedSensors.Add(MoveTemp(Sensor));
+			}
+			continue;
+		}
+		if(Type == static_cast<uint8>(HueBroker::EPacket::Confirm))
+		{
+			FHueBrokerCommand Command;
+			if(!HueBroker::ReadString(Reader, Command.LightId))
+			{
+				continue;
+			}
+			HueBroker::ReadState(Reader, Command.State);
+			if(!Reader.IsError())
+			{
+				Confirmed.Add(MoveTemp(Command));
+			}
+			continue;
+		}
+
+		uint16 Index = 0;
+		uint16 Count = 0;
+		Reader << Index << Count;
+		if(Reader.IsError() || Type != static_cast<uint8>(HueBroker::EPacket::Light) || Index >= Count)
+		{
+			continue;
+		}
+		FHueLightRecord Light;
+		uint8 bReachable = 0;
+		uint8 bHasState = 0;
+		uint8 GradientPoints = 0;
+		if(!HueBroker::ReadString(Reader, Light.ResourceId) || !HueBroker::ReadString(Reader, Light.Name))
+		{
+			continue;
+		}
+		HueBroker::ReadState(Reader, Light.State);
+		Reader << bReachable << bHasState << GradientPoints;
+		if(Reader.IsError())
+		{
+			continue;
+		}
+		Light.bReachable = bReachable != 0;
+		Light.bHasState = bHasState != 0;
+		Light.GradientPoints = GradientPoints;
+
+		//A list starts over at its first light, a lost packet only costs the lights it carried
+		if(Index == 0)
+		{
+			IncomingLights.Reset();
+		}
+		IncomingLights.Add(MoveTemp(Light));
+		if(Index == Count - 1)
+		{
+			ReceivedLights = MoveTemp(IncomingLights);
+			IncomingLights.Reset();
+			bLightsReady = true;
+		}
+	}
+}
+
+void FHueCommandBroker::AddClient(const TSharedRef<FInternetAddr>& Addr, double Now)
+{
+	for (FClient& Client : Clients)
+	{
+		if(Client.Addr->CompareEndpoints(*Addr))
+		{
+			Client.LastSeen = Now;
+			return;
+		}
+	}
+	if(Clients.Num() < HueBroker::MAX_CLIENTS)
+	{
+		Clients.Add({ Addr, Now });
+	}
+}
+
+bool FHueCommandBroker::SendPacket(const TArray<uint8>& Packet, const FInternetAddr& Addr)
+{
+	int32 BytesSent = 0;
+	return Socket->SendTo(Packet.GetData(), Packet.Num(), BytesSent, Addr);
+}
+
+/**
+ * @brief Greet whoever holds a port, it answers with the bridge key it owns :: Internal Call
+ */
+void FHueCommandBroker::SendHello(const FInternetAddr& Addr)
+{
+	TArray<uint8> Packet;
+	FMemoryWriter Writer(Packet);
+	HueBroker::WriteHeader(Writer, BridgeHash, HueBroker::EPacket::Hello);
+	HueBroker::WriteString(Writer, BridgeKey);
+	SendPacket(Packet, Addr);
+}
+
+/**
+ * @brief Send a lamp state to the owning process, it is handed over once ConsumeConfirmed returns it
+ * @param LightId Bridge light id of the lamp
+ * @param State FHueLampState the lamp should show
+ * @return False if this process is the owner, no owner of this bridge answered yet or the send failed
+ */
+bool FHueCommandBroker::Submit(const FString& LightId, const FHueLampState& State)
+{
+	if(!Socket || bOwner || !bWelcomed)
+	{
+		return false;
+	}
+
+	TArray<uint8> Packet;
+	FMemoryWriter Writer(Packet);
+	HueBroker::WriteHeader(Writer, BridgeHash, HueBroker::EPacket::State);
+	HueBroker::WriteString(Writer, LightId);
+	HueBroker::WriteState(Writer, State);
+	if(!SendPacket(Packet, *OwnerAddr))
+	{
+		return false;
+	}
+	SubmittedCount++;
+	return true;
+}
+
+/**
+ * @brief Ask the owner for the bridge's lights instead of reading the bridge, the answer arrives in ConsumeLights.
+ * Until the owner of this bridge has answered the request waits, it may still be moving past other bridges' ports
+ * @return False if this process is the owner or the send failed
+ */
+bool FHueCommandBroker::RequestRead()
+{
+	if(!Socket || bOwner)
+	{
+		return false;
+	}
+	if(!bWelcomed)
+	{
+		bReadQueued = true;
+		return true;
+	}
+	TArray<uint8> Packet;
+	FMemoryWriter Writer(Packet);
+	HueBroker::WriteHeader(Writer, BridgeHash, HueBroker::EPacket::Read);
+	return SendPacket(Packet, *OwnerAddr);
+}
+
+bool FHueCommandBroker::ConsumeLights(TArray<FHueLightRecord>& LightsOut)
+{
+	if(!bLightsReady)
+	{
+		return false;
+	}
+	bLightsReady = false;
+	LightsOut = MoveTemp(ReceivedLights);
+	ReceivedLights.Reset();
+	return true;
+}
+
+bool FHueCommandBroker::ConsumeConfirmed(TArray<FHueBrokerCommand>& ConfirmedOut)
+{
+	ConfirmedOut = MoveTemp(Confirmed);
+	Confirmed.Reset();
+	return ConfirmedOut.Num() > 0;
+}
+
+bool FHueCommandBroker::ConsumeSensors(TArray<FHueBrokerSensor>& SensorsOut)
+{
+	SensorsOut = MoveTemp(ReceivedSensors);
+	ReceivedSensors.Reset();
+	return SensorsOut.Num() > 0;
+}
+
+bool FHueCommandBroker::ConsumeReadRequest()
+{
+	const bool bRequested = bReadRequested;
+	bReadRequested = false;
+	return bRequested;
+}
+
+/**
+ * @brief Send the lights of a bulk read to every client, one datagram per light so any bridge size fits
+ * @param Lights Lights the owner just read from the bridge
+ */
+void FHueCommandBroker::Publish(const TArray<FHueLightRecord>& Lights)
+{
+	if(!Socket || !bOwner || Clients.Num() == 0)
+	{
+		return;
+	}
+	const int32 Count = FMath::Min(Lights.Num(), static_cast<int32>(MAX_uint16));
+	for (int32 Index = 0; Index < Count; ++Index)
+	{
+		const FHueLightRecord& Light = Lights[Index];
+		TArray<uint8> Packet;
+		FMemoryWriter Writer(Packet);
+		HueBroker::WriteHeader(Writer, BridgeHash, HueBroker::EPacket::Light);
+		uint16 PacketIndex = static_cast<uint16>(Index);
+		uint16 PacketCount = static_cast<uint16>(Count);
+		Writer << PacketIndex << PacketCount;
+		HueBroker::WriteString(Writer, Light.ResourceId);
+		HueBroker::WriteString(Writer, Light.Name);
+		HueBroker::WriteState(Writer, Light.State);
+		uint8 bReachable = Light.bReachable ? 1 : 0;
+		uint8 bHasState = Light.bHasState ? 1 : 0;
+		uint8 GradientPoints = static_cast<uint8>(FMath::Clamp(Light.GradientPoints, 0, 255));
+		Writer << bReachable << bHasState << GradientPoints;
+		for (const FClient& Client : Clients)
+		{
+			SendPacket(Packet, *Client.Addr);
+		}
+	}
+}
+
+/**
+ * @brief Tell a client its state was merged into the owner's scheduler, it stops holding the state then
+ * @param Command Command as it came out of Tick
+ */
+void FHueCommandBroker::Confirm(const FHueBrokerCommand& Command)
+{
+	if(!Socket || !bOwner || !Command.Sender.IsValid())
+	{
+		return;
+	}
+	TArray<uint8> Packet;
+	FMemoryWriter Writer(Packet);
+	HueBroker::WriteHeader(Writer, BridgeHash, HueBroker::EPacket::Confirm);
+	HueBroker::WriteString(Writer, Command.LightId);
+	HueBroker::WriteState(Writer, Command.State);
+	SendPacket(Packet, *Command.Sender);
+}
+
+/**
+ * @brief Send sensors to every client, one datagram per sensor
+ * @param Sensors Sensors to send
+ * @param bChanged True for changes the owner broadcast itself, false for the table a client reads on discovery
+ */
+void FHueCommandBroker::PublishSensors(const TArray<FHueSensorState>& Sensors, bool bChanged)
+{
+	if(!Socket || !bOwner || Clients.Num() == 0)
+	{
+		return;
+	}
+	for (const FHueSensorState& Sensor : Sensors)
+	{
+		TArray<uint8> Packet;
+		FMemoryWriter Writer(Packet);
+		HueBroker::WriteHeader(Writer, BridgeHash, HueBroker::EPacket::Sensor);
+		HueBroker::WriteSensor(Writer, Sensor, bChanged);
+		for (const FClient& Client : Clients)
+		{
+			SendPacket(Packet, *Client.Addr);
+		}
+	}
+}
@@ -0,0 +1,348 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueConfigStore.h"
+#include "HueBridge.h"
+#include "HueLighting.h"
+#include "Async/Async.h"
+#include "HAL/FileManager.h"
+#include "JsonObjectConverter.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "Serialization/ObjectAndNameAsStringProxyArchive.h"
+
+DECLARE_CYCLE_STAT(TEXT("Hue Config Write"), STAT_HueConfigWrite, STATGROUP_HueLighting);
+
+namespace HueConfig
+{
+	const uint32 CacheMagic = 0x48554543;
+	//Raise when the header changes, the config itself is tagged and survives new or removed fields
+	const int32 CacheVersion = 1;
+	const TCHAR* TempSuffix = TEXT(".tmp");
+}
+
+FHueConfigStore::FHueConfigStore(const FString& InPath)
+	: Path(InPath)
+{
+}
+
+FHueConfigStore::~FHueConfigStore()
+{
+	Flush();
+}
+
+/**
+ * @brief Copy the config and write it on a worker. A save asked for while one runs waits, and a newer one replaces it
+ * @param Config Config to write, copied before this returns
+ * @param bWriteCache Also write the binary cache next to the JSON
+ */
+void FHueConfigStore::Save(const FHueBridgeConfig& Config, bool bWriteCache)
+{
+	const TSharedRef<FHueBridgeConfig, ESPMode::ThreadSafe> Snapshot = MakeShared<FHueBridgeConfig, ESPMode::ThreadSafe>(Config);
+	Latest = Snapshot;
+	SaveCount++;
+	if(IsSaving())
+	{
+		Pending = Snapshot;
+		bPendingCache = bWriteCache;
+		return;
+	}
+	StartSave(Snapshot, bWriteCache);
+}
+
+void FHueConfigStore::Tick()
+{
+	if(Pending.IsValid() && !IsSaving())
+	{
+		StartSave(Pending.ToSharedRef(), bPendingCache);
+		Pending.Reset();
+	}
+}
+
+void FHueConfigStore::Flush()
+{
+	if(Running.IsValid())
+	{
+		Running.Wait();
+	}
+	Tick();
+	if(Running.IsValid())
+	{
+		Running.Wait();
+	}
+}
+
+/**
+ * @brief Read the config, from the cache if it was written for the JSON that is on disk now. While a save is out
+ * the disk is behind, the config that save was given is returned instead
+ * @param ConfigOut Config read
+ * @param bUseCache Try the binary cache first
+ * @return False if there is no config or it can't be read
+ */
+bool FHueConfigStore::Load(FHueBridgeConfig& ConfigOut, bool bUseCache) const
+{
+	if(HasUnsavedConfig() && Latest.IsValid())
+	{
+		ConfigOut = *Latest;
+		return true;
+	}
+	IFileManager& FileManager = IFileManager::Get();
+	FString JsonPath = Path;
+	//Where a replace is a delete then a rename, a crash between them leaves only the temp file
+	if(!FileManager.FileExists(*JsonPath) && FileManager.FileExists(*(Path + HueConfig::TempSuffix)))
+	{
+		JsonPath = Path + HueConfig::TempSuffix;
+	}
+	const FDateTime JsonStamp = FileManager.GetTimeStamp(*JsonPath);
+	if(JsonStamp == FDateTime::MinValue())
+	{
+		return false;
+	}
+	if(bUseCache && JsonPath == Path && ReadCache(GetCachePath(), JsonStamp, ConfigOut))
+	{
+		return true;
+	}
+	return ReadJson(JsonPath, ConfigOut);
+}
+
+FString FHueConfigStore::GetCachePath() const
+{
+	return FPaths::ChangeExtension(Path, TEXT("cache"));
+}
+
+/**
+ * @brief Write the JSON to a temp file and move it over the old one. A crash leaves the old file, the new one, or
+ * on platforms where the move deletes before it renames, only the temp file, which Load falls back to
+ * @return True if the new file is in place
+ */
+bool FHueConfigStore::WriteJson(const FHueBridgeConfig& Config, const FString& JsonPath)
+{
+	FString JsonData;
+	if(!FJsonObjectConverter::UStructToJsonObjectString(Config, JsonData))
+	{
+		return false;
+	}
+	const FString TempPath = JsonPath + HueConfig::TempSuffix;
+	return FFileHelper::SaveStringToFile(JsonData, *TempPath) && IFileManager::Get().Move(*JsonPath, *TempPath, true, true);
+}
+
+/**
+ * @brief Write the config as tagged binary, stamped with the JSON it was made from
+ * @param JsonStamp Time stamp of the JSON file, a cache with any other stamp is ignored
+ * @return True if the cache is in place
+ */
+bool FHueConfigStore::WriteCache(const FHueBridgeConfig& Config, const FString& CachePath, const FDateTime& JsonStamp)
+{
+	TArray<uint8> Bytes;
+	FMemoryWriter Writer(Bytes, true);
+	uint32 Magic = HueConfig::CacheMagic;
+	int32 Version = HueConfig::CacheVersion;
+	int64 Stamp = JsonStamp.GetTicks();
+	Writer << Magic << Version << Stamp;
+	FObjectAndNameAsStringProxyArchive Proxy(Writer, false);
+	FHueBridgeConfig::StaticStruct()->SerializeItem(Proxy, const_cast<FHueBridgeConfig*>(&Config), nullptr);
+	if(Writer.IsError())
+	{
+		return false;
+	}
+	const FString TempPath = CachePath + HueConfig::TempSuffix;
+	return FFileHelper::SaveArrayToFile(Bytes, *TempPath) && IFileManager::Get().Move(*CachePath, *TempPath, true, true);
+}
+
+bool FHueConfigStore::ReadJson(const FString& JsonPath, FHueBridgeConfig& ConfigOut)
+{
+	FString JsonData;
+	FHueBridgeConfig Loaded;
+	if(!FFileHelper::LoadFileToString(JsonData, *JsonPath) || !FJsonObjectConverter::JsonObjectStringToUStruct(JsonData, &Loaded))
+	{
+		return false;
+	}
+	ConfigOut = MoveTemp(Loaded);
+	return true;
+}
+
+/**
+ * @brief Read the binary cache
+ * @param JsonStamp Time stamp of the JSON on disk, the cache is stale if it was written for another
+ * @return False if there is no cache, it is stale or it can't be read
+ */
+bool FHueConfigStore::ReadCache(const FString& CachePath, const FDateTime& JsonStamp, FHueBridgeConfig& ConfigOut)
+{
+	TArray<uint8> Bytes;
+	if(!FFileHelper::LoadFileToArray(Bytes, *CachePath, FILEREAD_Silent))
+	{
+		return false;
+	}
+	FMemoryReader Reader(Bytes, true);
+	uint32 Magic = 0;
+	int32 Version = 0;
+	int64 Stamp = 0;
+	Reader << Magic << Version << Stamp;
+	if(Reader.IsError() || Magic != HueConfig::CacheMagic || Version != HueConfig::CacheVersion || Stamp != JsonStamp.GetTicks())
+	{
+		return false;
+	}
+	FHueBridgeConfig Loaded;
+	FObjectAndNameAsStringProxyArchive Proxy(Reader, false);
+	FHueBridgeConfig::StaticStruct()->SerializeItem(Proxy, &Loaded, nullptr);
+	if(Reader.IsError())
+	{
+		return false;
+	}
+	ConfigOut = MoveTemp(Loaded);
+	return true;
+}
+
+/**
+ * @brief Keep one entry per lamp. Entries match by id, or by name when either has no id yet, the later entry wins
+ * and keeps the place of the first
+ * @param Lights Entries to dedupe in place
+ */
+void FHueConfigStore::DedupeLights(TArray<FLightUse>& Lights)
+{
+	TMap<FString, int32> ById;
+	TMap<FString, int32> ByName;
+	TArray<FLightUse> Unique;
+	Unique.Reserve(Lights.Num());
+	for (const FLightUse& Light : Lights)
+	{
+		const int32* Found = Light.LightId.IsEmpty() ? nullptr : ById.Find(Light.LightId);
+		if(!Found)
+		{
+			Found = ByName.Find(Light.LightName);
+			//Two lamps can share a name, their ids tell them apart
+			if(Found && !Light.LightId.IsEmpty() && !Unique[*Found].LightId.IsEmpty())
+			{
+				Found = nullptr;
+			}
+		}
+		const int32 Index = Found ? *Found : Unique.Add(Light);
+		if(Found)
+		{
+			const FString KnownId = Unique[Index].LightId;
+			//Another lamp with the same name may own the name now
+			const int32* NameOwner = ByName.Find(Unique[Index].LightName);
+			if(NameOwner && *NameOwner == Index)
+			{
+				ByName.Remove(Unique[Index].LightName);
+			}
+			Unique[Index] = Light;
+			if(Light.LightId.IsEmpty())
+			{
+				Unique[Index].LightId = KnownId;
+			}
+		}
+		if(!Light.LightId.IsEmpty())
+		{
+			ById.Add(Light.LightId, Index);
+		}
+		ByName.Add(Light.LightName, Index);
+	}
+	Lights = MoveTemp(Unique);
+}
+
+/**
+ * @brief Time the whole save and load path against a scratch folder, the real config isn't touched
+ * @param NumLamps Lamps in the generated config
+ * @param Cycles Saves and loads to average over
+ * @return Average times per cycle and the file sizes
+ */
+FHueConfigBenchmark FHueConfigStore::Benchmark(int32 NumLamps, int32 Cycles)
+{
+	FHueConfigBenchmark Result;
+	Result.NumLamps = NumLamps = FMath::Max(NumLamps, 1);
+	Result.Cycles = Cycles = FMath::Max(Cycles, 1);
+
+	FHueBridgeConfig Config;
+	Config.HostName = TEXT("192.168.1.2");
+	Config.UserName = FGuid::NewGuid().ToString();
+	Config.Lights.Reserve(NumLamps);
+	for (int32 Index = 0; Index < NumLamps; ++Index)
+	{
+		FLightUse& Light = Config.Lights.AddDefaulted_GetRef();
+		Light.LightName = FString::Printf(TEXT("Hue lamp %d"), Index);
+		Light.LightId = FGuid::NewGuid().ToString(EGuidFormats::DigitsWithHyphensLower);
+		Light.bUseLight = Index % 4 != 0;
+	}
+
+	IFileManager& FileManager = IFileManager::Get();
+	const FString Folder = FPaths::ProjectSavedDir() / TEXT("HueConfigBenchmark");
+	const FString JsonPath = Folder / TEXT("HueConfig.json");
+	const FString CachePath = FPaths::ChangeExtension(JsonPath, TEXT("cache"));
+	double SnapshotSeconds = 0.0;
+	double WriteSeconds = 0.0;
+	double JsonLoadSeconds = 0.0;
+	double CacheLoadSeconds = 0.0;
+	int64 FirstSize = INDEX_NONE;
+	for (int32 Cycle = 0; Cycle < Cycles; ++Cycle)
+	{
+		//The game thread part of a save, merge the lamps into the config and copy it
+		double Start = FPlatformTime::Seconds();
+		DedupeLights(Config.Lights);
+		const FHueBridgeConfig Snapshot = Config;
+		SnapshotSeconds += FPlatformTime::Seconds() - Start;
+
+		Start = FPlatformTime::Seconds();
+		WriteFiles(Snapshot, JsonPath, CachePath, true);
+		WriteSeconds += FPlatformTime::Seconds() - Start;
+
+		FHueBridgeConfig Loaded;
+		Start = FPlatformTime::Seconds();
+		ReadJson(JsonPath, Loaded);
+		JsonLoadSeconds += FPlatformTime::Seconds() - Start;
+
+		Start = FPlatformTime::Seconds();
+		ReadCache(CachePath, FileManager.GetTimeStamp(*JsonPath), Loaded);
+		CacheLoadSeconds += FPlatformTime::Seconds() - Start;
+
+		if(FirstSize == INDEX_NONE)
+		{
+			FirstSize = FileManager.FileSize(*JsonPath);
+		}
+	}
+
+	Result.SnapshotMs = static_cast<float>(SnapshotSeconds / Cycles * 1000.0);
+	Result.WriteMs = static_cast<float>(WriteSeconds / Cycles * 1000.0);
+	Result.JsonLoadMs = static_cast<float>(JsonLoadSeconds / Cycles * 1000.0);
+	Result.CacheLoadMs = static_cast<float>(CacheLoadSeconds / Cycles * 1000.0);
+	Result.JsonBytes = static_cast<int32>(FileManager.FileSize(*JsonPath));
+	Result.CacheBytes = static_cast<int32>(FileManager.FileSize(*CachePath));
+	Result.bSizeStable = FirstSize == FileManager.FileSize(*JsonPath);
+	FileManager.DeleteDirectory(*Folder, false, true);
+	return Result;
+}
+
+/**
+ * @brief Start writing a snapshot on the thread pool :: Internal Call
+ */
+void FHueConfigStore::StartSave(TSharedRef<FHueBridgeConfig, ESPMode::ThreadSafe> Snapshot, bool bWriteCache)
+{
+	const FString JsonPath = Path;
+	const FString CachePath = GetCachePath();
+	Running = Async(EAsyncExecution::ThreadPool, [Snapshot, JsonPath, CachePath, bWriteCache]()
+	{
+		return WriteFiles(*Snapshot, JsonPath, CachePath, bWriteCache);
+	});
+}
+
+/**
+ * @brief Worker thread, writes the JSON then the cache stamped with it :: Internal Call
+ */
+bool FHueConfigStore::WriteFiles(const FHueBridgeConfig& Config, const FString& JsonPath, const FString& CachePath, bool bWriteCache)
+{
+	SCOPE_CYCLE_COUNTER(STAT_HueConfigWrite);
+	if(!WriteJson(Config, JsonPath))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("HueConfig could not be written to %s"), *JsonPath);
+		return false;
+	}
+	if(bWriteCache && !WriteCache(Config, CachePath, IFileManager::Get().GetTimeStamp(*JsonPath)))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("HueConfig cache could not be written to %s"), *CachePath);
+	}
+	return true;
+}
@@ -0,0 +1,619 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueDmxReceiver.h"
+#include "HueLighting.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "IPAddress.h"
+#include "Sockets.h"
+#include "SocketSubsystem.h"
+
+DECLARE_CYCLE_STAT(TEXT("Hue DMX Merge"), STAT_HueDmxMerge, STATGROUP_HueLighting);
+
+namespace HueDmx
+{
+	const uint8 ACN_ID[12] = { 'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0 };
+	const uint8 ARTNET_ID[8] = { 'A', 'r', 't', '-', 'N', 'e', 't', 0 };
+	const uint16 ARTNET_OP_DMX = 0x5000;
+	const int32 SACN_HEADER = 126;
+	const int32 ARTNET_HEADER = 18;
+	const uint8 SACN_DEFAULT_PRIORITY = 100;
+	const uint8 SACN_OPTION_PREVIEW = 0x80;
+	const uint8 SACN_OPTION_TERMINATED = 0x40;
+
+	FORCEINLINE uint16 ReadU16(const uint8* Data)
+	{
+		return static_cast<uint16>((Data[0] << 8) | Data[1]);
+	}
+
+	FORCEINLINE uint32 ReadU32(const uint8* Data)
+	{
+		return (static_cast<uint32>(Data[0]) << 24) | (Data[1] << 16) | (Data[2] << 8) | Data[3];
+	}
+
+	FORCEINLINE void WriteU16(uint8* Data, uint16 Value)
+	{
+		Data[0] = static_cast<uint8>(Value >> 8);
+		Data[1] = static_cast<uint8>(Value);
+	}
+
+	FORCEINLINE void WriteU32(uint8* Data, uint32 Value)
+	{
+		WriteU16(Data, static_cast<uint16>(Value >> 16));
+		WriteU16(Data + 2, static_cast<uint16>(Value));
+	}
+
+	//ACN flags and length, the top nibble is always 0x7
+	FORCEINLINE void WriteFlagsLength(uint8* Data, int32 Length)
+	{
+		WriteU16(Data, static_cast<uint16>(0x7000 | (Length & 0x0fff)));
+	}
+}
+
+//Runs the receiver's loop on its own thread
+class FHueDmxReceiveWorker : public FRunnable
+{
+public:
+	FHueDmxReceiveWorker(FHueDmxReceiver& InReceiver, FHueDmxReceiver::FListener& InListener)
+		: Receiver(InReceiver)
+		, Listener(InListener)
+	{
+	}
+
+	virtual uint32 Run() override
+	{
+		return Receiver.Receive(Listener);
+	}
+
+	virtual void Stop() override
+	{
+		Receiver.bStopping.store(true);
+	}
+
+private:
+	FHueDmxReceiver& Receiver;
+	FHueDmxReceiver::FListener& Listener;
+};
+
+/**
+ * @brief Channels a lamp takes in its universe
+ * @param InMode Patch mode
+ * @return int32 channel count
+ */
+int32 FHueDmxPatch::GetChannelCount(EHueDmxMode InMode)
+{
+	switch(InMode)
+	{
+	case EHueDmxMode::RGB:
+		return 3;
+	case EHueDmxMode::RGBDimmer:
+		return 4;
+	case EHueDmxMode::Dimmer:
+		return 1;
+	case EHueDmxMode::DimmerCT:
+		return 2;
+	}
+	return 0;
+}
+
+/**
+ * @brief Turn the lamp's channels into a lamp state, channels are sRGB levels like on a desk
+ * @param UniverseData 512 slots of the lamp's universe
+ * @return FHueLampState the lamp should show
+ */
+FHueLampState FHueDmxPatch::Evaluate(const uint8* UniverseData) const
+{
+	const int32 Start = StartChannel - 1;
+	if(Start < 0 || Start + GetChannelCount(Mode) > 512)
+	{
+		return FHueLampState();
+	}
+	const uint8* Channels = UniverseData + Start;
+	switch(Mode)
+	{
+	case EHueDmxMode::RGB:
+		return FHueLampState::FromLinearColor(FLinearColor::FromSRGBColor(FColor(Channels[0], Channels[1], Channels[2])));
+	case EHueDmxMode::RGBDimmer:
+		return FHueLampState::FromLinearColor(FLinearColor::FromSRGBColor(FColor(Channels[0], Channels[1], Channels[2])), Channels[3] / 255.0f);
+	case EHueDmxMode::Dimmer:
+		return FHueLampState::FromLinearColor(FLinearColor::White, Channels[0] / 255.0f);
+	case EHueDmxMode::DimmerCT:
+		{
+			const float Kelvin = FMath::Lerp(WarmKelvin, CoolKelvin, Channels[1] / 255.0f);
+			return FHueLampState::FromLinearColor(FLinearColor::MakeFromColorTemperature(Kelvin), Channels[0] / 255.0f);
+		}
+	}
+	return FHueLampState();
+}
+
+FHueDmxReceiver::FHueDmxReceiver()
+{
+	Sacn.bSacn = true;
+	Sacn.Ring.SetNum(RingSize);
+	ArtNet.Ring.SetNum(RingSize);
+}
+
+FHueDmxReceiver::~FHueDmxReceiver()
+{
+	Stop();
+}
+
+/**
+ * @brief Open a socket bound to every interface on a DMX port :: Internal Call
+ * @param Port UDP port
+ * @param Description Socket name for the socket subsystem
+ * @return FSocket or nullptr if the port could not be bound
+ */
+FSocket* FHueDmxReceiver::CreateListenSocket(int32 Port, const TCHAR* Description)
+{
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	FSocket* Socket = SocketSubsystem->CreateSocket(NAME_DGram, Description, FNetworkProtocolTypes::IPv4);
+	if(!Socket)
+	{
+		return nullptr;
+	}
+	//Visualisers and other nodes on this machine often listen on the same port
+	Socket->SetReuseAddr(true);
+	const TSharedRef<FInternetAddr> Addr = SocketSubsystem->CreateInternetAddr();
+	Addr->SetAnyAddress();
+	Addr->SetPort(Port);
+	if(!Socket->Bind(*Addr))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Hue DMX: could not bind port %d"), Port);
+		SocketSubsystem->DestroySocket(Socket);
+		return nullptr;
+	}
+	Socket->SetNonBlocking(true);
+	int32 BufferSize = 0;
+	Socket->SetReceiveBufferSize(2 * 1024 * 1024, BufferSize);
+	return Socket;
+}
+
+/**
+ * @brief Open the sockets and start the worker thread
+ * @param bSacn Listen for sACN on port 5568
+ * @param bArtNet Listen for Art-Net on port 6454
+ * @param SacnUniverses Universes to join the sACN multicast groups of, unicast sACN arrives without joining
+ * @return True if at least one protocol is listening
+ */
+bool FHueDmxReceiver::Start(bool bSacn, bool bArtNet, const TArray<int32>& SacnUniverses)
+{
+	Stop();
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	if(!SocketSubsystem)
+	{
+		return false;
+	}
+	if(bSacn)
+	{
+		Sacn.Socket = CreateListenSocket(SacnPort, TEXT("HueDmxSacn"));
+		if(Sacn.Socket)
+		{
+			const TSharedRef<FInternetAddr> Group = SocketSubsystem->CreateInternetAddr();
+			for (const int32 Universe : SacnUniverses)
+			{
+				//239.255.high byte.low byte of the universe
+				Group->SetIp((239u << 24) | (255u << 16) | (static_cast<uint32>(Universe) & 0xffff));
+				Sacn.Socket->JoinMulticastGroup(*Group);
+			}
+		}
+	}
+	if(bArtNet)
+	{
+		ArtNet.Socket = CreateListenSocket(ArtNetPort, TEXT("HueDmxArtNet"));
+	}
+	if(!Sacn.Socket && !ArtNet.Socket)
+	{
+		return false;
+	}
+
+	bStopping.store(false);
+	const bool bSacnStarted = StartListener(Sacn, TEXT("HueDmxSacn"));
+	const bool bArtNetStarted = StartListener(ArtNet, TEXT("HueDmxArtNet"));
+	UE_LOG(LogTemp, Log, TEXT("Hue DMX: listening for%s%s"), bSacnStarted ? TEXT(" sACN") : TEXT(""), bArtNetStarted ? TEXT(" Art-Net") : TEXT(""));
+	return bSacnStarted || bArtNetStarted;
+}
+
+/**
+ * @brief Give an open socket its worker thread :: Internal Call
+ * @param Listener Protocol to start
+ * @param ThreadName Name of the worker thread
+ * @return True if the worker is running
+ */
+bool FHueDmxReceiver::StartListener(FListener& Listener, const TCHAR* ThreadName)
+{
+	if(!Listener.Socket)
+	{
+		return false;
+	}
+	Listener.FromAddr = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->CreateInternetAddr();
+	Listener.Head.store(0);
+	Listener.Tail.store(0);
+	Listener.Worker = MakeUnique<FHueDmxReceiveWorker>(*this, Listener);
+	Listener.Thread = FRunnableThread::Create(Listener.Worker.Get(), ThreadName, 0, TPri_AboveNormal);
+	return Listener.Thread != nullptr;
+}
+
+void FHueDmxReceiver::Stop()
+{
+	bStopping.store(true);
+	StopListener(Sacn);
+	StopListener(ArtNet);
+}
+
+/**
+ * @brief Join a protocol's worker and close its socket :: Internal Call
+ * @param Listener Protocol to stop
+ */
+void FHueDmxReceiver::StopListener(FListener& Listener)
+{
+	if(Listener.Thread)
+	{
+		Listener.Thread->Kill(true);
+		delete Listener.Thread;
+		Listener.Thread = nullptr;
+	}
+	Listener.Worker.Reset();
+	if(Listener.Socket)
+	{
+		Listener.Socket->Close();
+		ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(Listener.Socket);
+		Listener.Socket = nullptr;
+	}
+}
+
+/**
+ * @brief Worker loop, drains the protocol's socket into its ring and sleeps in the socket wait when nothing
+ * arrives. Each protocol has its own worker so neither waits on the other :: Internal Call
+ * @param Listener Protocol this worker serves
+ * @return Thread exit code
+ */
+uint32 FHueDmxReceiver::Receive(FListener& Listener)
+{
+	const FTimespan WaitTime = FTimespan::FromMilliseconds(50);
+	while(!bStopping.load(std::memory_order_relaxed))
+	{
+		if(!ReceiveFrom(Listener))
+		{
+			Listener.Socket->Wait(ESocketWaitConditions::WaitForRead, WaitTime);
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief Receive every pending datagram of a socket straight into the next free ring slot :: Internal Call
+ * @param Listener Protocol whose socket to drain
+ * @return True if anything was read
+ */
+bool FHueDmxReceiver::ReceiveFrom(FListener& Listener)
+{
+	bool bReceived = false;
+	uint32 PendingSize = 0;
+	while(Listener.Socket->HasPendingData(PendingSize))
+	{
+		const uint32 Write = Listener.Head.load(std::memory_order_relaxed);
+		const bool bFull = Write - Listener.Tail.load(std::memory_order_acquire) >= static_cast<uint32>(RingSize);
+		FPacketSlot& Slot = Listener.Ring[Write % RingSize];
+
+		int32 BytesRead = 0;
+		if(!Listener.Socket->RecvFrom(bFull ? Listener.Scratch : Slot.Raw, MaxPacket, BytesRead, *Listener.FromAddr) || BytesRead <= 0)
+		{
+			break;
+		}
+		bReceived = true;
+		if(bFull)
+		{
+			DroppedCount.fetch_add(1, std::memory_order_relaxed);
+			continue;
+		}
+
+		uint32 SenderIp = 0;
+		Listener.FromAddr->GetIp(SenderIp);
+		if(Listener.bSacn ? ParseSacn(Slot, BytesRead) : ParseArtNet(Slot, BytesRead, SenderIp))
+		{
+			Listener.Head.store(Write + 1, std::memory_order_release);
+		}
+	}
+	return bReceived;
+}
+
+/**
+ * @brief Check an E1.31 data packet in place and note where its DMX data is :: Internal Call
+ * @param Slot Ring slot holding the datagram
+ * @param Size Bytes received
+ * @return True if the packet carries DMX data for a universe
+ */
+bool FHueDmxReceiver::ParseSacn(FPacketSlot& Slot, int32 Size)
+{
+	const uint8* Raw = Slot.Raw;
+	if(Size <= HueDmx::SACN_HEADER || FMemory::Memcmp(Raw + 4, HueDmx::ACN_ID, sizeof(HueDmx::ACN_ID)) != 0)
+	{
+		return false;
+	}
+	//Root data vector, framing data vector, DMP set property, DMX start code
+	if(HueDmx::ReadU32(Raw + 18) != 0x00000004 || HueDmx::ReadU32(Raw + 40) != 0x00000002 || Raw[117] != 0x02 || Raw[125] != 0x00)
+	{
+		return false;
+	}
+	const uint8 Options = Raw[112];
+	if(Options & HueDmx::SACN_OPTION_PREVIEW)
+	{
+		return false;
+	}
+	const int32 PropertyCount = HueDmx::ReadU16(Raw + 123);
+	Slot.Universe = HueDmx::ReadU16(Raw + 113);
+	Slot.DataOffset = HueDmx::SACN_HEADER;
+	Slot.DataLength = FMath::Min3(PropertyCount - 1, Size - HueDmx::SACN_HEADER, 512);
+	Slot.SourceId = FCrc::MemCrc32(Raw + 22, 16);
+	Slot.Priority = Raw[108];
+	Slot.Sequence = Raw[111];
+	Slot.bHasSequence = true;
+	Slot.bTerminated = (Options & HueDmx::SACN_OPTION_TERMINATED) != 0;
+	return Slot.Universe > 0 && Slot.DataLength > 0;
+}
+
+/**
+ * @brief Check an ArtDmx packet in place and note where its DMX data is :: Internal Call
+ * @param Slot Ring slot holding the datagram
+ * @param Size Bytes received
+ * @param SenderIp Address the packet came from, Art-Net has no source id of its own
+ * @return True if the packet carries DMX data for a universe
+ */
+bool FHueDmxReceiver::ParseArtNet(FPacketSlot& Slot, int32 Size, uint32 SenderIp)
+{
+	const uint8* Raw = Slot.Raw;
+	if(Size <= HueDmx::ARTNET_HEADER || FMemory::Memcmp(Raw, HueDmx::ARTNET_ID, sizeof(HueDmx::ARTNET_ID)) != 0)
+	{
+		return false;
+	}
+	//Art-Net op codes are little endian, everything else is big endian
+	if((Raw[8] | (Raw[9] << 8)) != HueDmx::ARTNET_OP_DMX)
+	{
+		return false;
+	}
+	const int32 PortAddress = Raw[14] | ((Raw[15] & 0x7f) << 8);
+	Slot.Universe = PortAddress + 1;
+	Slot.DataOffset = HueDmx::ARTNET_HEADER;
+	Slot.DataLength = FMath::Min3(static_cast<int32>(HueDmx::ReadU16(Raw + 16)), Size - HueDmx::ARTNET_HEADER, 512);
+	Slot.SourceId = HashCombine(SenderIp, static_cast<uint32>(ArtNetPort));
+	Slot.Priority = HueDmx::SACN_DEFAULT_PRIORITY;
+	Slot.Sequence = Raw[12];
+	//Sequence 0 means the sender doesn't number its packets
+	Slot.bHasSequence = Slot.Sequence != 0;
+	Slot.bTerminated = false;
+	return Slot.DataLength > 0;
+}
+
+/**
+ * @brief Merge every packet the worker has received since the last tick
+ * @param Now Current time in seconds
+ * @param ChangedUniversesOut Universes whose data changed
+ */
+void FHueDmxReceiver::Tick(double Now, TArray<int32>& ChangedUniversesOut)
+{
+	ChangedUniversesOut.Reset();
+	MergeRing(Sacn, Now, ChangedUniversesOut);
+	MergeRing(ArtNet, Now, ChangedUniversesOut);
+}
+
+/**
+ * @brief Merge the packets one protocol's worker has received since the last tick :: Internal Call
+ * @param Listener Protocol whose ring to drain
+ * @param Now Current time in seconds
+ * @param ChangedUniversesOut Universes whose data changed
+ */
+void FHueDmxReceiver::MergeRing(FListener& Listener, double Now, TArray<int32>& ChangedUniversesOut)
+{
+	const uint32 Read = Listener.Tail.load(std::memory_order_relaxed);
+	const uint32 Write = Listener.Head.load(std::memory_order_acquire);
+	if(Read == Write)
+	{
+		return;
+	}
+	SCOPE_CYCLE_COUNTER(STAT_HueDmxMerge);
+	for (uint32 Index = Read; Index != Write; ++Index)
+	{
+		MergeSlot(Listener.Ring[Index % RingSize], Now, ChangedUniversesOut);
+	}
+	ReceivedCount += static_cast<int32>(Write - Read);
+	Listener.Tail.store(Write, std::memory_order_release);
+}
+
+/**
+ * @brief Copy a packet's DMX data into its universe if its source holds the universe :: Internal Call
+ * @param Slot Ring slot to merge
+ * @param Now Current time in seconds
+ * @param ChangedUniversesOut Universes whose data changed
+ */
+void FHueDmxReceiver::MergeSlot(const FPacketSlot& Slot, double Now, TArray<int32>& ChangedUniversesOut)
+{
+	FUniverse* Universe = Universes.Find(Slot.Universe);
+	if(!Universe)
+	{
+		Universe = &Universes.Add(Slot.Universe);
+		FMemory::Memzero(Universe->Data, sizeof(Universe->Data));
+	}
+
+	//A source keeps its universe until a higher priority one shows up or it goes quiet
+	const bool bOwner = Universe->SourceId == Slot.SourceId;
+	const bool bStale = Now - Universe->LastTime > SourceTimeout;
+	if(!bOwner && !bStale && Slot.Priority <= Universe->Priority)
+	{
+		return;
+	}
+	if(Slot.bTerminated)
+	{
+		//Hold the last look, but let any other source take the universe straight away
+		if(bOwner)
+		{
+			Universe->LastTime = 0.0;
+		}
+		return;
+	}
+	//Drop late packets, E1.31 treats anything up to 20 behind as out of order
+	if(bOwner && !bStale && Slot.bHasSequence && Universe->bHasSequence)
+	{
+		const int8 Delta = static_cast<int8>(Slot.Sequence - Universe->Sequence);
+		if(Delta <= 0 && Delta > -20)
+		{
+			return;
+		}
+	}
+
+	Universe->SourceId = Slot.SourceId;
+	Universe->Priority = Slot.Priority;
+	Universe->Sequence = Slot.Sequence;
+	Universe->bHasSequence = Slot.bHasSequence;
+	Universe->LastTime = Now;
+	const uint8* Data = Slot.Raw + Slot.DataOffset;
+	if(FMemory::Memcmp(Universe->Data, Data, Slot.DataLength) != 0)
+	{
+		FMemory::Memcpy(Universe->Data, Data, Slot.DataLength);
+		ChangedUniversesOut.AddUnique(Slot.Universe);
+	}
+}
+
+const uint8* FHueDmxReceiver::GetUniverse(int32 Universe) const
+{
+	const FUniverse* Found = Universes.Find(Universe);
+	return Found ? Found->Data : nullptr;
+}
+
+/**
+ * @brief Build an E1.31 data packet
+ * @param Universe sACN universe 1-63999
+ * @param Data Up to 512 DMX slots
+ * @param Sequence Packet sequence number
+ * @param Priority Source priority 0-200
+ * @param PacketOut Datagram to send
+ */
+void FHueDmxReceiver::BuildSacnPacket(int32 Universe, TConstArrayView<uint8> Data, uint8 Sequence, uint8 Priority, TArray<uint8>& PacketOut)
+{
+	const int32 Slots = FMath::Min(Data.Num(), 512);
+	PacketOut.SetNumZeroed(HueDmx::SACN_HEADER + Slots);
+	uint8* Raw = PacketOut.GetData();
+
+	//Root layer
+	HueDmx::WriteU16(Raw, 0x0010);
+	FMemory::Memcpy(Raw + 4, HueDmx::ACN_ID, sizeof(HueDmx::ACN_ID));
+	HueDmx::WriteFlagsLength(Raw + 16, PacketOut.Num() - 16);
+	HueDmx::WriteU32(Raw + 18, 0x00000004);
+	const uint32 Cid = FCrc::StrCrc32(TEXT("HueDmxLoopbackGenerator"));
+	FMemory::Memcpy(Raw + 22, &Cid, sizeof(Cid));
+
+	//Framing layer
+	HueDmx::WriteFlagsLength(Raw + 38, PacketOut.Num() - 38);
+	HueDmx::WriteU32(Raw + 40, 0x00000002);
+	FMemory::Memcpy(Raw + 44, "Unreal Hue loopback", 19);
+	Raw[108] = Priority;
+	Raw[111] = Sequence;
+	HueDmx::WriteU16(Raw + 113, static_cast<uint16>(Universe));
+
+	//DMP layer
+	HueDmx::WriteFlagsLength(Raw + 115, PacketOut.Num() - 115);
+	Raw[117] = 0x02;
+	Raw[118] = 0xa1;
+	HueDmx::WriteU16(Raw + 121, 1);
+	HueDmx::WriteU16(Raw + 123, static_cast<uint16>(Slots + 1));
+	FMemory::Memcpy(Raw + HueDmx::SACN_HEADER, Data.GetData(), Slots);
+}
+
+/**
+ * @brief Build an ArtDmx packet
+ * @param Universe Universe in the patch's numbering, port address + 1
+ * @param Data Up to 512 DMX slots
+ * @param Sequence Packet sequence number, 0 turns sequencing off
+ * @param PacketOut Datagram to send
+ */
+void FHueDmxReceiver::BuildArtNetPacket(int32 Universe, TConstArrayView<uint8> Data, uint8 Sequence, TArray<uint8>& PacketOut)
+{
+	//Art-Net wants an even slot count
+	const int32 Slots = FMath::Min(Data.Num() + (Data.Num() & 1), 512);
+	PacketOut.SetNumZeroed(HueDmx::ARTNET_HEADER + Slots);
+	uint8* Raw = PacketOut.GetData();
+	const int32 PortAddress = FMath::Max(Universe - 1, 0);
+
+	FMemory::Memcpy(Raw, HueDmx::ARTNET_ID, sizeof(HueDmx::ARTNET_ID));
+	Raw[8] = static_cast<uint8>(HueDmx::ARTNET_OP_DMX & 0xff);
+	Raw[9] = static_cast<uint8>(HueDmx::ARTNET_OP_DMX >> 8);
+	Raw[11] = 14;
+	Raw[12] = Sequence;
+	Raw[14] = static_cast<uint8>(PortAddress & 0xff);
+	Raw[15] = static_cast<uint8>((PortAddress >> 8) & 0x7f);
+	HueDmx::WriteU16(Raw + 16, static_cast<uint16>(Slots));
+	FMemory::Memcpy(Raw + HueDmx::ARTNET_HEADER, Data.GetData(), FMath::Min(Data.Num(), 512));
+}
+
+FHueDmxLoopbackGenerator::FHueDmxLoopbackGenerator(int32 InUniverseCount, float InRate, bool bInArtNet)
+	: UniverseCount(FMath::Max(InUniverseCount, 1))
+	, Rate(FMath::Max(InRate, 1.0f))
+	, bArtNet(bInArtNet)
+{
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	if(!SocketSubsystem)
+	{
+		return;
+	}
+	Socket = SocketSubsystem->CreateSocket(NAME_DGram, TEXT("HueDmxLoopback"), FNetworkProtocolTypes::IPv4);
+	if(Socket)
+	{
+		Socket->SetNonBlocking(true);
+	}
+	Target = SocketSubsystem->CreateInternetAddr();
+	Target->SetLoopbackAddress();
+	Target->SetPort(bArtNet ? FHueDmxReceiver::ArtNetPort : FHueDmxReceiver::SacnPort);
+	Data.SetNumZeroed(512);
+}
+
+FHueDmxLoopbackGenerator::~FHueDmxLoopbackGenerator()
+{
+	if(Socket)
+	{
+		Socket->Close();
+		ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(Socket);
+	}
+}
+
+/**
+ * @brief Send a rainbow chase to every universe when the next frame is due
+ * @param Now Current time in seconds
+ */
+void FHueDmxLoopbackGenerator::Tick(double Now)
+{
+	if(!Socket || (LastSendTime >= 0.0 && Now - LastSendTime < 1.0 / Rate))
+	{
+		return;
+	}
+	LastSendTime = Now;
+	Sequence = Sequence == 255 ? 1 : Sequence + 1;
+
+	for (int32 Universe = 1; Universe <= UniverseCount; ++Universe)
+	{
+		//Every three channels is one RGB fixture a little further round the color wheel
+		for (int32 Channel = 0; Channel + 2 < Data.Num(); Channel += 3)
+		{
+			const float Hue = FMath::Frac(static_cast<float>(Now) * 0.25f + Channel / 512.0f + Universe * 0.1f) * 360.0f;
+			const FColor Color = FLinearColor(Hue, 1.0f, 1.0f).HSVToLinearRGB().ToFColorSRGB();
+			Data[Channel] = Color.R;
+			Data[Channel + 1] = Color.G;
+			Data[Channel + 2] = Color.B;
+		}
+		if(bArtNet)
+		{
+			FHueDmxReceiver::BuildArtNetPacket(Universe, Data, Sequence, Packet);
+		}
+		else
+		{
+			FHueDmxReceiver::BuildSacnPacket(Universe, Data, Sequence, 100, Packet);
+		}
+		int32 BytesSent = 0;
+		if(Socket->SendTo(Packet.GetData(), Packet.Num(), BytesSent, *Target))
+		{
+			SentCount++;
+		}
+	}
+}
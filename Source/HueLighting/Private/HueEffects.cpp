@@ -0,0 +1,429 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueEffects.h"
+#include "HueLighting.h"
+#include "Async/Async.h"
+
+DECLARE_CYCLE_STAT(TEXT("Hue Effect Evaluate"), STAT_HueEffectEvaluate, STATGROUP_HueLighting);
+
+namespace HueEffects
+{
+	//Cheap shader style hash, fractional part of a large sine. Good enough for flicker, not for anything else
+	FORCEINLINE VectorRegister4Float Hash(const VectorRegister4Float& X)
+	{
+		const VectorRegister4Float S = VectorAbs(VectorMultiply(VectorSin(VectorMultiply(X, VectorSetFloat1(12.9898f))), VectorSetFloat1(43758.5453f)));
+		return VectorSubtract(S, VectorFloor(S));
+	}
+
+	FORCEINLINE VectorRegister4Float Frac(const VectorRegister4Float& X)
+	{
+		return VectorSubtract(X, VectorFloor(X));
+	}
+
+	FORCEINLINE VectorRegister4Float Saturate(const VectorRegister4Float& X)
+	{
+		return VectorMin(VectorMax(X, VectorZeroFloat()), VectorOneFloat());
+	}
+
+	//Smooth 1D value noise, each lamp gets its own seed
+	FORCEINLINE VectorRegister4Float ValueNoise(const VectorRegister4Float& X)
+	{
+		const VectorRegister4Float Cell = VectorFloor(X);
+		const VectorRegister4Float F = VectorSubtract(X, Cell);
+		const VectorRegister4Float A = Hash(Cell);
+		const VectorRegister4Float B = Hash(VectorAdd(Cell, VectorOneFloat()));
+		//Smoothstep F * F * (3 - 2F)
+		const VectorRegister4Float U = VectorMultiply(VectorMultiply(F, F), VectorSubtract(VectorSetFloat1(3.0f), VectorAdd(F, F)));
+		return VectorMultiplyAdd(VectorSubtract(B, A), U, A);
+	}
+
+	FORCEINLINE VectorRegister4Float Waveform(EHueEffectWaveform Shape, const VectorRegister4Float& Phase, float DutyCycle)
+	{
+		switch(Shape)
+		{
+		case EHueEffectWaveform::Square:
+			return VectorSelect(VectorCompareLT(Phase, VectorSetFloat1(DutyCycle)), VectorOneFloat(), VectorZeroFloat());
+		case EHueEffectWaveform::Triangle:
+			return VectorSubtract(VectorOneFloat(), VectorAbs(VectorSubtract(VectorAdd(Phase, Phase), VectorOneFloat())));
+		case EHueEffectWaveform::Saw:
+			return Phase;
+		default:
+			return VectorMultiplyAdd(VectorSin(VectorMultiply(Phase, VectorSetFloat1(UE_TWO_PI))), VectorSetFloat1(0.5f), VectorSetFloat1(0.5f));
+		}
+	}
+
+	FORCEINLINE VectorRegister4Float Blend(EHueEffectBlend Mode, const VectorRegister4Float& Base, const VectorRegister4Float& Layer, const VectorRegister4Float& Opacity)
+	{
+		switch(Mode)
+		{
+		case EHueEffectBlend::Multiply:
+			//Base * Lerp(1, Layer, Opacity)
+			return VectorMultiply(Base, VectorMultiplyAdd(VectorSubtract(Layer, VectorOneFloat()), Opacity, VectorOneFloat()));
+		case EHueEffectBlend::Add:
+			return VectorMultiplyAdd(Layer, Opacity, Base);
+		case EHueEffectBlend::Max:
+			return VectorMax(Base, VectorMultiply(Layer, Opacity));
+		default:
+			return VectorMultiplyAdd(VectorSubtract(Layer, Base), Opacity, Base);
+		}
+	}
+
+	/**
+	 * @brief 0-1 value of a layer for four lamps
+	 * @param Layer Layer to evaluate
+	 * @param LayerIndex Index of the layer, salts the noise so stacked noise layers differ
+	 * @param LampIndex Index of the four lamps within the effect
+	 * @param Time Seconds since the effect started
+	 * @param DeltaTime Seconds since the last evaluation
+	 * @param Walk Random walk state of the four lamps, read and written
+	 */
+	FORCEINLINE VectorRegister4Float EvaluateLayer(const FHueEffectLayer& Layer, int32 LayerIndex, const VectorRegister4Float& LampIndex, float Time, float DeltaTime, float* Walk)
+	{
+		const VectorRegister4Float Phase = Frac(VectorMultiplyAdd(LampIndex, VectorSetFloat1(Layer.PhaseStep), VectorSetFloat1(Time * Layer.Frequency + Layer.PhaseOffset)));
+		const VectorRegister4Float Seed = VectorMultiplyAdd(LampIndex, VectorSetFloat1(7.31f), VectorSetFloat1(LayerIndex * 13.7f));
+		switch(Layer.Type)
+		{
+		case EHueEffectType::Periodic:
+			return Waveform(Layer.Waveform, Phase, Layer.DutyCycle);
+
+		case EHueEffectType::Envelope:
+		{
+			const float Length = FMath::Max(Layer.Attack + Layer.Hold + Layer.Release, KINDA_SMALL_NUMBER);
+			const float Cycle = Layer.Period > 0.0f ? Layer.Period : Length;
+			//Lamps are staggered by their phase step, repeating envelopes wrap around the period
+			VectorRegister4Float Local = VectorSubtract(VectorSetFloat1(Time), VectorMultiply(VectorMultiplyAdd(LampIndex, VectorSetFloat1(Layer.PhaseStep), VectorSetFloat1(Layer.PhaseOffset)), VectorSetFloat1(Cycle)));
+			if(Layer.Period > 0.0f)
+			{
+				Local = VectorMultiply(Frac(VectorMultiply(Local, VectorSetFloat1(1.0f / Layer.Period))), VectorSetFloat1(Layer.Period));
+			}
+			const VectorRegister4Float Rise = Saturate(VectorMultiply(Local, VectorSetFloat1(1.0f / FMath::Max(Layer.Attack, KINDA_SMALL_NUMBER))));
+			const VectorRegister4Float Fall = Saturate(VectorSubtract(VectorOneFloat(),
+				VectorMultiply(VectorSubtract(Local, VectorSetFloat1(Layer.Attack + Layer.Hold)), VectorSetFloat1(1.0f / FMath::Max(Layer.Release, KINDA_SMALL_NUMBER)))));
+			return VectorMin(Rise, Fall);
+		}
+
+		case EHueEffectType::RandomWalk:
+		{
+			const VectorRegister4Float State = VectorLoad(Walk);
+			const VectorRegister4Float Random = VectorSubtract(VectorAdd(Hash(VectorAdd(Seed, VectorSetFloat1(Time * 61.7f))), Hash(VectorAdd(Seed, VectorSetFloat1(Time * 17.3f + 5.0f)))), VectorOneFloat());
+			const VectorRegister4Float Step = VectorMultiply(Random, VectorSetFloat1(Layer.StepSize * FMath::Sqrt(DeltaTime)));
+			const VectorRegister4Float Pull = VectorMultiply(VectorSubtract(State, VectorSetFloat1(0.5f)), VectorSetFloat1(FMath::Min(Layer.MeanReversion * DeltaTime, 1.0f)));
+			const VectorRegister4Float Next = Saturate(VectorSubtract(VectorAdd(State, Step), Pull));
+			VectorStore(Next, Walk);
+			return Next;
+		}
+
+		default:
+			return ValueNoise(VectorMultiplyAdd(VectorSetFloat1(Time), VectorSetFloat1(Layer.Frequency), VectorMultiply(Seed, VectorSetFloat1(31.0f))));
+		}
+	}
+}
+
+/**
+ * @brief Size the structure of arrays for the slots :: Internal Call
+ */
+void FHueEffectRunner::FInstance::Init(const TArray<int32>& InSlots, const TArray<FHueEffectLayer>& InLayers)
+{
+	Slots = InSlots;
+	Layers = InLayers;
+	const int32 Padded = Align(FMath::Max(Slots.Num(), 1), 4);
+	R.SetNumZeroed(Padded);
+	G.SetNumZeroed(Padded);
+	B.SetNumZeroed(Padded);
+	WalkState.SetNum(Layers.Num());
+	for (TArray<float>& Walk : WalkState)
+	{
+		Walk.Init(0.5f, Padded);
+	}
+}
+
+FHueEffectRunner::FHueEffectRunner(float InRate)
+	: Batch(MakeShared<FBatch, ESPMode::ThreadSafe>())
+	, Rate(FMath::Max(InRate, 1.0f))
+{
+}
+
+FHueEffectRunner::~FHueEffectRunner()
+{
+	//The worker holds its own reference to the batch but don't leave it running past the owner
+	if(Running.IsValid())
+	{
+		Running.Wait();
+	}
+}
+
+/**
+ * @brief Start an effect, it joins the next batch
+ * @param Slots Scheduler slots of the lamps, lamp order sets their phase step
+ * @param Layers Layers from bottom to top
+ * @param Duration Seconds to play, 0 plays until stopped
+ * @param Now Current time in seconds
+ * @return Handle for Stop
+ */
+int32 FHueEffectRunner::Play(const TArray<int32>& Slots, const TArray<FHueEffectLayer>& Layers, float Duration, double Now)
+{
+	FInstance& Instance = Added.AddDefaulted_GetRef();
+	Instance.Handle = NextHandle++;
+	Instance.StartTime = Now;
+	Instance.Duration = Duration;
+	Instance.Init(Slots, Layers);
+	return Instance.Handle;
+}
+
+void FHueEffectRunner::Stop(int32 Handle)
+{
+	Added.RemoveAll([Handle](const FInstance& Instance) { return Instance.Handle == Handle; });
+	Removed.Add(Handle);
+}
+
+void FHueEffectRunner::StopAll()
+{
+	Added.Empty();
+	Removed.Empty();
+	bStopAll = true;
+}
+
+/**
+ * @brief Pick up the finished batch, apply plays and stops that came in while it ran and kick the next batch
+ * @param Now Current time in seconds
+ * @param OutputsOut Colors from the batch that just finished, empty if none finished this tick
+ */
+void FHueEffectRunner::Tick(double Now, TArray<FHueEffectOutput>& OutputsOut)
+{
+	OutputsOut.Reset();
+	if(Running.IsValid())
+	{
+		if(!Running.IsReady())
+		{
+			return;
+		}
+		Running.Reset();
+		OutputsOut = MoveTemp(Batch->Outputs);
+		LastEvaluateMs = static_cast<float>(Batch->EvaluateSeconds * 1000.0);
+		LastEvaluatedLamps = Batch->EvaluatedLamps;
+		Batch->Instances.RemoveAll([](const FInstance& Instance) { return Instance.bFinished; });
+	}
+
+	TArray<FInstance>& Instances = Batch->Instances;
+	if(bStopAll)
+	{
+		Instances.Empty();
+		bStopAll = false;
+	}
+	if(Removed.Num() > 0)
+	{
+		Instances.RemoveAll([this](const FInstance& Instance) { return Removed.Contains(Instance.Handle); });
+		Removed.Reset();
+	}
+	for (FInstance& Instance : Added)
+	{
+		Instances.Add(MoveTemp(Instance));
+	}
+	Added.Reset();
+
+	if(Instances.Num() == 0 || (LastKickTime >= 0.0 && Now - LastKickTime < 1.0 / Rate))
+	{
+		return;
+	}
+	LastKickTime = Now;
+	Batch->Now = Now;
+	TSharedRef<FBatch, ESPMode::ThreadSafe> Work = Batch;
+	Running = Async(EAsyncExecution::ThreadPool, [Work]()
+	{
+		Evaluate(*Work);
+	});
+}
+
+/**
+ * @brief Worker thread, evaluates every instance and collects one color per slot, later effects win :: Internal Call
+ */
+void FHueEffectRunner::Evaluate(FBatch& Work)
+{
+	SCOPE_CYCLE_COUNTER(STAT_HueEffectEvaluate);
+	const double StartSeconds = FPlatformTime::Seconds();
+
+	Work.Outputs.Reset();
+	Work.EvaluatedLamps = 0;
+	TMap<int32, int32> OutputBySlot;
+	for (FInstance& Instance : Work.Instances)
+	{
+		float Time = static_cast<float>(Work.Now - Instance.StartTime);
+		if(Instance.Duration > 0.0f && Time >= Instance.Duration)
+		{
+			Instance.bFinished = true;
+			Time = Instance.Duration;
+		}
+		const float DeltaTime = FMath::Max(Time - Instance.LastTime, 0.0f);
+		Instance.LastTime = Time;
+		EvaluateInstance(Instance, Time, DeltaTime);
+
+		for (int32 Index = 0; Index < Instance.Slots.Num(); ++Index)
+		{
+			const int32 Slot = Instance.Slots[Index];
+			const FLinearColor Color(Instance.R[Index], Instance.G[Index], Instance.B[Index]);
+			if(const int32* Existing = OutputBySlot.Find(Slot))
+			{
+				Work.Outputs[*Existing].Color = Color;
+				continue;
+			}
+			OutputBySlot.Add(Slot, Work.Outputs.Num());
+			Work.Outputs.Add({Slot, Color});
+		}
+		Work.EvaluatedLamps += Instance.Slots.Num();
+	}
+	Work.EvaluateSeconds = FPlatformTime::Seconds() - StartSeconds;
+}
+
+/**
+ * @brief Evaluate every layer of an instance four lamps at a time and blend them bottom to top :: Internal Call
+ */
+void FHueEffectRunner::EvaluateInstance(FInstance& Instance, float Time, float DeltaTime)
+{
+	const int32 Num = Instance.R.Num();
+	float* R = Instance.R.GetData();
+	float* G = Instance.G.GetData();
+	float* B = Instance.B.GetData();
+	for (int32 Index = 0; Index < Num; Index += 4)
+	{
+		VectorStore(VectorZeroFloat(), R + Index);
+		VectorStore(VectorZeroFloat(), G + Index);
+		VectorStore(VectorZeroFloat(), B + Index);
+	}
+
+	for (int32 LayerIndex = 0; LayerIndex < Instance.Layers.Num(); ++LayerIndex)
+	{
+		const FHueEffectLayer& Layer = Instance.Layers[LayerIndex];
+		float* Walk = Instance.WalkState[LayerIndex].GetData();
+		const VectorRegister4Float LayerR = VectorSetFloat1(Layer.Color.R);
+		const VectorRegister4Float LayerG = VectorSetFloat1(Layer.Color.G);
+		const VectorRegister4Float LayerB = VectorSetFloat1(Layer.Color.B);
+		const VectorRegister4Float Min = VectorSetFloat1(Layer.Min);
+		const VectorRegister4Float Range = VectorSetFloat1(Layer.Max - Layer.Min);
+		const VectorRegister4Float Opacity = VectorSetFloat1(Layer.Opacity);
+
+		for (int32 Index = 0; Index < Num; Index += 4)
+		{
+			const VectorRegister4Float LampIndex = MakeVectorRegisterFloat(static_cast<float>(Index), Index + 1.0f, Index + 2.0f, Index + 3.0f);
+			const VectorRegister4Float Value = HueEffects::EvaluateLayer(Layer, LayerIndex, LampIndex, Time, DeltaTime, Walk + Index);
+			const VectorRegister4Float Scale = VectorMultiplyAdd(Value, Range, Min);
+			VectorStore(HueEffects::Blend(Layer.Blend, VectorLoad(R + Index), VectorMultiply(LayerR, Scale), Opacity), R + Index);
+			VectorStore(HueEffects::Blend(Layer.Blend, VectorLoad(G + Index), VectorMultiply(LayerG, Scale), Opacity), G + Index);
+			VectorStore(HueEffects::Blend(Layer.Blend, VectorLoad(B + Index), VectorMultiply(LayerB, Scale), Opacity), B + Index);
+		}
+	}
+}
+
+/**
+ * @brief Layers for the effects every project ends up building by hand
+ * @param Preset Effect to build
+ * @param LayersOut Layers from bottom to top
+ */
+void FHueEffectRunner::GetPreset(EHueEffectPreset Preset, TArray<FHueEffectLayer>& LayersOut)
+{
+	LayersOut.Reset();
+	switch(Preset)
+	{
+	case EHueEffectPreset::Fire:
+	{
+		FHueEffectLayer& Glow = LayersOut.AddDefaulted_GetRef();
+		Glow.Type = EHueEffectType::Noise;
+		Glow.Color = FLinearColor(1.0f, 0.35f, 0.05f);
+		Glow.Min = 0.5f;
+		Glow.Frequency = 3.0f;
+		FHueEffectLayer& Flicker = LayersOut.AddDefaulted_GetRef();
+		Flicker.Type = EHueEffectType::Noise;
+		Flicker.Blend = EHueEffectBlend::Multiply;
+		Flicker.Min = 0.7f;
+		Flicker.Frequency = 9.0f;
+		break;
+	}
+	case EHueEffectPreset::Candle:
+	{
+		FHueEffectLayer& Flame = LayersOut.AddDefaulted_GetRef();
+		Flame.Type = EHueEffectType::Noise;
+		Flame.Color = FLinearColor(1.0f, 0.55f, 0.2f);
+		Flame.Min = 0.6f;
+		Flame.Frequency = 2.0f;
+		FHueEffectLayer& Drift = LayersOut.AddDefaulted_GetRef();
+		Drift.Type = EHueEffectType::RandomWalk;
+		Drift.Blend = EHueEffectBlend::Multiply;
+		Drift.Min = 0.8f;
+		Drift.StepSize = 0.5f;
+		break;
+	}
+	case EHueEffectPreset::Strobe:
+	{
+		FHueEffectLayer& Flash = LayersOut.AddDefaulted_GetRef();
+		Flash.Type = EHueEffectType::Periodic;
+		Flash.Waveform = EHueEffectWaveform::Square;
+		Flash.Frequency = 10.0f;
+		Flash.DutyCycle = 0.2f;
+		break;
+	}
+	case EHueEffectPreset::Police:
+	{
+		//Red and blue half a cycle apart, neighbouring lamps swap
+		FHueEffectLayer& Red = LayersOut.AddDefaulted_GetRef();
+		Red.Type = EHueEffectType::Periodic;
+		Red.Waveform = EHueEffectWaveform::Square;
+		Red.Color = FLinearColor::Red;
+		Red.Frequency = 2.0f;
+		Red.PhaseStep = 0.5f;
+		FHueEffectLayer& Blue = LayersOut.AddDefaulted_GetRef();
+		Blue = Red;
+		Blue.Blend = EHueEffectBlend::Add;
+		Blue.Color = FLinearColor::Blue;
+		Blue.PhaseOffset = 0.5f;
+		break;
+	}
+	case EHueEffectPreset::Lightning:
+	{
+		FHueEffectLayer& Strike = LayersOut.AddDefaulted_GetRef();
+		Strike.Type = EHueEffectType::Envelope;
+		Strike.Color = FLinearColor(0.8f, 0.85f, 1.0f);
+		Strike.Attack = 0.02f;
+		Strike.Hold = 0.05f;
+		Strike.Release = 0.4f;
+		Strike.Period = 4.0f;
+		Strike.PhaseStep = 0.03f;
+		FHueEffectLayer& Flicker = LayersOut.AddDefaulted_GetRef();
+		Flicker.Type = EHueEffectType::Noise;
+		Flicker.Blend = EHueEffectBlend::Multiply;
+		Flicker.Min = 0.3f;
+		Flicker.Frequency = 25.0f;
+		break;
+	}
+	}
+}
+
+/**
+ * @brief Time the batch evaluation on the calling thread, used to size how many lamps an effect rate can carry
+ * @param Layers Layers to evaluate
+ * @param NumLamps Lamps in the effect
+ * @param Iterations Batches to average over
+ * @return Microseconds per batch for a thousand lamps
+ */
+double FHueEffectRunner::MeasureCost(const TArray<FHueEffectLayer>& Layers, int32 NumLamps, int32 Iterations)
+{
+	NumLamps = FMath::Max(NumLamps, 1);
+	Iterations = FMath::Max(Iterations, 1);
+	FBatch Work;
+	TArray<int32> Slots;
+	for (int32 Index = 0; Index < NumLamps; ++Index)
+	{
+		Slots.Add(Index);
+	}
+	Work.Instances.AddDefaulted_GetRef().Init(Slots, Layers);
+
+	double Total = 0.0;
+	for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+	{
+		Work.Now = Iteration / 30.0;
+		Evaluate(Work);
+		Total += Work.EvaluateSeconds;
+	}
+	return Total / Iterations * 1000000.0 * (1000.0 / NumLamps);
+}
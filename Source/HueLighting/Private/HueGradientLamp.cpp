@@ -0,0 +1,467 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueGradientLamp.h"
+#include "HueLighting.h"
+#include "HueSendScheduler.h"
+#include "HueTransport.h"
+#include "Components/SplineComponent.h"
+#include "Curves/CurveLinearColor.h"
+
+DECLARE_CYCLE_STAT(TEXT("Hue Gradient Sample"), STAT_HueGradientSample, STATGROUP_HueLighting);
+
+AHueGradientLamp::AHueGradientLamp()
+{
+	//Only ticks while a curve or spline is being sampled
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bStartWithTickEnabled = false;
+	PrimaryActorTick.TickGroup = TG_PostUpdateWork;
+}
+
+void AHueGradientLamp::BeginPlay()
+{
+	Super::BeginPlay();
+	UpdateSampling();
+}
+
+/**
+ * @brief Sample the curve or spline and pass it on, the gradient only goes out when a quantized point changed
+ */
+void AHueGradientLamp::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+	SCOPE_CYCLE_COUNTER(STAT_HueGradientSample);
+
+	if(!GradientCurve)
+	{
+		return;
+	}
+	if(Spline)
+	{
+		SampleSpline(Spline, GradientCurve, PointCount, SampleBuffer);
+	}
+	else
+	{
+		SampleCurve(GradientCurve, PointCount, SampleBuffer);
+	}
+	ApplyGradient(SampleBuffer, Intensity);
+}
+
+/**
+ * @brief Show a gradient on the strip, colors are resampled to the strip's point count
+ * @param Colors Colors from strip start to end
+ * @param GradientIntensity float 0-1 scale applied on top of the colors
+ * @return True if the gradient differs from what the strip is showing or about to show
+ */
+bool AHueGradientLamp::ApplyGradient(const TArray<FLinearColor>& Colors, float GradientIntensity)
+{
+	if(!bHasBeenConfigured || Colors.Num() == 0)
+	{
+		return false;
+	}
+	TArray<FHueLampState> Gradient;
+	QuantizeGradient(Colors, GradientIntensity, Gradient);
+	return ApplyGradientStates(Gradient);
+}
+
+/**
+ * @brief A single color is a gradient with every point the same, so scenes, bindings and the broker all work
+ * @param State FHueLampState quantized state to show on every point
+ * @param TransitionTime Fade to it in 100ms steps, negative leaves the bridge default
+ * @return True if the strip wasn't already showing it
+ */
+bool AHueGradientLamp::ApplyState(const FHueLampState& State, int32 TransitionTime)
+{
+	if(!bHasBeenConfigured)
+	{
+		return false;
+	}
+	TArray<FHueLampState> Gradient;
+	MakeUniformGradient(State, Gradient);
+	return ApplyGradientStates(Gradient, TransitionTime);
+}
+
+/**
+ * @brief Same path as AHueLamp::ApplyState for a whole gradient :: Internal Call
+ * @param Gradient Quantized points, every point shares one brightness
+ * @param TransitionTime Fade to it in 100ms steps, negative leaves the bridge default
+ * @return True if the gradient differs from what the strip is showing or about to show
+ */
+bool AHueGradientLamp::ApplyGradientStates(const TArray<FHueLampState>& Gradient, int32 TransitionTime)
+{
+	const FHueLampState Average = AverageState(Gradient);
+	if(!bReachable)
+	{
+		ReconnectGradient = Gradient;
+		bHasReconnectGradient = true;
+		SuppressUntilReachable(Average);
+		return false;
+	}
+
+	//Scheduled lamps only record what they want, the error is the worst point so one changed point still counts
+	if(Scheduler.IsValid())
+	{
+		if(bHasSentState && DesiredGradient == Gradient)
+		{
+			return false;
+		}
+		DesiredGradient = Gradient;
+		const double Now = FPlatformTime::Seconds();
+		Scheduler->SetDesired(ScheduleSlot, Average, Now, TransitionTime);
+		const float Error = GradientDistance(Gradient, LastSentGradient);
+		Scheduler->SetDesiredError(ScheduleSlot, bHasSentState ? Error : FMath::Max(Error, 1.0f), Now);
+		return true;
+	}
+
+	if(bStateRequestInFlight)
+	{
+		const TArray<FHueLampState>& Queued = bHasPendingGradient ? PendingGradient : LastSentGradient;
+		if(Queued == Gradient)
+		{
+			return false;
+		}
+		PendingGradient = Gradient;
+		PendingTransition = TransitionTime;
+		bHasPendingGradient = true;
+		return true;
+	}
+
+	if(bHasSentState && LastSentGradient == Gradient)
+	{
+		return false;
+	}
+	CreateRequestGradient(Gradient, TransitionTime);
+	return true;
+}
+
+/**
+ * @brief Send the gradient the scheduler is holding, called by the bridge when the strip gets a send slot
+ */
+void AHueGradientLamp::SendDesiredState()
+{
+	if(!Scheduler.IsValid() || bStateRequestInFlight)
+	{
+		return;
+	}
+	if(!bReachable)
+	{
+		HoldForReconnect();
+		return;
+	}
+	if(DesiredGradient.Num() != PointCount)
+	{
+		MakeUniformGradient(Scheduler->GetDesired(ScheduleSlot), DesiredGradient);
+	}
+	CreateRequestGradient(DesiredGradient, Scheduler->GetDesiredTransition(ScheduleSlot));
+	Scheduler->MarkSent(ScheduleSlot, FPlatformTime::Seconds());
+}
+
+/**
+ * @brief Create the single request that sets every point :: Internal Call
+ * @param Gradient Quantized points from strip start to end
+ * @param TransitionTime Fade time of this request in 100ms steps, negative leaves the bridge default
+ */
+void AHueGradientLamp::CreateRequestGradient(const TArray<FHueLampState>& Gradient, int32 TransitionTime)
+{
+	const FHueLampState Average = AverageState(Gradient);
+	//Hue and Saturation carry the average for bridges that can't take a gradient
+	FHueLightCommand Command = FHueLightCommand::FromState(Average, TransitionTime);
+	if(Average.bOn)
+	{
+		FHueLampState::ToXYBatch(Gradient, Command.GradientPoints);
+	}
+
+	const TSharedRef<IHttpRequest> Request = Transport->CreateSetLight(DeviceKey, Command);
+	Request->OnProcessRequestComplete().BindUObject(this, &AHueGradientLamp::OnResponseReceivedState);
+	Request->ProcessRequest();
+	StateSentTime = FPlatformTime::Seconds();
+
+	LastSentGradient = Gradient;
+	LastSentState = Average;
+	LampColor = Average.ToColor();
+	bHasSentState = true;
+	bStateRequestInFlight = true;
+	if(Scheduler.IsValid())
+	{
+		Scheduler->SetBusy(ScheduleSlot, true);
+	}
+	OnStateSent.Broadcast(this);
+}
+
+/**
+ * @brief Callback for a gradient request, sends the newest gradient that was queued while we were waiting
+ * @param Request Signature for callback
+ * @param Response Signature for callback
+ * @param bWasSuccessful Signature for callback
+ */
+void AHueGradientLamp::OnResponseReceivedState(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful)
+{
+	Super::OnResponseReceivedState(Request, Response, bWasSuccessful);
+
+	//Strip went away, HoldForReconnect kept the whole gradient
+	if(!bReachable)
+	{
+		return;
+	}
+	if(bHasPendingGradient)
+	{
+		bHasPendingGradient = false;
+		if(PendingGradient != LastSentGradient)
+		{
+			CreateRequestGradient(PendingGradient, PendingTransition);
+		}
+	}
+}
+
+/**
+ * @brief Hold the whole gradient for the reconnect rather than the average the base lamp keeps :: Internal Call
+ */
+void AHueGradientLamp::HoldForReconnect()
+{
+	if(!bHasReconnectGradient)
+	{
+		if(Scheduler.IsValid())
+		{
+			if(DesiredGradient.Num() == PointCount)
+			{
+				ReconnectGradient = DesiredGradient;
+			}
+			else
+			{
+				MakeUniformGradient(Scheduler->GetDesired(ScheduleSlot), ReconnectGradient);
+			}
+		}
+		else
+		{
+			ReconnectGradient = bHasPendingGradient ? PendingGradient : LastSentGradient;
+		}
+		bHasReconnectGradient = true;
+	}
+	bHasPendingGradient = false;
+	Super::HoldForReconnect();
+}
+
+/**
+ * @brief Record a state the bridge already shows without sending anything, e.g. after a scene recall
+ * @param State FHueLampState every point is now showing
+ */
+void AHueGradientLamp::MarkStateFromBridge(const FHueLampState& State)
+{
+	Super::MarkStateFromBridge(State);
+	MakeUniformGradient(State, LastSentGradient);
+	DesiredGradient = LastSentGradient;
+	bHasPendingGradient = false;
+}
+
+/**
+ * @brief State the bridge reported for the strip. The bridge only reports one color, so the gradient we sent is
+ * kept unless the strip was changed from somewhere else
+ * @param State FHueLampState the bridge reported
+ * @param bIsReachable False if the bridge can't reach the strip
+ */
+void AHueGradientLamp::ApplyBridgeState(const FHueLampState& State, bool bIsReachable)
+{
+	const bool bReconnected = !bReachable && bIsReachable && bHasReconnectGradient;
+	if(bReconnected)
+	{
+		//The held gradient goes out below, not the average the base lamp would send
+		bHasReconnectState = false;
+	}
+	const bool bIdle = !bStateRequestInFlight && !bHasPendingGradient;
+	const bool bChangedElsewhere = bIdle && bHasSentState && State != AverageState(LastSentGradient);
+	Super::ApplyBridgeState(State, bIsReachable);
+	if(bChangedElsewhere)
+	{
+		MakeUniformGradient(State, LastSentGradient);
+	}
+
+	if(bReconnected)
+	{
+		//Only the bridge's report is known about the strip now, so a gradient that failed on the way out is wanted again
+		if(bIdle)
+		{
+			MakeUniformGradient(State, LastSentGradient);
+			DesiredGradient.Reset();
+		}
+		bHasReconnectGradient = false;
+		ReconnectFlushCount++;
+		UE_LOG(LogTemp, Log, TEXT("%s reachable again, sending held gradient"), *LampName);
+		ApplyGradientStates(ReconnectGradient);
+	}
+}
+
+/**
+ * @brief Quantize colors into strip points, every point shares the brightest color's brightness because the
+ * bridge only takes one brightness per light :: Internal Call
+ * @param Colors Colors from strip start to end, resampled when the count doesn't match the strip
+ * @param InIntensity float 0-1 scale applied on top of the colors
+ * @param GradientOut Quantized points
+ */
+void AHueGradientLamp::QuantizeGradient(TConstArrayView<FLinearColor> Colors, float InIntensity, TArray<FHueLampState>& GradientOut) const
+{
+	GradientOut.SetNum(PointCount);
+	float MaxValue = 0.0f;
+	for (const FLinearColor& Color : Colors)
+	{
+		MaxValue = FMath::Max(MaxValue, FMath::Max3(Color.R, Color.G, Color.B));
+	}
+	const FHueLampState Bright = FHueLampState::FromLinearColor(FLinearColor(MaxValue, MaxValue, MaxValue), InIntensity);
+
+	for (int32 Index = 0; Index < PointCount; ++Index)
+	{
+		const float Position = PointCount > 1 ? static_cast<float>(Index) / (PointCount - 1) * (Colors.Num() - 1) : 0.0f;
+		const int32 Lower = FMath::FloorToInt(Position);
+		const int32 Upper = FMath::Min(Lower + 1, Colors.Num() - 1);
+		const FLinearColor Color = FMath::Lerp(Colors[Lower], Colors[Upper], Position - Lower);
+
+		FHueLampState& Point = GradientOut[Index];
+		Point = FHueLampState::FromLinearColor(Color);
+		Point.Brightness = Bright.Brightness;
+		Point.bOn = Bright.bOn;
+	}
+}
+
+/**
+ * @brief Every point set to the same state :: Internal Call
+ */
+void AHueGradientLamp::MakeUniformGradient(const FHueLampState& State, TArray<FHueLampState>& GradientOut) const
+{
+	GradientOut.Init(State, PointCount);
+}
+
+/**
+ * @brief Average color of a gradient, what v1 bridges show and what the scheduler and broker see
+ * @param Gradient Quantized points
+ * @return FHueLampState with the shared brightness
+ */
+FHueLampState AHueGradientLamp::AverageState(TConstArrayView<FHueLampState> Gradient)
+{
+	if(Gradient.Num() == 0)
+	{
+		return FHueLampState();
+	}
+	FLinearColor Sum = FLinearColor::Transparent;
+	for (const FHueLampState& Point : Gradient)
+	{
+		FHueLampState Full = Point;
+		Full.bOn = true;
+		Full.Brightness = 254;
+		Sum += Full.ToLinearColor();
+	}
+	FHueLampState Average = FHueLampState::FromLinearColor(Sum / Gradient.Num());
+	Average.Brightness = Gradient[0].Brightness;
+	Average.bOn = Gradient[0].bOn;
+	return Average;
+}
+
+/**
+ * @brief Visible error between two gradients, the worst point decides
+ * @return float delta E, 0 if both gradients look the same
+ */
+float AHueGradientLamp::GradientDistance(TConstArrayView<FHueLampState> A, TConstArrayView<FHueLampState> B)
+{
+	if(A.Num() != B.Num())
+	{
+		//Point count changed, nothing to compare against so treat it as a full change
+		return 100.0f;
+	}
+	float Worst = 0.0f;
+	for (int32 Index = 0; Index < A.Num(); ++Index)
+	{
+		Worst = FMath::Max(Worst, FHueLampState::PerceptualDistance(A[Index], B[Index]));
+	}
+	return Worst;
+}
+
+/**
+ * @brief Sample a color curve evenly over its time range
+ * @param Curve Curve to sample
+ * @param Count Number of points
+ * @param ColorsOut Colors from the first key to the last
+ */
+void AHueGradientLamp::SampleCurve(const UCurveLinearColor* Curve, int32 Count, TArray<FLinearColor>& ColorsOut)
+{
+	ColorsOut.SetNum(Count);
+	float MinTime = 0.0f;
+	float MaxTime = 0.0f;
+	Curve->GetTimeRange(MinTime, MaxTime);
+	for (int32 Index = 0; Index < Count; ++Index)
+	{
+		const float Alpha = Count > 1 ? static_cast<float>(Index) / (Count - 1) : 0.0f;
+		ColorsOut[Index] = Curve->GetLinearColorValue(FMath::Lerp(MinTime, MaxTime, Alpha));
+	}
+}
+
+/**
+ * @brief Sample a color curve along a spline, points are spaced evenly by distance and the curve is keyed in
+ * spline input key space so key 1 is the color at the second spline point
+ * @param InSpline Spline the strip follows
+ * @param Curve Curve keyed by spline input key
+ * @param Count Number of points
+ * @param ColorsOut Colors from the spline start to end
+ */
+void AHueGradientLamp::SampleSpline(const USplineComponent* InSpline, const UCurveLinearColor* Curve, int32 Count, TArray<FLinearColor>& ColorsOut)
+{
+	ColorsOut.SetNum(Count);
+	const float Length = InSpline->GetSplineLength();
+	for (int32 Index = 0; Index < Count; ++Index)
+	{
+		const float Alpha = Count > 1 ? static_cast<float>(Index) / (Count - 1) : 0.0f;
+		//Distance to input key goes through the spline's reparam table
+		const float InputKey = InSpline->SplineCurves.ReparamTable.Eval(Alpha * Length, 0.0f);
+		ColorsOut[Index] = Curve->GetLinearColorValue(InputKey);
+	}
+}
+
+/**
+ * @brief Show a color curve on the strip, sampled over the curve's time range
+ * @param Curve UCurveLinearColor to sample, nullptr stops sampling
+ */
+void AHueGradientLamp::SetGradientCurve(UCurveLinearColor* Curve)
+{
+	GradientCurve = Curve;
+	Spline = nullptr;
+	UpdateSampling();
+}
+
+/**
+ * @brief Follow a spline with the strip, the curve gives the color at every spline input key
+ * @param InSpline USplineComponent the strip follows
+ * @param Curve UCurveLinearColor keyed by spline input key
+ */
+void AHueGradientLamp::SetSplineSource(USplineComponent* InSpline, UCurveLinearColor* Curve)
+{
+	Spline = InSpline;
+	GradientCurve = Curve;
+	UpdateSampling();
+}
+
+/**
+ * @brief Stop sampling, the strip keeps its last gradient
+ */
+void AHueGradientLamp::ClearGradientSource()
+{
+	GradientCurve = nullptr;
+	Spline = nullptr;
+	UpdateSampling();
+}
+
+/**
+ * @brief Set how many color points the strip has
+ * @param Count int32 point count, the bridge reports it on discovery
+ */
+void AHueGradientLamp::SetPointCount(int32 Count)
+{
+	PointCount = FMath::Max(Count, 1);
+}
+
+/**
+ * @brief Tick only while there is something to sample :: Internal Call
+ */
+void AHueGradientLamp::UpdateSampling()
+{
+	SetActorTickInterval(1.0f / FMath::Max(SampleRate, 0.1f));
+	SetActorTickEnabled(GradientCurve != nullptr);
+}
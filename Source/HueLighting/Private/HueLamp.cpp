@@ -5,6 +5,8 @@ Copyright (c) 2022 Scott Tongue all rights reversed
 #include "HueLamp.h"
 #include "HttpModule.h"
 #include "HueBridge.h"
+#include "HueSendScheduler.h"
+#include "HueTransport.h"
 #include "Dom/JsonObject.h"
 #include "Interfaces/IHttpRequest.h"
 #include "Interfaces/IHttpResponse.h"
@@ -12,8 +14,6 @@ Copyright (c) 2022 Scott Tongue all rights reversed
 #include "Kismet/KismetMathLibrary.h"
 #include "Math/Color.h"
 
-const static FString VERB_PUT = TEXT("PUT");
-
 // Sets default values
 AHueLamp::AHueLamp()
 {
@@ -80,6 +80,22 @@ FVector AHueLamp::CovertRGBToHSV(const FColor &RGB)
 	return  FVector(Hue, Saturation, Brightness);;
 }
 
+/**
+ * @brief Quantize the output of CovertRGBToHSV into a lamp state :: Internal Call
+ * @param HSV FVector with X as Hue in degrees, Y as Sat 0-1 and Z as Bri 0-255
+ * @return Lamp state with the bridge value ranges, off when the brightness rounds down to 0
+ */
+FHueLampState AHueLamp::HSVToState(const FVector& HSV)
+{
+	FHueLampState State;
+	// Magic numbers are the hue bridge max values, Hue 65535,Sat 254 Bri 254
+	State.Hue = FMath::Clamp(FMath::RoundToInt(HSV.X / 360 * 65535), 0, 65535);
+	State.Saturation = FMath::Clamp(FMath::RoundToInt(HSV.Y * 254), 0, 254);
+	State.Brightness = FMath::Clamp(FMath::RoundToInt(HSV.Z / 255 * 254), 0, 254);
+	State.bOn = State.Brightness > 0;
+	return State;
+}
+
 FColor AHueLamp::ConvertHSVToRGB( int32 Hue,  int32 Saturation,  int32 Brightness)
 {
 	FColor RGB;
@@ -90,106 +106,27 @@ FColor AHueLamp::ConvertHSVToRGB( int32 Hue,  int32 Saturation,  int32 Brightnes
 }
 
 /**
- * @brief Create Hue Light Lamp Brightness REST API Call request  :: Internal Call
- * @param Bri int32 brightness level
+ * @brief Create HTTP REST API Call with a full quantized lamp state :: Internal Call
+ * @param State FHueLampState state to send to the lamp
+ * @param TransitionTime Fade time of this request in 100ms steps, negative leaves the bridge default
  */
-void AHueLamp::CreateRequestBrightness(int32 Bri)
+void AHueLamp::CreateRequestState(const FHueLampState& State, int32 TransitionTime)
 {
-	//if Bri is set to 0 light is off, and set data to be turn off only to save payload size
-	if(Bri <= 0)
-	{
-		CreateRequestTurnLightOnOff(false);
-		return; 
-	}
-	
-	//Setup HTTP REST CALL 
-	const TSharedRef<IHttpRequest> Request = HTTPHandler->Get().CreateRequest();
-	const FString URL = DevicePath;
-	const TSharedRef<FJsonObject> RequestOBJ = MakeShared<FJsonObject>();
-	
-	//Fill out JSON DATA
-	RequestOBJ->SetBoolField(TEXT("on"), true);
-	RequestOBJ->SetNumberField(TEXT("bri"),Bri);
-	
-	//Serialize Data
-	FString RequestBody;
-	const TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&RequestBody);
-	FJsonSerializer::Serialize(RequestOBJ, Writer);
-	
-	Request->SetURL(URL);
-	Request->SetVerb(VERB_PUT);
-	Request->SetHeader("Content-Type", TEXT("application/json"));
-	Request->SetContentAsString(RequestBody);
+	//Setup HTTP REST CALL and Completed Request Delegate 
+	const TSharedRef<IHttpRequest> Request = Transport->CreateSetLight(DeviceKey, FHueLightCommand::FromState(State, TransitionTime));
+	Request->OnProcessRequestComplete().BindUObject(this, &AHueLamp::OnResponseReceivedState);
 	Request->ProcessRequest();
-	
-	bInUse = false;
-}
+	StateSentTime = FPlatformTime::Seconds();
 
-/**
- * @brief Create Hue Light Lamp Color Rest API request with HSV format :: Internal Call
- * @param HSV FVector with color data formatted in HSV
- */
-void AHueLamp::CreateRequestColor(const FVector& HSV)
-{
-	//if Bri is set to 0 light is off, and set data to be turn off only to save payload size
-	if(static_cast<int32>(HSV.Z * 255) <= 0)
+	LastSentState = State;
+	LampColor = State.ToColor();
+	bHasSentState = true;
+	bStateRequestInFlight = true;
+	if(Scheduler.IsValid())
 	{
-		CreateRequestTurnLightOnOff(false);
-		return; 
+		Scheduler->SetBusy(ScheduleSlot, true);
 	}
-	
-	//Setup HTTP REST CALL  
-	const TSharedRef<IHttpRequest> Request = HTTPHandler->Get().CreateRequest();
-	const FString URL = DevicePath;
-	const TSharedRef<FJsonObject> RequestOBJ = MakeShared<FJsonObject>();
-
-	//Fill out JSON DATA
-	RequestOBJ->SetBoolField(TEXT("on"), true);
-	// Magic numbers are the hue bridge max values, Hue 65535,Sat 254 Bri 254
-	RequestOBJ->SetNumberField(TEXT("hue"),static_cast<int32>(HSV.X / 360 * 65535));
-	RequestOBJ->SetNumberField(TEXT("sat"),static_cast<int32>(HSV.Y * 254));
-	RequestOBJ->SetNumberField(TEXT("bri"),static_cast<int32>(HSV.Z * 254));
-	
-	//Serialize Data
-	FString RequestBody;
-	const TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&RequestBody);
-	FJsonSerializer::Serialize(RequestOBJ, Writer);
-	
-	Request->SetURL(URL);
-	Request->SetVerb(VERB_PUT);
-	Request->SetHeader("Content-Type", TEXT("application/json"));
-	Request->SetContentAsString(RequestBody);
-	Request->ProcessRequest();
-	
-	bInUse = false;
-}
-
-/**
- * @brief Create HTTP REST API Call to turn Hue Light Lamp on or off
- * @param bTurnOn boolean set true to make Hue Light Lamp turn on
- */
-void AHueLamp::CreateRequestTurnLightOnOff(bool bTurnOn)
-{
-	//Setup HTTP REST CALL  
-	const TSharedRef<IHttpRequest> Request = HTTPHandler->Get().CreateRequest();
-	const FString URL = DevicePath;
-	const TSharedRef<FJsonObject> RequestOBJ = MakeShared<FJsonObject>();
-	
-	//Fill out JSON DATA
-	RequestOBJ->SetBoolField(TEXT("on"), bTurnOn);
-	
-	//Serialize Data
-	FString RequestBody;
-	const TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&RequestBody);
-	FJsonSerializer::Serialize(RequestOBJ, Writer);
-	
-	Request->SetURL(URL);
-	Request->SetVerb(VERB_PUT);
-	Request->SetHeader("Content-Type", TEXT("application/json"));
-	Request->SetContentAsString(RequestBody);
-	Request->ProcessRequest();
-	
-	bInUse = false;
+	OnStateSent.Broadcast(this);
 }
 
 /**
@@ -200,31 +137,69 @@ void AHueLamp::CreateRequestTurnLightOnOff(bool bTurnOn)
  */
 void AHueLamp::OnResponseTest(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful)
 {
+	//A timed out request has no response
+	if(!bWasSuccessful || !Response.IsValid())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("%s request failed"), *LampName);
+		return;
+	}
 	const FString Data = Response->GetContentAsString();
 	UE_LOG(LogTemp, Warning, TEXT("%s"),*Data);
 }
 
 void AHueLamp::OnResponseReceivedGetLightColor(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful)
 {
-	const FString Data = Response->GetContentAsString();
-	
-	TSharedPtr<FJsonObject> ResponseObj = MakeShareable(new FJsonObject);
-	const TSharedRef<TJsonReader<>> JsonReader = TJsonReaderFactory<>::Create(Response->GetContentAsString());
-		
-	if(! FJsonSerializer::Deserialize(JsonReader, ResponseObj))
+	FHueLightRecord Light;
+	if(!bWasSuccessful || !Response.IsValid() || !Transport->ParseLight(DeviceKey, Response->GetContentAsString(), Light))
 	{
-			UE_LOG(LogTemp, Warning, TEXT("FAILED TO Deserialize %s Get Color"), *LampName);
+		UE_LOG(LogTemp, Warning, TEXT("FAILED TO Deserialize %s Get Color"), *LampName);
 	}
 	else
 	{
-		int32 Bri = ResponseObj->GetNumberField(TEXT("bri"));
-		int32 Hue = ResponseObj->GetNumberField(TEXT("hue"));
-		int32 Sat = ResponseObj->GetNumberField(TEXT("sat"));
+		ApplyBridgeState(Light.State, Light.bReachable);
 	}
 	bInUse =false;
 }
 
 
+/**
+ * @brief Callback for a native state request, sends the newest state that was queued while we were waiting
+ * @param Request Signature for callback 
+ * @param Response Signature for callback 
+ * @param bWasSuccessful Signature for callback 
+ */
+void AHueLamp::OnResponseReceivedState(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful)
+{
+	bStateRequestInFlight = false;
+	if(Scheduler.IsValid())
+	{
+		Scheduler->SetBusy(ScheduleSlot, false);
+	}
+	if(bWasSuccessful)
+	{
+		const float LatencyMs = static_cast<float>((FPlatformTime::Seconds() - StateSentTime) * 1000.0);
+		StateLatencyMs = StateLatencyMs <= 0.0f ? LatencyMs : FMath::Lerp(StateLatencyMs, LatencyMs, 0.1f);
+	}
+	OnStateAcknowledged.Broadcast(this);
+
+	//Resource not available or device can't take the change, hold everything until the bridge reports it back
+	if(Transport->IsUnreachableError(Response))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("%s unreachable, holding commands until it returns"), *LampName);
+		bReachable = false;
+		HoldForReconnect();
+		return;
+	}
+	if(bHasPendingState)
+	{
+		bHasPendingState = false;
+		if(PendingState != LastSentState)
+		{
+			CreateRequestState(PendingState, PendingTransition);
+		}
+	}
+}
+
 // Called every frame
 void AHueLamp::Tick(float DeltaTime)
 {
@@ -234,13 +209,13 @@ void AHueLamp::Tick(float DeltaTime)
 
 /**
  * @brief Setup Hue Lamp Data
- * @param Path FString URL path to the lamp device on the bridge
- * @param Key  FString Key for the lamp Device
+ * @param InTransport Transport of the bridge the lamp belongs to
+ * @param Key  FString resource id of the lamp on the bridge, light number on v1 and resource id on CLIP v2
  * @param Name Fstring Name of the device
  */
-void AHueLamp::SetupLamp(const FString& Path, const FString& Key,const FString &Name)
+void AHueLamp::SetupLamp(const TSharedPtr<IHueTransport>& InTransport, const FString& Key,const FString &Name)
 {
-	DevicePath = Path;
+	Transport = InTransport;
 	DeviceKey = Key;
 	LampName = Name;
 	bHasBeenConfigured =true;
@@ -255,61 +230,271 @@ void AHueLamp::GetLightColor()
 
 	bInUse = true;
 	//Setup HTTP REST CALL and Completed Request Delegate 
-	const TSharedRef<IHttpRequest> Request = HTTPHandler->Get().CreateRequest();
-//	Request->OnProcessRequestComplete().BindUObject(this, &AHueLamp::OnResponseReceivedGetLightColor);
-	const FString URL = DevicePath;
-	
-	TSharedRef<FJsonObject> RequestOBJ = MakeShared<FJsonObject>();
-
-	//Serialize Data
-	FString RequestBody;
-	const TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&RequestBody);
-	FJsonSerializer::Serialize(RequestOBJ, Writer);
-	
-	Request->SetURL(URL);
-	Request->SetVerb(VERB_GET);
-	Request->SetHeader("Content-Type", TEXT("application/json"));
+	const TSharedRef<IHttpRequest> Request = Transport->CreateGetLight(DeviceKey);
+	Request->OnProcessRequestComplete().BindUObject(this, &AHueLamp::OnResponseReceivedGetLightColor);
 	Request->ProcessRequest();
-	
 }
 
 /**
- * @brief Turn the Hue Light lamp on or off 
+ * @brief Turn the Hue Light lamp on or off, goes through the bridge's send scheduler like every other change
  * @param bTurnOn boolean Turn light on or off true is on
  */
 void AHueLamp::TurnLightOnOff(bool bTurnOn)
 {
-	if(CheckInUse())
-		return;
-	
-	bInUse = true;
-	CreateRequestTurnLightOnOff(bTurnOn);
+	FHueLampState State = GetCommandBaseState();
+	State.bOn = bTurnOn;
+	//An off lamp holds no brightness, come back at what the bridge last showed
+	if(bTurnOn && State.Brightness <= 0)
+	{
+		State.Brightness = BridgeState.Brightness > 0 ? BridgeState.Brightness : 254;
+	}
+	ApplyState(State);
 }
 
 /**
- * @brief Set the color of the Lamp
+ * @brief Set the color of the Lamp, alpha is the brightness
  * @param Color FColor of the color to be set
  */
 void AHueLamp::SetColor(const FColor &Color)
 {
-	if(CheckInUse())
-		return;
-	
-	bInUse = true;
-	CreateRequestColor(CovertRGBToHSV(Color));
+	ApplyState(HSVToState(CovertRGBToHSV(Color)));
 }
 
 /**
- * @brief Check to see if we are using lamp to prevent a flood of requests
+ * @brief Set the brightness of the Lamp and keep its color, 0 turns it off
  * @param Brightness int32 brightness value
  */
 void AHueLamp::SetBrightness(const int32 Brightness)
 {
-	if(CheckInUse())
+	FHueLampState State = GetCommandBaseState();
+	State.Brightness = FMath::Clamp(Brightness, 0, 254);
+	State.bOn = State.Brightness > 0;
+	ApplyState(State);
+}
+
+/**
+ * @brief State a partial change starts from, the held state while unreachable else the newest desired state :: Internal Call
+ */
+FHueLampState AHueLamp::GetCommandBaseState() const
+{
+	return bHasReconnectState ? ReconnectState : GetDesiredState();
+}
+
+/**
+ * @brief Native path for high rate callers, only sends when the quantized state changes and never drops the
+ * latest state. While a request is in flight the newest state is held and sent once the bridge answers
+ * @param State FHueLampState quantized state to show on the lamp
+ * @param TransitionTime Fade to this state in 100ms steps, negative leaves the bridge default. Only this state fades
+ * with it, later states go back to whatever they ask for
+ * @return True if the state differs from what the lamp is showing or about to show
+ */
+bool AHueLamp::ApplyState(const FHueLampState& State, int32 TransitionTime)
+{
+	if(!bHasBeenConfigured)
+	{
+		return false;
+	}
+	if(!bReachable)
+	{
+		SuppressUntilReachable(State);
+		return false;
+	}
+
+	//Scheduled lamps only record what they want, the bridge decides when it goes out
+	if(Scheduler.IsValid())
+	{
+		const FHueLampState& Desired = Scheduler->GetDesired(ScheduleSlot);
+		if(bHasSentState && Desired == State)
+		{
+			return false;
+		}
+		const double Now = FPlatformTime::Seconds();
+		Scheduler->SetDesired(ScheduleSlot, State, Now, TransitionTime);
+		if(!bHasSentState)
+		{
+			//Nothing known about the lamp yet, make sure even an off state goes out
+			Scheduler->SetDesiredError(ScheduleSlot, FMath::Max(FHueLampState::PerceptualDistance(State, LastSentState), 1.0f), Now);
+		}
+		return true;
+	}
+	
+	if(bStateRequestInFlight)
+	{
+		const FHueLampState& Queued = bHasPendingState ? PendingState : LastSentState;
+		if(Queued == State)
+		{
+			return false;
+		}
+		PendingState = State;
+		PendingTransition = TransitionTime;
+		bHasPendingState = true;
+		return true;
+	}
+
+	if(bHasSentState && LastSentState == State)
+	{
+		return false;
+	}
+	CreateRequestState(State, TransitionTime);
+	return true;
+}
+
+/**
+ * @brief State the lamp is heading to, what the scheduler holds or what was last asked for
+ * @return Newest state this lamp was given
+ */
+FHueLampState AHueLamp::GetDesiredState() const
+{
+	if(Scheduler.IsValid())
+	{
+		return Scheduler->GetDesired(ScheduleSlot);
+	}
+	return bHasPendingState ? PendingState : LastSentState;
+}
+
+/**
+ * @brief Record a state the bridge already shows without sending anything, e.g. after a scene recall
+ * @param State FHueLampState the lamp is now in
+ */
+void AHueLamp::MarkStateFromBridge(const FHueLampState& State)
+{
+	LastSentState = State;
+	LampColor = State.ToColor();
+	bHasSentState = true;
+	bHasPendingState = false;
+	if(Scheduler.IsValid())
+	{
+		Scheduler->SetDesired(ScheduleSlot, State, FPlatformTime::Seconds());
+		Scheduler->SyncSent(ScheduleSlot, State);
+	}
+}
+
+/**
+ * @brief Send the state the scheduler holds for this lamp, called by the bridge when the lamp gets a send slot
+ */
+void AHueLamp::SendDesiredState()
+{
+	if(!Scheduler.IsValid() || bStateRequestInFlight)
+	{
+		return;
+	}
+	if(!bReachable)
+	{
+		HoldForReconnect();
 		return;
+	}
+	CreateRequestState(Scheduler->GetDesired(ScheduleSlot), Scheduler->GetDesiredTransition(ScheduleSlot));
+	Scheduler->MarkSent(ScheduleSlot, FPlatformTime::Seconds());
+}
 
-	bInUse = true;
-	CreateRequestBrightness(Brightness);
+/**
+ * @brief Hand the lamp the bridge's send scheduler
+ * @param InScheduler Scheduler shared by every lamp on the bridge
+ * @param Slot Slot index for this lamp
+ */
+void AHueLamp::SetScheduler(const TSharedPtr<FHueSendScheduler>& InScheduler, int32 Slot)
+{
+	Scheduler = InScheduler;
+	ScheduleSlot = Slot;
+	if(Scheduler.IsValid())
+	{
+		Scheduler->SetImportance(ScheduleSlot, Importance);
+		if(bHasSentState)
+		{
+			Scheduler->SyncSent(ScheduleSlot, LastSentState);
+		}
+	}
+}
+
+/**
+ * @brief Set how much this lamp's error counts against the other lamps on the bridge
+ * @param NewImportance float weight, 1 is normal
+ */
+void AHueLamp::SetImportance(float NewImportance)
+{
+	Importance = FMath::Max(NewImportance, 0.0f);
+	if(Scheduler.IsValid())
+	{
+		Scheduler->SetImportance(ScheduleSlot, Importance);
+	}
+}
+
+/**
+ * @brief State the bridge reported for this lamp, from the bulk /lights read or a single lamp read.
+ * The first report is kept as the start state. It only replaces what we think we sent when nothing is on the way
+ * @param State FHueLampState the bridge reported
+ * @param bIsReachable False if the bridge can't reach the lamp
+ */
+void AHueLamp::ApplyBridgeState(const FHueLampState& State, bool bIsReachable)
+{
+	BridgeState = State;
+	const bool bReconnected = !bReachable && bIsReachable;
+	const bool bLost = bReachable && !bIsReachable;
+	bReachable = bIsReachable;
+	if(!bHasStartState)
+	{
+		StartState = State;
+		StartColor = State.ToColor();
+		bHasStartState = true;
+	}
+	if(!bStateRequestInFlight && !bHasPendingState)
+	{
+		LastSentState = State;
+		LampColor = State.ToColor();
+		bHasSentState = true;
+		if(Scheduler.IsValid())
+		{
+			Scheduler->SyncSent(ScheduleSlot, State);
+		}
+	}
+
+	if(bLost)
+	{
+		HoldForReconnect();
+	}
+	//The slot sat out the scheduler while the lamp was gone
+	if(bReconnected && Scheduler.IsValid() && !bStateRequestInFlight)
+	{
+		Scheduler->SetBusy(ScheduleSlot, false);
+	}
+
+	//Everything held while the lamp was gone goes out once, as the newest state only
+	if(bReconnected && bHasReconnectState)
+	{
+		bHasReconnectState = false;
+		ReconnectFlushCount++;
+		UE_LOG(LogTemp, Log, TEXT("%s reachable again, sending held state"), *LampName);
+		ApplyState(ReconnectState);
+	}
+}
+
+/**
+ * @brief The lamp went unreachable. Keep the newest state it was given for the reconnect, for scheduled lamps that is
+ * what the scheduler holds, and take the slot out of the scheduler so no send slot is spent on it :: Internal Call
+ */
+void AHueLamp::HoldForReconnect()
+{
+	if(!bHasReconnectState)
+	{
+		ReconnectState = GetDesiredState();
+		bHasReconnectState = true;
+	}
+	bHasPendingState = false;
+	if(Scheduler.IsValid())
+	{
+		Scheduler->SetBusy(ScheduleSlot, true);
+	}
+}
+
+/**
+ * @brief Fold a command for an unreachable lamp into the state to send once it returns :: Internal Call
+ * @param State FHueLampState the lamp should show when it is reachable again
+ */
+void AHueLamp::SuppressUntilReachable(const FHueLampState& State)
+{
+	ReconnectState = State;
+	bHasReconnectState = true;
+	SuppressedCommandCount++;
 }
 
 /**
@@ -0,0 +1,177 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueLampBinding.h"
+#include "EngineUtils.h"
+#include "HueBridge.h"
+#include "HueLamp.h"
+#include "HueLighting.h"
+#include "Components/LightComponent.h"
+#include "Materials/MaterialParameterCollection.h"
+#include "Materials/MaterialParameterCollectionInstance.h"
+
+DECLARE_CYCLE_STAT(TEXT("Hue Binding Sample"), STAT_HueBindingSample, STATGROUP_HueLighting);
+
+UHueLampBindingComponent::UHueLampBindingComponent()
+{
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.bStartWithTickEnabled = true;
+	// Sampling only reads finished frame data so it can run after everything else has moved
+	PrimaryComponentTick.TickGroup = TG_PostUpdateWork;
+}
+
+void UHueLampBindingComponent::BeginPlay()
+{
+	Super::BeginPlay();
+	SetSampleRate(SampleRate);
+
+	if(!Bridge)
+	{
+		for (TActorIterator<AHueBridge> It(GetWorld()); It; ++It)
+		{
+			Bridge = *It;
+			break;
+		}
+	}
+
+	if(!SourceLight.IsValid())
+	{
+		const AActor* Actor = SourceActor ? SourceActor.Get() : GetOwner();
+		if(Actor)
+		{
+			SourceLight = Actor->FindComponentByClass<ULightComponent>();
+		}
+	}
+}
+
+/**
+ * @brief Sample the bound source and pass it on to the lamp only when the quantized state changed
+ */
+void UHueLampBindingComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+	UpdateLamp();
+}
+
+/**
+ * @brief Sample the source once and hand the lamp the state if it changed since the last state the lamp took
+ * @return True if the lamp took a new state
+ */
+bool UHueLampBindingComponent::UpdateLamp()
+{
+	SCOPE_CYCLE_COUNTER(STAT_HueBindingSample);
+
+	FHueLampState State;
+	if(!SampleSource(State))
+	{
+		return false;
+	}
+	if(bHasLastState && State == LastState)
+	{
+		return false;
+	}
+
+	AHueLamp* Lamp = ResolveLamp();
+	if(!Lamp)
+	{
+		return false;
+	}
+	//A state the lamp turned down, e.g. before it is configured, is offered again on the next sample
+	if(!Lamp->ApplyState(State))
+	{
+		return false;
+	}
+	LastState = State;
+	bHasLastState = true;
+	return true;
+}
+
+/**
+ * @brief Set the light component to mirror on to the lamp
+ * @param Light ULightComponent to sample
+ */
+void UHueLampBindingComponent::SetSourceLight(ULightComponent* Light)
+{
+	SourceLight = Light;
+	Source = EHueBindingSource::LightComponent;
+	bHasLastState = false;
+}
+
+/**
+ * @brief Set how many times a second the source is sampled
+ * @param Rate float samples per second
+ */
+void UHueLampBindingComponent::SetSampleRate(float Rate)
+{
+	SampleRate = FMath::Max(Rate, 0.1f);
+	SetComponentTickInterval(1.0f / SampleRate);
+}
+
+/**
+ * @brief Bind to a lamp directly, the lamp name follows it so the bridge lookup is skipped
+ * @param Lamp AHueLamp to drive
+ */
+void UHueLampBindingComponent::SetLamp(AHueLamp* Lamp)
+{
+	BoundLamp = Lamp;
+	LampName = Lamp ? Lamp->GetLampName() : FString();
+	bHasLastState = false;
+}
+
+/**
+ * @brief Read the source property and quantize it :: Internal Call
+ * @param StateOut FHueLampState out param to be filled
+ * @return False if the source is missing
+ */
+bool UHueLampBindingComponent::SampleSource(FHueLampState& StateOut) const
+{
+	if(Source == EHueBindingSource::LightComponent)
+	{
+		const ULightComponent* Light = SourceLight.Get();
+		if(!Light)
+		{
+			return false;
+		}
+		const float Intensity = Light->IsVisible() ? Light->Intensity / MaxIntensity : 0.0f;
+		StateOut = FHueLampState::FromLinearColor(Light->GetLightColor(), Intensity);
+		return true;
+	}
+
+	if(!ParameterCollection || ColorParameterName.IsNone())
+	{
+		return false;
+	}
+	const UMaterialParameterCollectionInstance* Instance = GetWorld()->GetParameterCollectionInstance(ParameterCollection);
+	FLinearColor Color;
+	if(!Instance || !Instance->GetVectorParameterValue(ColorParameterName, Color))
+	{
+		return false;
+	}
+	float Intensity = 1.0f;
+	if(!IntensityParameterName.IsNone())
+	{
+		Instance->GetScalarParameterValue(IntensityParameterName, Intensity);
+	}
+	StateOut = FHueLampState::FromLinearColor(Color, Intensity);
+	return true;
+}
+
+/**
+ * @brief Find the lamp by name on the bridge, lamps are spawned by discovery so this can fail until then
+ * @return Pointer to the bound Hue Lamp or nullptr
+ */
+AHueLamp* UHueLampBindingComponent::ResolveLamp()
+{
+	if(BoundLamp.IsValid() && BoundLamp->GetLampName() == LampName)
+	{
+		return BoundLamp.Get();
+	}
+	if(!Bridge)
+	{
+		return nullptr;
+	}
+	BoundLamp = Bridge->GetLamp(LampName);
+	return BoundLamp.Get();
+}
@@ -0,0 +1,277 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueReplication.h"
+#include "HueBridge.h"
+#include "HueLamp.h"
+#include "EngineUtils.h"
+#include "Net/UnrealNetwork.h"
+#include "Serialization/BitReader.h"
+#include "Serialization/BitWriter.h"
+
+void FHueReplicatedLight::PostReplicatedAdd(const FHueReplicatedLightArray& InArraySerializer)
+{
+	if(InArraySerializer.Owner)
+	{
+		InArraySerializer.Owner->OnLightReplicated(*this);
+	}
+}
+
+void FHueReplicatedLight::PostReplicatedChange(const FHueReplicatedLightArray& InArraySerializer)
+{
+	if(InArraySerializer.Owner)
+	{
+		InArraySerializer.Owner->OnLightReplicated(*this);
+	}
+}
+
+/**
+ * @brief Pack a light into bridge sized fields. An off light is only its id and one bit, its color can't be seen.
+ * Ids are never negative, SetLightState turns those away, so the id goes packed unsigned
+ * @param Ar Archive to read or write
+ * @param Map Signature for net serializers
+ * @param bOutSuccess True if the light was read or written
+ * @return True, the light always serializes itself
+ */
+bool FHueReplicatedLight::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	uint32 Id = static_cast<uint32>(FMath::Max(LightId, 0));
+	Ar.SerializeIntPacked(Id);
+	if(Ar.IsLoading() && Id > static_cast<uint32>(MAX_int32))
+	{
+		Ar.SetError();
+	}
+	uint8 bOn = State.bOn ? 1 : 0;
+	Ar.SerializeBits(&bOn, 1);
+	//255 stands for the bridge default fade
+	uint8 Transition = TransitionTime < 0 ? 255 : static_cast<uint8>(FMath::Min(TransitionTime, 254));
+	Ar << Transition;
+	uint16 Hue = static_cast<uint16>(FMath::Clamp(State.Hue, 0, 65535));
+	uint8 Saturation = static_cast<uint8>(FMath::Clamp(State.Saturation, 0, 254));
+	uint8 Brightness = static_cast<uint8>(FMath::Clamp(State.Brightness, 0, 254));
+	if(bOn)
+	{
+		Ar << Hue;
+		Ar << Saturation;
+		Ar << Brightness;
+	}
+	if(Ar.IsLoading() && !Ar.IsError())
+	{
+		LightId = static_cast<int32>(Id);
+		State.bOn = bOn != 0;
+		State.Hue = bOn ? Hue : 0;
+		State.Saturation = bOn ? Saturation : 0;
+		State.Brightness = bOn ? Brightness : 0;
+		TransitionTime = Transition == 255 ? -1 : Transition;
+	}
+	bOutSuccess = !Ar.IsError();
+	return true;
+}
+
+/**
+ * @brief Fast array delta, counting the bits it reads and writes so the component can report its bandwidth
+ */
+bool FHueReplicatedLightArray::NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms)
+{
+	const int64 WriterStart = DeltaParms.Writer ? DeltaParms.Writer->GetNumBits() : 0;
+	const int64 ReaderStart = DeltaParms.Reader ? DeltaParms.Reader->GetPosBits() : 0;
+	const bool bResult = FFastArraySerializer::FastArrayDeltaSerialize<FHueReplicatedLight, FHueReplicatedLightArray>(Lights, DeltaParms, *this);
+	if(Owner)
+	{
+		if(DeltaParms.Writer)
+		{
+			Owner->CountBits(DeltaParms.Writer->GetNumBits() - WriterStart, true);
+		}
+		if(DeltaParms.Reader)
+		{
+			Owner->CountBits(DeltaParms.Reader->GetPosBits() - ReaderStart, false);
+		}
+	}
+	return bResult;
+}
+
+UHueLightingReplicationComponent::UHueLightingReplicationComponent()
+{
+	//Only ticks to roll the bandwidth window over
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.TickInterval = 1.0f;
+	SetIsReplicatedByDefault(true);
+	ReplicatedLights.Owner = this;
+}
+
+void UHueLightingReplicationComponent::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+	DOREPLIFETIME(UHueLightingReplicationComponent, ReplicatedLights);
+}
+
+void UHueLightingReplicationComponent::BeginPlay()
+{
+	Super::BeginPlay();
+	ReplicatedLights.Owner = this;
+	WindowStart = FPlatformTime::Seconds();
+	if(!Bridge && GetWorld())
+	{
+		TActorIterator<AHueBridge> It(GetWorld());
+		Bridge = It ? *It : nullptr;
+	}
+}
+
+void UHueLightingReplicationComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+	const double Now = FPlatformTime::Seconds();
+	if(Now - WindowStart >= 1.0)
+	{
+		Stats.BytesPerSecond = static_cast<float>(WindowBits / 8.0 / (Now - WindowStart));
+		WindowBits = 0;
+		WindowStart = Now;
+	}
+	//Lamps discovered after their light arrived get it now
+	if(UnresolvedLights.Num() > 0)
+	{
+		const TArray<int32> Waiting = UnresolvedLights.Array();
+		UnresolvedLights.Reset();
+		for (const FHueReplicatedLight& Light : ReplicatedLights.Lights)
+		{
+			if(Waiting.Contains(Light.LightId))
+			{
+				ApplyLight(Light, false);
+			}
+		}
+	}
+}
+
+/**
+ * @brief Server sets a logical light. Nothing goes on the wire unless the quantized state changed
+ * @param LightId Logical light, the same on every machine, 0 or more
+ * @param State State every machine should show
+ * @param TransitionTime Fade time in 100ms steps, negative leaves the bridge default
+ */
+void UHueLightingReplicationComponent::SetLightState(int32 LightId, const FHueLampState& State, int32 TransitionTime)
+{
+	if(!GetOwner() || !GetOwner()->HasAuthority())
+	{
+		return;
+	}
+	if(LightId < 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Hue light id %d is negative, logical light ids start at 0"), LightId);
+		return;
+	}
+	FHueReplicatedLight* Light = ReplicatedLights.Lights.FindByPredicate([LightId](const FHueReplicatedLight& Item) { return Item.LightId == LightId; });
+	if(!Light)
+	{
+		Light = &ReplicatedLights.Lights.AddDefaulted_GetRef();
+		Light->LightId = LightId;
+	}
+	else if(Light->State == State)
+	{
+		return;
+	}
+	Light->State = State;
+	Light->TransitionTime = TransitionTime;
+	ReplicatedLights.MarkItemDirty(*Light);
+	Stats.LightChanges++;
+	if(bApplyOnServer && GetNetMode() != NM_DedicatedServer)
+	{
+		ApplyLight(*Light);
+	}
+}
+
+void UHueLightingReplicationComponent::SetLightColor(int32 LightId, const FLinearColor& Color, float Intensity, int32 TransitionTime)
+{
+	SetLightState(LightId, FHueLampState::FromLinearColor(Color, Intensity), TransitionTime);
+}
+
+void UHueLightingReplicationComponent::RemoveLight(int32 LightId)
+{
+	if(!GetOwner() || !GetOwner()->HasAuthority())
+	{
+		return;
+	}
+	if(ReplicatedLights.Lights.RemoveAll([LightId](const FHueReplicatedLight& Item) { return Item.LightId == LightId; }) > 0)
+	{
+		ReplicatedLights.MarkArrayDirty();
+	}
+}
+
+/**
+ * @brief Replace the logical to physical mapping and show the current lights on the new lamps
+ * @param Map Logical light to lamp name on this machine
+ */
+void UHueLightingReplicationComponent::SetLightMap(const TArray<FHueLightMapping>& Map)
+{
+	LightMap = Map;
+	MappedLamps.Reset();
+	UnresolvedLights.Reset();
+	for (const FHueReplicatedLight& Light : ReplicatedLights.Lights)
+	{
+		ApplyLight(Light, false);
+	}
+}
+
+void UHueLightingReplicationComponent::OnLightReplicated(const FHueReplicatedLight& Light)
+{
+	Stats.LightChanges++;
+	ApplyLight(Light);
+}
+
+void UHueLightingReplicationComponent::CountBits(int64 Bits, bool bSent)
+{
+	const int32 Bytes = static_cast<int32>((Bits + 7) / 8);
+	if(bSent)
+	{
+		Stats.BytesSent += Bytes;
+	}
+	else
+	{
+		Stats.BytesReceived += Bytes;
+	}
+	WindowBits += Bits;
+}
+
+/**
+ * @brief Show a logical light on this machine's lamp, it goes through the bridge's send scheduler like any change.
+ * The fade goes with this one write only
+ * @param Light Light to show
+ * @param bFade False to snap, for a lamp catching up on a light that changed before it was mapped
+ */
+void UHueLightingReplicationComponent::ApplyLight(const FHueReplicatedLight& Light, bool bFade)
+{
+	AHueLamp* Lamp = ResolveLamp(Light.LightId);
+	if(!Lamp)
+	{
+		if(LightMap.ContainsByPredicate([&Light](const FHueLightMapping& Item) { return Item.LightId == Light.LightId; }))
+		{
+			UnresolvedLights.Add(Light.LightId);
+		}
+		return;
+	}
+	Lamp->ApplyState(Light.State, bFade ? Light.TransitionTime : -1);
+}
+
+/**
+ * @brief Find the lamp a logical light is mapped to, cached until the map changes :: Internal Call
+ * @param LightId Logical light
+ * @return The lamp, nullptr if the light isn't mapped or its lamp isn't discovered yet
+ */
+AHueLamp* UHueLightingReplicationComponent::ResolveLamp(int32 LightId)
+{
+	if(const TWeakObjectPtr<AHueLamp>* Cached = MappedLamps.Find(LightId))
+	{
+		if(Cached->IsValid())
+		{
+			return Cached->Get();
+		}
+	}
+	const FHueLightMapping* Mapping = LightMap.FindByPredicate([LightId](const FHueLightMapping& Item) { return Item.LightId == LightId; });
+	AHueLamp* Lamp = Mapping && Bridge ? Bridge->GetLamp(Mapping->LampName) : nullptr;
+	if(Lamp)
+	{
+		MappedLamps.Add(LightId, Lamp);
+	}
+	return Lamp;
+}
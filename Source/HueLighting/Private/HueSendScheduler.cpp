@@ -0,0 +1,318 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueSendScheduler.h"
+
+FHueSendScheduler::FHueSendScheduler(float InSendRate, EHueSchedulePolicy InPolicy)
+	: Policy(InPolicy)
+	, SendRate(FMath::Max(InSendRate, 0.1f))
+{
+}
+
+/**
+ * @brief Add a lamp to the scheduler
+ * @param Importance float weight, 2 makes the same error twice as urgent
+ * @return Slot index used for every other call
+ */
+int32 FHueSendScheduler::AddSlot(float Importance)
+{
+	FSlot& Slot = Slots.AddDefaulted_GetRef();
+	Slot.Importance = Importance;
+	return Slots.Num() - 1;
+}
+
+/**
+ * @brief Remove every slot, used when the lamps are cleared out
+ */
+void FHueSendScheduler::Reset()
+{
+	Slots.Empty();
+	IntegratedError = 0.0;
+	LastTickTime = -1.0;
+}
+
+/**
+ * @brief Set the state a lamp should be showing
+ * @param Slot Slot index
+ * @param State FHueLampState wanted state
+ * @param Now Current time in seconds
+ * @param TransitionTime Fade time of this state in 100ms steps, negative leaves the bridge default
+ */
+void FHueSendScheduler::SetDesired(int32 Slot, const FHueLampState& State, double Now, int32 TransitionTime)
+{
+	FSlot& Entry = Slots[Slot];
+	Entry.Desired = State;
+	Entry.Transition = TransitionTime;
+	if(bRecording)
+	{
+		FHueTraceEvent& Event = Recording.AddDefaulted_GetRef();
+		Event.Time = static_cast<float>(Now - RecordStartTime);
+		Event.Slot = Slot;
+		Event.State = State;
+	}
+	SetDesiredError(Slot, FHueLampState::PerceptualDistance(State, Entry.Sent), Now);
+}
+
+/**
+ * @brief Set the visible error directly, for lamps whose state is more than a single color
+ * @param Slot Slot index
+ * @param Error float visible error between what is wanted and what was sent
+ * @param Now Current time in seconds
+ */
+void FHueSendScheduler::SetDesiredError(int32 Slot, float Error, double Now)
+{
+	FSlot& Entry = Slots[Slot];
+	const bool bWasDirty = Entry.bDirty;
+	Entry.Error = Error;
+	Entry.bDirty = Error > 0.0f;
+	if(Entry.bDirty && !bWasDirty)
+	{
+		Entry.DirtySince = Now;
+	}
+}
+
+void FHueSendScheduler::SetImportance(int32 Slot, float Importance)
+{
+	Slots[Slot].Importance = FMath::Max(Importance, 0.0f);
+}
+
+/**
+ * @brief Busy slots have a request in flight and are skipped until it is answered
+ */
+void FHueSendScheduler::SetBusy(int32 Slot, bool bBusy)
+{
+	Slots[Slot].bBusy = bBusy;
+}
+
+/**
+ * @brief The desired state of a slot has been sent
+ * @param Slot Slot index
+ * @param Now Current time in seconds
+ */
+void FHueSendScheduler::MarkSent(int32 Slot, double Now)
+{
+	FSlot& Entry = Slots[Slot];
+	Entry.Sent = Entry.Desired;
+	Entry.Error = 0.0f;
+	Entry.bDirty = false;
+	Entry.LastSendTime = Now;
+}
+
+/**
+ * @brief The bridge reported what a lamp shows without us sending it, e.g. a bulk refresh or a scene recall
+ * @param Slot Slot index
+ * @param State FHueLampState the lamp is showing
+ */
+void FHueSendScheduler::SyncSent(int32 Slot, const FHueLampState& State)
+{
+	FSlot& Entry = Slots[Slot];
+	Entry.Sent = State;
+	if(!Entry.bDirty)
+	{
+		Entry.Desired = State;
+		return;
+	}
+	Entry.Error = FHueLampState::PerceptualDistance(Entry.Desired, State);
+	Entry.bDirty = Entry.Error > 0.0f;
+}
+
+/**
+ * @brief Refill the send budget and hand out the free send slots
+ * @param Now Current time in seconds
+ * @param SlotsOut Slots to send now, in the order they should go out
+ */
+void FHueSendScheduler::Tick(double Now, TArray<int32>& SlotsOut)
+{
+	SlotsOut.Reset();
+	Refill(Now);
+
+	while(Tokens >= 1.0f)
+	{
+		int32 Best = INDEX_NONE;
+		float BestPriority = 0.0f;
+		for (int32 Index = 0; Index < Slots.Num(); ++Index)
+		{
+			const FSlot& Entry = Slots[Index];
+			if(!Entry.bDirty || Entry.bBusy || SlotsOut.Contains(Index))
+			{
+				continue;
+			}
+			const float Priority = GetPriority(Entry, Now);
+			if(Best == INDEX_NONE || Priority > BestPriority)
+			{
+				Best = Index;
+				BestPriority = Priority;
+			}
+		}
+		if(Best == INDEX_NONE)
+		{
+			break;
+		}
+		SlotsOut.Add(Best);
+		Tokens -= 1.0f;
+	}
+}
+
+/**
+ * @brief Deepest the budget may go into debt, one second of sends. A large forced burst would otherwise hold every
+ * later send back for as many seconds as it had lamps :: Internal Call
+ */
+float FHueSendScheduler::GetMinTokens() const
+{
+	return -SendRate;
+}
+
+/**
+ * @brief Hand out every dirty slot at once so a frame's changes leave together
+ * @param Now Current time in seconds
+ * @param bForce Send even if the budget is spent, the debt is paid back before the next normal send
+ * @param SlotsOut Slots to send now, best first
+ */
+void FHueSendScheduler::Burst(double Now, bool bForce, TArray<int32>& SlotsOut)
+{
+	SlotsOut.Reset();
+	Refill(Now);
+	if(!bForce && Tokens < 1.0f)
+	{
+		return;
+	}
+	for (int32 Index = 0; Index < Slots.Num(); ++Index)
+	{
+		if(Slots[Index].bDirty && !Slots[Index].bBusy)
+		{
+			SlotsOut.Add(Index);
+		}
+	}
+	SlotsOut.Sort([this, Now](int32 A, int32 B)
+	{
+		return GetPriority(Slots[A], Now) > GetPriority(Slots[B], Now);
+	});
+	Tokens = FMath::Max(Tokens - SlotsOut.Num(), GetMinTokens());
+}
+
+/**
+ * @brief Take requests that didn't go through a slot out of the budget, the lamps wait until it is paid back
+ * @param Now Current time in seconds
+ * @param Requests Requests sent
+ */
+void FHueSendScheduler::Spend(double Now, int32 Requests)
+{
+	Refill(Now);
+	Tokens = FMath::Max(Tokens - Requests, GetMinTokens());
+}
+
+/**
+ * @brief Refill the token bucket and integrate the error since the last call :: Internal Call
+ * @param Now Current time in seconds
+ */
+void FHueSendScheduler::Refill(double Now)
+{
+	if(LastTickTime >= 0.0)
+	{
+		const double DeltaTime = Now - LastTickTime;
+		Tokens = FMath::Min(MaxTokens, Tokens + static_cast<float>(DeltaTime) * SendRate);
+		IntegratedError += GetTotalError() * DeltaTime;
+	}
+	LastTickTime = Now;
+}
+
+/**
+ * @brief Sum of every slot's visible error weighted by importance
+ */
+float FHueSendScheduler::GetTotalError() const
+{
+	float Total = 0.0f;
+	for (const FSlot& Entry : Slots)
+	{
+		Total += Entry.Error * Entry.Importance;
+	}
+	return Total;
+}
+
+bool FHueSendScheduler::HasDirtySlots() const
+{
+	return Slots.ContainsByPredicate([](const FSlot& Entry) { return Entry.bDirty; });
+}
+
+/**
+ * @brief How urgently a slot wants a send slot :: Internal Call
+ * @return Larger is more urgent
+ */
+float FHueSendScheduler::GetPriority(const FSlot& Slot, double Now) const
+{
+	if(Policy == EHueSchedulePolicy::Fifo)
+	{
+		//Oldest change first
+		return static_cast<float>(Now - Slot.DirtySince);
+	}
+	const float Age = static_cast<float>(Now - Slot.LastSendTime);
+	return Slot.Error * (1.0f + AgeWeight * Age) * Slot.Importance;
+}
+
+/**
+ * @brief Start recording every desired state change as a trace
+ * @param Now Current time in seconds, trace times are relative to it
+ */
+void FHueSendScheduler::StartRecording(double Now)
+{
+	Recording.Reset();
+	RecordStartTime = Now;
+	bRecording = true;
+}
+
+/**
+ * @brief Stop recording and hand back the trace
+ * @param TraceOut Recorded desired state changes
+ */
+void FHueSendScheduler::StopRecording(TArray<FHueTraceEvent>& TraceOut)
+{
+	bRecording = false;
+	TraceOut = MoveTemp(Recording);
+}
+
+/**
+ * @brief Replay recorded desired state changes through a scheduler, every picked slot is treated as answered
+ * before the next tick. Used to compare policies on recorded gameplay
+ * @param Trace Desired state changes sorted by time
+ * @param NumSlots Number of lamps in the trace
+ * @param SendRate Requests per second the bridge allows
+ * @param Policy Policy to replay with
+ * @param TickRate Ticks per second to replay at
+ * @return Visible error integrated over the trace
+ */
+double FHueSendScheduler::SimulateTrace(const TArray<FHueTraceEvent>& Trace, int32 NumSlots, float SendRate, EHueSchedulePolicy Policy, float TickRate)
+{
+	FHueSendScheduler Scheduler(SendRate, Policy);
+	for (int32 Index = 0; Index < NumSlots; ++Index)
+	{
+		Scheduler.AddSlot();
+	}
+	if(Trace.Num() == 0)
+	{
+		return 0.0;
+	}
+
+	const double Step = 1.0 / FMath::Max(TickRate, 1.0f);
+	const double EndTime = Trace.Last().Time + 1.0;
+	int32 EventIndex = 0;
+	TArray<int32> Picked;
+	for (double Now = Trace[0].Time; Now <= EndTime; Now += Step)
+	{
+		while(EventIndex < Trace.Num() && Trace[EventIndex].Time <= Now)
+		{
+			const FHueTraceEvent& Event = Trace[EventIndex++];
+			if(Event.Slot >= 0 && Event.Slot < NumSlots)
+			{
+				Scheduler.SetDesired(Event.Slot, Event.State, Now);
+			}
+		}
+		Scheduler.Tick(Now, Picked);
+		for (const int32 Slot : Picked)
+		{
+			Scheduler.MarkSent(Slot, Now);
+		}
+	}
+	return Scheduler.GetIntegratedError();
+}
@@ -0,0 +1,193 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueSensors.h"
+
+FHueSensorPoller::FHueSensorPoller(float InFastInterval, float InSlowInterval, float InActiveHold)
+	: FastInterval(FMath::Max(InFastInterval, 0.05f))
+	, SlowInterval(FMath::Max(InSlowInterval, InFastInterval))
+	, ActiveHold(InActiveHold)
+	, Interval(SlowInterval)
+{
+}
+
+/**
+ * @brief A read didn't make it, wait the slow interval before trying again
+ * @param Now Current time in seconds
+ */
+void FHueSensorPoller::MarkPollFailed(double Now)
+{
+	bPollInFlight = false;
+	NextPollTime = Now + SlowInterval;
+}
+
+/**
+ * @brief Merge a bulk read and list every sensor whose stamp or reading moved
+ * @param Polled Every sensor the bridge reported
+ * @param Now Current time in seconds
+ * @param ChangedOut Sensors that changed since the last read
+ */
+void FHueSensorPoller::MergePoll(const TArray<FHueSensorState>& Polled, double Now, TArray<FHueSensorState>& ChangedOut)
+{
+	ChangedOut.Reset();
+	bPollInFlight = false;
+	const float RoundTripMs = NoteRoundTrip(Now);
+	for (const FHueSensorState& Sensor : Polled)
+	{
+		FHueSensorState* Known = Sensors.Find(Sensor.SensorId);
+		if(!Known)
+		{
+			Sensors.Add(Sensor.SensorId, Sensor);
+			continue;
+		}
+		//Same press or reading, whether the last read or the stream brought it in
+		if(Known->LastUpdated == Sensor.LastUpdated && SameReading(*Known, Sensor))
+		{
+			continue;
+		}
+		//The stream already delivered this one a second off, the poll just takes the bridge's stamp. A switch
+		//pressed again reads the same, only its stamp tells, so it always counts
+		if(bStreaming && Sensor.Type != EHueSensorType::Switch && SameReading(*Known, Sensor))
+		{
+			Known->LastUpdated = Sensor.LastUpdated;
+			continue;
+		}
+		*Known = Sensor;
+		Known->LatencyMs = RoundTripMs;
+		NoteChange(Now);
+		ChangedOut.Add(*Known);
+	}
+	UpdateInterval(Now);
+	NextPollTime = Now + Interval;
+}
+
+/**
+ * @brief Merge event stream changes. A button event without its button number only asks for a poll, the v1 read
+ * has the full button event
+ * @param Events Partial sensor states from the stream
+ * @param Now Current time in seconds
+ * @param ChangedOut Sensors that changed
+ */
+void FHueSensorPoller::MergeEvents(const TArray<FHueSensorState>& Events, double Now, TArray<FHueSensorState>& ChangedOut)
+{
+	ChangedOut.Reset();
+	for (const FHueSensorState& Event : Events)
+	{
+		FHueSensorState* Known = Sensors.Find(Event.SensorId);
+		if(!Known)
+		{
+			continue;
+		}
+		switch(Event.Type)
+		{
+		case EHueSensorType::Switch:
+			if(Event.ButtonEvent < 1000)
+			{
+				LastActivityTime = Now;
+				PollNow();
+				continue;
+			}
+			//A read already brought this press in
+			if(Known->ButtonEvent == Event.ButtonEvent && Known->LastUpdated == Event.LastUpdated)
+			{
+				continue;
+			}
+			Known->ButtonEvent = Event.ButtonEvent;
+			break;
+		case EHueSensorType::Presence:
+			Known->bPresence = Event.bPresence;
+			break;
+		case EHueSensorType::LightLevel:
+			Known->LightLevel = Event.LightLevel;
+			break;
+		case EHueSensorType::Temperature:
+			Known->Temperature = Event.Temperature;
+			break;
+		default:
+			continue;
+		}
+		Known->LastUpdated = Event.LastUpdated;
+		Known->LatencyMs = 0.0f;
+		NoteChange(Now);
+		ChangedOut.Add(*Known);
+	}
+}
+
+/**
+ * @brief Merge sensors a broker owner relayed. The owner already merged them, a change it sent twice is taken once
+ * @param Relayed Whole sensor states from the owner
+ * @param bChanged True for changes, false for the table sent when the client read the bridge, that is only recorded
+ * @param Now Current time in seconds
+ * @param ChangedOut Sensors that changed
+ */
+void FHueSensorPoller::MergeRelayed(const TArray<FHueSensorState>& Relayed, bool bChanged, double Now, TArray<FHueSensorState>& ChangedOut)
+{
+	ChangedOut.Reset();
+	for (const FHueSensorState& Sensor : Relayed)
+	{
+		FHueSensorState* Known = Sensors.Find(Sensor.SensorId);
+		if(Known && Known->LastUpdated == Sensor.LastUpdated && SameReading(*Known, Sensor))
+		{
+			continue;
+		}
+		Sensors.Add(Sensor.SensorId, Sensor);
+		if(bChanged)
+		{
+			NoteChange(Now);
+			ChangedOut.Add(Sensor);
+		}
+	}
+}
+
+/**
+ * @brief Count a change :: Internal Call
+ * @param Now Current time in seconds
+ */
+void FHueSensorPoller::NoteChange(double Now)
+{
+	LastActivityTime = Now;
+	ChangeCount++;
+}
+
+/**
+ * @brief Measure a read from send to answer on the local clock, the bridge clock only stamps whole seconds and
+ * isn't synced to ours :: Internal Call
+ * @param Now Current time in seconds
+ * @return Milliseconds the read took
+ */
+float FHueSensorPoller::NoteRoundTrip(double Now)
+{
+	const float RoundTripMs = FMath::Max(static_cast<float>((Now - PollSentTime) * 1000.0), 0.0f);
+	RoundTrips++;
+	AverageLatencyMs = RoundTrips == 1 ? RoundTripMs : FMath::Lerp(AverageLatencyMs, RoundTripMs, 0.1f);
+	MaxLatencyMs = FMath::Max(MaxLatencyMs, RoundTripMs);
+	return RoundTripMs;
+}
+
+/**
+ * @brief Fast while something happened lately, then back off a little every poll :: Internal Call
+ * @param Now Current time in seconds
+ */
+void FHueSensorPoller::UpdateInterval(double Now)
+{
+	if(bStreaming)
+	{
+		Interval = SlowInterval;
+	}
+	else if(Now - LastActivityTime < ActiveHold)
+	{
+		Interval = FastInterval;
+	}
+	else
+	{
+		Interval = FMath::Min(Interval * 1.5f, SlowInterval);
+	}
+}
+
+bool FHueSensorPoller::SameReading(const FHueSensorState& A, const FHueSensorState& B)
+{
+	return A.ButtonEvent == B.ButtonEvent && A.bPresence == B.bPresence && A.LightLevel == B.LightLevel
+		&& FMath::IsNearlyEqual(A.Temperature, B.Temperature, 0.01f);
+}
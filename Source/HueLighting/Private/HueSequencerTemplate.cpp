@@ -0,0 +1,185 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueSequencerTemplate.h"
+#include "HueBridge.h"
+#include "HueLamp.h"
+#include "EngineUtils.h"
+#include "IMovieScenePlayer.h"
+#include "Evaluation/MovieSceneExecutionTokens.h"
+
+//Where a section's cursor is, kept between evaluations
+struct FHueCuePlayerData : IPersistentEvaluationData
+{
+	TWeakObjectPtr<AHueBridge> Bridge;
+	TWeakObjectPtr<AHueLamp> Lamp;
+	int32 Cursor = INDEX_NONE;
+	float LastTime = 0.0f;
+	bool bStarted = false;
+	int32 EffectHandle = 0;
+};
+
+namespace HueSequencer
+{
+	/**
+	 * @brief Find the bridge that has the lamp in the player's world
+	 * @return True if the lamp was found
+	 */
+	bool ResolveLamp(IMovieScenePlayer& Player, const FString& LampName, FHueCuePlayerData& Data)
+	{
+		const UObject* Context = Player.GetPlaybackContext();
+		UWorld* World = Context ? Context->GetWorld() : nullptr;
+		if(!World)
+		{
+			return false;
+		}
+		for (TActorIterator<AHueBridge> It(World); It; ++It)
+		{
+			if(AHueLamp* Lamp = It->GetLamp(LampName))
+			{
+				Data.Bridge = *It;
+				Data.Lamp = Lamp;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void StopEffect(FHueCuePlayerData& Data)
+	{
+		if(Data.EffectHandle != 0 && Data.Bridge.IsValid())
+		{
+			Data.Bridge->StopEffect(Data.EffectHandle);
+		}
+		Data.EffectHandle = 0;
+	}
+}
+
+struct FHueCueExecutionToken : IMovieSceneExecutionToken
+{
+	//The template outlives the token, tokens are applied in the same evaluation they are made in
+	FHueCueExecutionToken(const FMovieSceneHueSectionTemplate& InTemplate) : Template(&InTemplate) {}
+
+	virtual void Execute(const FMovieSceneContext& Context, const FMovieSceneEvaluationOperand& Operand, FPersistentEvaluationData& PersistentData, IMovieScenePlayer& Player) override
+	{
+		FHueCuePlayerData* Data = PersistentData.FindSectionData<FHueCuePlayerData>();
+		const FHueCueBuffer& Buffer = Template->Buffer;
+		if(!Data || Buffer.Cues.Num() == 0)
+		{
+			return;
+		}
+		if(!Data->Lamp.IsValid() && !HueSequencer::ResolveLamp(Player, Template->LampName, *Data))
+		{
+			return;
+		}
+		AHueLamp* Lamp = Data->Lamp.Get();
+
+		//Send ahead by however much the bridge is slower than what was baked in. The measured latency is the request
+		//to answer round trip, the lamp changes about when the request lands, half way through it. Time a cue waits
+		//for a send slot behind other lamps isn't known here and isn't compensated
+		float Time = static_cast<float>(Context.GetTime() / Context.GetFrameRate());
+		if(Template->bUseMeasuredLatency && Data->Bridge.IsValid())
+		{
+			const float Measured = Data->Bridge->GetStateLatency();
+			if(Measured > 0.0f)
+			{
+				Time += Measured * 0.5f - Buffer.BakedLatency;
+			}
+		}
+		const bool bPlaying = Context.GetStatus() == EMovieScenePlayerStatus::Playing;
+		const bool bSeek = !Data->bStarted || !bPlaying || Context.HasJumped() || Time < Data->LastTime;
+		Data->bStarted = true;
+		Data->LastTime = Time;
+
+		if(Buffer.Type == EHueCueType::Effect)
+		{
+			ExecuteEffect(Buffer, Time, bPlaying, bSeek, *Data);
+			return;
+		}
+
+		const int32 Previous = Data->Cursor;
+		if(bSeek)
+		{
+			Data->Cursor = Buffer.FindCue(Time);
+		}
+		else
+		{
+			while(Data->Cursor + 1 < Buffer.Cues.Num() && Buffer.Cues[Data->Cursor + 1].Time <= Time)
+			{
+				Data->Cursor++;
+			}
+		}
+		if(Data->Cursor == INDEX_NONE || (!bSeek && Data->Cursor == Previous))
+		{
+			return;
+		}
+
+		//Only the newest cue passed matters, a late cue fades for whatever is left of its transition
+		const FHueCue& Cue = Buffer.Cues[Data->Cursor];
+		FHueLampState State = bPlaying ? Cue.State : Buffer.StateAt(Time);
+		const int32 Elapsed = FMath::FloorToInt((Time - Cue.Time) * 10.0f);
+		const int32 TransitionTime = bPlaying ? FMath::Max(Cue.TransitionTime - Elapsed, 0) : 0;
+		if(Buffer.Type == EHueCueType::Brightness)
+		{
+			const bool bOn = State.bOn;
+			const int32 Brightness = State.Brightness;
+			State = Lamp->GetDesiredState();
+			State.bOn = bOn;
+			State.Brightness = Brightness;
+		}
+		//The fade belongs to this cue only, whatever the lamp is sent next fades as it asks
+		Lamp->ApplyState(State, TransitionTime);
+	}
+
+	//Effects can't be seeked, a jump restarts the effect with what is left of the section
+	void ExecuteEffect(const FHueCueBuffer& Buffer, float Time, bool bPlaying, bool bSeek, FHueCuePlayerData& Data) const
+	{
+		const float Remaining = Buffer.EffectDuration - (Time - Buffer.Cues[0].Time);
+		if(!bPlaying || !Data.Bridge.IsValid() || Time < Buffer.Cues[0].Time || Remaining <= 0.0f)
+		{
+			HueSequencer::StopEffect(Data);
+			return;
+		}
+		if(bSeek || Data.EffectHandle == 0)
+		{
+			HueSequencer::StopEffect(Data);
+			Data.EffectHandle = Data.Bridge->PlayEffect({ Template->LampName }, Buffer.EffectLayers, Remaining);
+		}
+	}
+
+	const FMovieSceneHueSectionTemplate* Template;
+};
+
+FMovieSceneHueSectionTemplate::FMovieSceneHueSectionTemplate(const UMovieSceneHueTrack& Track, const UMovieSceneHueSection& Section)
+	: LampName(Track.LampName)
+	, bUseMeasuredLatency(Track.bUseMeasuredLatency)
+{
+	Section.BakeCues(Track.LatencyCompensation, Track.BakeTolerance, Buffer);
+	EnableOverrides(RequiresSetupFlag | RequiresTearDownFlag);
+}
+
+void FMovieSceneHueSectionTemplate::Setup(FPersistentEvaluationData& PersistentData, IMovieScenePlayer& Player) const
+{
+	PersistentData.AddSectionData<FHueCuePlayerData>();
+}
+
+/**
+ * @brief Section finished, stop its effect
+ */
+void FMovieSceneHueSectionTemplate::TearDown(FPersistentEvaluationData& PersistentData, IMovieScenePlayer& Player) const
+{
+	FHueCuePlayerData* Data = PersistentData.FindSectionData<FHueCuePlayerData>();
+	if(!Data)
+	{
+		return;
+	}
+	HueSequencer::StopEffect(*Data);
+	PersistentData.ResetSectionData();
+}
+
+void FMovieSceneHueSectionTemplate::Evaluate(const FMovieSceneEvaluationOperand& Operand, const FMovieSceneContext& Context, const FPersistentEvaluationData& PersistentData, FMovieSceneExecutionTokens& ExecutionTokens) const
+{
+	ExecutionTokens.Add(FHueCueExecutionToken(*this));
+}
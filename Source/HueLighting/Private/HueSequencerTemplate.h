@@ -0,0 +1,40 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Evaluation/MovieSceneEvalTemplate.h"
+#include "HueSequencerTrack.h"
+#include "HueSequencerTemplate.generated.h"
+
+class UMovieSceneHueTrack;
+class UMovieSceneHueSection;
+
+/**
+ * Plays one baked Hue section. Holds the cue buffer, evaluating is walking a cursor to the current time and sending
+ * the newest cue it passed. A jump or a scrub sends the single state the lamp should show at the new time.
+ */
+USTRUCT()
+struct FMovieSceneHueSectionTemplate : public FMovieSceneEvalTemplate
+{
+	GENERATED_BODY()
+
+	FMovieSceneHueSectionTemplate() {}
+	FMovieSceneHueSectionTemplate(const UMovieSceneHueTrack& Track, const UMovieSceneHueSection& Section);
+
+	UPROPERTY()
+		FString LampName;
+	UPROPERTY()
+		bool bUseMeasuredLatency = true;
+	UPROPERTY()
+		FHueCueBuffer Buffer;
+
+private:
+	virtual UScriptStruct& GetScriptStructImpl() const override { return *StaticStruct(); }
+	virtual void Setup(FPersistentEvaluationData& PersistentData, IMovieScenePlayer& Player) const override;
+	virtual void TearDown(FPersistentEvaluationData& PersistentData, IMovieScenePlayer& Player) const override;
+	virtual void Evaluate(const FMovieSceneEvaluationOperand& Operand, const FMovieSceneContext& Context, const FPersistentEvaluationData& PersistentData, FMovieSceneExecutionTokens& ExecutionTokens) const override;
+};
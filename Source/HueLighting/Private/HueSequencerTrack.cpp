@@ -0,0 +1,397 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueSequencerTrack.h"
+#include "HueSequencerTemplate.h"
+#include "MovieScene.h"
+#include "MovieSceneTimeHelpers.h"
+#include "Channels/MovieSceneChannelProxy.h"
+#include "Channels/MovieSceneChannelEditorData.h"
+#include "Algo/BinarySearch.h"
+
+#define LOCTEXT_NAMESPACE "HueSequencerTrack"
+
+namespace HueSequencer
+{
+	//Bridges take about 10 changes a second per lamp, baking finer than a transition step gains nothing
+	constexpr double BakeStep = 0.1;
+}
+
+/**
+ * @brief Binary search for the newest cue that is due
+ * @param Time Sequence seconds
+ * @return Cue index, INDEX_NONE before the first cue
+ */
+int32 FHueCueBuffer::FindCue(float Time) const
+{
+	return Algo::UpperBoundBy(Cues, Time, &FHueCue::Time) - 1;
+}
+
+/**
+ * @brief Where the fade of the newest due cue has got to, from the state the cue before it left
+ * @param Time Sequence seconds
+ * @return FHueLampState the lamp shows
+ */
+FHueLampState FHueCueBuffer::StateAt(float Time) const
+{
+	if(Cues.Num() == 0)
+	{
+		return FHueLampState();
+	}
+	const int32 Index = FMath::Max(FindCue(Time), 0);
+	const FHueCue& Cue = Cues[Index];
+	if(Index == 0 || Cue.TransitionTime <= 0)
+	{
+		return Cue.State;
+	}
+	const float Alpha = FMath::Clamp((Time - Cue.Time) / (Cue.TransitionTime * 0.1f), 0.0f, 1.0f);
+	return LerpState(Cues[Index - 1].State, Cue.State, Alpha);
+}
+
+FHueLampState FHueCueBuffer::LerpState(const FHueLampState& A, const FHueLampState& B, float Alpha)
+{
+	return FHueLampState::FromLinearColor(FMath::Lerp(A.ToLinearColor(), B.ToLinearColor(), Alpha));
+}
+
+UMovieSceneHueSection::UMovieSceneHueSection(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	bSupportsInfiniteRange = false;
+}
+
+/**
+ * @brief Sample the section at the bridge's step and at every key, then join samples into fades for as long as a
+ * straight fade stays within Tolerance of the curve
+ * @param Latency Seconds every cue is moved earlier
+ * @param Tolerance Largest delta E a fade may be off the curve
+ * @param BufferOut Baked cues
+ */
+void UMovieSceneHueSection::BakeCues(float Latency, float Tolerance, FHueCueBuffer& BufferOut) const
+{
+	BufferOut.Cues.Reset();
+	BufferOut.BakedLatency = Latency;
+	double Start = 0.0;
+	double End = 0.0;
+	const UMovieScene* MovieScene = GetTypedOuter<UMovieScene>();
+	if(!MovieScene || !GetBakeRange(Start, End))
+	{
+		return;
+	}
+	const FFrameRate TickResolution = MovieScene->GetTickResolution();
+
+	TArray<double> Times;
+	for (double Time = Start; Time < End; Time += HueSequencer::BakeStep)
+	{
+		Times.Add(Time);
+	}
+	Times.Add(End);
+	TArray<FFrameNumber> KeyTimes;
+	GetKeyTimes(KeyTimes);
+	for (const FFrameNumber Key : KeyTimes)
+	{
+		const double KeySeconds = TickResolution.AsSeconds(Key);
+		if(KeySeconds > Start && KeySeconds < End)
+		{
+			Times.Add(KeySeconds);
+		}
+	}
+	Times.Sort();
+	for (int32 Index = Times.Num() - 1; Index > 0; --Index)
+	{
+		//A key on a bridge step would make a zero length fade
+		if(Times[Index] - Times[Index - 1] < 0.001)
+		{
+			Times.RemoveAt(Index == Times.Num() - 1 ? Index - 1 : Index);
+		}
+	}
+
+	TArray<FHueLampState> States;
+	States.Reserve(Times.Num());
+	for (const double Time : Times)
+	{
+		States.Add(SampleState(TickResolution.AsFrameTime(Time)));
+	}
+
+	//Land on the first state a bridge step before the section so the first fade starts from it
+	BufferOut.Cues.Add({ static_cast<float>(Start - Latency - HueSequencer::BakeStep), States[0], 0 });
+	int32 From = 0;
+	while(From < Times.Num() - 1)
+	{
+		int32 To = From + 1;
+		while(To + 1 < Times.Num())
+		{
+			const int32 Next = To + 1;
+			bool bFits = States[From].bOn == States[Next].bOn;
+			for (int32 Index = From + 1; bFits && Index < Next; ++Index)
+			{
+				const float Alpha = static_cast<float>((Times[Index] - Times[From]) / (Times[Next] - Times[From]));
+				bFits = FHueLampState::PerceptualDistance(FHueCueBuffer::LerpState(States[From], States[Next], Alpha), States[Index]) <= Tolerance;
+			}
+			if(!bFits)
+			{
+				break;
+			}
+			To = Next;
+		}
+		const int32 TransitionTime = FMath::RoundToInt((Times[To] - Times[From]) / HueSequencer::BakeStep);
+		BufferOut.Cues.Add({ static_cast<float>(Times[From] - Latency), States[To], TransitionTime });
+		From = To;
+	}
+}
+
+/**
+ * @brief Section range in seconds, sections left open are cut to the playback range :: Internal Call
+ * @return False if the section covers no time
+ */
+bool UMovieSceneHueSection::GetBakeRange(double& StartOut, double& EndOut) const
+{
+	const UMovieScene* MovieScene = GetTypedOuter<UMovieScene>();
+	if(!MovieScene)
+	{
+		return false;
+	}
+	TRange<FFrameNumber> Range = GetRange();
+	if(!Range.HasLowerBound() || !Range.HasUpperBound())
+	{
+		Range = TRange<FFrameNumber>::Intersection(Range, MovieScene->GetPlaybackRange());
+	}
+	if(Range.IsEmpty() || !Range.HasLowerBound() || !Range.HasUpperBound())
+	{
+		return false;
+	}
+	const FFrameRate TickResolution = MovieScene->GetTickResolution();
+	StartOut = TickResolution.AsSeconds(UE::MovieScene::DiscreteInclusiveLower(Range));
+	EndOut = TickResolution.AsSeconds(UE::MovieScene::DiscreteExclusiveUpper(Range));
+	return EndOut > StartOut;
+}
+
+UMovieSceneHueColorSection::UMovieSceneHueColorSection(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	Red.SetDefault(1.0f);
+	Green.SetDefault(1.0f);
+	Blue.SetDefault(1.0f);
+	Brightness.SetDefault(1.0f);
+
+	FMovieSceneChannelProxyData Channels;
+#if WITH_EDITOR
+	FMovieSceneChannelMetaData RedMetaData(TEXT("Red"), LOCTEXT("RedChannel", "Red"), LOCTEXT("ColorGroup", "Color"));
+	RedMetaData.SortOrder = 0;
+	RedMetaData.Color = FLinearColor::Red;
+	FMovieSceneChannelMetaData GreenMetaData(TEXT("Green"), LOCTEXT("GreenChannel", "Green"), LOCTEXT("ColorGroup", "Color"));
+	GreenMetaData.SortOrder = 1;
+	GreenMetaData.Color = FLinearColor::Green;
+	FMovieSceneChannelMetaData BlueMetaData(TEXT("Blue"), LOCTEXT("BlueChannel", "Blue"), LOCTEXT("ColorGroup", "Color"));
+	BlueMetaData.SortOrder = 2;
+	BlueMetaData.Color = FLinearColor::Blue;
+	FMovieSceneChannelMetaData BrightnessMetaData(TEXT("Brightness"), LOCTEXT("BrightnessChannel", "Brightness"));
+	BrightnessMetaData.SortOrder = 3;
+	Channels.Add(Red, RedMetaData, TMovieSceneExternalValue<float>());
+	Channels.Add(Green, GreenMetaData, TMovieSceneExternalValue<float>());
+	Channels.Add(Blue, BlueMetaData, TMovieSceneExternalValue<float>());
+	Channels.Add(Brightness, BrightnessMetaData, TMovieSceneExternalValue<float>());
+#else
+	Channels.Add(Red);
+	Channels.Add(Green);
+	Channels.Add(Blue);
+	Channels.Add(Brightness);
+#endif
+	ChannelProxy = MakeShared<FMovieSceneChannelProxy>(MoveTemp(Channels));
+}
+
+FHueLampState UMovieSceneHueColorSection::SampleState(FFrameTime Time) const
+{
+	FLinearColor Color = FLinearColor::White;
+	float Intensity = 1.0f;
+	Red.Evaluate(Time, Color.R);
+	Green.Evaluate(Time, Color.G);
+	Blue.Evaluate(Time, Color.B);
+	Brightness.Evaluate(Time, Intensity);
+	return FHueLampState::FromLinearColor(Color, Intensity);
+}
+
+void UMovieSceneHueColorSection::GetKeyTimes(TArray<FFrameNumber>& TimesOut) const
+{
+	TimesOut.Append(Red.GetTimes().GetData(), Red.GetTimes().Num());
+	TimesOut.Append(Green.GetTimes().GetData(), Green.GetTimes().Num());
+	TimesOut.Append(Blue.GetTimes().GetData(), Blue.GetTimes().Num());
+	TimesOut.Append(Brightness.GetTimes().GetData(), Brightness.GetTimes().Num());
+}
+
+UMovieSceneHueBrightnessSection::UMovieSceneHueBrightnessSection(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	Brightness.SetDefault(1.0f);
+
+	FMovieSceneChannelProxyData Channels;
+#if WITH_EDITOR
+	Channels.Add(Brightness, FMovieSceneChannelMetaData(TEXT("Brightness"), LOCTEXT("BrightnessChannel", "Brightness")), TMovieSceneExternalValue<float>());
+#else
+	Channels.Add(Brightness);
+#endif
+	ChannelProxy = MakeShared<FMovieSceneChannelProxy>(MoveTemp(Channels));
+}
+
+void UMovieSceneHueBrightnessSection::BakeCues(float Latency, float Tolerance, FHueCueBuffer& BufferOut) const
+{
+	Super::BakeCues(Latency, Tolerance, BufferOut);
+	BufferOut.Type = EHueCueType::Brightness;
+}
+
+//Brightness only cues keep the lamp's color, white stands in for it while baking
+FHueLampState UMovieSceneHueBrightnessSection::SampleState(FFrameTime Time) const
+{
+	float Intensity = 1.0f;
+	Brightness.Evaluate(Time, Intensity);
+	return FHueLampState::FromLinearColor(FLinearColor::White, Intensity);
+}
+
+void UMovieSceneHueBrightnessSection::GetKeyTimes(TArray<FFrameNumber>& TimesOut) const
+{
+	TimesOut.Append(Brightness.GetTimes().GetData(), Brightness.GetTimes().Num());
+}
+
+UMovieSceneHueEffectSection::UMovieSceneHueEffectSection(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	ChannelProxy = MakeShared<FMovieSceneChannelProxy>();
+}
+
+/**
+ * @brief Effects run on the bridge's effect runner, the section bakes to a single cue that starts it
+ */
+void UMovieSceneHueEffectSection::BakeCues(float Latency, float Tolerance, FHueCueBuffer& BufferOut) const
+{
+	BufferOut.Type = EHueCueType::Effect;
+	BufferOut.BakedLatency = Latency;
+	BufferOut.Cues.Reset();
+	BufferOut.EffectLayers = Layers;
+	if(bUsePreset)
+	{
+		FHueEffectRunner::GetPreset(Preset, BufferOut.EffectLayers);
+	}
+	double Start = 0.0;
+	double End = 0.0;
+	if(!GetBakeRange(Start, End) || BufferOut.EffectLayers.Num() == 0)
+	{
+		return;
+	}
+	BufferOut.EffectDuration = static_cast<float>(End - Start);
+	BufferOut.Cues.Add({ static_cast<float>(Start - Latency), FHueLampState(), 0 });
+}
+
+UMovieSceneHueTrack::UMovieSceneHueTrack(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	//Cues are sent ahead of the section, pre roll lets the first ones go out in time
+	EvalOptions.bEvaluateInPreroll = true;
+#if WITH_EDITORONLY_DATA
+	TrackTint = FColor(255, 190, 60, 65);
+#endif
+}
+
+bool UMovieSceneHueTrack::SupportsType(TSubclassOf<UMovieSceneSection> SectionClass) const
+{
+	return SectionClass && SectionClass->IsChildOf(UMovieSceneHueSection::StaticClass());
+}
+
+UMovieSceneSection* UMovieSceneHueTrack::CreateNewSection()
+{
+	return NewObject<UMovieSceneHueColorSection>(this, NAME_None, RF_Transactional);
+}
+
+void UMovieSceneHueTrack::AddSection(UMovieSceneSection& Section)
+{
+	UpdatePreRoll(Section);
+	Sections.Add(&Section);
+}
+
+void UMovieSceneHueTrack::RemoveSection(UMovieSceneSection& Section)
+{
+	Sections.Remove(&Section);
+}
+
+void UMovieSceneHueTrack::RemoveSectionAt(int32 SectionIndex)
+{
+	Sections.RemoveAt(SectionIndex);
+}
+
+void UMovieSceneHueTrack::RemoveAllAnimationData()
+{
+	Sections.Empty();
+}
+
+bool UMovieSceneHueTrack::HasSection(const UMovieSceneSection& Section) const
+{
+	return Sections.Contains(&Section);
+}
+
+bool UMovieSceneHueTrack::IsEmpty() const
+{
+	return Sections.Num() == 0;
+}
+
+const TArray<UMovieSceneSection*>& UMovieSceneHueTrack::GetAllSections() const
+{
+	return Sections;
+}
+
+/**
+ * @brief Bake the section, called when the sequence compiles
+ * @param InSection Section to bake
+ * @return Template holding the section's cues
+ */
+FMovieSceneEvalTemplatePtr UMovieSceneHueTrack::CreateTemplateForSection(const UMovieSceneSection& InSection) const
+{
+	const UMovieSceneHueSection* HueSection = Cast<const UMovieSceneHueSection>(&InSection);
+	if(!HueSection || LampName.IsEmpty())
+	{
+		return FMovieSceneEvalTemplatePtr();
+	}
+	return FMovieSceneHueSectionTemplate(*this, *HueSection);
+}
+
+/**
+ * @brief Give a section enough pre roll for its first cue to go out ahead of it :: Internal Call
+ * @param Section Section to update
+ */
+void UMovieSceneHueTrack::UpdatePreRoll(UMovieSceneSection& Section) const
+{
+	const UMovieScene* MovieScene = GetTypedOuter<UMovieScene>();
+	if(!MovieScene)
+	{
+		return;
+	}
+	const FFrameRate TickResolution = MovieScene->GetTickResolution();
+	const int32 PreRollFrames = (TickResolution.AsFrameTime(LatencyCompensation + HueSequencer::BakeStep)).CeilToFrame().Value;
+	if(Section.GetPreRollFrames() < PreRollFrames)
+	{
+		Section.SetPreRollFrames(PreRollFrames);
+	}
+}
+
+#if WITH_EDITOR
+void UMovieSceneHueTrack::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+	if(PropertyChangedEvent.GetPropertyName() == GET_MEMBER_NAME_CHECKED(UMovieSceneHueTrack, LatencyCompensation))
+	{
+		for (UMovieSceneSection* Section : Sections)
+		{
+			Section->Modify();
+			UpdatePreRoll(*Section);
+		}
+	}
+}
+#endif
+
+#if WITH_EDITORONLY_DATA
+FText UMovieSceneHueTrack::GetDefaultDisplayName() const
+{
+	return LampName.IsEmpty() ? LOCTEXT("TrackName", "Hue Light") : FText::Format(LOCTEXT("TrackNameLamp", "Hue Light ({0})"), FText::FromString(LampName));
+}
+#endif
+
+#undef LOCTEXT_NAMESPACE
@@ -0,0 +1,920 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueTransport.h"
+#include "HttpModule.h"
+#include "Dom/JsonObject.h"
+#include "Interfaces/IHttpResponse.h"
+#include "Misc/Paths.h"
+#include "Serialization/JsonSerializer.h"
+
+namespace HueTransport
+{
+	/**
+	 * @brief v1 stamps lastupdated without a zone, v2 stamps creationtime with milliseconds and a Z. Both are UTC,
+	 * cut to whole seconds they compare equal for the same change. "none" and anything else unreadable is zero
+	 */
+	FDateTime ParseStamp(const FString& Stamp)
+	{
+		FDateTime Parsed;
+		if(!FDateTime::ParseIso8601(*Stamp, Parsed))
+		{
+			return FDateTime(0);
+		}
+		return FDateTime(Parsed.GetTicks() - Parsed.GetTicks() % ETimespan::TicksPerSecond);
+	}
+
+	FString Serialize(const TSharedRef<FJsonObject>& Object)
+	{
+		FString Body;
+		const TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Body);
+		FJsonSerializer::Serialize(Object, Writer);
+		return Body;
+	}
+
+	TSharedRef<FJsonObject> MakeV1State(const FHueLightCommand& Command)
+	{
+		TSharedRef<FJsonObject> Object = MakeShared<FJsonObject>();
+		if(Command.bOn.IsSet())
+		{
+			Object->SetBoolField(TEXT("on"), Command.bOn.GetValue());
+		}
+		if(Command.Hue.IsSet())
+		{
+			Object->SetNumberField(TEXT("hue"), Command.Hue.GetValue());
+		}
+		if(Command.Saturation.IsSet())
+		{
+			Object->SetNumberField(TEXT("sat"), Command.Saturation.GetValue());
+		}
+		if(Command.Brightness.IsSet())
+		{
+			Object->SetNumberField(TEXT("bri"), Command.Brightness.GetValue());
+		}
+		if(Command.TransitionTime.IsSet())
+		{
+			Object->SetNumberField(TEXT("transitiontime"), Command.TransitionTime.GetValue());
+		}
+		return Object;
+	}
+}
+
+/**
+ * @brief Command that sets a lamp to a full state, an off lamp only needs the on field to save payload size
+ * @param State FHueLampState to send
+ * @param TransitionTime Fade time in 100ms steps, negative leaves the bridge default
+ */
+FHueLightCommand FHueLightCommand::FromState(const FHueLampState& State, int32 TransitionTime)
+{
+	FHueLightCommand Command;
+	Command.bOn = State.bOn;
+	if(State.bOn)
+	{
+		Command.Hue = State.Hue;
+		Command.Saturation = State.Saturation;
+		Command.Brightness = State.Brightness;
+	}
+	if(TransitionTime >= 0)
+	{
+		Command.TransitionTime = TransitionTime;
+	}
+	return Command;
+}
+
+/**
+ * @brief Create a request with the json content type, every transport request goes through here so it gets counted
+ */
+TSharedRef<IHttpRequest> IHueTransport::NewRequest(const FString& URL, const FString& Verb, const FString& Body)
+{
+	const TSharedRef<IHttpRequest> Request = FHttpModule::Get().CreateRequest();
+	Request->SetURL(URL);
+	Request->SetVerb(Verb);
+	Request->SetHeader(TEXT("Content-Type"), TEXT("application/json"));
+	if(!Body.IsEmpty())
+	{
+		Request->SetContentAsString(Body);
+	}
+	RequestCount++;
+	return Request;
+}
+
+/**
+ * Legacy v1 REST api, lights are addressed by their light number
+ */
+class FHueTransportV1 : public IHueTransport
+{
+public:
+	FHueTransportV1(const FString& InHost, const FString& InKey) : IHueTransport(InHost, InKey) {}
+
+	virtual EHueApiVersion GetApiVersion() const override { return EHueApiVersion::V1; }
+
+	FString GetApiURL() const
+	{
+		return TEXT("http://") + Host + TEXT("/api/") + Key;
+	}
+
+	virtual TSharedRef<IHttpRequest> CreateGetLights() override
+	{
+		return NewRequest(GetApiURL() + TEXT("/lights"), TEXT("GET"));
+	}
+
+	virtual TSharedRef<IHttpRequest> CreateGetLight(const FString& ResourceId) override
+	{
+		return NewRequest(GetApiURL() + TEXT("/lights/") + ResourceId, TEXT("GET"));
+	}
+
+	virtual TSharedRef<IHttpRequest> CreateSetLight(const FString& ResourceId, const FHueLightCommand& Command) override
+	{
+		return NewRequest(GetApiURL() + TEXT("/lights/") + ResourceId + TEXT("/state"), TEXT("PUT"),
+			HueTransport::Serialize(HueTransport::MakeV1State(Command)));
+	}
+
+	/**
+	 * @brief Group 0 is every light the bridge knows
+	 */
+	virtual TSharedRef<IHttpRequest> CreateSetAllLights(const FHueLightCommand& Command) override
+	{
+		return NewRequest(GetApiURL() + TEXT("/groups/0/action"), TEXT("PUT"), HueTransport::Serialize(HueTransport::MakeV1State(Command)));
+	}
+
+	/**
+	 * @brief A LightScene stores a state per light so one recall sets every lamp
+	 */
+	virtual TSharedRef<IHttpRequest> CreateCreateScene(const FString& Name, const TMap<FString, FHueLampState>& States, int32 TransitionTime, bool bRecycle) override
+	{
+		TSharedRef<FJsonObject> RequestOBJ = MakeShared<FJsonObject>();
+		TSharedRef<FJsonObject> LightStates = MakeShared<FJsonObject>();
+		TArray<TSharedPtr<FJsonValue>> Lights;
+		for (const auto& Element : States)
+		{
+			LightStates->SetObjectField(Element.Key, HueTransport::MakeV1State(FHueLightCommand::FromState(Element.Value, TransitionTime)));
+			Lights.Add(MakeShared<FJsonValueString>(Element.Key));
+		}
+		RequestOBJ->SetStringField(TEXT("name"), Name.Left(32));
+		RequestOBJ->SetStringField(TEXT("type"), TEXT("LightScene"));
+		RequestOBJ->SetArrayField(TEXT("lights"), Lights);
+		RequestOBJ->SetObjectField(TEXT("lightstates"), LightStates);
+		RequestOBJ->SetBoolField(TEXT("recycle"), bRecycle);
+		return NewRequest(GetApiURL() + TEXT("/scenes"), TEXT("POST"), HueTransport::Serialize(RequestOBJ));
+	}
+
+	virtual TSharedRef<IHttpRequest> CreateDeleteScene(const FString& SceneId) override
+	{
+		return NewRequest(GetApiURL() + TEXT("/scenes/") + SceneId, TEXT("DELETE"));
+	}
+
+	virtual TSharedRef<IHttpRequest> CreateRecallScene(const FString& SceneId) override
+	{
+		TSharedRef<FJsonObject> RequestOBJ = MakeShared<FJsonObject>();
+		RequestOBJ->SetStringField(TEXT("scene"), SceneId);
+		return NewRequest(GetApiURL() + TEXT("/groups/0/action"), TEXT("PUT"), HueTransport::Serialize(RequestOBJ));
+	}
+
+	/**
+	 * @brief The command is a request the bridge makes to itself, so its address is the api path without the host
+	 */
+	virtual TSharedRef<IHttpRequest> CreateCreateSchedule(const FString& Name, const FHueScheduleCommand& Command, const FString& LocalTime, bool bEnabled, bool bAutoDelete) override
+	{
+		TSharedRef<FJsonObject> CommandBody = MakeShared<FJsonObject>();
+		FString Address = TEXT("/api/") + Key;
+		if(!Command.EnableScheduleId.IsEmpty())
+		{
+			Address += TEXT("/schedules/") + Command.EnableScheduleId;
+			CommandBody->SetStringField(TEXT("status"), TEXT("enabled"));
+		}
+		else
+		{
+			Address += TEXT("/groups/0/action");
+			CommandBody->SetStringField(TEXT("scene"), Command.SceneId);
+		}
+		TSharedRef<FJsonObject> CommandOBJ = MakeShared<FJsonObject>();
+		CommandOBJ->SetStringField(TEXT("address"), Address);
+		CommandOBJ->SetStringField(TEXT("method"), TEXT("PUT"));
+		CommandOBJ->SetObjectField(TEXT("body"), CommandBody);
+
+		TSharedRef<FJsonObject> RequestOBJ = MakeShared<FJsonObject>();
+		RequestOBJ->SetStringField(TEXT("name"), Name.Left(32));
+		RequestOBJ->SetObjectField(TEXT("command"), CommandOBJ);
+		RequestOBJ->SetStringField(TEXT("localtime"), LocalTime);
+		RequestOBJ->SetStringField(TEXT("status"), bEnabled ? TEXT("enabled") : TEXT("disabled"));
+		//Only one shot timers may delete themselves
+		if(bAutoDelete)
+		{
+			RequestOBJ->SetBoolField(TEXT("autodelete"), true);
+		}
+		return NewRequest(GetApiURL() + TEXT("/schedules"), TEXT("POST"), HueTransport::Serialize(RequestOBJ));
+	}
+
+	virtual TSharedRef<IHttpRequest> CreateDeleteSchedule(const FString& ScheduleId) override
+	{
+		return NewRequest(GetApiURL() + TEXT("/schedules/") + ScheduleId, TEXT("DELETE"));
+	}
+
+	virtual TSharedRef<IHttpRequest> CreateGetSensors() override
+	{
+		return NewRequest(GetApiURL() + TEXT("/sensors"), TEXT("GET"));
+	}
+
+	virtual TSharedRef<IHttpRequest> CreateCreateUser(const FString& AppName) override
+	{
+		TSharedRef<FJsonObject> RequestOBJ = MakeShared<FJsonObject>();
+		RequestOBJ->SetStringField(TEXT("devicetype"), AppName);
+		return NewRequest(TEXT("http://") + Host + TEXT("/api"), TEXT("POST"), HueTransport::Serialize(RequestOBJ));
+	}
+
+	static void ReadLight(const FString& ResourceId, const TSharedPtr<FJsonObject>& LightObj, FHueLightRecord& LightOut)
+	{
+		LightOut.ResourceId = ResourceId;
+		LightObj->TryGetStringField(TEXT("name"), LightOut.Name);
+		//v1 doesn't report the point count, every gradient strip and play bar takes 5
+		FString ProductName;
+		if(LightObj->TryGetStringField(TEXT("productname"), ProductName) && ProductName.Contains(TEXT("gradient")))
+		{
+			LightOut.GradientPoints = 5;
+		}
+		const TSharedPtr<FJsonObject>* StateObj;
+		LightOut.bHasState = LightObj->TryGetObjectField(TEXT("state"), StateObj);
+		if(LightOut.bHasState)
+		{
+			FHueLampState::FromBridgeJson(*StateObj, LightOut.State, LightOut.bReachable);
+		}
+	}
+
+	/**
+	 * @brief /lights is an object of light number to light, errors come back as an array instead
+	 */
+	virtual bool ParseLights(const FString& Data, TArray<FHueLightRecord>& LightsOut) const override
+	{
+		TSharedPtr<FJsonObject> ResponseObj;
+		const TSharedRef<TJsonReader<>> JsonReader = TJsonReaderFactory<>::Create(Data);
+		if(!FJsonSerializer::Deserialize(JsonReader, ResponseObj) || !ResponseObj.IsValid())
+		{
+			return false;
+		}
+		for (const auto& Element : ResponseObj->Values)
+		{
+			const TSharedPtr<FJsonObject>* LightObj;
+			if(Element.Value->TryGetObject(LightObj))
+			{
+				ReadLight(Element.Key, *LightObj, LightsOut.AddDefaulted_GetRef());
+			}
+		}
+		return true;
+	}
+
+	virtual bool ParseLight(const FString& ResourceId, const FString& Data, FHueLightRecord& LightOut) const override
+	{
+		TSharedPtr<FJsonObject> ResponseObj;
+		const TSharedRef<TJsonReader<>> JsonReader = TJsonReaderFactory<>::Create(Data);
+		if(!FJsonSerializer::Deserialize(JsonReader, ResponseObj) || !ResponseObj.IsValid())
+		{
+			return false;
+		}
+		ReadLight(ResourceId, ResponseObj, LightOut);
+		return LightOut.bHasState;
+	}
+
+	/**
+	 * @brief /sensors is an object of sensor number to sensor, the type name says which state field it has.
+	 * Daylight and other virtual sensors are left out
+	 */
+	virtual bool ParseSensors(const FString& Data, TArray<FHueSensorState>& SensorsOut) const override
+	{
+		TSharedPtr<FJsonObject> ResponseObj;
+		const TSharedRef<TJsonReader<>> JsonReader = TJsonReaderFactory<>::Create(Data);
+		if(!FJsonSerializer::Deserialize(JsonReader, ResponseObj) || !ResponseObj.IsValid())
+		{
+			return false;
+		}
+		for (const auto& Element : ResponseObj->Values)
+		{
+			const TSharedPtr<FJsonObject>* SensorObj;
+			const TSharedPtr<FJsonObject>* StateObj;
+			FString TypeName;
+			if(!Element.Value->TryGetObject(SensorObj) || !(*SensorObj)->TryGetObjectField(TEXT("state"), StateObj)
+				|| !(*SensorObj)->TryGetStringField(TEXT("type"), TypeName))
+			{
+				continue;
+			}
+			FHueSensorState Sensor;
+			if(TypeName.EndsWith(TEXT("Switch")))
+			{
+				Sensor.Type = EHueSensorType::Switch;
+				(*StateObj)->TryGetNumberField(TEXT("buttonevent"), Sensor.ButtonEvent);
+			}
+			else if(TypeName.EndsWith(TEXT("Presence")))
+			{
+				Sensor.Type = EHueSensorType::Presence;
+				(*StateObj)->TryGetBoolField(TEXT("presence"), Sensor.bPresence);
+			}
+			else if(TypeName.EndsWith(TEXT("LightLevel")))
+			{
+				Sensor.Type = EHueSensorType::LightLevel;
+				(*StateObj)->TryGetNumberField(TEXT("lightlevel"), Sensor.LightLevel);
+			}
+			else if(TypeName.EndsWith(TEXT("Temperature")))
+			{
+				//Hundredths of a degree
+				int32 Temperature = 0;
+				Sensor.Type = EHueSensorType::Temperature;
+				(*StateObj)->TryGetNumberField(TEXT("temperature"), Temperature);
+				Sensor.Temperature = Temperature / 100.0f;
+			}
+			else
+			{
+				continue;
+			}
+			Sensor.SensorId = Element.Key;
+			(*SensorObj)->TryGetStringField(TEXT("name"), Sensor.Name);
+			FString LastUpdated;
+			(*StateObj)->TryGetStringField(TEXT("lastupdated"), LastUpdated);
+			Sensor.LastUpdated = HueTransport::ParseStamp(LastUpdated);
+			SensorsOut.Add(MoveTemp(Sensor));
+		}
+		return true;
+	}
+
+	/**
+	 * @brief Respond comes back as [{"success":{"id":"Id"}}]
+	 */
+	virtual bool ParseCreatedId(const FString& Data, FString& IdOut) const override
+	{
+		TArray<TSharedPtr<FJsonValue>> ResponseArray;
+		const TSharedRef<TJsonReader<>> JsonReader = TJsonReaderFactory<>::Create(Data);
+		if(!FJsonSerializer::Deserialize(JsonReader, ResponseArray))
+		{
+			return false;
+		}
+		for (const auto& Element : ResponseArray)
+		{
+			const TSharedPtr<FJsonObject>* Entry;
+			const TSharedPtr<FJsonObject>* Success;
+			if(Element->TryGetObject(Entry) && (*Entry)->TryGetObjectField(TEXT("success"), Success) && (*Success)->TryGetStringField(TEXT("id"), IdOut))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * @brief Respond has one success or error entry per changed field, a single error means part of it didn't happen
+	 */
+	virtual bool ParseActionSucceeded(const FString& Data) const override
+	{
+		TArray<TSharedPtr<FJsonValue>> ResponseArray;
+		const TSharedRef<TJsonReader<>> JsonReader = TJsonReaderFactory<>::Create(Data);
+		if(!FJsonSerializer::Deserialize(JsonReader, ResponseArray) || ResponseArray.Num() == 0)
+		{
+			return false;
+		}
+		for (const auto& Element : ResponseArray)
+		{
+			const TSharedPtr<FJsonObject>* Entry;
+			if(!Element->TryGetObject(Entry) || (*Entry)->HasField(TEXT("error")))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * @brief Respond comes back as [{"success":{"username":"User"}}], or type 101 while the link button isn't pressed
+	 */
+	virtual bool ParseCreatedUser(const FString& Data, FString& UserOut) const override
+	{
+		TArray<TSharedPtr<FJsonValue>> ResponseArray;
+		const TSharedRef<TJsonReader<>> JsonReader = TJsonReaderFactory<>::Create(Data);
+		if(!FJsonSerializer::Deserialize(JsonReader, ResponseArray))
+		{
+			return false;
+		}
+		for (const auto& Element : ResponseArray)
+		{
+			const TSharedPtr<FJsonObject>* Entry;
+			const TSharedPtr<FJsonObject>* Success;
+			if(Element->TryGetObject(Entry) && (*Entry)->TryGetObjectField(TEXT("success"), Success)
+				&& (*Success)->TryGetStringField(TEXT("username"), UserOut) && !UserOut.IsEmpty())
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * @brief v1 answers with [{"error":{"type":N,...}}], 3 is resource not available. 201 only means the lamp is off,
+	 * whether it is reachable comes from state.reachable in the bulk read
+	 */
+	virtual bool IsUnreachableError(const FHttpResponsePtr& Response) const override
+	{
+		if(!Response.IsValid())
+		{
+			return false;
+		}
+		const FString Data = Response->GetContentAsString();
+		if(!Data.Contains(TEXT("error")))
+		{
+			return false;
+		}
+
+		TArray<TSharedPtr<FJsonValue>> ResponseArray;
+		const TSharedRef<TJsonReader<>> JsonReader = TJsonReaderFactory<>::Create(Data);
+		if(!FJsonSerializer::Deserialize(JsonReader, ResponseArray))
+		{
+			return false;
+		}
+		for (const auto& Element : ResponseArray)
+		{
+			const TSharedPtr<FJsonObject>* Entry;
+			const TSharedPtr<FJsonObject>* Error;
+			int32 Type = 0;
+			if(Element->TryGetObject(Entry) && (*Entry)->TryGetObjectField(TEXT("error"), Error) && (*Error)->TryGetNumberField(TEXT("type"), Type))
+			{
+				return Type == 3;
+			}
+		}
+		return false;
+	}
+};
+
+/**
+ * CLIP v2 api, lights are addressed by resource id. The bridge serves it over https with a certificate signed by
+ * the Hue root CA, add that CA to the project's certificate bundle or peer verification will fail.
+ * Only light reads, light writes, connectivity and the event stream use v2 resources. Group actions, scenes,
+ * schedules and sensor reads stay on the v1 endpoints every v2 bridge still serves: v2 scenes have to belong to a
+ * room or zone, v2 has no writable timers and its sensors are split over four resource types
+ */
+class FHueTransportClipV2 : public IHueTransport
+{
+public:
+	FHueTransportClipV2(const FString& InHost, const FString& InKey)
+		: IHueTransport(InHost, InKey)
+		, Legacy(InHost, InKey)
+	{
+	}
+
+	virtual EHueApiVersion GetApiVersion() const override { return EHueApiVersion::ClipV2; }
+
+	FString GetBaseURL() const
+	{
+		return (bUseTls ? TEXT("https://") : TEXT("http://")) + Host;
+	}
+
+	FString GetResourceURL() const
+	{
+		return GetBaseURL() + TEXT("/clip/v2/resource");
+	}
+
+	TSharedRef<IHttpRequest> NewClipRequest(const FString& URL, const FString& Verb, const FString& Body = FString())
+	{
+		const TSharedRef<IHttpRequest> Request = NewRequest(URL, Verb, Body);
+		Request->SetHeader(TEXT("hue-application-key"), Key);
+		return Request;
+	}
+
+	//Scenes go through the v1 transport but still count as requests from this one
+	TSharedRef<IHttpRequest> CountLegacy(const TSharedRef<IHttpRequest>& Request)
+	{
+		RequestCount++;
+		return Request;
+	}
+
+	virtual TSharedRef<IHttpRequest> CreateGetLights() override
+	{
+		return NewClipRequest(GetResourceURL() + TEXT("/light"), TEXT("GET"));
+	}
+
+	virtual TSharedRef<IHttpRequest> CreateGetLight(const FString& ResourceId) override
+	{
+		return NewClipRequest(GetResourceURL() + TEXT("/light/") + ResourceId, TEXT("GET"));
+	}
+
+	/**
+	 * @brief v2 takes brightness as a percentage, color as xy, a gradient as one xy per point and fade time in ms
+	 */
+	virtual TSharedRef<IHttpRequest> CreateSetLight(const FString& ResourceId, const FHueLightCommand& Command) override
+	{
+		TSharedRef<FJsonObject> RequestOBJ = MakeShared<FJsonObject>();
+		if(Command.bOn.IsSet())
+		{
+			TSharedRef<FJsonObject> On = MakeShared<FJsonObject>();
+			On->SetBoolField(TEXT("on"), Command.bOn.GetValue());
+			RequestOBJ->SetObjectField(TEXT("on"), On);
+		}
+		if(Command.Brightness.IsSet())
+		{
+			TSharedRef<FJsonObject> Dimming = MakeShared<FJsonObject>();
+			Dimming->SetNumberField(TEXT("brightness"), FMath::Clamp(Command.Brightness.GetValue() / 254.0 * 100.0, 0.0, 100.0));
+			RequestOBJ->SetObjectField(TEXT("dimming"), Dimming);
+		}
+		if(Command.GradientPoints.Num() > 0)
+		{
+			TArray<TSharedPtr<FJsonValue>> Points;
+			for (const FVector2D& Point : Command.GradientPoints)
+			{
+				TSharedRef<FJsonObject> PointObj = MakeShared<FJsonObject>();
+				PointObj->SetObjectField(TEXT("color"), MakeXY(Point));
+				Points.Add(MakeShared<FJsonValueObject>(PointObj));
+			}
+			TSharedRef<FJsonObject> Gradient = MakeShared<FJsonObject>();
+			Gradient->SetArrayField(TEXT("points"), Points);
+			RequestOBJ->SetObjectField(TEXT("gradient"), Gradient);
+		}
+		else if(Command.Hue.IsSet() || Command.Saturation.IsSet())
+		{
+			FHueLampState State;
+			State.bOn = true;
+			State.Hue = Command.Hue.Get(0);
+			State.Saturation = Command.Saturation.Get(254);
+			RequestOBJ->SetObjectField(TEXT("color"), MakeXY(State.ToXY()));
+		}
+		if(Command.TransitionTime.IsSet())
+		{
+			TSharedRef<FJsonObject> Dynamics = MakeShared<FJsonObject>();
+			Dynamics->SetNumberField(TEXT("duration"), Command.TransitionTime.GetValue() * 100);
+			RequestOBJ->SetObjectField(TEXT("dynamics"), Dynamics);
+		}
+		return NewClipRequest(GetResourceURL() + TEXT("/light/") + ResourceId, TEXT("PUT"), HueTransport::Serialize(RequestOBJ));
+	}
+
+	/**
+	 * @brief v2 groups every light under the bridge home grouped_light, whose id has to be looked up. The v1 group 0
+	 * is the same set of lights and needs no lookup
+	 */
+	virtual TSharedRef<IHttpRequest> CreateSetAllLights(const FHueLightCommand& Command) override
+	{
+		return CountLegacy(Legacy.CreateSetAllLights(Command));
+	}
+
+	virtual TSharedRef<IHttpRequest> CreateCreateScene(const FString& Name, const TMap<FString, FHueLampState>& States, int32 TransitionTime, bool bRecycle) override
+	{
+		//Scene lightstates are keyed by v1 light number
+		TMap<FString, FHueLampState> LegacyStates;
+		for (const auto& Element : States)
+		{
+			const FString* LegacyId = LegacyIds.Find(Element.Key);
+			LegacyStates.Add(LegacyId ? *LegacyId : Element.Key, Element.Value);
+		}
+		return CountLegacy(Legacy.CreateCreateScene(Name, LegacyStates, TransitionTime, bRecycle));
+	}
+
+	virtual TSharedRef<IHttpRequest> CreateDeleteScene(const FString& SceneId) override
+	{
+		return CountLegacy(Legacy.CreateDeleteScene(SceneId));
+	}
+
+	virtual TSharedRef<IHttpRequest> CreateRecallScene(const FString& SceneId) override
+	{
+		return CountLegacy(Legacy.CreateRecallScene(SceneId));
+	}
+
+	//v2 has no writable timers, v1 schedules on the same bridge recall the v1 scenes above
+	virtual TSharedRef<IHttpRequest> CreateCreateSchedule(const FString& Name, const FHueScheduleCommand& Command, const FString& LocalTime, bool bEnabled, bool bAutoDelete) override
+	{
+		return CountLegacy(Legacy.CreateCreateSchedule(Name, Command, LocalTime, bEnabled, bAutoDelete));
+	}
+
+	virtual TSharedRef<IHttpRequest> CreateDeleteSchedule(const FString& ScheduleId) override
+	{
+		return CountLegacy(Legacy.CreateDeleteSchedule(ScheduleId));
+	}
+
+	//The v1 read has every sensor type in one request, v2 splits them over four resource types
+	virtual TSharedRef<IHttpRequest> CreateGetSensors() override
+	{
+		return CountLegacy(Legacy.CreateGetSensors());
+	}
+
+	//The key is made over https, generateclientkey also hands out the entertainment key
+	virtual TSharedRef<IHttpRequest> CreateCreateUser(const FString& AppName) override
+	{
+		TSharedRef<FJsonObject> RequestOBJ = MakeShared<FJsonObject>();
+		RequestOBJ->SetStringField(TEXT("devicetype"), AppName);
+		RequestOBJ->SetBoolField(TEXT("generateclientkey"), true);
+		return NewRequest(GetBaseURL() + TEXT("/api"), TEXT("POST"), HueTransport::Serialize(RequestOBJ));
+	}
+
+	//Light resources don't say if the bridge can reach them, their device's zigbee_connectivity does
+	virtual TSharedPtr<IHttpRequest> CreateGetConnectivity() override
+	{
+		return NewClipRequest(GetResourceURL() + TEXT("/zigbee_connectivity"), TEXT("GET"));
+	}
+
+	virtual TSharedPtr<IHttpRequest> CreateEventStream() override
+	{
+		const TSharedRef<IHttpRequest> Request = NewClipRequest(GetBaseURL() + TEXT("/eventstream/clip/v2"), TEXT("GET"));
+		Request->SetHeader(TEXT("Accept"), TEXT("text/event-stream"));
+		return Request;
+	}
+
+	static TSharedRef<FJsonObject> MakeXY(const FVector2D& XY)
+	{
+		TSharedRef<FJsonObject> Point = MakeShared<FJsonObject>();
+		Point->SetNumberField(TEXT("x"), XY.X);
+		Point->SetNumberField(TEXT("y"), XY.Y);
+		TSharedRef<FJsonObject> Color = MakeShared<FJsonObject>();
+		Color->SetObjectField(TEXT("xy"), Point);
+		return Color;
+	}
+
+	void ReadLight(const TSharedPtr<FJsonObject>& LightObj, FHueLightRecord& LightOut) const
+	{
+		LightObj->TryGetStringField(TEXT("id"), LightOut.ResourceId);
+		//Reachable until the connectivity read says the light's device lost its link
+		const TSharedPtr<FJsonObject>* Owner;
+		FString DeviceId;
+		if(LightObj->TryGetObjectField(TEXT("owner"), Owner) && (*Owner)->TryGetStringField(TEXT("rid"), DeviceId))
+		{
+			LightDevices.Add(LightOut.ResourceId, DeviceId);
+			if(const bool* bConnected = ConnectedDevices.Find(DeviceId))
+			{
+				LightOut.bReachable = *bConnected;
+			}
+		}
+		const TSharedPtr<FJsonObject>* Metadata;
+		if(LightObj->TryGetObjectField(TEXT("metadata"), Metadata))
+		{
+			(*Metadata)->TryGetStringField(TEXT("name"), LightOut.Name);
+		}
+
+		const TSharedPtr<FJsonObject>* On;
+		LightOut.bHasState = LightObj->TryGetObjectField(TEXT("on"), On);
+		if(LightOut.bHasState)
+		{
+			(*On)->TryGetBoolField(TEXT("on"), LightOut.State.bOn);
+		}
+		const TSharedPtr<FJsonObject>* Dimming;
+		double Brightness = 100.0;
+		if(LightObj->TryGetObjectField(TEXT("dimming"), Dimming))
+		{
+			(*Dimming)->TryGetNumberField(TEXT("brightness"), Brightness);
+		}
+		LightOut.State.Brightness = FMath::Clamp(FMath::RoundToInt(Brightness / 100.0 * 254.0), 0, 254);
+
+		const TSharedPtr<FJsonObject>* Color;
+		const TSharedPtr<FJsonObject>* XY;
+		double X = 0.0;
+		double Y = 0.0;
+		if(LightObj->TryGetObjectField(TEXT("color"), Color) && (*Color)->TryGetObjectField(TEXT("xy"), XY) &&
+			(*XY)->TryGetNumberField(TEXT("x"), X) && (*XY)->TryGetNumberField(TEXT("y"), Y))
+		{
+			LightOut.State.SetColorFromXY(X, Y);
+		}
+
+		const TSharedPtr<FJsonObject>* Gradient;
+		int32 PointsCapable = 0;
+		if(LightObj->TryGetObjectField(TEXT("gradient"), Gradient) && (*Gradient)->TryGetNumberField(TEXT("points_capable"), PointsCapable))
+		{
+			LightOut.GradientPoints = PointsCapable;
+		}
+	}
+
+	/**
+	 * @brief v2 wraps every resource in {"errors":[],"data":[...]}, also remembers the v1 number of every light for scenes
+	 */
+	virtual bool ParseLights(const FString& Data, TArray<FHueLightRecord>& LightsOut) const override
+	{
+		TSharedPtr<FJsonObject> ResponseObj;
+		const TSharedRef<TJsonReader<>> JsonReader = TJsonReaderFactory<>::Create(Data);
+		const TArray<TSharedPtr<FJsonValue>>* DataArray;
+		if(!FJsonSerializer::Deserialize(JsonReader, ResponseObj) || !ResponseObj.IsValid() || !ResponseObj->TryGetArrayField(TEXT("data"), DataArray))
+		{
+			return false;
+		}
+		for (const auto& Element : *DataArray)
+		{
+			const TSharedPtr<FJsonObject>* LightObj;
+			if(!Element->TryGetObject(LightObj))
+			{
+				continue;
+			}
+			FHueLightRecord& Light = LightsOut.AddDefaulted_GetRef();
+			ReadLight(*LightObj, Light);
+			FString LegacyPath;
+			if((*LightObj)->TryGetStringField(TEXT("id_v1"), LegacyPath))
+			{
+				LegacyIds.Add(Light.ResourceId, FPaths::GetCleanFilename(LegacyPath));
+			}
+		}
+		return true;
+	}
+
+	virtual bool ParseLight(const FString& ResourceId, const FString& Data, FHueLightRecord& LightOut) const override
+	{
+		TArray<FHueLightRecord> Lights;
+		if(!ParseLights(Data, Lights) || Lights.Num() == 0)
+		{
+			return false;
+		}
+		LightOut = Lights[0];
+		return LightOut.bHasState;
+	}
+
+	virtual bool ParseCreatedId(const FString& Data, FString& IdOut) const override
+	{
+		return Legacy.ParseCreatedId(Data, IdOut);
+	}
+
+	virtual bool ParseSensors(const FString& Data, TArray<FHueSensorState>& SensorsOut) const override
+	{
+		return Legacy.ParseSensors(Data, SensorsOut);
+	}
+
+	virtual bool ParseCreatedUser(const FString& Data, FString& UserOut) const override
+	{
+		return Legacy.ParseCreatedUser(Data, UserOut);
+	}
+
+	//Group actions go through the v1 group 0
+	virtual bool ParseActionSucceeded(const FString& Data) const override
+	{
+		return Legacy.ParseActionSucceeded(Data);
+	}
+
+	/**
+	 * @brief Every zigbee_connectivity resource belongs to a device, only "connected" can take commands.
+	 * connectivity_issue, disconnected and unidirectional_incoming all mean our changes won't arrive
+	 */
+	virtual bool ParseConnectivity(const FString& Data) const override
+	{
+		TSharedPtr<FJsonObject> ResponseObj;
+		const TSharedRef<TJsonReader<>> JsonReader = TJsonReaderFactory<>::Create(Data);
+		const TArray<TSharedPtr<FJsonValue>>* DataArray;
+		if(!FJsonSerializer::Deserialize(JsonReader, ResponseObj) || !ResponseObj.IsValid() || !ResponseObj->TryGetArrayField(TEXT("data"), DataArray))
+		{
+			return false;
+		}
+		for (const auto& Element : *DataArray)
+		{
+			const TSharedPtr<FJsonObject>* Connectivity;
+			const TSharedPtr<FJsonObject>* Owner;
+			FString DeviceId;
+			FString Status;
+			if(Element->TryGetObject(Connectivity) && (*Connectivity)->TryGetObjectField(TEXT("owner"), Owner)
+				&& (*Owner)->TryGetStringField(TEXT("rid"), DeviceId) && (*Connectivity)->TryGetStringField(TEXT("status"), Status))
+			{
+				ConnectedDevices.Add(DeviceId, Status == TEXT("connected"));
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * @brief Every "data:" line is an array of events, each with the changed resources. Resources are mapped back to
+	 * their v1 sensor through id_v1. Button updates don't say which button of a switch it was unless metadata is sent,
+	 * those come out with just the event code
+	 */
+	virtual bool ParseEvents(const FString& Lines, TArray<FHueSensorState>& EventsOut) const override
+	{
+		TArray<FString> LineArray;
+		Lines.ParseIntoArrayLines(LineArray);
+		for (const FString& Line : LineArray)
+		{
+			if(!Line.StartsWith(TEXT("data:")))
+			{
+				continue;
+			}
+			TArray<TSharedPtr<FJsonValue>> Events;
+			const TSharedRef<TJsonReader<>> JsonReader = TJsonReaderFactory<>::Create(Line.RightChop(5));
+			if(!FJsonSerializer::Deserialize(JsonReader, Events))
+			{
+				continue;
+			}
+			for (const auto& EventValue : Events)
+			{
+				const TSharedPtr<FJsonObject>* EventObj;
+				const TArray<TSharedPtr<FJsonValue>>* Items;
+				if(!EventValue->TryGetObject(EventObj) || !(*EventObj)->TryGetArrayField(TEXT("data"), Items))
+				{
+					continue;
+				}
+				FString CreationTime;
+				(*EventObj)->TryGetStringField(TEXT("creationtime"), CreationTime);
+				const FDateTime Stamp = HueTransport::ParseStamp(CreationTime);
+				for (const auto& ItemValue : *Items)
+				{
+					const TSharedPtr<FJsonObject>* Item;
+					FHueSensorState Event;
+					if(ItemValue->TryGetObject(Item) && ReadEvent(*Item, Event))
+					{
+						Event.LastUpdated = Stamp;
+						EventsOut.Add(MoveTemp(Event));
+					}
+				}
+			}
+		}
+		return EventsOut.Num() > 0;
+	}
+
+	static bool ReadEvent(const TSharedPtr<FJsonObject>& Item, FHueSensorState& EventOut)
+	{
+		FString LegacyPath;
+		FString TypeName;
+		if(!Item->TryGetStringField(TEXT("id_v1"), LegacyPath) || !LegacyPath.StartsWith(TEXT("/sensors/")) || !Item->TryGetStringField(TEXT("type"), TypeName))
+		{
+			return false;
+		}
+		EventOut.SensorId = FPaths::GetCleanFilename(LegacyPath);
+		const TSharedPtr<FJsonObject>* Field;
+		if(TypeName == TEXT("button") && Item->TryGetObjectField(TEXT("button"), Field))
+		{
+			static const TCHAR* Codes[] = { TEXT("initial_press"), TEXT("repeat"), TEXT("short_release"), TEXT("long_release") };
+			FString LastEvent;
+			(*Field)->TryGetStringField(TEXT("last_event"), LastEvent);
+			EventOut.Type = EHueSensorType::Switch;
+			for (int32 Code = 0; Code < static_cast<int32>(UE_ARRAY_COUNT(Codes)); ++Code)
+			{
+				if(LastEvent == Codes[Code])
+				{
+					EventOut.ButtonEvent = Code;
+				}
+			}
+			const TSharedPtr<FJsonObject>* Metadata;
+			int32 ControlId = 0;
+			if(Item->TryGetObjectField(TEXT("metadata"), Metadata) && (*Metadata)->TryGetNumberField(TEXT("control_id"), ControlId))
+			{
+				EventOut.ButtonEvent += ControlId * 1000;
+			}
+			return true;
+		}
+		if(TypeName == TEXT("motion") && Item->TryGetObjectField(TEXT("motion"), Field))
+		{
+			EventOut.Type = EHueSensorType::Presence;
+			return (*Field)->TryGetBoolField(TEXT("motion"), EventOut.bPresence);
+		}
+		if(TypeName == TEXT("light_level") && Item->TryGetObjectField(TEXT("light"), Field))
+		{
+			EventOut.Type = EHueSensorType::LightLevel;
+			return (*Field)->TryGetNumberField(TEXT("light_level"), EventOut.LightLevel);
+		}
+		if(TypeName == TEXT("temperature") && Item->TryGetObjectField(TEXT("temperature"), Field))
+		{
+			double Temperature = 0.0;
+			EventOut.Type = EHueSensorType::Temperature;
+			const bool bRead = (*Field)->TryGetNumberField(TEXT("temperature"), Temperature);
+			EventOut.Temperature = static_cast<float>(Temperature);
+			return bRead;
+		}
+		return false;
+	}
+
+	/**
+	 * @brief v2 still takes a change for a light it can't reach and warns in the errors array with
+	 * "device (light) has communication issues, command (...) may not have effect". A 404 is a deleted light, not an
+	 * unreachable one. Without the warning the last connectivity read decides
+	 */
+	virtual bool IsUnreachableError(const FHttpResponsePtr& Response) const override
+	{
+		if(!Response.IsValid())
+		{
+			return false;
+		}
+		TSharedPtr<FJsonObject> ResponseObj;
+		const TSharedRef<TJsonReader<>> JsonReader = TJsonReaderFactory<>::Create(Response->GetContentAsString());
+		const TArray<TSharedPtr<FJsonValue>>* Errors;
+		if(FJsonSerializer::Deserialize(JsonReader, ResponseObj) && ResponseObj.IsValid() && ResponseObj->TryGetArrayField(TEXT("errors"), Errors))
+		{
+			for (const auto& Element : *Errors)
+			{
+				const TSharedPtr<FJsonObject>* Error;
+				FString Description;
+				if(Element->TryGetObject(Error) && (*Error)->TryGetStringField(TEXT("description"), Description)
+					&& Description.Contains(TEXT("communication issues")))
+				{
+					return true;
+				}
+			}
+		}
+		const FString* DeviceId = LightDevices.Find(FPaths::GetCleanFilename(Response->GetURL()));
+		const bool* bConnected = DeviceId ? ConnectedDevices.Find(*DeviceId) : nullptr;
+		return bConnected && !*bConnected;
+	}
+
+private:
+	FHueTransportV1 Legacy;
+	//v2 resource id to v1 light number
+	mutable TMap<FString, FString> LegacyIds;
+	//v2 light id to the device that owns it
+	mutable TMap<FString, FString> LightDevices;
+	//Device id to whether its zigbee link is connected
+	mutable TMap<FString, bool> ConnectedDevices;
+};
+
+/**
+ * @brief Create the transport for a bridge
+ * @param Version Api version to talk
+ * @param Host Bridge host name or ip
+ * @param Key v1 user name, the same value is the v2 application key
+ */
+TSharedRef<IHueTransport> IHueTransport::Create(EHueApiVersion Version, const FString& Host, const FString& Key)
+{
+	if(Version == EHueApiVersion::ClipV2)
+	{
+		return MakeShared<FHueTransportClipV2>(Host, Key);
+	}
+	return MakeShared<FHueTransportV1>(Host, Key);
+}
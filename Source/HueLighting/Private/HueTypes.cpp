@@ -0,0 +1,167 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueTypes.h"
+#include "Dom/JsonObject.h"
+
+/**
+ * @brief Quantize a linear color into the Hue bridge value ranges
+ * @param Color FLinearColor color to convert, alpha is ignored
+ * @param Intensity float 0-1 scale applied on top of the color value
+ * @return Quantized lamp state, off when the brightness rounds down to 0
+ */
+FHueLampState FHueLampState::FromLinearColor(const FLinearColor& Color, float Intensity)
+{
+	// HSV is packed as R = Hue in degrees, G = Saturation, B = Value
+	const FLinearColor HSV = Color.LinearRGBToHSV();
+
+	FHueLampState State;
+	// Magic numbers are the hue bridge max values, Hue 65535,Sat 254 Bri 254
+	State.Hue = FMath::Clamp(FMath::RoundToInt(HSV.R / 360.0f * 65535.0f), 0, 65535);
+	State.Saturation = FMath::Clamp(FMath::RoundToInt(HSV.G * 254.0f), 0, 254);
+	State.Brightness = FMath::Clamp(FMath::RoundToInt(FMath::Clamp(HSV.B, 0.0f, 1.0f) * FMath::Clamp(Intensity, 0.0f, 1.0f) * 254.0f), 0, 254);
+	State.bOn = State.Brightness > 0;
+	return State;
+}
+
+/**
+ * @brief Expand a quantized lamp state back into a linear color
+ * @return FLinearColor, black when the lamp is off
+ */
+FLinearColor FHueLampState::ToLinearColor() const
+{
+	if(!bOn)
+	{
+		return FLinearColor::Black;
+	}
+	const FLinearColor HSV(Hue / 65535.0f * 360.0f, Saturation / 254.0f, Brightness / 254.0f);
+	return HSV.HSVToLinearRGB();
+}
+
+/**
+ * @brief Convert the state to CIE L*a*b* (D65) so color differences can be compared the way eyes see them
+ * @return FVector with X as L, Y as a, Z as b
+ */
+FVector FHueLampState::ToLab() const
+{
+	const FLinearColor RGB = ToLinearColor();
+	//Linear sRGB to XYZ, normalized to the D65 white point
+	const float X = (0.4124f * RGB.R + 0.3576f * RGB.G + 0.1805f * RGB.B) / 0.95047f;
+	const float Y = 0.2126f * RGB.R + 0.7152f * RGB.G + 0.0722f * RGB.B;
+	const float Z = (0.0193f * RGB.R + 0.1192f * RGB.G + 0.9505f * RGB.B) / 1.08883f;
+
+	auto F = [](float T)
+	{
+		return T > 0.008856f ? FMath::Pow(T, 1.0f / 3.0f) : 7.787f * T + 16.0f / 116.0f;
+	};
+	const float FX = F(X);
+	const float FY = F(Y);
+	const float FZ = F(Z);
+	return FVector(116.0f * FY - 16.0f, 500.0f * (FX - FY), 200.0f * (FY - FZ));
+}
+
+/**
+ * @brief CIE xy chromaticity of the state's color, what the CLIP v2 api and gradients take.
+ * Uses the wide gamut conversion from the Hue developer docs, brightness is sent separately
+ * @return FVector2D with X as x, Y as y
+ */
+FVector2D FHueLampState::ToXY() const
+{
+	TArray<FVector2D> XY;
+	ToXYBatch(MakeArrayView(this, 1), XY);
+	return XY[0];
+}
+
+/**
+ * @brief CIE xy chromaticity of many states at once, used for gradient strips that send every point in one request.
+ * Hue and saturation are expanded first, then the gamut matrix runs over the whole array in one pass
+ * @param States States to convert, brightness and on are ignored
+ * @param XYOut One xy point per state
+ */
+void FHueLampState::ToXYBatch(TConstArrayView<FHueLampState> States, TArray<FVector2D>& XYOut)
+{
+	TArray<FLinearColor, TInlineAllocator<16>> RGB;
+	RGB.SetNumUninitialized(States.Num());
+	for (int32 Index = 0; Index < States.Num(); ++Index)
+	{
+		RGB[Index] = FLinearColor(States[Index].Hue / 65535.0f * 360.0f, States[Index].Saturation / 254.0f, 1.0f).HSVToLinearRGB();
+	}
+
+	XYOut.SetNumUninitialized(States.Num());
+	for (int32 Index = 0; Index < RGB.Num(); ++Index)
+	{
+		const FLinearColor& Color = RGB[Index];
+		const double X = Color.R * 0.664511 + Color.G * 0.154324 + Color.B * 0.162028;
+		const double Y = Color.R * 0.283881 + Color.G * 0.668433 + Color.B * 0.047685;
+		const double Z = Color.R * 0.000088 + Color.G * 0.072310 + Color.B * 0.986039;
+		const double Sum = X + Y + Z;
+		//Black has no chromaticity, use D65 white
+		XYOut[Index] = Sum <= 0.0 ? FVector2D(0.3127, 0.3290) : FVector2D(X / Sum, Y / Sum);
+	}
+}
+
+/**
+ * @brief Set hue and saturation from CIE xy chromaticity, brightness and on are left alone
+ * @param X CIE x
+ * @param Y CIE y
+ */
+void FHueLampState::SetColorFromXY(double X, double Y)
+{
+	if(Y <= 0.0)
+	{
+		return;
+	}
+	const double CX = X / Y;
+	const double CZ = (1.0 - X - Y) / Y;
+	FLinearColor RGB(
+		static_cast<float>(CX * 1.656492 - 0.354851 - CZ * 0.255038),
+		static_cast<float>(-CX * 0.707196 + 1.655397 + CZ * 0.036152),
+		static_cast<float>(CX * 0.051713 - 0.121364 + CZ * 1.011530));
+	RGB.R = FMath::Max(RGB.R, 0.0f);
+	RGB.G = FMath::Max(RGB.G, 0.0f);
+	RGB.B = FMath::Max(RGB.B, 0.0f);
+	const float Max = RGB.GetMax();
+	if(Max <= 0.0f)
+	{
+		return;
+	}
+	const FLinearColor HSV = (RGB / Max).LinearRGBToHSV();
+	Hue = FMath::Clamp(FMath::RoundToInt(HSV.R / 360.0f * 65535.0f), 0, 65535);
+	Saturation = FMath::Clamp(FMath::RoundToInt(HSV.G * 254.0f), 0, 254);
+}
+
+/**
+ * @brief Visible difference between two lamp states, CIE76 delta E. Around 2.3 is just noticeable
+ * @return float delta E, 0 if both states look the same
+ */
+float FHueLampState::PerceptualDistance(const FHueLampState& A, const FHueLampState& B)
+{
+	if(A == B)
+	{
+		return 0.0f;
+	}
+	return static_cast<float>(FVector::Distance(A.ToLab(), B.ToLab()));
+}
+
+/**
+ * @brief Read a lamp state object as the bridge reports it in /lights, white only lamps have no hue or sat
+ * @param StateObj Json "state" object of a light
+ * @param StateOut FHueLampState out param to be filled
+ * @param bReachableOut Out param, false if the bridge can't reach the lamp
+ */
+void FHueLampState::FromBridgeJson(const TSharedPtr<FJsonObject>& StateObj, FHueLampState& StateOut, bool& bReachableOut)
+{
+	StateOut = FHueLampState();
+	bReachableOut = true;
+	if(!StateObj.IsValid())
+	{
+		return;
+	}
+	StateObj->TryGetBoolField(TEXT("on"), StateOut.bOn);
+	StateObj->TryGetNumberField(TEXT("hue"), StateOut.Hue);
+	StateObj->TryGetNumberField(TEXT("sat"), StateOut.Saturation);
+	StateObj->TryGetNumberField(TEXT("bri"), StateOut.Brightness);
+	StateObj->TryGetBoolField(TEXT("reachable"), bReachableOut);
+}
@@ -0,0 +1,87 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueBridge.h"
+#include "HueBridgeDiscovery.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FHueBridgeDiscoveryChainTest, "HueLighting.Discovery.ChainedLampDiscovery",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/**
+ * @brief LoadConfig asks for lamps once the bridge is found. A failed discovery has to drop that request so a later
+ * unrelated discovery doesn't start lamp discovery
+ */
+bool FHueBridgeDiscoveryChainTest::RunTest(const FString& Parameters)
+{
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false);
+	FWorldContext& Context = GEngine->CreateNewWorldContext(EWorldType::Game);
+	Context.SetCurrentWorld(World);
+	AHueBridge* Bridge = World->SpawnActor<AHueBridge>();
+
+	//Failed discovery drops the chained request
+	Bridge->bDiscoverLampsAfterBridge = true;
+	Bridge->OnBridgeDiscoveryFinished(false, FString());
+	TestFalse(TEXT("Failed discovery clears the lamp request"), Bridge->bDiscoverLampsAfterBridge);
+
+	//A later success that nobody chained lamps onto only updates the host
+	Bridge->OnBridgeDiscoveryFinished(true, TEXT("127.0.0.1"));
+	TestFalse(TEXT("Unchained discovery doesn't discover lamps"), Bridge->IsOperationRunning(EHueBridgeOperation::Discover));
+	TestEqual(TEXT("Host follows the found bridge"), Bridge->HueBridgeConfig.HostName, FString(TEXT("127.0.0.1")));
+
+	//A chained success starts lamp discovery once
+	Bridge->bDiscoverLampsAfterBridge = true;
+	Bridge->OnBridgeDiscoveryFinished(true, TEXT("127.0.0.1"));
+	TestTrue(TEXT("Chained discovery discovers lamps"), Bridge->IsOperationRunning(EHueBridgeOperation::Discover));
+	TestFalse(TEXT("Chained request is used up"), Bridge->bDiscoverLampsAfterBridge);
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FHueBridgeDiscoverySubnetTest, "HueLighting.Discovery.SubnetProbe",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/**
+ * @brief The default settings can probe the whole /24 inside their time budget, hosts near ours go first, and only a
+ * real bridge answer sets the bridge id
+ */
+bool FHueBridgeDiscoverySubnetTest::RunTest(const FString& Parameters)
+{
+	const FHueDiscoverySettings Defaults;
+	TestTrue(TEXT("Default settings probe the whole subnet within the budget"),
+		FHueBridgeDiscovery::GetSubnetProbeTime(Defaults) <= Defaults.TimeBudget);
+
+	TArray<int32> Order;
+	FHueBridgeDiscovery::GetSubnetOrder(200, Order);
+	TestEqual(TEXT("Every other host is probed once"), Order.Num(), 253);
+	TestFalse(TEXT("Our own address isn't probed"), Order.Contains(200));
+	TestTrue(TEXT("Neighbours go first"), Order.Num() > 2 && FMath::Abs(Order[0] - 200) == 1 && FMath::Abs(Order[1] - 200) == 1);
+	TestEqual(TEXT("The far end goes last"), Order.Last(), 1);
+	TArray<int32> Sorted = Order;
+	Sorted.Sort();
+	TestTrue(TEXT("No host is probed twice"), Sorted.Num() == 253 && Sorted[0] == 1 && Sorted.Last() == 254);
+
+	//An override subnet has no host of ours in it
+	FHueBridgeDiscovery::GetSubnetOrder(0, Order);
+	TestEqual(TEXT("Unknown local host probes all 254"), Order.Num(), 254);
+
+	FString BridgeId = TEXT("stale");
+	TestFalse(TEXT("A config without a model isn't a bridge"),
+		FHueBridgeDiscovery::ParseConfig(TEXT("{\"bridgeid\":\"001788FFFE000001\"}"), BridgeId));
+	TestEqual(TEXT("A rejected answer leaves the id alone"), BridgeId, FString(TEXT("stale")));
+	TestFalse(TEXT("Garbage isn't a bridge"), FHueBridgeDiscovery::ParseConfig(TEXT("<html></html>"), BridgeId));
+	TestTrue(TEXT("A bridge config parses"),
+		FHueBridgeDiscovery::ParseConfig(TEXT("{\"bridgeid\":\"001788FFFE000002\",\"modelid\":\"BSB002\"}"), BridgeId));
+	TestEqual(TEXT("The bridge id is read"), BridgeId, FString(TEXT("001788FFFE000002")));
+	return true;
+}
+
+#endif
@@ -0,0 +1,83 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueBridge.h"
+#include "HueLamp.h"
+#include "HueTransport.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FHueBridgeHydrationTest, "HueLighting.Bridge.BulkHydration",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/**
+ * @brief One /lights answer spawns and fills every lamp, start colors come from the first answer only, a bulk refresh
+ * neither spawns lamps nor overwrites a change the game is still sending, and an error body is not a light list
+ */
+bool FHueBridgeHydrationTest::RunTest(const FString& Parameters)
+{
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false);
+	FWorldContext& Context = GEngine->CreateNewWorldContext(EWorldType::Game);
+	Context.SetCurrentWorld(World);
+	AHueBridge* Bridge = World->SpawnActor<AHueBridge>();
+	const TSharedPtr<IHueTransport> Transport = Bridge->Transport;
+
+	TArray<FHueLightRecord> Records;
+	TestTrue(TEXT("The startup read parses"), Transport->ParseLights(TEXT("{")
+		TEXT("\"1\":{\"name\":\"Desk\",\"state\":{\"on\":true,\"bri\":200,\"hue\":10000,\"sat\":254,\"reachable\":true}},")
+		TEXT("\"2\":{\"name\":\"Shelf\",\"state\":{\"on\":false,\"bri\":1,\"hue\":0,\"sat\":0,\"reachable\":false}},")
+		TEXT("\"3\":{\"name\":\"\",\"state\":{\"on\":true,\"reachable\":true}}}"), Records));
+	Bridge->OnLampsDiscovered(Records);
+
+	TestEqual(TEXT("Named lights get a lamp each"), Bridge->HueLamps.Num(), 2);
+	TestEqual(TEXT("Every light on the bridge is counted"), Bridge->BridgeLightCount, 3);
+	AHueLamp* Desk = Bridge->GetLamp(TEXT("Desk"));
+	AHueLamp* Shelf = Bridge->GetLamp(TEXT("Shelf"));
+	if(!TestNotNull(TEXT("Desk spawned"), Desk) || !TestNotNull(TEXT("Shelf spawned"), Shelf))
+	{
+		return false;
+	}
+	const FHueLampState StartState = Desk->GetBridgeState();
+	TestEqual(TEXT("State comes from the bulk read"), StartState.Brightness, 200);
+	TestTrue(TEXT("Start color is filled without a lamp read"), Desk->GetStartColor() == StartState.ToColor());
+	TestTrue(TEXT("Lamp color is filled without a lamp read"), Desk->GetLampColor() == StartState.ToColor());
+	TestTrue(TEXT("What the lamp shows counts as sent"), Desk->GetLastSentState() == StartState);
+	TestFalse(TEXT("Reachability comes from the bulk read"), Shelf->IsReachable());
+
+	//The game changes the desk while the next refresh is on its way
+	FHueLampState Wanted;
+	Wanted.bOn = true;
+	Wanted.Hue = 40000;
+	Wanted.Saturation = 100;
+	Wanted.Brightness = 80;
+	TestTrue(TEXT("The change is taken"), Desk->ApplyState(Wanted));
+
+	Records.Reset();
+	Transport->ParseLights(TEXT("{")
+		TEXT("\"1\":{\"name\":\"Desk\",\"state\":{\"on\":true,\"bri\":120,\"hue\":10000,\"sat\":254,\"reachable\":true}},")
+		TEXT("\"2\":{\"name\":\"Shelf\",\"state\":{\"on\":false,\"bri\":1,\"hue\":0,\"sat\":0,\"reachable\":true}},")
+		TEXT("\"4\":{\"name\":\"Porch\",\"state\":{\"on\":true,\"bri\":254,\"hue\":0,\"sat\":0,\"reachable\":true}}}"), Records);
+	Bridge->UpdateLamps(Records, false);
+
+	TestEqual(TEXT("A refresh doesn't spawn lamps"), Bridge->HueLamps.Num(), 2);
+	TestEqual(TEXT("A refresh updates the bridge state"), Desk->GetBridgeState().Brightness, 120);
+	TestTrue(TEXT("The start color stays the first one read"), Desk->GetStartColor() == StartState.ToColor());
+	TestTrue(TEXT("A refresh doesn't drop the change still to be sent"), Desk->GetDesiredState() == Wanted);
+	TestTrue(TEXT("A refresh brings a lamp back"), Shelf->IsReachable());
+
+	//An unknown user gets an error array back, that is not an empty room
+	Records.Reset();
+	TestFalse(TEXT("An error body is not a light list"),
+		Transport->ParseLights(TEXT("[{\"error\":{\"type\":1,\"address\":\"/lights\",\"description\":\"unauthorized user\"}}]"), Records));
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+	return true;
+}
+
+#endif
@@ -0,0 +1,168 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueCommandBroker.h"
+#include "HueSensors.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace HueBrokerTest
+{
+	//Away from the bridge default so a running game doesn't answer
+	const int32 BASE_PORT = 49650;
+
+	//Tick every broker a few rounds, loopback datagrams arrive between rounds
+	void Pump(const TArray<FHueCommandBroker*>& Brokers, double& Now, double Step, int32 Rounds, TArray<FHueBrokerCommand>& OwnerCommandsOut)
+	{
+		TArray<FHueBrokerCommand> Commands;
+		for (int32 Round = 0; Round < Rounds; ++Round)
+		{
+			Now += Step;
+			for (FHueCommandBroker* Broker : Brokers)
+			{
+				Broker->Tick(Now, Commands);
+				OwnerCommandsOut.Append(Commands);
+			}
+			FPlatformProcess::Sleep(0.002f);
+		}
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FHueCommandBrokerCollisionTest, "HueLighting.Broker.PortCollision",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/**
+ * @brief Two bridges that hash to the same port get their own owners, a client of the second bridge finds its owner
+ * past the first one's port, its submits only count once the owner confirms them and it takes over when the owner exits
+ */
+bool FHueCommandBrokerCollisionTest::RunTest(const FString& Parameters)
+{
+	const FString KeyA = TEXT("001788fffe000001");
+	FString KeyB;
+	for (int32 Index = 2; KeyB.IsEmpty(); ++Index)
+	{
+		const FString Key = FString::Printf(TEXT("001788fffe%06d"), Index);
+		if(FCrc::StrCrc32(*Key) % 64 == FCrc::StrCrc32(*KeyA) % 64)
+		{
+			KeyB = Key;
+		}
+	}
+
+	FHueCommandBroker OwnerA(HueBrokerTest::BASE_PORT, KeyA);
+	FHueCommandBroker OwnerB(HueBrokerTest::BASE_PORT, KeyB);
+	FHueCommandBroker ClientB(HueBrokerTest::BASE_PORT, KeyB);
+	if(!TestTrue(TEXT("The first bridge owns its port"), OwnerA.Start()))
+	{
+		return false;
+	}
+	TestFalse(TEXT("The second bridge finds its port taken"), OwnerB.Start());
+	TArray<FHueBrokerCommand> Commands;
+	double Now = FPlatformTime::Seconds();
+	HueBrokerTest::Pump({ &OwnerA, &OwnerB }, Now, 0.01, 5, Commands);
+	TestTrue(TEXT("The second bridge owns the next port"), OwnerB.IsOwner() && OwnerB.GetPort() != OwnerA.GetPort());
+
+	ClientB.Start();
+	HueBrokerTest::Pump({ &OwnerA, &OwnerB, &ClientB }, Now, 0.01, 10, Commands);
+	TestTrue(TEXT("The client reaches its own bridge's owner"), ClientB.IsConnected() && ClientB.GetPort() == OwnerB.GetPort());
+
+	FHueLampState State;
+	State.bOn = true;
+	State.Brightness = 120;
+	TestTrue(TEXT("The connected client submits"), ClientB.Submit(TEXT("3"), State));
+	Commands.Reset();
+	HueBrokerTest::Pump({ &OwnerA, &OwnerB, &ClientB }, Now, 0.01, 3, Commands);
+	TestEqual(TEXT("The other bridge's owner gets nothing"), OwnerA.GetReceivedCount(), 0);
+	if(!TestEqual(TEXT("The owner gets the state"), Commands.Num(), 1))
+	{
+		return false;
+	}
+	TArray<FHueBrokerCommand> Confirmed;
+	TestFalse(TEXT("Nothing counts as handed over before the owner confirms"), ClientB.ConsumeConfirmed(Confirmed));
+	OwnerB.Confirm(Commands[0]);
+	HueBrokerTest::Pump({ &OwnerA, &OwnerB, &ClientB }, Now, 0.01, 3, Commands);
+	TestTrue(TEXT("The confirmation comes back"), ClientB.ConsumeConfirmed(Confirmed) && Confirmed.Num() == 1
+		&& Confirmed[0].LightId == TEXT("3") && Confirmed[0].State == State);
+
+	//The owner exits, the client walks the ports again and takes the free one
+	OwnerB.Stop();
+	HueBrokerTest::Pump({ &OwnerA, &ClientB }, Now, 0.3, 10, Commands);
+	TestTrue(TEXT("The client takes over its bridge"), ClientB.IsOwner() && ClientB.GetPort() != OwnerA.GetPort());
+
+	//The first bridge's owner exits and a new process of the second bridge takes the port it hashes to
+	OwnerA.Stop();
+	FHueCommandBroker LateB(HueBrokerTest::BASE_PORT, KeyB);
+	TestTrue(TEXT("A new process owns the freed port"), LateB.Start());
+	HueBrokerTest::Pump({ &ClientB, &LateB }, Now, 0.3, 10, Commands);
+	TestTrue(TEXT("The owner further up hands over"), LateB.IsOwner() && ClientB.IsConnected() && ClientB.GetPort() == LateB.GetPort());
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FHueCommandBrokerSensorRelayTest, "HueLighting.Broker.SensorRelay",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/**
+ * @brief Sensors the owner sends reach the client whole. The table a client gets on its read is only recorded, a
+ * change is broadcast once even if it arrives twice
+ */
+bool FHueCommandBrokerSensorRelayTest::RunTest(const FString& Parameters)
+{
+	FHueCommandBroker Owner(HueBrokerTest::BASE_PORT, TEXT("001788fffe00aaaa"));
+	FHueCommandBroker Client(HueBrokerTest::BASE_PORT, TEXT("001788fffe00aaaa"));
+	if(!TestTrue(TEXT("The first process owns the bridge"), Owner.Start()))
+	{
+		return false;
+	}
+	Client.Start();
+	TArray<FHueBrokerCommand> Commands;
+	double Now = FPlatformTime::Seconds();
+	HueBrokerTest::Pump({ &Owner, &Client }, Now, 0.01, 5, Commands);
+	if(!TestTrue(TEXT("The client reaches the owner"), Client.IsConnected()))
+	{
+		return false;
+	}
+
+	FHueSensorState Switch;
+	Switch.SensorId = TEXT("5");
+	Switch.Name = TEXT("Hallway dimmer");
+	Switch.Type = EHueSensorType::Switch;
+	Switch.ButtonEvent = 1002;
+	Switch.LastUpdated = FDateTime(2023, 5, 1, 10, 0, 0);
+	FHueSensorState Pressed = Switch;
+	Pressed.ButtonEvent = 4002;
+	Pressed.LastUpdated = FDateTime(2023, 5, 1, 10, 0, 3);
+	Pressed.LatencyMs = 42.0f;
+	Owner.PublishSensors({ Switch }, false);
+	Owner.PublishSensors({ Pressed }, true);
+	Owner.PublishSensors({ Pressed }, true);
+	HueBrokerTest::Pump({ &Owner, &Client }, Now, 0.01, 3, Commands);
+
+	TArray<FHueBrokerSensor> Relayed;
+	Client.ConsumeSensors(Relayed);
+	if(!TestEqual(TEXT("Every sensor packet arrives"), Relayed.Num(), 3))
+	{
+		return false;
+	}
+	TestFalse(TEXT("The table is marked as such"), Relayed[0].bChanged);
+	const FHueSensorState& Change = Relayed[1].State;
+	TestTrue(TEXT("A change arrives whole"), Relayed[1].bChanged && Change.SensorId == Pressed.SensorId && Change.Name == Pressed.Name
+		&& Change.Type == Pressed.Type && Change.ButtonEvent == Pressed.ButtonEvent && Change.LastUpdated == Pressed.LastUpdated
+		&& FMath::IsNearlyEqual(Change.LatencyMs, Pressed.LatencyMs));
+
+	FHueSensorPoller Poller(0.1f, 2.0f, 5.0f);
+	TArray<FHueSensorState> Changed;
+	int32 Broadcasts = 0;
+	for (const FHueBrokerSensor& Sensor : Relayed)
+	{
+		Poller.MergeRelayed({ Sensor.State }, Sensor.bChanged, Now, Changed);
+		Broadcasts += Changed.Num();
+	}
+	TestEqual(TEXT("The client knows the sensor"), Poller.GetSensors().Num(), 1);
+	TestEqual(TEXT("The press is broadcast once"), Broadcasts, 1);
+	TestEqual(TEXT("The client holds the newest reading"), Poller.GetSensors()[TEXT("5")].ButtonEvent, 4002);
+	return true;
+}
+
+#endif
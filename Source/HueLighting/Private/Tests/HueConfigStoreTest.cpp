@@ -0,0 +1,131 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueConfigStore.h"
+#include "HueBridge.h"
+#include "HAL/FileManager.h"
+#include "Misc/AutomationTest.h"
+#include "Misc/Paths.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace HueConfigStoreTest
+{
+	FLightUse MakeLight(const TCHAR* LightId, const TCHAR* LightName, bool bUseLight)
+	{
+		FLightUse Light;
+		Light.LightId = LightId;
+		Light.LightName = LightName;
+		Light.bUseLight = bUseLight;
+		return Light;
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FHueConfigStoreDedupeTest, "HueLighting.Config.DedupeLights",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/**
+ * @brief One entry is left per lamp, later entries win in the place of the first, entries saved without an id keep
+ * the id they merge into, and lamps sharing a name stay apart
+ */
+bool FHueConfigStoreDedupeTest::RunTest(const FString& Parameters)
+{
+	using namespace HueConfigStoreTest;
+	TArray<FLightUse> Lights;
+	Lights.Add(MakeLight(TEXT("1"), TEXT("Desk"), true));
+	Lights.Add(MakeLight(TEXT("2"), TEXT("Desk"), false));
+	Lights.Add(MakeLight(TEXT(""), TEXT("Lamp"), true));
+	Lights.Add(MakeLight(TEXT("3"), TEXT("Lamp"), false));
+	//Lamp 1 renamed, its new name must not take the old name away from lamp 2
+	Lights.Add(MakeLight(TEXT("1"), TEXT("Desk left"), false));
+	Lights.Add(MakeLight(TEXT(""), TEXT("Desk"), true));
+	Lights.Add(MakeLight(TEXT(""), TEXT("Old"), true));
+	Lights.Add(MakeLight(TEXT(""), TEXT("Old"), false));
+	FHueConfigStore::DedupeLights(Lights);
+
+	if(!TestEqual(TEXT("One entry per lamp"), Lights.Num(), 4))
+	{
+		return false;
+	}
+	TestEqual(TEXT("A later entry keeps the first one's place"), Lights[0].LightId, FString(TEXT("1")));
+	TestEqual(TEXT("The later entry wins"), Lights[0].LightName, FString(TEXT("Desk left")));
+	TestFalse(TEXT("The later flag wins"), Lights[0].bUseLight);
+	TestEqual(TEXT("Same name with another id is another lamp"), Lights[1].LightId, FString(TEXT("2")));
+	TestTrue(TEXT("A name only entry merges into the lamp still holding the name"), Lights[1].bUseLight);
+	TestEqual(TEXT("A name only entry is replaced by the lamp's id"), Lights[2].LightId, FString(TEXT("3")));
+	TestFalse(TEXT("The id entry's flag wins over the name only one"), Lights[2].bUseLight);
+	TestTrue(TEXT("Name only entries dedupe by name"), Lights[3].LightId.IsEmpty() && Lights[3].LightName == TEXT("Old"));
+	TestFalse(TEXT("The last name only entry wins"), Lights[3].bUseLight);
+
+	//A clean list is left as it is
+	const TArray<FLightUse> Clean = Lights;
+	FHueConfigStore::DedupeLights(Lights);
+	TestEqual(TEXT("Deduping twice changes nothing"), Lights.Num(), Clean.Num());
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FHueConfigStoreCacheStampTest, "HueLighting.Config.CacheStamp",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/**
+ * @brief The cache is read only while the JSON keeps the stamp it was made with, an edited JSON or one put back with
+ * an older stamp is read instead
+ */
+bool FHueConfigStoreCacheStampTest::RunTest(const FString& Parameters)
+{
+	using namespace HueConfigStoreTest;
+	IFileManager& FileManager = IFileManager::Get();
+	const FString Folder = FPaths::ProjectSavedDir() / TEXT("HueConfigStampTest");
+	FHueConfigStore Store(Folder / TEXT("HueConfig.json"));
+	FHueBridgeConfig Config;
+	Config.HostName = TEXT("192.168.1.2");
+	Config.Lights.Add(MakeLight(TEXT("1"), TEXT("Desk"), true));
+	Store.Save(Config, true);
+	Store.Flush();
+
+	FHueBridgeConfig Loaded;
+	const FDateTime Stamp = FileManager.GetTimeStamp(*Store.GetPath());
+	TestTrue(TEXT("The cache of a fresh save is read"), FHueConfigStore::ReadCache(Store.GetCachePath(), Stamp, Loaded) && Loaded.HostName == Config.HostName);
+
+	//Hand edit, stamped clearly later in case the file system counts whole seconds
+	FHueBridgeConfig Edited = Config;
+	Edited.HostName = TEXT("192.168.1.3");
+	FHueConfigStore::WriteJson(Edited, Store.GetPath());
+	FileManager.SetTimeStamp(*Store.GetPath(), Stamp + FTimespan::FromSeconds(2.0));
+	TestTrue(TEXT("An edited JSON wins over the cache"), Store.Load(Loaded, true) && Loaded.HostName == Edited.HostName);
+
+	//A JSON put back from a backup is older than the cache, it still wins
+	FileManager.SetTimeStamp(*Store.GetPath(), Stamp - FTimespan::FromHours(1.0));
+	TestTrue(TEXT("An older JSON wins over the cache"), Store.Load(Loaded, true) && Loaded.HostName == Edited.HostName);
+
+	FileManager.DeleteDirectory(*Folder, false, true);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FHueConfigStoreBenchmarkTest, "HueLighting.Config.Benchmark",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/**
+ * @brief Five thousand lamps saved and loaded twenty times. The file keeps its size, the cache is smaller and loads
+ * faster than the JSON, and the game thread only pays for a copy of the config
+ */
+bool FHueConfigStoreBenchmarkTest::RunTest(const FString& Parameters)
+{
+	const FHueConfigBenchmark Result = FHueConfigStore::Benchmark(5000, 20);
+	AddInfo(FString::Printf(TEXT("%d lamps: %.2fms game thread, %.2fms write, %.2fms json load, %.2fms cache load, %d json bytes, %d cache bytes"),
+		Result.NumLamps, Result.SnapshotMs, Result.WriteMs, Result.JsonLoadMs, Result.CacheLoadMs, Result.JsonBytes, Result.CacheBytes));
+	TestTrue(TEXT("Saving the same lamps again doesn't grow the file"), Result.bSizeStable);
+	TestTrue(TEXT("Both files are written"), Result.JsonBytes > 0 && Result.CacheBytes > 0);
+	TestTrue(TEXT("The cache is smaller than the JSON"), Result.CacheBytes < Result.JsonBytes);
+#if UE_BUILD_DEBUG
+	//Unoptimized builds only report the cost
+#else
+	TestTrue(TEXT("The cache loads faster than the JSON"), Result.CacheLoadMs < Result.JsonLoadMs);
+	TestTrue(TEXT("The game thread pays a fraction of the save"), Result.SnapshotMs < Result.WriteMs);
+#endif
+	return true;
+}
+
+#endif
@@ -0,0 +1,134 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueDmxReceiver.h"
+#include "IPAddress.h"
+#include "Sockets.h"
+#include "SocketSubsystem.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace HueDmxTest
+{
+	//Every universe gets a different ramp each frame so a stale or misrouted packet shows up
+	void FillFrame(int32 Frame, int32 Universe, TArray<uint8>& DataOut)
+	{
+		DataOut.SetNumUninitialized(512);
+		for (int32 Channel = 0; Channel < DataOut.Num(); ++Channel)
+		{
+			DataOut[Channel] = static_cast<uint8>(Frame * 7 + Universe * 31 + Channel);
+		}
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FHueDmxLoopbackTest, "HueLighting.Dmx.LoopbackMultiUniverse",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/**
+ * @brief Send half a second of a 44Hz show over loopback, two universes of sACN and two of Art-Net at the same time,
+ * and check every universe ends up with the last frame sent to it
+ */
+bool FHueDmxLoopbackTest::RunTest(const FString& Parameters)
+{
+	FHueDmxReceiver Receiver;
+	if(!Receiver.Start(true, true, { 1, 2 }))
+	{
+		AddWarning(TEXT("DMX ports are taken on this machine, loopback not tested"));
+		return true;
+	}
+
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	FSocket* Sender = SocketSubsystem->CreateSocket(NAME_DGram, TEXT("HueDmxTestSender"), FNetworkProtocolTypes::IPv4);
+	const TSharedRef<FInternetAddr> SacnTarget = SocketSubsystem->CreateInternetAddr();
+	SacnTarget->SetLoopbackAddress();
+	SacnTarget->SetPort(FHueDmxReceiver::SacnPort);
+	const TSharedRef<FInternetAddr> ArtNetTarget = SocketSubsystem->CreateInternetAddr();
+	ArtNetTarget->SetLoopbackAddress();
+	ArtNetTarget->SetPort(FHueDmxReceiver::ArtNetPort);
+
+	const int32 Frames = 22;
+	const float Rate = 44.0f;
+	TArray<uint8> Data;
+	TArray<uint8> Packet;
+	TArray<int32> Changed;
+	int32 Sent = 0;
+	for (int32 Frame = 0; Frame < Frames; ++Frame)
+	{
+		const uint8 Sequence = static_cast<uint8>(Frame + 1);
+		for (int32 Universe = 1; Universe <= 4; ++Universe)
+		{
+			HueDmxTest::FillFrame(Frame, Universe, Data);
+			const bool bSacn = Universe <= 2;
+			if(bSacn)
+			{
+				FHueDmxReceiver::BuildSacnPacket(Universe, Data, Sequence, 100, Packet);
+			}
+			else
+			{
+				FHueDmxReceiver::BuildArtNetPacket(Universe, Data, Sequence, Packet);
+			}
+			int32 BytesSent = 0;
+			if(Sender->SendTo(Packet.GetData(), Packet.Num(), BytesSent, bSacn ? *SacnTarget : *ArtNetTarget))
+			{
+				Sent++;
+			}
+		}
+		FPlatformProcess::Sleep(1.0f / Rate);
+		Receiver.Tick(FPlatformTime::Seconds(), Changed);
+	}
+
+	//Give the workers a moment to pick up the last frame
+	const double EndTime = FPlatformTime::Seconds() + 1.0;
+	while(Receiver.GetReceivedCount() < Sent && FPlatformTime::Seconds() < EndTime)
+	{
+		FPlatformProcess::Sleep(0.005f);
+		Receiver.Tick(FPlatformTime::Seconds(), Changed);
+	}
+	Receiver.Stop();
+	SocketSubsystem->DestroySocket(Sender);
+
+	TestEqual(TEXT("Every packet sent was received"), Receiver.GetReceivedCount(), Sent);
+	TestEqual(TEXT("Nothing was dropped"), Receiver.GetDroppedCount(), 0);
+	TestEqual(TEXT("Both protocols fill their own universes"), Receiver.GetUniverseCount(), 4);
+	for (int32 Universe = 1; Universe <= 4; ++Universe)
+	{
+		const uint8* Received = Receiver.GetUniverse(Universe);
+		HueDmxTest::FillFrame(Frames - 1, Universe, Data);
+		TestTrue(FString::Printf(TEXT("Universe %d holds the last frame"), Universe),
+			Received && FMemory::Memcmp(Received, Data.GetData(), Data.Num()) == 0);
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FHueDmxPatchTest, "HueLighting.Dmx.PatchEvaluate",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/**
+ * @brief A patch reads its own channels, 1 based like the console, and ignores channels past the universe
+ */
+bool FHueDmxPatchTest::RunTest(const FString& Parameters)
+{
+	uint8 Universe[512] = {};
+	Universe[9] = 255;
+	Universe[10] = 0;
+	Universe[11] = 0;
+
+	FHueDmxPatch Patch;
+	Patch.StartChannel = 10;
+	Patch.Mode = EHueDmxMode::RGB;
+	const FHueLampState Red = Patch.Evaluate(Universe);
+	TestTrue(TEXT("Full red is on"), Red.bOn);
+	TestTrue(TEXT("Full red is bright"), Red.Brightness > 200);
+
+	Patch.StartChannel = 1;
+	TestFalse(TEXT("Black channels are off"), Patch.Evaluate(Universe).bOn);
+
+	Patch.StartChannel = 511;
+	TestTrue(TEXT("A patch past the end of the universe is off"), Patch.Evaluate(Universe) == FHueLampState());
+	return true;
+}
+
+#endif
@@ -0,0 +1,95 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueEffects.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace HueEffectsTest
+{
+	//Tick until the worker hands a batch back
+	TArray<FHueEffectOutput> TickUntilOutputs(FHueEffectRunner& Runner, double Now)
+	{
+		TArray<FHueEffectOutput> Outputs;
+		for (int32 Attempt = 0; Attempt < 1000 && Outputs.Num() == 0; ++Attempt)
+		{
+			Runner.Tick(Now, Outputs);
+			if(Outputs.Num() == 0)
+			{
+				FPlatformProcess::Sleep(0.001f);
+			}
+		}
+		return Outputs;
+	}
+
+	const FHueEffectOutput* FindSlot(const TArray<FHueEffectOutput>& Outputs, int32 Slot)
+	{
+		return Outputs.FindByPredicate([Slot](const FHueEffectOutput& Output) { return Output.Slot == Slot; });
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FHueEffectsLayeringTest, "HueLighting.Effects.Layering",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/**
+ * @brief Police lamps alternate red and blue through the phase step and an added layer, a later effect wins a slot it
+ * shares and hands it back once its duration is up
+ */
+bool FHueEffectsLayeringTest::RunTest(const FString& Parameters)
+{
+	FHueEffectRunner Runner;
+	TArray<FHueEffectLayer> Police;
+	TArray<FHueEffectLayer> Strobe;
+	FHueEffectRunner::GetPreset(EHueEffectPreset::Police, Police);
+	FHueEffectRunner::GetPreset(EHueEffectPreset::Strobe, Strobe);
+	Runner.Play({ 0, 1 }, Police, 0.0f, 0.0);
+	Runner.Play({ 1 }, Strobe, 0.5f, 0.0);
+
+	TArray<FHueEffectOutput> Outputs = HueEffectsTest::TickUntilOutputs(Runner, 0.0);
+	if(!TestEqual(TEXT("One color per slot"), Outputs.Num(), 2))
+	{
+		return false;
+	}
+	const FHueEffectOutput* First = HueEffectsTest::FindSlot(Outputs, 0);
+	const FHueEffectOutput* Second = HueEffectsTest::FindSlot(Outputs, 1);
+	TestTrue(TEXT("The first police lamp is red"), First && First->Color.Equals(FLinearColor(1.0f, 0.0f, 0.0f), 0.001f));
+	TestTrue(TEXT("The strobe played later wins the shared lamp"), Second && Second->Color.Equals(FLinearColor::White, 0.001f));
+
+	//The strobe runs out here, its last color still goes out
+	HueEffectsTest::TickUntilOutputs(Runner, 1.0);
+	Outputs = HueEffectsTest::TickUntilOutputs(Runner, 2.0);
+	Second = HueEffectsTest::FindSlot(Outputs, 1);
+	TestEqual(TEXT("A finished effect leaves the batch"), Outputs.Num(), 2);
+	TestTrue(TEXT("The shared lamp goes back to the police effect, blue half a cycle on"), Second && Second->Color.Equals(FLinearColor(0.0f, 0.0f, 1.0f), 0.001f));
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FHueEffectsCostTest, "HueLighting.Effects.BatchCost",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/**
+ * @brief Every preset evaluated for a thousand lamps costs well under a millisecond a batch
+ */
+bool FHueEffectsCostTest::RunTest(const FString& Parameters)
+{
+	const UEnum* Presets = StaticEnum<EHueEffectPreset>();
+	for (int32 Index = 0; Index < Presets->NumEnums() - 1; ++Index)
+	{
+		TArray<FHueEffectLayer> Layers;
+		FHueEffectRunner::GetPreset(static_cast<EHueEffectPreset>(Presets->GetValueByIndex(Index)), Layers);
+		const double Cost = FHueEffectRunner::MeasureCost(Layers, 1000);
+		AddInfo(FString::Printf(TEXT("%s, %d layers: %.2fus per batch per thousand lamps"), *Presets->GetNameStringByIndex(Index), Layers.Num(), Cost));
+		TestTrue(TEXT("A batch measures"), Cost > 0.0);
+#if UE_BUILD_DEBUG
+		//Unoptimized builds only report the cost
+#else
+		TestTrue(TEXT("A thousand lamps cost under a millisecond a batch"), Cost < 1000.0);
+#endif
+	}
+	return true;
+}
+
+#endif
@@ -0,0 +1,113 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueLampBinding.h"
+#include "HueLamp.h"
+#include "HueSendScheduler.h"
+#include "Components/PointLightComponent.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FHueLampBindingRetryTest, "HueLighting.Binding.RetryRefusedState",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/**
+ * @brief A state the lamp turns down is offered again, an unchanged source costs the lamp nothing
+ */
+bool FHueLampBindingRetryTest::RunTest(const FString& Parameters)
+{
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false);
+	FWorldContext& Context = GEngine->CreateNewWorldContext(EWorldType::Game);
+	Context.SetCurrentWorld(World);
+
+	AHueLamp* Lamp = World->SpawnActor<AHueLamp>();
+	UPointLightComponent* Light = NewObject<UPointLightComponent>(Lamp);
+	Light->SetIntensity(2500.0f);
+	UHueLampBindingComponent* Binding = NewObject<UHueLampBindingComponent>(Lamp);
+	Binding->SetSourceLight(Light);
+	Binding->SetLamp(Lamp);
+
+	//Not set up by discovery yet, the lamp refuses everything
+	TestFalse(TEXT("An unconfigured lamp refuses the state"), Binding->UpdateLamp());
+
+	const TSharedPtr<FHueSendScheduler> Scheduler = MakeShared<FHueSendScheduler>();
+	Lamp->SetupLamp(nullptr, TEXT("1"), TEXT("Lamp"));
+	Lamp->SetScheduler(Scheduler, Scheduler->AddSlot());
+	TestTrue(TEXT("The refused state goes out once the lamp is set up"), Binding->UpdateLamp());
+	TestTrue(TEXT("The lamp wants the sampled state"), Scheduler->IsDirty(0) && Scheduler->GetDesired(0).bOn);
+	TestFalse(TEXT("An unchanged source is not sent again"), Binding->UpdateLamp());
+
+	Light->SetIntensity(0.0f);
+	TestTrue(TEXT("A dimmed source is sent"), Binding->UpdateLamp());
+	TestFalse(TEXT("The lamp is turned off"), Scheduler->GetDesired(0).bOn);
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FHueLampBindingCostTest, "HueLighting.Binding.FrameCost",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/**
+ * @brief Three hundred bindings sampled every frame, half of them changing each frame, stay well under 0.1ms a frame
+ */
+bool FHueLampBindingCostTest::RunTest(const FString& Parameters)
+{
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false);
+	FWorldContext& Context = GEngine->CreateNewWorldContext(EWorldType::Game);
+	Context.SetCurrentWorld(World);
+
+	const int32 NumBindings = 300;
+	const int32 Frames = 200;
+	const TSharedPtr<FHueSendScheduler> Scheduler = MakeShared<FHueSendScheduler>();
+	TArray<UHueLampBindingComponent*> Bindings;
+	TArray<UPointLightComponent*> Lights;
+	for (int32 Index = 0; Index < NumBindings; ++Index)
+	{
+		AHueLamp* Lamp = World->SpawnActor<AHueLamp>();
+		Lamp->SetupLamp(nullptr, FString::FromInt(Index + 1), FString::Printf(TEXT("Lamp %d"), Index));
+		Lamp->SetScheduler(Scheduler, Scheduler->AddSlot());
+		UPointLightComponent* Light = NewObject<UPointLightComponent>(Lamp);
+		UHueLampBindingComponent* Binding = NewObject<UHueLampBindingComponent>(Lamp);
+		Binding->SetSourceLight(Light);
+		Binding->SetLamp(Lamp);
+		Lights.Add(Light);
+		Bindings.Add(Binding);
+	}
+
+	int32 Applied = 0;
+	double Seconds = 0.0;
+	for (int32 Frame = 0; Frame < Frames; ++Frame)
+	{
+		for (int32 Index = 0; Index < NumBindings; Index += 2)
+		{
+			Lights[Index]->SetIntensity(static_cast<float>((Frame * 37 + Index) % 5000));
+		}
+		const double Start = FPlatformTime::Seconds();
+		for (UHueLampBindingComponent* Binding : Bindings)
+		{
+			Applied += Binding->UpdateLamp() ? 1 : 0;
+		}
+		Seconds += FPlatformTime::Seconds() - Start;
+	}
+	const double FrameMs = Seconds * 1000.0 / Frames;
+	AddInfo(FString::Printf(TEXT("%d bindings: %.4f ms a frame, %d states applied"), NumBindings, FrameMs, Applied));
+	TestTrue(TEXT("Changing sources reach their lamps"), Applied >= Frames * NumBindings / 3);
+#if UE_BUILD_DEBUG
+	//Unoptimized builds only report the cost
+#else
+	TestTrue(TEXT("Hundreds of bindings cost under 0.1ms a frame"), FrameMs < 0.1);
+#endif
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+	return true;
+}
+
+#endif
@@ -0,0 +1,84 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueLamp.h"
+#include "HueSendScheduler.h"
+#include "HueTransport.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FHueLampScheduledReachabilityTest, "HueLighting.Lamp.ScheduledHoldWhileUnreachable",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/**
+ * @brief A scheduled lamp that goes unreachable holds the scheduler's newest state, sits out the scheduler while
+ * it is gone and sends the newest state once when it comes back
+ */
+bool FHueLampScheduledReachabilityTest::RunTest(const FString& Parameters)
+{
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false);
+	FWorldContext& Context = GEngine->CreateNewWorldContext(EWorldType::Game);
+	Context.SetCurrentWorld(World);
+
+	const TSharedPtr<FHueSendScheduler> Scheduler = MakeShared<FHueSendScheduler>();
+	const int32 Slot = Scheduler->AddSlot();
+	AHueLamp* Lamp = World->SpawnActor<AHueLamp>();
+	Lamp->SetupLamp(IHueTransport::Create(EHueApiVersion::V1, TEXT("127.0.0.1"), TEXT("test")), TEXT("1"), TEXT("Lamp"));
+	Lamp->SetScheduler(Scheduler, Slot);
+	int32 Sends = 0;
+	Lamp->OnStateSent.AddLambda([&Sends](AHueLamp*) { ++Sends; });
+
+	FHueLampState Showing;
+	Showing.bOn = true;
+	Showing.Brightness = 50;
+	Lamp->ApplyBridgeState(Showing, true);
+
+	//Wanted but not sent yet when the bulk read finds the lamp gone
+	FHueLampState Wanted = Showing;
+	Wanted.Brightness = 200;
+	TestTrue(TEXT("The change is recorded"), Lamp->ApplyState(Wanted));
+	Lamp->ApplyBridgeState(Showing, false);
+	TestTrue(TEXT("The lamp holds a state for the reconnect"), Lamp->HasHeldReconnectState());
+	TestTrue(TEXT("The held state is what the scheduler wanted"), Lamp->GetDesiredState() == Wanted);
+
+	double Now = FPlatformTime::Seconds();
+	TArray<int32> Picked;
+	Scheduler->Tick(Now, Picked);
+	TestEqual(TEXT("The unreachable lamp sits out the scheduler"), Picked.Num(), 0);
+	Lamp->SendDesiredState();
+	TestEqual(TEXT("Nothing goes out while it is unreachable"), Sends, 0);
+
+	//Only the newest of the changes made while it was gone goes out
+	FHueLampState Newest = Showing;
+	Newest.Brightness = 120;
+	TestFalse(TEXT("Changes while unreachable are held, not sent"), Lamp->ApplyState(Newest));
+	TestEqual(TEXT("The held change is counted"), Lamp->GetSuppressedCommandCount(), 1);
+
+	Lamp->ApplyBridgeState(Showing, true);
+	TestFalse(TEXT("The held state is released"), Lamp->HasHeldReconnectState());
+	TestTrue(TEXT("The scheduler wants the newest state"), Scheduler->IsDirty(Slot) && Scheduler->GetDesired(Slot) == Newest);
+	for (int32 Step = 0; Step < 3; ++Step)
+	{
+		Now += 1.0;
+		Scheduler->Tick(Now, Picked);
+		for (const int32 Picks : Picked)
+		{
+			TestEqual(TEXT("Only the lamp is picked"), Picks, Slot);
+			Lamp->SendDesiredState();
+		}
+	}
+	TestEqual(TEXT("One send follows the reconnect"), Sends, 1);
+	TestTrue(TEXT("The newest state went out"), Lamp->GetLastSentState() == Newest);
+	TestEqual(TEXT("One flush is counted"), Lamp->GetReconnectFlushCount(), 1);
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+	return true;
+}
+
+#endif
@@ -0,0 +1,180 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueReplication.h"
+#include "Serialization/BitReader.h"
+#include "Serialization/BitWriter.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace HueReplicationTest
+{
+	/**
+	 * @brief Write a light and read it back the way a client would
+	 * @return False if either side failed
+	 */
+	bool RoundTrip(FHueReplicatedLight& Light, FHueReplicatedLight& LightOut, int64& BitsOut)
+	{
+		FBitWriter Writer(0, true);
+		bool bWritten = false;
+		Light.NetSerialize(Writer, nullptr, bWritten);
+		BitsOut = Writer.GetNumBits();
+
+		FBitReader Reader(Writer.GetData(), Writer.GetNumBits());
+		bool bRead = false;
+		LightOut.NetSerialize(Reader, nullptr, bRead);
+		return bWritten && bRead;
+	}
+
+	//UE 5.2 FastArrayDeltaSerialize frames every delta with four int32s (replication keys, deletes, changes) and
+	//every changed item with its int32 replication id. Counted here since a delta needs a live net driver
+	const int32 DELTA_HEADER_BYTES = 16;
+	const int32 ITEM_ID_BYTES = 4;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FHueReplicationNetSerializeTest, "HueLighting.Replication.NetSerializeRoundTrip",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/**
+ * @brief Lights come back as they were sent, off lights drop their color, and a corrupt id fails the read
+ */
+bool FHueReplicationNetSerializeTest::RunTest(const FString& Parameters)
+{
+	FHueReplicatedLight Light;
+	Light.LightId = 1 << 30;
+	Light.State.bOn = true;
+	Light.State.Hue = 43690;
+	Light.State.Saturation = 200;
+	Light.State.Brightness = 254;
+	Light.TransitionTime = 4;
+	FHueReplicatedLight Received;
+	int64 Bits = 0;
+	TestTrue(TEXT("On light round trips"), HueReplicationTest::RoundTrip(Light, Received, Bits));
+	TestEqual(TEXT("Large id survives"), Received.LightId, Light.LightId);
+	TestTrue(TEXT("State survives"), Received.State == Light.State);
+	TestEqual(TEXT("Fade survives"), Received.TransitionTime, 4);
+
+	//Off lights carry no color and keep the bridge default fade
+	Light.LightId = 3;
+	Light.State.bOn = false;
+	Light.TransitionTime = -1;
+	TestTrue(TEXT("Off light round trips"), HueReplicationTest::RoundTrip(Light, Received, Bits));
+	TestEqual(TEXT("Off light id"), Received.LightId, 3);
+	TestFalse(TEXT("Off light is off"), Received.State.bOn);
+	TestEqual(TEXT("Off light drops its color"), Received.State.Hue, 0);
+	TestEqual(TEXT("Default fade survives"), Received.TransitionTime, -1);
+	TestTrue(TEXT("Off light is a couple of bytes"), Bits <= 24);
+
+	//Fades longer than a byte holds are cut, not wrapped
+	Light.State.bOn = true;
+	Light.TransitionTime = 600;
+	HueReplicationTest::RoundTrip(Light, Received, Bits);
+	TestEqual(TEXT("Long fade is capped"), Received.TransitionTime, 254);
+
+	//An id past int32 can only come from a corrupt or hostile packet
+	FBitWriter Writer(0, true);
+	uint32 BadId = 0xFFFFFFFFu;
+	Writer.SerializeIntPacked(BadId);
+	uint8 Padding[8] = {};
+	Writer.Serialize(Padding, sizeof(Padding));
+	FBitReader Reader(Writer.GetData(), Writer.GetNumBits());
+	FHueReplicatedLight Corrupt;
+	Corrupt.LightId = 7;
+	bool bRead = true;
+	Corrupt.NetSerialize(Reader, nullptr, bRead);
+	TestFalse(TEXT("An id past int32 fails the read"), bRead);
+	TestEqual(TEXT("A failed read leaves the light alone"), Corrupt.LightId, 7);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FHueReplicationDeltaBudgetTest, "HueLighting.Replication.DeltaBudget",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/**
+ * @brief Thirty seconds of a co-op scene at the default net update rate: sixteen lights, four of them a fire flickering
+ * every update, a full scene change with a fade every five seconds and a light switched off now and then. Only lights
+ * whose quantized state moved are serialized, each delta stays inside its budget and the stream under a kilobyte a
+ * second per client
+ */
+bool FHueReplicationDeltaBudgetTest::RunTest(const FString& Parameters)
+{
+	const int32 NumLights = 16;
+	const int32 NumFire = 4;
+	const int32 UpdateRate = 10;
+	const int32 Seconds = 30;
+	const FLinearColor SceneColors[] = { FLinearColor(0.2f, 0.4f, 1.0f), FLinearColor(1.0f, 0.6f, 0.3f), FLinearColor(0.5f, 1.0f, 0.4f) };
+	FRandomStream Random(1234);
+	TArray<FHueReplicatedLight> Lights;
+	for (int32 Index = 0; Index < NumLights; ++Index)
+	{
+		FHueReplicatedLight& Light = Lights.AddDefaulted_GetRef();
+		Light.LightId = Index;
+	}
+
+	int64 TotalBytes = 0;
+	int32 MaxUpdateBytes = 0;
+	int32 Changes = 0;
+	int32 OverBudget = 0;
+	for (int32 Update = 0; Update < Seconds * UpdateRate; ++Update)
+	{
+		//Set every light the way the game would, SetLightState marks only real changes dirty
+		FBitWriter Writer(0, true);
+		int32 Changed = 0;
+		for (FHueReplicatedLight& Light : Lights)
+		{
+			FHueLampState State;
+			int32 TransitionTime = -1;
+			if(Light.LightId < NumFire)
+			{
+				State = FHueLampState::FromLinearColor(FLinearColor(1.0f, 0.35f, 0.05f), Random.FRandRange(0.6f, 1.0f));
+				TransitionTime = 1;
+			}
+			else if(Update % 37 == 0 && Light.LightId == NumFire + (Update / 37) % (NumLights - NumFire))
+			{
+				State.bOn = false;
+			}
+			else
+			{
+				State = FHueLampState::FromLinearColor(SceneColors[(Update / (5 * UpdateRate)) % UE_ARRAY_COUNT(SceneColors)]);
+				TransitionTime = 20;
+			}
+			if(Update > 0 && Light.State == State)
+			{
+				continue;
+			}
+			Light.State = State;
+			Light.TransitionTime = TransitionTime;
+			bool bWritten = false;
+			Light.NetSerialize(Writer, nullptr, bWritten);
+			Changed++;
+		}
+		if(Changed == 0)
+		{
+			continue;
+		}
+		//Off lights are about two bytes, on lights about six, plus the ids and header the fast array adds
+		const int32 Bytes = HueReplicationTest::DELTA_HEADER_BYTES + Changed * HueReplicationTest::ITEM_ID_BYTES + static_cast<int32>(Writer.GetNumBytes());
+		const int32 Budget = HueReplicationTest::DELTA_HEADER_BYTES + Changed * (HueReplicationTest::ITEM_ID_BYTES + 7);
+		OverBudget += Bytes > Budget ? 1 : 0;
+		MaxUpdateBytes = FMath::Max(MaxUpdateBytes, Bytes);
+		TotalBytes += Bytes;
+		Changes += Changed;
+	}
+
+	const double BytesPerSecond = static_cast<double>(TotalBytes) / Seconds;
+	//What replicating every light as four int32s and a fade every update would cost
+	const double FullBytesPerSecond = static_cast<double>(NumLights * (sizeof(int32) * 6) * UpdateRate);
+	AddInfo(FString::Printf(TEXT("%d light changes, %.0f bytes a second a client, largest delta %d bytes, %.0f bytes a second sending every light"),
+		Changes, BytesPerSecond, MaxUpdateBytes, FullBytesPerSecond));
+	TestTrue(TEXT("Flickering lights change on most updates"), Changes > Seconds * UpdateRate * NumFire / 2);
+	TestEqual(TEXT("Every delta stays within seven bytes a light plus framing"), OverBudget, 0);
+	TestTrue(TEXT("A full scene change fits one packet easily"), MaxUpdateBytes < 256);
+	TestTrue(TEXT("The stream stays under a kilobyte a second a client"), BytesPerSecond < 1024.0);
+	TestTrue(TEXT("Deltas cost a fraction of sending every light"), BytesPerSecond < FullBytesPerSecond * 0.25);
+	return true;
+}
+
+#endif
@@ -0,0 +1,96 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueBridge.h"
+#include "HueLamp.h"
+#include "HueSendScheduler.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FHueSceneSwitchCountTest, "HueLighting.Scenes.LampByLampCountsSends",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/**
+ * @brief A lamp by lamp switch counts and times the requests that leave, not the states queued on the scheduler.
+ * A lamp changed again before its turn drops out of the switch, and the switch only ends once nothing is left queued
+ */
+bool FHueSceneSwitchCountTest::RunTest(const FString& Parameters)
+{
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false);
+	FWorldContext& Context = GEngine->CreateNewWorldContext(EWorldType::Game);
+	Context.SetCurrentWorld(World);
+	AHueBridge* Bridge = World->SpawnActor<AHueBridge>();
+	Bridge->HueBridgeConfig.HostName = TEXT("127.0.0.1");
+	Bridge->HueBridgeConfig.UserName = TEXT("test");
+	Bridge->RefreshTransport();
+
+	FHueSceneDefinition& Scene = Bridge->SceneDefinitions.Add(TEXT("Dim"));
+	for (int32 Index = 0; Index < 3; ++Index)
+	{
+		AHueLamp* Lamp = World->SpawnActor<AHueLamp>();
+		const FString Name = FString::Printf(TEXT("Lamp %d"), Index);
+		Lamp->SetupLamp(Bridge->Transport, FString::FromInt(Index + 1), Name);
+		Bridge->RegisterLamp(Lamp);
+		FHueLampState& State = Scene.LampStates.Add(Name);
+		State.bOn = true;
+		State.Hue = Index * 10000;
+		State.Saturation = 254;
+		State.Brightness = 100;
+	}
+
+	Bridge->ApplySceneLampByLamp(TEXT("Dim"));
+	TestEqual(TEXT("Queued states are not requests"), Bridge->LastSceneSwitch.Requests, 0);
+	TestEqual(TEXT("Every lamp waits on the scheduler"), Bridge->QueuedSwitchLamps.Num(), 3);
+	TestTrue(TEXT("The clock doesn't start while nothing has left"), Bridge->SceneSwitchStartTime <= 0.0);
+
+	//The budget holds one send, the first lamp leaves and starts the clock
+	const double Now = FPlatformTime::Seconds();
+	Bridge->SendScheduled(Now);
+	TestEqual(TEXT("The sent lamp is a request"), Bridge->LastSceneSwitch.Requests, 1);
+	TestTrue(TEXT("The clock starts with the first send"), Bridge->SceneSwitchStartTime >= Now);
+	if(!TestEqual(TEXT("One lamp waits for its answer"), Bridge->PendingSwitchLamps.Num(), 1))
+	{
+		return false;
+	}
+	AHueLamp* Sent = Bridge->PendingSwitchLamps.Array()[0].Get();
+
+	//Another change takes over a lamp that hasn't had its turn
+	AHueLamp* Changed = nullptr;
+	for (const auto& Element : Bridge->QueuedSwitchLamps)
+	{
+		Changed = Element.Key.Get();
+		break;
+	}
+	FHueLampState Other;
+	Other.bOn = true;
+	Other.Brightness = 254;
+	Changed->ApplyState(Other);
+
+	Bridge->OnLampStateAcknowledged(Sent);
+	TestEqual(TEXT("An answer with lamps still queued doesn't end the switch"), Bridge->QueuedSwitchLamps.Num(), 2);
+
+	Bridge->SendScheduled(Now + 0.15);
+	Bridge->SendScheduled(Now + 0.3);
+	TestEqual(TEXT("The taken over lamp isn't counted"), Bridge->LastSceneSwitch.Requests, 2);
+	TestEqual(TEXT("Nothing is left queued"), Bridge->QueuedSwitchLamps.Num(), 0);
+	TestTrue(TEXT("The switch isn't done before its last answer"), Bridge->LastSceneSwitch.LatencyMs <= 0.0f);
+
+	for (const TWeakObjectPtr<AHueLamp>& Lamp : Bridge->PendingSwitchLamps.Array())
+	{
+		Bridge->OnLampStateAcknowledged(Lamp.Get());
+	}
+	TestEqual(TEXT("Every answer is in"), Bridge->PendingSwitchLamps.Num(), 0);
+	TestTrue(TEXT("The switch is timed once done"), Bridge->LastSceneSwitch.LatencyMs > 0.0f);
+	TestEqual(TEXT("Finished with the requests that left"), Bridge->LastSceneSwitch.Requests, 2);
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+	return true;
+}
+
+#endif
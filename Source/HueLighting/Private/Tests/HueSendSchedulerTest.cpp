@@ -0,0 +1,216 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueSendScheduler.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace HueSchedulerTest
+{
+	FHueLampState MakeState(int32 Hue, int32 Brightness = 200)
+	{
+		FHueLampState State;
+		State.bOn = true;
+		State.Hue = Hue;
+		State.Saturation = 254;
+		State.Brightness = Brightness;
+		return State;
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FHueSendSchedulerBudgetTest, "HueLighting.Scheduler.TokenBucket",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/**
+ * @brief Every slot stays dirty for ten seconds, the bridge must never get more than its rate plus the burst room
+ */
+bool FHueSendSchedulerBudgetTest::RunTest(const FString& Parameters)
+{
+	const float SendRate = 10.0f;
+	FHueSendScheduler Scheduler(SendRate);
+	for (int32 Index = 0; Index < 20; ++Index)
+	{
+		Scheduler.AddSlot();
+	}
+
+	int32 Sent = 0;
+	int32 MaxInOneTick = 0;
+	TArray<int32> Picked;
+	const double Step = 1.0 / 60.0;
+	for (double Now = 0.0; Now < 10.0; Now += Step)
+	{
+		for (int32 Index = 0; Index < 20; ++Index)
+		{
+			Scheduler.SetDesired(Index, HueSchedulerTest::MakeState(FMath::RoundToInt(Now * 1000.0) % 65535 + Index), Now);
+		}
+		Scheduler.Tick(Now, Picked);
+		for (const int32 Slot : Picked)
+		{
+			Scheduler.MarkSent(Slot, Now);
+		}
+		Sent += Picked.Num();
+		MaxInOneTick = FMath::Max(MaxInOneTick, Picked.Num());
+	}
+	TestTrue(TEXT("Sends stay within the rate"), Sent <= FMath::CeilToInt(10.0f * SendRate) + 2);
+	TestTrue(TEXT("The budget is used"), Sent >= FMath::FloorToInt(10.0f * SendRate) - 2);
+	TestTrue(TEXT("No tick spends more than the burst room"), MaxInOneTick <= 2);
+
+	//A long idle only refills up to the burst room
+	Scheduler.Tick(100.0, Picked);
+	TestEqual(TEXT("Idle refill is capped"), Picked.Num(), 2);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FHueSendSchedulerCoalesceTest, "HueLighting.Scheduler.Coalescing",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/**
+ * @brief Many changes to one lamp between sends leave as one send of the newest state, busy lamps wait
+ */
+bool FHueSendSchedulerCoalesceTest::RunTest(const FString& Parameters)
+{
+	FHueSendScheduler Scheduler(10.0f);
+	const int32 Slot = Scheduler.AddSlot();
+	TArray<int32> Picked;
+	Scheduler.Tick(0.0, Picked);
+
+	for (int32 Step = 0; Step < 50; ++Step)
+	{
+		Scheduler.SetDesired(Slot, HueSchedulerTest::MakeState(Step * 1000), Step * 0.001);
+	}
+	Scheduler.Tick(0.1, Picked);
+	TestEqual(TEXT("Fifty changes go out as one send"), Picked.Num(), 1);
+	TestTrue(TEXT("The newest state is the one sent"), Scheduler.GetDesired(Slot) == HueSchedulerTest::MakeState(49000));
+	Scheduler.MarkSent(Slot, 0.1);
+	TestFalse(TEXT("Sent slot is clean"), Scheduler.IsDirty(Slot));
+
+	//Setting what was just sent is no change
+	Scheduler.SetDesired(Slot, HueSchedulerTest::MakeState(49000), 0.2);
+	TestFalse(TEXT("Same state doesn't dirty the slot"), Scheduler.IsDirty(Slot));
+
+	//A lamp with a request in flight keeps its change until it is answered
+	Scheduler.SetDesired(Slot, HueSchedulerTest::MakeState(1000), 0.3);
+	Scheduler.SetBusy(Slot, true);
+	Scheduler.Tick(1.0, Picked);
+	TestEqual(TEXT("Busy slot is skipped"), Picked.Num(), 0);
+	Scheduler.SetBusy(Slot, false);
+	Scheduler.Tick(1.1, Picked);
+	TestEqual(TEXT("Answered slot is sent"), Picked.Num(), 1);
+
+	//Every off lamp looks the same, only the on flag matters
+	FHueLampState OffA;
+	FHueLampState OffB;
+	OffB.Hue = 30000;
+	Scheduler.MarkSent(Slot, 1.1);
+	Scheduler.SetDesired(Slot, OffA, 1.2);
+	Scheduler.MarkSent(Slot, 1.2);
+	Scheduler.SetDesired(Slot, OffB, 1.3);
+	TestFalse(TEXT("Off colors don't dirty the slot"), Scheduler.IsDirty(Slot));
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FHueSendSchedulerBurstDebtTest, "HueLighting.Scheduler.BurstDebt",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/**
+ * @brief A forced frame commit of many lamps borrows at most a second of sends, normal sends resume after it
+ */
+bool FHueSendSchedulerBurstDebtTest::RunTest(const FString& Parameters)
+{
+	FHueSendScheduler Scheduler(10.0f);
+	for (int32 Index = 0; Index < 50; ++Index)
+	{
+		Scheduler.SetDesired(Scheduler.AddSlot(), HueSchedulerTest::MakeState(Index * 1000), 0.0);
+	}
+	TArray<int32> Picked;
+	Scheduler.Burst(0.0, true, Picked);
+	TestEqual(TEXT("Forced burst sends every dirty slot"), Picked.Num(), 50);
+	for (const int32 Slot : Picked)
+	{
+		Scheduler.MarkSent(Slot, 0.0);
+	}
+
+	Scheduler.SetDesired(0, HueSchedulerTest::MakeState(60000), 0.1);
+	Scheduler.Tick(0.9, Picked);
+	TestEqual(TEXT("The debt is paid back first"), Picked.Num(), 0);
+	Scheduler.Tick(1.15, Picked);
+	TestEqual(TEXT("Sends resume a second after the burst"), Picked.Num(), 1);
+	Scheduler.MarkSent(0, 1.15);
+
+	//Requests outside the slots share the same floor
+	Scheduler.Spend(1.15, 100);
+	Scheduler.SetDesired(1, HueSchedulerTest::MakeState(60000), 1.2);
+	Scheduler.Tick(2.3, Picked);
+	TestEqual(TEXT("Spent requests borrow at most a second too"), Picked.Num(), 1);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FHueSendSchedulerPolicyTraceTest, "HueLighting.Scheduler.PolicyTrace",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/**
+ * @brief Replays a recorded trace through both policies. Five lamps swing color every two seconds while twenty five
+ * lamps flicker by a step every frame, more than the bridge can take. Oldest first spends the budget on the flicker,
+ * the perceptual policy has to show less visible error on the same trace
+ */
+bool FHueSendSchedulerPolicyTraceTest::RunTest(const FString& Parameters)
+{
+	const int32 NumSwing = 5;
+	const int32 NumFlicker = 25;
+	const float SendRate = 10.0f;
+
+	//Record the way the bridge does, every SetDesired made during play ends up in the trace
+	FHueSendScheduler Recorder(SendRate);
+	for (int32 Index = 0; Index < NumSwing + NumFlicker; ++Index)
+	{
+		Recorder.AddSlot();
+	}
+	Recorder.StartRecording(0.0);
+	const double Step = 1.0 / 60.0;
+	int32 Frame = 0;
+	for (double Now = 0.0; Now < 20.0; Now += Step, ++Frame)
+	{
+		if(Frame % 120 == 0)
+		{
+			for (int32 Index = 0; Index < NumSwing; ++Index)
+			{
+				Recorder.SetDesired(Index, HueSchedulerTest::MakeState(((Frame / 120 + Index) % 2) * 40000), Now);
+			}
+		}
+		for (int32 Index = 0; Index < NumFlicker; ++Index)
+		{
+			Recorder.SetDesired(NumSwing + Index, HueSchedulerTest::MakeState(10000, 150 + (Frame + Index) % 3), Now);
+		}
+	}
+	TArray<FHueTraceEvent> Trace;
+	Recorder.StopRecording(Trace);
+	TestEqual(TEXT("Every change is recorded"), Trace.Num(), Frame * NumFlicker + (Frame + 119) / 120 * NumSwing);
+
+	const double Start = FPlatformTime::Seconds();
+	const double Fifo = FHueSendScheduler::SimulateTrace(Trace, NumSwing + NumFlicker, SendRate, EHueSchedulePolicy::Fifo);
+	const double Perceptual = FHueSendScheduler::SimulateTrace(Trace, NumSwing + NumFlicker, SendRate, EHueSchedulePolicy::PerceptualError);
+	const double ReplayMs = (FPlatformTime::Seconds() - Start) * 1000.0;
+	AddInfo(FString::Printf(TEXT("%d events: fifo %.1f, perceptual %.1f integrated error, both replays %.2f ms"),
+		Trace.Num(), Fifo, Perceptual, ReplayMs));
+	TestTrue(TEXT("The trace shows visible error under the budget"), Fifo > 0.0);
+	TestTrue(TEXT("The perceptual policy shows less visible error than oldest first"), Perceptual < Fifo * 0.5);
+
+	//Under the budget the order doesn't matter, both policies keep up
+	TArray<FHueTraceEvent> Light;
+	for (const FHueTraceEvent& Event : Trace)
+	{
+		if(Event.Slot < NumSwing)
+		{
+			Light.Add(Event);
+		}
+	}
+	const double LightFifo = FHueSendScheduler::SimulateTrace(Light, NumSwing, SendRate, EHueSchedulePolicy::Fifo);
+	const double LightPerceptual = FHueSendScheduler::SimulateTrace(Light, NumSwing, SendRate, EHueSchedulePolicy::PerceptualError);
+	TestTrue(TEXT("Both policies match when the bridge keeps up"), FMath::IsNearlyEqual(LightFifo, LightPerceptual, LightFifo * 0.1 + 1.0));
+	return true;
+}
+
+#endif
@@ -0,0 +1,71 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueSensors.h"
+#include "HueTransport.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace HueSensorsTest
+{
+	FString MakeRead(int32 ButtonEvent, const TCHAR* LastUpdated)
+	{
+		return FString::Printf(TEXT("{\"5\":{\"name\":\"Dimmer\",\"type\":\"ZLLSwitch\",\"state\":{\"buttonevent\":%d,\"lastupdated\":\"%s\"}}}"),
+			ButtonEvent, LastUpdated);
+	}
+
+	FString MakeEvent(const TCHAR* LastEvent, const TCHAR* CreationTime)
+	{
+		return FString::Printf(TEXT("data: [{\"creationtime\":\"%s\",\"type\":\"update\",\"data\":[{\"id_v1\":\"/sensors/5\",")
+			TEXT("\"type\":\"button\",\"button\":{\"last_event\":\"%s\"},\"metadata\":{\"control_id\":1}}]}]\n"), CreationTime, LastEvent);
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FHueSensorsStreamDedupeTest, "HueLighting.Sensors.StreamAndPollDedupe",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/**
+ * @brief A press seen on the event stream and again in the next v1 read is broadcast once, a new press with the same
+ * button event is not swallowed
+ */
+bool FHueSensorsStreamDedupeTest::RunTest(const FString& Parameters)
+{
+	const TSharedRef<IHueTransport> Transport = IHueTransport::Create(EHueApiVersion::ClipV2, TEXT("127.0.0.1"), TEXT("test"));
+	FHueSensorPoller Poller(0.1f, 2.0f, 5.0f);
+	Poller.SetStreaming(true);
+	TArray<FHueSensorState> Read;
+	TArray<FHueSensorState> Events;
+	TArray<FHueSensorState> Changed;
+
+	Transport->ParseSensors(HueSensorsTest::MakeRead(1002, TEXT("2023-05-01T10:00:00")), Read);
+	Poller.MarkPollSent(0.0);
+	Poller.MergePoll(Read, 0.05, Changed);
+	TestEqual(TEXT("The first read only records"), Changed.Num(), 0);
+
+	//Same press, stream first with milliseconds and a zone, then the v1 read
+	TestTrue(TEXT("Stream event parses"), Transport->ParseEvents(HueSensorsTest::MakeEvent(TEXT("short_release"), TEXT("2023-05-01T10:00:07.734Z")), Events));
+	Poller.MergeEvents(Events, 1.0, Changed);
+	TestEqual(TEXT("Stream press is broadcast"), Changed.Num(), 1);
+	Read.Reset();
+	Transport->ParseSensors(HueSensorsTest::MakeRead(1002, TEXT("2023-05-01T10:00:07")), Read);
+	TestTrue(TEXT("Both formats stamp the same second"), Read.Num() == 1 && Events.Num() == 1 && Read[0].LastUpdated == Events[0].LastUpdated);
+	Poller.MarkPollSent(1.5);
+	Poller.MergePoll(Read, 1.6, Changed);
+	TestEqual(TEXT("The read doesn't repeat the stream press"), Changed.Num(), 0);
+
+	//The same button again a few seconds later is a new press
+	Read.Reset();
+	Transport->ParseSensors(HueSensorsTest::MakeRead(1002, TEXT("2023-05-01T10:00:12")), Read);
+	Poller.MarkPollSent(6.0);
+	Poller.MergePoll(Read, 6.04, Changed);
+	if(TestEqual(TEXT("A new press of the same button is broadcast"), Changed.Num(), 1))
+	{
+		TestTrue(TEXT("Latency is the read round trip"), FMath::IsNearlyEqual(Changed[0].LatencyMs, 40.0f, 1.0f));
+	}
+	return true;
+}
+
+#endif
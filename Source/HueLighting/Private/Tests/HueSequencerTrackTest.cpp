@@ -0,0 +1,82 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueSequencerTrack.h"
+#include "MovieScene.h"
+#include "UObject/Package.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace HueSequencerTest
+{
+	const FFrameRate TickResolution(24000, 1);
+
+	UMovieSceneHueBrightnessSection* MakeSection(double Seconds)
+	{
+		UMovieScene* MovieScene = NewObject<UMovieScene>(GetTransientPackage());
+		MovieScene->SetTickResolutionDirectly(TickResolution);
+		const FFrameNumber End = TickResolution.AsFrameNumber(Seconds);
+		MovieScene->SetPlaybackRange(TRange<FFrameNumber>(FFrameNumber(0), End));
+		UMovieSceneHueBrightnessSection* Section = NewObject<UMovieSceneHueBrightnessSection>(MovieScene);
+		Section->SetRange(TRange<FFrameNumber>(FFrameNumber(0), End));
+		return Section;
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FHueSequencerBakeTest, "HueLighting.Sequencer.CueBaking",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/**
+ * @brief A linear ramp bakes to a single fade, a stepped key bakes to a cue that lands on the step, and every cue is
+ * moved earlier by the latency
+ */
+bool FHueSequencerBakeTest::RunTest(const FString& Parameters)
+{
+	using namespace HueSequencerTest;
+	const float Latency = 0.2f;
+
+	//Two seconds of straight ramp are one 2 second bridge fade after the landing cue
+	UMovieSceneHueBrightnessSection* Ramp = MakeSection(2.0);
+	Ramp->Brightness.AddLinearKey(FFrameNumber(0), 0.2f);
+	Ramp->Brightness.AddLinearKey(TickResolution.AsFrameNumber(2.0), 1.0f);
+	FHueCueBuffer Buffer;
+	Ramp->BakeCues(Latency, 2.0f, Buffer);
+	if(!TestEqual(TEXT("A straight ramp bakes to one fade"), Buffer.Cues.Num(), 2))
+	{
+		return false;
+	}
+	TestTrue(TEXT("Brightness sections bake brightness cues"), Buffer.Type == EHueCueType::Brightness);
+	TestTrue(TEXT("Landing cue goes out a step and the latency early"), FMath::IsNearlyEqual(Buffer.Cues[0].Time, -Latency - 0.1f, 0.001f));
+	TestEqual(TEXT("Landing cue doesn't fade"), Buffer.Cues[0].TransitionTime, 0);
+	TestTrue(TEXT("Fade starts the latency early"), FMath::IsNearlyEqual(Buffer.Cues[1].Time, -Latency, 0.001f));
+	TestEqual(TEXT("Fade covers the ramp"), Buffer.Cues[1].TransitionTime, 20);
+	TestEqual(TEXT("Fade ends on the last key"), Buffer.Cues[1].State.Brightness, 254);
+	TestEqual(TEXT("Nothing is due before the first cue"), Buffer.FindCue(-1.0f), static_cast<int32>(INDEX_NONE));
+	const FHueLampState Halfway = Buffer.StateAt(1.0f - Latency);
+	TestTrue(TEXT("Half way through the fade is half way up the ramp"), FMath::Abs(Halfway.Brightness - FMath::RoundToInt(0.6f * 254.0f)) <= 2);
+
+	//A stepped key can't be faded into, it gets its own cue that lands on the step
+	UMovieSceneHueBrightnessSection* Step = MakeSection(2.0);
+	Step->Brightness.AddConstantKey(FFrameNumber(0), 1.0f);
+	Step->Brightness.AddConstantKey(TickResolution.AsFrameNumber(1.0), 0.3f);
+	Step->BakeCues(Latency, 2.0f, Buffer);
+	const int32 Dimmed = FMath::RoundToInt(0.3f * 254.0f);
+	const FHueCue* StepCue = Buffer.Cues.FindByPredicate([Dimmed](const FHueCue& Cue) { return Cue.State.Brightness == Dimmed; });
+	if(!TestNotNull(TEXT("The step is baked"), StepCue))
+	{
+		return false;
+	}
+	TestTrue(TEXT("The step fades at most one bridge step"), StepCue->TransitionTime <= 1);
+	TestTrue(TEXT("The step lands by its key"), StepCue->Time + StepCue->TransitionTime * 0.1f <= 1.0f - Latency + 0.001f);
+	TestTrue(TEXT("Holds around the step don't add cues"), Buffer.Cues.Num() <= 4);
+	for (int32 Index = 1; Index < Buffer.Cues.Num(); ++Index)
+	{
+		TestTrue(TEXT("Cues are sorted"), Buffer.Cues[Index - 1].Time <= Buffer.Cues[Index].Time);
+	}
+	return true;
+}
+
+#endif
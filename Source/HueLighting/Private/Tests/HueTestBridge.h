@@ -0,0 +1,305 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HttpManager.h"
+#include "HttpModule.h"
+#include "IPAddress.h"
+#include "Sockets.h"
+#include "SocketSubsystem.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+/**
+ * Stand-in bridge on a loopback port for tests. Answers every request with the canned body of the longest route
+ * that matches its verb and path, stream routes stay open and get every pushed event as a server sent event.
+ * Plain http only, CLIP v2 transports talk to it with SetUseTls(false). Nothing runs on its own thread, PumpUntil
+ * serves it and ticks the http manager together
+ */
+class FHueTestBridge
+{
+public:
+	FHueTestBridge()
+	{
+		ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+		Listener = SocketSubsystem->CreateSocket(NAME_Stream, TEXT("HueTestBridge"), FNetworkProtocolTypes::IPv4);
+		if(!Listener)
+		{
+			return;
+		}
+		const TSharedRef<FInternetAddr> Addr = SocketSubsystem->CreateInternetAddr();
+		Addr->SetLoopbackAddress();
+		Addr->SetPort(0);
+		if(!Listener->Bind(*Addr) || !Listener->Listen(16))
+		{
+			SocketSubsystem->DestroySocket(Listener);
+			Listener = nullptr;
+			return;
+		}
+		Listener->SetNonBlocking(true);
+		Port = Listener->GetPortNo();
+	}
+
+	~FHueTestBridge()
+	{
+		ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+		for (FConnection& Connection : Connections)
+		{
+			Connection.Socket->Close();
+			SocketSubsystem->DestroySocket(Connection.Socket);
+		}
+		if(Listener)
+		{
+			Listener->Close();
+			SocketSubsystem->DestroySocket(Listener);
+		}
+	}
+
+	bool IsListening() const { return Listener != nullptr; }
+	//Host the transports are created with
+	FString GetHost() const { return FString::Printf(TEXT("127.0.0.1:%d"), Port); }
+
+	/**
+	 * @brief Answer every request with this verb whose path starts with Path
+	 * @param Delay Seconds the answer waits, e.g. the time a bridge spends on a light change
+	 */
+	void SetRoute(const FString& Verb, const FString& Path, const FString& Body, int32 Code = 200, float Delay = 0.0f)
+	{
+		FRoute& Route = Routes.FindOrAdd(Verb + TEXT(" ") + Path);
+		Route.Body = Body;
+		Route.Code = Code;
+		Route.Delay = Delay;
+		Route.bStream = false;
+	}
+
+	//Requests on this path stay open as an event stream
+	void SetStream(const FString& Path)
+	{
+		Routes.FindOrAdd(TEXT("GET ") + Path).bStream = true;
+	}
+
+	//Send one server sent event to every open stream
+	void PushEvent(const FString& Data)
+	{
+		const FTCHARToUTF8 Utf8(*(TEXT("data: ") + Data + TEXT("\n\n")));
+		for (FConnection& Connection : Connections)
+		{
+			if(Connection.bStream)
+			{
+				SendAll(Connection.Socket, reinterpret_cast<const uint8*>(Utf8.Get()), Utf8.Length());
+			}
+		}
+	}
+
+	int32 GetOpenStreams() const
+	{
+		return Connections.FilterByPredicate([](const FConnection& Connection) { return Connection.bStream; }).Num();
+	}
+
+	//"VERB path" of every request served so far, in the order they arrived
+	const TArray<FString>& GetRequests() const { return Requests; }
+	int32 CountRequests(const FString& Verb, const FString& Path) const
+	{
+		const FString Prefix = Verb + TEXT(" ") + Path;
+		return Requests.FilterByPredicate([&Prefix](const FString& Request) { return Request.StartsWith(Prefix); }).Num();
+	}
+
+	/**
+	 * @brief Serve the bridge and tick the http manager until Done is true
+	 * @return False if Timeout seconds passed first
+	 */
+	bool PumpUntil(TFunctionRef<bool()> Done, float Timeout = 5.0f)
+	{
+		const double End = FPlatformTime::Seconds() + Timeout;
+		double Last = FPlatformTime::Seconds();
+		while(!Done())
+		{
+			const double Now = FPlatformTime::Seconds();
+			if(Now > End)
+			{
+				return false;
+			}
+			Tick();
+			FHttpModule::Get().GetHttpManager().Tick(static_cast<float>(Now - Last));
+			Last = Now;
+			FPlatformProcess::Sleep(0.0005f);
+		}
+		return true;
+	}
+
+	//Accept connections, read requests and send the answers that are due
+	void Tick()
+	{
+		if(!Listener)
+		{
+			return;
+		}
+		bool bPending = false;
+		while(Listener->HasPendingConnection(bPending) && bPending)
+		{
+			FSocket* Socket = Listener->Accept(TEXT("HueTestBridgeConnection"));
+			if(!Socket)
+			{
+				break;
+			}
+			Socket->SetNonBlocking(true);
+			Connections.Add({ Socket });
+		}
+
+		ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+		const double Now = FPlatformTime::Seconds();
+		for (int32 Index = Connections.Num() - 1; Index >= 0; --Index)
+		{
+			FConnection& Connection = Connections[Index];
+			bool bClosed = false;
+			uint8 Buffer[4096];
+			uint32 PendingSize = 0;
+			while(Connection.Socket->HasPendingData(PendingSize))
+			{
+				int32 BytesRead = 0;
+				if(!Connection.Socket->Recv(Buffer, sizeof(Buffer), BytesRead) || BytesRead <= 0)
+				{
+					bClosed = true;
+					break;
+				}
+				Connection.Received.Append(Buffer, BytesRead);
+			}
+			if(Connection.bStream)
+			{
+				bClosed |= Connection.Socket->GetConnectionState() != SCS_Connected;
+			}
+			else if(!Connection.bAnswered)
+			{
+				ReadRequest(Connection, Now);
+			}
+			if(Connection.bAnswered && Now >= Connection.AnswerTime)
+			{
+				SendAll(Connection.Socket, Connection.Answer.GetData(), Connection.Answer.Num());
+				bClosed = true;
+			}
+			if(bClosed)
+			{
+				Connection.Socket->Close();
+				SocketSubsystem->DestroySocket(Connection.Socket);
+				Connections.RemoveAt(Index);
+			}
+		}
+	}
+
+private:
+	struct FRoute
+	{
+		FString Body;
+		int32 Code = 200;
+		float Delay = 0.0f;
+		bool bStream = false;
+	};
+
+	struct FConnection
+	{
+		FSocket* Socket = nullptr;
+		TArray<uint8> Received;
+		TArray<uint8> Answer;
+		double AnswerTime = 0.0;
+		bool bAnswered = false;
+		bool bStream = false;
+	};
+
+	/**
+	 * @brief Parse a whole request once its headers and body are in, queue the answer of its route :: Internal Call
+	 */
+	void ReadRequest(FConnection& Connection, double Now)
+	{
+		const FUTF8ToTCHAR Converted(reinterpret_cast<const ANSICHAR*>(Connection.Received.GetData()), Connection.Received.Num());
+		const FString Text(Converted.Length(), Converted.Get());
+		const int32 HeaderEnd = Text.Find(TEXT("\r\n\r\n"));
+		if(HeaderEnd == INDEX_NONE)
+		{
+			return;
+		}
+		TArray<FString> Lines;
+		Text.Left(HeaderEnd).ParseIntoArrayLines(Lines);
+		TArray<FString> RequestLine;
+		if(Lines.Num() == 0 || Lines[0].ParseIntoArrayWS(RequestLine) < 2)
+		{
+			return;
+		}
+		int32 ContentLength = 0;
+		for (const FString& Line : Lines)
+		{
+			if(Line.StartsWith(TEXT("Content-Length:"), ESearchCase::IgnoreCase))
+			{
+				ContentLength = FCString::Atoi(*Line.RightChop(15).TrimStartAndEnd());
+			}
+		}
+		if(Connection.Received.Num() < HeaderEnd + 4 + ContentLength)
+		{
+			return;
+		}
+
+		const FString& Verb = RequestLine[0];
+		FString Path;
+		RequestLine[1].Split(TEXT("?"), &Path, nullptr);
+		Path = Path.IsEmpty() ? RequestLine[1] : Path;
+		Requests.Add(Verb + TEXT(" ") + Path);
+
+		const FRoute* Best = nullptr;
+		int32 BestLength = -1;
+		for (const TPair<FString, FRoute>& Route : Routes)
+		{
+			FString RouteVerb;
+			FString RoutePath;
+			Route.Key.Split(TEXT(" "), &RouteVerb, &RoutePath);
+			if(RouteVerb == Verb && Path.StartsWith(RoutePath) && RoutePath.Len() > BestLength)
+			{
+				Best = &Route.Value;
+				BestLength = RoutePath.Len();
+			}
+		}
+
+		if(Best && Best->bStream)
+		{
+			const FTCHARToUTF8 Head(TEXT("HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n\r\n"));
+			SendAll(Connection.Socket, reinterpret_cast<const uint8*>(Head.Get()), Head.Length());
+			Connection.bStream = true;
+			return;
+		}
+		const int32 Code = Best ? Best->Code : 404;
+		const FTCHARToUTF8 Body(Best ? *Best->Body : TEXT("[]"));
+		const FTCHARToUTF8 Head(*FString::Printf(TEXT("HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %d\r\nConnection: close\r\n\r\n"),
+			Code, Code == 200 ? TEXT("OK") : TEXT("Error"), Body.Length()));
+		Connection.Answer.Append(reinterpret_cast<const uint8*>(Head.Get()), Head.Length());
+		Connection.Answer.Append(reinterpret_cast<const uint8*>(Body.Get()), Body.Length());
+		Connection.AnswerTime = Now + (Best ? Best->Delay : 0.0f);
+		Connection.bAnswered = true;
+	}
+
+	static void SendAll(FSocket* Socket, const uint8* Data, int32 Count)
+	{
+		int32 Offset = 0;
+		for (int32 Attempt = 0; Offset < Count && Attempt < 1000; ++Attempt)
+		{
+			int32 BytesSent = 0;
+			if(Socket->Send(Data + Offset, Count - Offset, BytesSent) && BytesSent > 0)
+			{
+				Offset += BytesSent;
+			}
+			else
+			{
+				FPlatformProcess::Sleep(0.0001f);
+			}
+		}
+	}
+
+	FSocket* Listener = nullptr;
+	int32 Port = 0;
+	TArray<FConnection> Connections;
+	TMap<FString, FRoute> Routes;
+	TArray<FString> Requests;
+};
+
+#endif
@@ -0,0 +1,340 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueTransport.h"
+#include "HueTestBridge.h"
+#include "Interfaces/IHttpRequest.h"
+#include "Interfaces/IHttpResponse.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace HueTransportTest
+{
+	const int32 NUM_LIGHTS = 20;
+	const int32 NUM_READS = 10;
+	const int32 NUM_PRESSES = 5;
+	//The bridge's default fast sensor poll
+	const double POLL_INTERVAL = 0.1;
+
+	struct FWorkloadResult
+	{
+		//Requests the stand-in bridge served for each workload
+		int32 ReadRequests = 0;
+		int32 SceneRequests = 0;
+		int32 EventRequests = 0;
+		//Requests that went to CLIP v2 resources, everything else used the v1 paths
+		int32 ResourceRequests = 0;
+		//Average bulk read, whole scene switch and average time from a sensor change to it being parsed
+		double ReadMs = 0.0;
+		double SceneMs = 0.0;
+		double EventMs = 0.0;
+		int32 LightsRead = 0;
+		int32 EventsSeen = 0;
+		bool bCompleted = false;
+	};
+
+	FString MakeV1Lights()
+	{
+		TArray<FString> Lights;
+		for (int32 Light = 1; Light <= NUM_LIGHTS; ++Light)
+		{
+			Lights.Add(FString::Printf(TEXT("\"%d\":{\"name\":\"Lamp %d\",\"productname\":\"Hue color lamp\",")
+				TEXT("\"state\":{\"on\":true,\"bri\":200,\"hue\":%d,\"sat\":254,\"reachable\":true}}"), Light, Light, Light * 3000));
+		}
+		return TEXT("{") + FString::Join(Lights, TEXT(",")) + TEXT("}");
+	}
+
+	FString MakeV2Lights()
+	{
+		TArray<FString> Lights;
+		for (int32 Light = 1; Light <= NUM_LIGHTS; ++Light)
+		{
+			Lights.Add(FString::Printf(TEXT("{\"id\":\"light-%d\",\"id_v1\":\"/lights/%d\",\"owner\":{\"rid\":\"device-%d\",\"rtype\":\"device\"},")
+				TEXT("\"metadata\":{\"name\":\"Lamp %d\"},\"on\":{\"on\":true},\"dimming\":{\"brightness\":78.7},")
+				TEXT("\"color\":{\"xy\":{\"x\":0.4,\"y\":0.35}}}"), Light, Light, Light, Light));
+		}
+		return TEXT("{\"errors\":[],\"data\":[") + FString::Join(Lights, TEXT(",")) + TEXT("]}");
+	}
+
+	FString MakeV2Connectivity()
+	{
+		TArray<FString> Links;
+		for (int32 Light = 1; Light <= NUM_LIGHTS; ++Light)
+		{
+			Links.Add(FString::Printf(TEXT("{\"id\":\"zc-%d\",\"owner\":{\"rid\":\"device-%d\",\"rtype\":\"device\"},\"status\":\"connected\"}"), Light, Light));
+		}
+		return TEXT("{\"errors\":[],\"data\":[") + FString::Join(Links, TEXT(",")) + TEXT("]}");
+	}
+
+	FString MakeV1Sensors(int32 Press)
+	{
+		return FString::Printf(TEXT("{\"5\":{\"name\":\"Dimmer\",\"type\":\"ZLLSwitch\",")
+			TEXT("\"state\":{\"buttonevent\":1002,\"lastupdated\":\"2023-05-01T10:00:%02d\"}}}"), Press);
+	}
+
+	FString MakeV2Event(int32 Press)
+	{
+		return FString::Printf(TEXT("[{\"creationtime\":\"2023-05-01T10:00:%02d.120Z\",\"type\":\"update\",\"data\":[{\"id_v1\":\"/sensors/5\",")
+			TEXT("\"type\":\"button\",\"button\":{\"last_event\":\"short_release\"}}]}]"), Press);
+	}
+
+	//Everything a session touches, on both the v1 paths and the CLIP v2 resources
+	void AddRoutes(FHueTestBridge& Bridge)
+	{
+		Bridge.SetRoute(TEXT("GET"), TEXT("/api/benchmark/lights"), MakeV1Lights());
+		Bridge.SetRoute(TEXT("PUT"), TEXT("/api/benchmark/lights/"), TEXT("[{\"success\":{\"/lights/1/state/on\":true}}]"));
+		Bridge.SetRoute(TEXT("POST"), TEXT("/api/benchmark/scenes"), TEXT("[{\"success\":{\"id\":\"abc\"}}]"));
+		Bridge.SetRoute(TEXT("PUT"), TEXT("/api/benchmark/groups/0/action"), TEXT("[{\"success\":{\"/groups/0/action/scene\":\"abc\"}}]"));
+		Bridge.SetRoute(TEXT("DELETE"), TEXT("/api/benchmark/scenes/"), TEXT("[{\"success\":\"/scenes/abc deleted\"}]"));
+		Bridge.SetRoute(TEXT("GET"), TEXT("/api/benchmark/sensors"), MakeV1Sensors(0));
+		Bridge.SetRoute(TEXT("GET"), TEXT("/clip/v2/resource/light"), MakeV2Lights());
+		Bridge.SetRoute(TEXT("GET"), TEXT("/clip/v2/resource/zigbee_connectivity"), MakeV2Connectivity());
+		Bridge.SetRoute(TEXT("PUT"), TEXT("/clip/v2/resource/light/"), TEXT("{\"errors\":[],\"data\":[{\"rid\":\"light-1\",\"rtype\":\"light\"}]}"));
+		Bridge.SetStream(TEXT("/eventstream/clip/v2"));
+	}
+
+	//Send one request and wait for its answer
+	bool Send(FHueTestBridge& Bridge, const TSharedPtr<IHttpRequest>& Request, FString& BodyOut)
+	{
+		bool bDone = false;
+		bool bOk = false;
+		Request->OnProcessRequestComplete().BindLambda([&](FHttpRequestPtr, FHttpResponsePtr Response, bool bWasSuccessful)
+		{
+			bDone = true;
+			bOk = bWasSuccessful && Response.IsValid() && Response->GetResponseCode() == 200;
+			BodyOut = bOk ? Response->GetContentAsString() : FString();
+		});
+		Request->ProcessRequest();
+		if(!Bridge.PumpUntil([&bDone]() { return bDone; }))
+		{
+			Request->OnProcessRequestComplete().Unbind();
+			Request->CancelRequest();
+			return false;
+		}
+		return bOk;
+	}
+
+	/**
+	 * @brief Run one transport against its own stand-in bridge. Bulk reads as discovery does them, a scene switch of
+	 * every light written at once plus a bridge scene round trip, and button presses seen through the transport's
+	 * sensor path: v1 polls at the bridge's fast interval, v2 listens on the event stream
+	 */
+	FWorkloadResult RunWorkload(EHueApiVersion Version)
+	{
+		FWorkloadResult Result;
+		FHueTestBridge Bridge;
+		if(!Bridge.IsListening())
+		{
+			return Result;
+		}
+		AddRoutes(Bridge);
+		const TSharedRef<IHueTransport> Transport = IHueTransport::Create(Version, Bridge.GetHost(), TEXT("benchmark"));
+		Transport->SetUseTls(false);
+		FString Body;
+
+		//Bulk reads, v2 reads the link state of every light first
+		int32 Served = Bridge.GetRequests().Num();
+		double Start = FPlatformTime::Seconds();
+		for (int32 Read = 0; Read < NUM_READS; ++Read)
+		{
+			if(const TSharedPtr<IHttpRequest> Connectivity = Transport->CreateGetConnectivity())
+			{
+				if(!Send(Bridge, Connectivity, Body) || !Transport->ParseConnectivity(Body))
+				{
+					return Result;
+				}
+			}
+			TArray<FHueLightRecord> Lights;
+			if(!Send(Bridge, Transport->CreateGetLights(), Body) || !Transport->ParseLights(Body, Lights))
+			{
+				return Result;
+			}
+			Result.LightsRead = Lights.Num();
+		}
+		Result.ReadMs = (FPlatformTime::Seconds() - Start) * 1000.0 / NUM_READS;
+		Result.ReadRequests = Bridge.GetRequests().Num() - Served;
+
+		//Scene switch, every light written at once then the same scene stored, recalled and deleted on the bridge
+		Served = Bridge.GetRequests().Num();
+		Start = FPlatformTime::Seconds();
+		TMap<FString, FHueLampState> States;
+		int32 Answered = 0;
+		for (int32 Light = 1; Light <= NUM_LIGHTS; ++Light)
+		{
+			FHueLampState State;
+			State.bOn = true;
+			State.Hue = Light * 2000;
+			State.Saturation = 254;
+			State.Brightness = 120;
+			const FString LightId = Version == EHueApiVersion::V1 ? FString::FromInt(Light) : FString::Printf(TEXT("light-%d"), Light);
+			States.Add(LightId, State);
+			const TSharedRef<IHttpRequest> Request = Transport->CreateSetLight(LightId, FHueLightCommand::FromState(State, 4));
+			Request->OnProcessRequestComplete().BindLambda([&Answered](FHttpRequestPtr, FHttpResponsePtr Response, bool bWasSuccessful)
+			{
+				Answered += bWasSuccessful && Response.IsValid() && Response->GetResponseCode() == 200 ? 1 : 0;
+			});
+			Request->ProcessRequest();
+		}
+		if(!Bridge.PumpUntil([&Answered]() { return Answered == NUM_LIGHTS; }))
+		{
+			return Result;
+		}
+		FString SceneId;
+		if(!Send(Bridge, Transport->CreateCreateScene(TEXT("Benchmark"), States, 4), Body) || !Transport->ParseCreatedId(Body, SceneId)
+			|| !Send(Bridge, Transport->CreateRecallScene(SceneId), Body) || !Transport->ParseActionSucceeded(Body)
+			|| !Send(Bridge, Transport->CreateDeleteScene(SceneId), Body))
+		{
+			return Result;
+		}
+		Result.SceneMs = (FPlatformTime::Seconds() - Start) * 1000.0;
+		Result.SceneRequests = Bridge.GetRequests().Num() - Served;
+
+		//Button presses, each made at a different point of the poll cycle
+		Served = Bridge.GetRequests().Num();
+		const TSharedPtr<IHttpRequest> Stream = Transport->CreateEventStream();
+		int32 StreamEvents = 0;
+		if(Stream.IsValid())
+		{
+			Stream->OnRequestProgress().BindLambda([&StreamEvents, &Transport](FHttpRequestPtr Request, int32, int32)
+			{
+				const FHttpResponsePtr Response = Request.IsValid() ? Request->GetResponse() : nullptr;
+				TArray<FHueSensorState> Events;
+				if(Response.IsValid() && Transport->ParseEvents(Response->GetContentAsString(), Events))
+				{
+					StreamEvents = Events.Num();
+				}
+			});
+			Stream->ProcessRequest();
+			if(!Bridge.PumpUntil([&Bridge]() { return Bridge.GetOpenStreams() == 1; }))
+			{
+				Stream->OnRequestProgress().Unbind();
+				Stream->CancelRequest();
+				return Result;
+			}
+		}
+		double NextPoll = FPlatformTime::Seconds();
+		FDateTime LastSeen;
+		TArray<FHueSensorState> Sensors;
+		if(!Stream.IsValid() && Send(Bridge, Transport->CreateGetSensors(), Body) && Transport->ParseSensors(Body, Sensors) && Sensors.Num() == 1)
+		{
+			LastSeen = Sensors[0].LastUpdated;
+		}
+		for (int32 Press = 1; Press <= NUM_PRESSES; ++Press)
+		{
+			FPlatformProcess::Sleep(static_cast<float>(FMath::Frac(0.37 * Press) * POLL_INTERVAL));
+			const double Changed = FPlatformTime::Seconds();
+			bool bSeen = false;
+			if(Stream.IsValid())
+			{
+				Bridge.PushEvent(MakeV2Event(Press));
+				bSeen = Bridge.PumpUntil([&StreamEvents, Press]() { return StreamEvents >= Press; });
+			}
+			else
+			{
+				Bridge.SetRoute(TEXT("GET"), TEXT("/api/benchmark/sensors"), MakeV1Sensors(Press));
+				for (int32 Poll = 0; Poll < 50 && !bSeen; ++Poll)
+				{
+					Bridge.PumpUntil([&NextPoll]() { return FPlatformTime::Seconds() >= NextPoll; });
+					NextPoll += POLL_INTERVAL;
+					Sensors.Reset();
+					if(Send(Bridge, Transport->CreateGetSensors(), Body) && Transport->ParseSensors(Body, Sensors) && Sensors.Num() == 1)
+					{
+						bSeen = Sensors[0].LastUpdated != LastSeen;
+						LastSeen = Sensors[0].LastUpdated;
+					}
+				}
+			}
+			if(!bSeen)
+			{
+				break;
+			}
+			Result.EventMs += (FPlatformTime::Seconds() - Changed) * 1000.0;
+			Result.EventsSeen++;
+		}
+		if(Stream.IsValid())
+		{
+			Stream->OnRequestProgress().Unbind();
+			Stream->OnProcessRequestComplete().Unbind();
+			Stream->CancelRequest();
+		}
+		Result.EventMs /= FMath::Max(Result.EventsSeen, 1);
+		Result.EventRequests = Bridge.GetRequests().Num() - Served;
+		Result.ResourceRequests = Bridge.GetRequests().FilterByPredicate([](const FString& Request) { return Request.Contains(TEXT("/clip/v2/resource/")); }).Num();
+		Result.bCompleted = Result.EventsSeen == NUM_PRESSES;
+		return Result;
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FHueTransportBenchmarkTest, "HueLighting.Transport.StandInBenchmark",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/**
+ * @brief Both transports run the same session against a stand-in bridge on a loopback port and are timed side by
+ * side. Requests are counted by what the stand-in served. v2 pays a link state read per bulk read and gets sensor
+ * changes pushed instead of polling for them
+ */
+bool FHueTransportBenchmarkTest::RunTest(const FString& Parameters)
+{
+	const HueTransportTest::FWorkloadResult V1 = HueTransportTest::RunWorkload(EHueApiVersion::V1);
+	const HueTransportTest::FWorkloadResult V2 = HueTransportTest::RunWorkload(EHueApiVersion::ClipV2);
+	for (const HueTransportTest::FWorkloadResult* Result : { &V1, &V2 })
+	{
+		AddInfo(FString::Printf(TEXT("%s: bulk read %.2f ms (%d requests), scene switch %.2f ms (%d requests), sensor change seen after %.2f ms (%d requests)"),
+			Result == &V1 ? TEXT("v1") : TEXT("CLIP v2"), Result->ReadMs, Result->ReadRequests, Result->SceneMs, Result->SceneRequests,
+			Result->EventMs, Result->EventRequests));
+	}
+	if(!TestTrue(TEXT("v1 finishes the session"), V1.bCompleted) || !TestTrue(TEXT("v2 finishes the session"), V2.bCompleted))
+	{
+		return false;
+	}
+
+	TestEqual(TEXT("v1 reads every light"), V1.LightsRead, HueTransportTest::NUM_LIGHTS);
+	TestEqual(TEXT("v2 reads every light"), V2.LightsRead, HueTransportTest::NUM_LIGHTS);
+	TestEqual(TEXT("A v1 bulk read is one request"), V1.ReadRequests, HueTransportTest::NUM_READS);
+	TestEqual(TEXT("A v2 bulk read also reads the link state"), V2.ReadRequests, HueTransportTest::NUM_READS * 2);
+	TestEqual(TEXT("Both switch a scene with the same requests"), V2.SceneRequests, V1.SceneRequests);
+	TestEqual(TEXT("v1 never touches a v2 resource"), V1.ResourceRequests, 0);
+	TestEqual(TEXT("v2 reads and writes lights through v2 resources, scenes stay on v1"), V2.ResourceRequests,
+		HueTransportTest::NUM_READS * 2 + HueTransportTest::NUM_LIGHTS);
+	TestEqual(TEXT("v2 listens on one stream instead of polling"), V2.EventRequests, 1);
+	TestTrue(TEXT("v1 polls for every change"), V1.EventRequests >= HueTransportTest::NUM_PRESSES);
+	TestTrue(TEXT("Pushed changes are seen sooner than polled ones"), V2.EventMs < V1.EventMs);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FHueTransportReachabilityTest, "HueLighting.Transport.ClipV2Reachability",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+/**
+ * @brief v2 lights take their reachability from the zigbee_connectivity of the device that owns them
+ */
+bool FHueTransportReachabilityTest::RunTest(const FString& Parameters)
+{
+	const TSharedRef<IHueTransport> Transport = IHueTransport::Create(EHueApiVersion::ClipV2, TEXT("127.0.0.1"), TEXT("test"));
+	const FString Lights = TEXT("{\"errors\":[],\"data\":["
+		"{\"id\":\"light-a\",\"owner\":{\"rid\":\"device-a\",\"rtype\":\"device\"},\"metadata\":{\"name\":\"A\"},\"on\":{\"on\":true}},"
+		"{\"id\":\"light-b\",\"owner\":{\"rid\":\"device-b\",\"rtype\":\"device\"},\"metadata\":{\"name\":\"B\"},\"on\":{\"on\":true}}]}");
+	const FString Connectivity = TEXT("{\"errors\":[],\"data\":["
+		"{\"id\":\"zc-a\",\"owner\":{\"rid\":\"device-a\",\"rtype\":\"device\"},\"status\":\"connected\"},"
+		"{\"id\":\"zc-b\",\"owner\":{\"rid\":\"device-b\",\"rtype\":\"device\"},\"status\":\"connectivity_issue\"}]}");
+
+	TArray<FHueLightRecord> Records;
+	TestTrue(TEXT("Lights parse"), Transport->ParseLights(Lights, Records));
+	TestTrue(TEXT("Unknown link state counts as reachable"), Records.Num() == 2 && Records[0].bReachable && Records[1].bReachable);
+
+	TestTrue(TEXT("Connectivity parses"), Transport->ParseConnectivity(Connectivity));
+	Records.Reset();
+	Transport->ParseLights(Lights, Records);
+	if(!TestEqual(TEXT("Both lights read"), Records.Num(), 2))
+	{
+		return false;
+	}
+	TestTrue(TEXT("Connected device is reachable"), Records[0].bReachable);
+	TestFalse(TEXT("Device with a connectivity issue is unreachable"), Records[1].bReachable);
+	return true;
+}
+
+#endif
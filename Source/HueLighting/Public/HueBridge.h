@@ -7,6 +7,14 @@ Copyright (c) 2022 Scott Tongue all rights reversed
 
 #include "CoreMinimal.h"
 #include "HueLamp.h"
+#include "HueBridgeDiscovery.h"
+#include "HueSendScheduler.h"
+#include "HueCommandBroker.h"
+#include "HueTransport.h"
+#include "HueEffects.h"
+#include "HueDmxReceiver.h"
+#include "HueSensors.h"
+#include "HueConfigStore.h"
 #include "GameFramework/Actor.h"
 #include "Interfaces/IHttpRequest.h"
 #include "HueBridge.generated.h"
@@ -22,6 +30,28 @@ const static FString TYPE = TEXT("type");
 const static FString STATE = TEXT("/state");
 const static FString USERNAME = TEXT("username");
 const static FString NAME = TEXT("name");
+const static FString VERB_PUT = TEXT("PUT");
+const static FString VERB_DELETE = TEXT("DELETE");
+const static FString SUCCESS = TEXT("success");
+
+//Bridge calls that are tracked on their own, different operations run side by side
+UENUM(BlueprintType)
+enum class EHueBridgeOperation : uint8
+{
+	Discover,
+	CreateUser,
+	CheckUser,
+	RefreshState
+};
+
+//How a bridge operation ended, a bridge that never answered is told apart from one that said no
+UENUM(BlueprintType)
+enum class EHueOperationResult : uint8
+{
+	Succeeded,
+	Rejected,
+	Unreachable
+};
 
 USTRUCT()
 struct FLightInfo
@@ -41,8 +71,252 @@ struct FLightUse
 public:
 	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Lamp")
 		FString LightName;
+	//Id the bridge knows the lamp by, stays the same when the lamp is renamed
 	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Lamp")
-		bool bUseLight;
+		FString LightId;
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Lamp")
+		bool bUseLight = true;
+};
+
+USTRUCT(BlueprintType)
+struct FHueSceneDefinition
+{
+	GENERATED_USTRUCT_BODY() 
+public:
+	//Lamp name to the state it should be in for this scene
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Scene")
+		TMap<FString, FHueLampState> LampStates;
+	//Fade time in 100ms steps the bridge uses when recalling the scene
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Scene")
+		int32 TransitionTime = 4;
+};
+
+USTRUCT(BlueprintType)
+struct FHueSceneConfig
+{
+	GENERATED_USTRUCT_BODY() 
+public:
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Scene")
+		FString SceneName;
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Scene")
+		FString SceneId;
+	//Crc of the scene definition the bridge scene was compiled from
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Scene")
+		int32 DefinitionHash = 0;
+};
+
+//One look of an ambient program and how long it takes to get there
+USTRUCT(BlueprintType)
+struct FHueAmbientStep
+{
+	GENERATED_USTRUCT_BODY() 
+public:
+	//Lamp name to the state it should be in for this step
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Ambient")
+		TMap<FString, FHueLampState> LampStates;
+	//Seconds to fade into this step, the bridge fades for at most 6553 seconds
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Ambient", meta = (ClampMin = "0.0", ClampMax = "6553.0"))
+		float FadeSeconds = 60.0f;
+	//Seconds to stay on this step once the fade is done
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Ambient", meta = (ClampMin = "0.0"))
+		float HoldSeconds = 0.0f;
+};
+
+//A slow light cycle the bridge runs on its own timers
+USTRUCT(BlueprintType)
+struct FHueAmbientProgram
+{
+	GENERATED_USTRUCT_BODY() 
+public:
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Ambient")
+		TArray<FHueAmbientStep> Steps;
+	//Start over after the last step, otherwise the program runs once and stays on the last step
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Ambient")
+		bool bLoop = true;
+};
+
+//Scenes and schedules an installed ambient program owns on the bridge
+USTRUCT(BlueprintType)
+struct FHueScheduleConfig
+{
+	GENERATED_USTRUCT_BODY() 
+public:
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Ambient")
+		FString ProgramName;
+	//Crc of the program the schedules were built from
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Ambient")
+		int32 ProgramHash = 0;
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Ambient")
+		bool bLoop = true;
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Ambient")
+		TArray<FString> SceneIds;
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Ambient")
+		TArray<FString> ScheduleIds;
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Ambient")
+		FDateTime InstalledAt;
+};
+
+//An ambient program on its way to the bridge, scenes go first and then the schedules that recall them
+struct FHueAmbientInstall
+{
+	FHueScheduleConfig Config;
+	TArray<double> Offsets;
+	double Period = 0.0;
+	int32 Pending = 0;
+	bool bSchedulesStarted = false;
+	bool bFailed = false;
+};
+
+USTRUCT(BlueprintType)
+struct FHueSceneSwitchStats
+{
+	GENERATED_USTRUCT_BODY() 
+public:
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Scene")
+		FString SceneName;
+	//True if switched with a single bridge scene recall, false if sent lamp by lamp
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Scene")
+		bool bUsedBridgeScene = false;
+	//Requests that actually left for the bridge, lamp states still waiting on the send scheduler don't count
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Scene")
+		int32 Requests = 0;
+	//Time from the first request leaving to the last bridge answer
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Scene")
+		float LatencyMs = 0.0f;
+};
+
+//Every lamp's state at one moment, restored when the session ends
+USTRUCT(BlueprintType)
+struct FHueRoomSnapshot
+{
+	GENERATED_USTRUCT_BODY() 
+public:
+	//Light id to the state it was in, names still work for snapshots made by hand
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Snapshot")
+		TMap<FString, FHueLampState> LampStates;
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Snapshot")
+		FDateTime CapturedAt;
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Snapshot")
+		bool bValid = false;
+};
+
+USTRUCT(BlueprintType)
+struct FHueRestoreStats
+{
+	GENERATED_USTRUCT_BODY() 
+public:
+	//Lamps that weren't already showing their snapshot state
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Snapshot")
+		int32 Lamps = 0;
+	//Lamps sharing a state with another lamp, restored with one temporary scene
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Snapshot")
+		int32 SceneLamps = 0;
+	//Lamps with a state of their own, restored through the send scheduler
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Snapshot")
+		int32 DirectLamps = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Snapshot")
+		int32 Requests = 0;
+	//Time from starting the restore to the last bridge answer
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Snapshot")
+		float LatencyMs = 0.0f;
+	//False if the time budget ran out before every answer came back
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Snapshot")
+		bool bCompleted = false;
+};
+
+USTRUCT(BlueprintType)
+struct FHueFrameStats
+{
+	GENERATED_USTRUCT_BODY() 
+public:
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Frame")
+		int32 Lamps = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Frame")
+		int32 Requests = 0;
+	//True if every lamp went to the same state and the frame went out as one group action
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Frame")
+		bool bGroupAction = false;
+	//Time between the first and the last lamp of the frame being answered
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Frame")
+		float SkewMs = 0.0f;
+	//Time from the commit to the last answer
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Frame")
+		float LatencyMs = 0.0f;
+};
+
+//A committed frame waiting for the bridge to answer its lamps
+struct FHueFrameTransaction
+{
+	int32 Id = 0;
+	double CommitTime = 0.0;
+	double FirstAck = 0.0;
+	double LastAck = 0.0;
+	TArray<TWeakObjectPtr<AHueLamp>> Waiting;
+	//Slots a group action covers and the state it sets, they count as sent once the bridge accepts it
+	TArray<int32> GroupSlots;
+	FHueLampState GroupState;
+	FHueFrameStats Stats;
+};
+
+USTRUCT(BlueprintType)
+struct FHueBridgeMetrics
+{
+	GENERATED_USTRUCT_BODY() 
+public:
+	//Commands folded away because their lamp was unreachable
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge")
+		int32 SuppressedCommands = 0;
+	//Lamps holding a state to send once they are reachable again
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge")
+		int32 PendingOnReconnect = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge")
+		int32 ReconnectFlushes = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge")
+		int32 UnreachableLamps = 0;
+	//Visible error between what every lamp should show and what was sent, delta E weighted by importance
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge")
+		float TotalVisibleError = 0.0f;
+	//True if this process owns the bridge connection, always true without the command broker
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge")
+		bool bOwnsBridge = true;
+	//Commands this process handed to the broker owner
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge")
+		int32 BrokerSubmitted = 0;
+	//Commands other processes handed to this process
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge")
+		int32 BrokerReceived = 0;
+	//Requests the transport has built since it was last created
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge")
+		int32 RequestsSent = 0;
+	//Request to answer time of lamp state requests, averaged over the lamps that sent any
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge")
+		float StateLatencyMs = 0.0f;
+	//Worker time of the last effect batch
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge")
+		float EffectEvaluateMs = 0.0f;
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge")
+		int32 EffectLamps = 0;
+	//DMX packets merged since the receiver started
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge")
+		int32 DmxPackets = 0;
+	//DMX packets thrown away because the game thread fell behind the receiver
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge")
+		int32 DmxDropped = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge")
+		int32 DmxUniverses = 0;
+	//Round trip of the sensor reads on the local clock, a change is seen at most one poll interval plus this late
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge")
+		float SensorLatencyMs = 0.0f;
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge")
+		float SensorMaxLatencyMs = 0.0f;
+	//Seconds until the next sensor read at the current pace
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge")
+		float SensorPollInterval = 0.0f;
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge")
+		int32 SensorChanges = 0;
+	//True while the v2 event stream is open
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge")
+		bool bSensorStreaming = false;
 };
 
 USTRUCT(BlueprintType)
@@ -55,10 +329,47 @@ public:
 		FString UserName;
 	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Bridge")
 		FString HostName;
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Bridge")
+		FString BridgeId;
+	//Api the bridge is talked to with, CLIP v2 needs a v2 capable bridge and its HTTPS certificate
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Bridge")
+		EHueApiVersion ApiVersion = EHueApiVersion::V1;
 	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Bridge")
 		FString AppName = "MyUnrealApp";
 	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Bridge")
 		TArray<FLightUse> Lights;
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Bridge")
+		TArray<FHueSceneConfig> Scenes;
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Bridge")
+		TArray<FHueScheduleConfig> Schedules;
+};
+
+USTRUCT(BlueprintType)
+struct FHueConfigBenchmark
+{
+	GENERATED_USTRUCT_BODY() 
+public:
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge")
+		int32 NumLamps = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge")
+		int32 Cycles = 0;
+	//Game thread cost of a save, the snapshot copy
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge")
+		float SnapshotMs = 0.0f;
+	//Worker cost of a save, JSON written and renamed plus the cache
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge")
+		float WriteMs = 0.0f;
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge")
+		float JsonLoadMs = 0.0f;
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge")
+		float CacheLoadMs = 0.0f;
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge")
+		int32 JsonBytes = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge")
+		int32 CacheBytes = 0;
+	//False if the file grew between the first and last save of the same lamps
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge")
+		bool bSizeStable = false;
 };
 
 DECLARE_DYNAMIC_MULTICAST_DELEGATE(FSaveConfig );
@@ -66,11 +377,25 @@ DECLARE_DYNAMIC_MULTICAST_DELEGATE(FTooManyRequests );
 DECLARE_DYNAMIC_MULTICAST_DELEGATE(FFoundLights);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FNewUserRequest, float, Message );
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FUserConfigured, bool, Message );
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FBridgeDiscovered, bool, bFound, const FString&, Host );
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FSceneSwitched, const FHueSceneSwitchStats&, Stats );
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FFrameCommitted, const FHueFrameStats&, Stats );
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FSnapshotCaptured, const FHueRoomSnapshot&, Snapshot );
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FSnapshotRestored, const FHueRestoreStats&, Stats );
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FAmbientProgramInstalled, const FString&, ProgramName, bool, bSuccess );
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FSensorChanged, const FHueSensorState&, Sensor );
+DECLARE_MULTICAST_DELEGATE_TwoParams(FOnHueOperationFinished, EHueBridgeOperation, EHueOperationResult);
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnHueSensorChanged, const FHueSensorState&);
 
 UCLASS()
 class HUELIGHTING_API AHueBridge : public AActor
 {
 	GENERATED_BODY()
+#if WITH_DEV_AUTOMATION_TESTS
+	friend class FHueBridgeDiscoveryChainTest;
+	friend class FHueBridgeHydrationTest;
+	friend class FHueSceneSwitchCountTest;
+#endif
 	
 public:	
 	// Sets default values for this actor's properties
@@ -81,30 +406,271 @@ public:
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 	TMap<FString, TObjectPtr<AHueLamp>> HueLamps;
 	FTimerHandle LinkBridgeTimer;
 	bool bUserExist = false;
+	//True once lights were read with the current host and user
+	bool bLampsDiscovered = false;
+
+	//Operations that may be waiting on the bridge at once, more are queued until one finishes
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Hue Bridge Config", meta = (ClampMin = "1"))
+		int32 MaxConcurrentOperations = 3;
 
-	UPROPERTY(BlueprintGetter = BridgeInUse, Category = "Hue Bridge Config")
-		bool bInUse = false;
+	TSet<EHueBridgeOperation> ActiveOperations;
+	TArray<EHueBridgeOperation> QueuedOperations;
 	
 	UPROPERTY(EditDefaultsOnly, BlueprintReadWrite, Category = "Hue Bridge Config")
 		float  DelayTimerForBridgePress = 5.0;
 	
 	UPROPERTY(EditDefaultsOnly, BlueprintReadWrite, Category = "Hue Bridge Config")
 		FHueBridgeConfig HueBridgeConfig;
+
+	//Lighting moods that get compiled into bridge side scenes, keyed by scene name
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Hue Bridge Config")
+		TMap<FString, FHueSceneDefinition> SceneDefinitions;
+
+	//Light cycles the bridge runs by itself once installed, keyed by program name
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Hue Bridge Config")
+		TMap<FString, FHueAmbientProgram> AmbientPrograms;
+
+	TMap<FString, FHueAmbientInstall> AmbientInstalls;
+
+	//Recompile scenes whose definition changed as soon as lamps are discovered
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Hue Bridge Config")
+		bool bCompileScenesOnDiscover = true;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge Config")
+		FHueSceneSwitchStats LastSceneSwitch;
+
+	//Find the bridge on the network when the config is loaded instead of trusting the saved host
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Hue Bridge Config")
+		bool bAutoDiscoverBridge = true;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Hue Bridge Config")
+		FHueDiscoverySettings DiscoverySettings;
+
+	//Seconds between bulk state refreshes of every lamp, 0 turns it off
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Hue Bridge Config")
+		float StateRefreshInterval = 10.0f;
+
+	//Light state requests per second the bridge is allowed, Hue recommends about 10
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Hue Bridge Config")
+		float SendRate = 10.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Hue Bridge Config")
+		EHueSchedulePolicy SchedulePolicy = EHueSchedulePolicy::PerceptualError;
+
+	//How fast waiting raises a lamp's priority, per second since its last send
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Hue Bridge Config")
+		float ScheduleAgeWeight = 1.0f;
+
+	TSharedPtr<FHueSendScheduler> Scheduler;
+	TArray<TWeakObjectPtr<AHueLamp>> ScheduledLamps;
+	TMap<FString, TWeakObjectPtr<AHueLamp>> LampsByKey;
+	TArray<int32> ScheduledThisTick;
+
+	//Share the bridge with other processes on this machine, one owns the connection and the others submit to it
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Hue Bridge Config")
+		bool bUseCommandBroker = false;
+
+	//First loopback port brokers use, each bridge gets its own port above it
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Hue Bridge Config")
+		int32 BrokerPort = 47950;
+
+	//Seconds a client waits for the owner to answer a light read before the operation fails
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Hue Bridge Config")
+		float BrokerReadTimeout = 5.0f;
+
+	//Seconds a client waits for the owner to confirm a lamp state before it submits the state again
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Hue Bridge Config")
+		float BrokerConfirmTimeout = 1.0f;
+
+	TUniquePtr<FHueCommandBroker> CommandBroker;
+	TArray<FHueBrokerCommand> BrokerCommands;
+	//Client only, submitted states by scheduler slot, the slot is held busy until the owner confirms
+	TMap<int32, FHueBrokerSubmit> UnconfirmedSubmits;
+	TArray<FHueLightRecord> BrokerLights;
+	TArray<FHueBrokerSensor> BrokerSensors;
+	bool bBrokerRequested = false;
+	bool bBrokerReadPending = false;
+	double BrokerReadTime = 0.0;
+
+	//Effect batches a second, the scheduler still decides what reaches the bridge
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Hue Bridge Config")
+		float EffectRate = 30.0f;
+
+	TSharedPtr<FHueEffectRunner> EffectRunner;
+	TArray<FHueEffectOutput> EffectOutputs;
+
+	//Let a lighting console drive lamps over sACN or Art-Net, the patch says which channels feed which lamp
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Hue Bridge Config")
+		bool bEnableDmxInput = false;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Hue Bridge Config")
+		bool bListenSacn = true;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Hue Bridge Config")
+		bool bListenArtNet = true;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Hue Bridge Config")
+		TArray<FHueDmxPatch> DmxPatch;
+
+	TUniquePtr<FHueDmxReceiver> DmxReceiver;
+	TUniquePtr<FHueDmxLoopbackGenerator> DmxLoopback;
+	TArray<TWeakObjectPtr<AHueLamp>> DmxPatchLamps;
+	TArray<int32> DmxChangedUniverses;
+
+	//Read switches and motion sensors, polls speed up after a change and back off while nothing happens
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Hue Bridge Config")
+		bool bEnableSensors = false;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Hue Bridge Config", meta = (ClampMin = "0.05"))
+		float SensorFastInterval = 0.1f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Hue Bridge Config", meta = (ClampMin = "0.05"))
+		float SensorSlowInterval = 2.0f;
+
+	//Seconds sensor polls stay fast after the last change
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Hue Bridge Config", meta = (ClampMin = "0.0"))
+		float SensorActiveHold = 5.0f;
+
+	//v2 bridges push changes on an event stream, polls then only catch what it missed
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Hue Bridge Config")
+		bool bUseEventStream = true;
+
+	TSharedPtr<FHueSensorPoller> SensorPoller;
+	TSharedPtr<IHttpRequest> EventStream;
+	int32 EventStreamOffset = 0;
+	double EventStreamRetryTime = 0.0;
+	TArray<FHueSensorState> ChangedSensors;
+
+	//Collect every lamp change made in a frame and send them together at the end of the frame
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Hue Bridge Config")
+		bool bAutoCommitFrames = false;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge Config")
+		FHueFrameStats LastFrame;
+
+	int32 FrameDepth = 0;
+	int32 NextFrameId = 1;
+	//Lights in the last bulk read, a group action only fits when we have a lamp for every one of them
+	int32 BridgeLightCount = 0;
+	TArray<FHueFrameTransaction> FrameTransactions;
+	FDelegateHandle EndFrameHandle;
+
+	//Keep the room's lighting from the first lamp discovery so it can be put back when the session ends
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Hue Bridge Config")
+		bool bCaptureSnapshotOnDiscover = true;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Hue Bridge Config")
+		bool bRestoreSnapshotOnEndPlay = true;
+
+	//Seconds EndPlay may wait for the restore to reach the bridge
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Hue Bridge Config", meta = (ClampMin = "0.0"))
+		float RestoreTimeBudget = 1.5f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge Config")
+		FHueRoomSnapshot SessionSnapshot;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Bridge Config")
+		FHueRestoreStats LastRestore;
+
+	int32 RestoreRequestsInFlight = 0;
+	int32 RestoreId = 0;
+	double RestoreStartTime = 0.0;
+	TMap<FString, FHueLampState> RestoreSceneStates;
+	//Lamps restored through the scheduler and the state they wait to have sent
+	TMap<TWeakObjectPtr<AHueLamp>, FHueLampState> RestoreLamps;
+
+	//Write a binary copy of the config next to the JSON, loads read it while the JSON hasn't been edited since
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Hue Bridge Config")
+		bool bUseConfigCache = true;
+
+	TSharedPtr<FHueConfigStore> ConfigStore;
+
+	//Builds every lamp and scene request, recreated whenever the host, user or api version changes
+	TSharedPtr<IHueTransport> Transport;
+
+	FTimerHandle StateRefreshTimer;
+
+	TSharedPtr<FHueBridgeDiscovery> BridgeDiscovery;
+	bool bDiscoverLampsAfterBridge = false;
+
+	//Lamp by lamp switch states still waiting on the send scheduler, they count once they leave
+	TMap<TWeakObjectPtr<AHueLamp>, FHueLampState> QueuedSwitchLamps;
+	//Lamps of the switch that were sent and wait for their answer
+	TSet<TWeakObjectPtr<AHueLamp>> PendingSwitchLamps;
+	double SceneSwitchStartTime = 0.0;
+	//Counts scene switches so answers to an older switch are ignored
+	int32 SceneSwitchId = 0;
 	
 	
 	virtual void OnResponseReceivedDiscover( FHttpRequestPtr Request,  FHttpResponsePtr Response, bool bWasSuccessful);
 	virtual void OnResponseReceivedNewUser( FHttpRequestPtr Request,  FHttpResponsePtr Response, bool bWasSuccessful);
 	virtual void OnResponseReceivedUserExist( FHttpRequestPtr Request,  FHttpResponsePtr Response, bool bWasSuccessful);
-	virtual bool CheckIfBusy();
+	virtual void OnResponseReceivedCreateScene( FHttpRequestPtr Request,  FHttpResponsePtr Response, bool bWasSuccessful, FString SceneName, int32 DefinitionHash);
+	virtual void OnResponseReceivedRecallScene( FHttpRequestPtr Request,  FHttpResponsePtr Response, bool bWasSuccessful, int32 SwitchId);
+	virtual void OnResponseReceivedStateRefresh( FHttpRequestPtr Request,  FHttpResponsePtr Response, bool bWasSuccessful);
+	virtual void OnResponseReceivedConnectivity( FHttpRequestPtr Request,  FHttpResponsePtr Response, bool bWasSuccessful, EHueBridgeOperation Operation);
+	virtual void OnResponseReceivedAmbientScene( FHttpRequestPtr Request,  FHttpResponsePtr Response, bool bWasSuccessful, FString ProgramName, int32 Step);
+	virtual void OnResponseReceivedAmbientSchedule( FHttpRequestPtr Request,  FHttpResponsePtr Response, bool bWasSuccessful, FString ProgramName, int32 Step, bool bStarter);
+	virtual void OnResponseReceivedFrameGroup( FHttpRequestPtr Request,  FHttpResponsePtr Response, bool bWasSuccessful, int32 FrameId);
+	virtual void OnResponseReceivedSnapshot( FHttpRequestPtr Request,  FHttpResponsePtr Response, bool bWasSuccessful);
+	virtual void OnResponseReceivedRestoreScene( FHttpRequestPtr Request,  FHttpResponsePtr Response, bool bWasSuccessful, int32 Id);
+	virtual void OnResponseReceivedRestore( FHttpRequestPtr Request,  FHttpResponsePtr Response, bool bWasSuccessful, FString SceneId, int32 Id);
+	virtual void OnResponseReceivedSensors( FHttpRequestPtr Request,  FHttpResponsePtr Response, bool bWasSuccessful);
+	virtual void OnResponseReceivedEventStream( FHttpRequestPtr Request,  FHttpResponsePtr Response, bool bWasSuccessful);
+	virtual void OnEventStreamProgress( FHttpRequestPtr Request, int32 BytesSent, int32 BytesReceived);
+	virtual void OnLampStateAcknowledged(AHueLamp* Lamp);
+	virtual void OnLampStateSent(AHueLamp* Lamp);
+	virtual void OnBridgeDiscoveryFinished(bool bFound, const FString& Host);
+	virtual bool CheckIfBusy(EHueBridgeOperation Operation);
+	bool BeginOperation(EHueBridgeOperation Operation);
+	void FinishOperation(EHueBridgeOperation Operation, EHueOperationResult Result);
 	
 	void GetLightInfo(TSharedPtr<FJsonObject> JsonObject,  FLightInfo& LightInfoOut);
 	void GetStringName(TSharedPtr<FJsonObject> JsonObject,  const FString& Field, FString& NameOut );
 
 	void UserConfiguredCorrectly(bool Value);
+	void RegisterLamp(AHueLamp* Lamp);
+	void TickCommandBroker();
+	void RefreshCommandBroker();
+	void ReleaseBrokerSubmit(int32 Slot);
+	void SubmitToBroker(double Now);
+	void RequestBrokerRead(EHueBridgeOperation Operation);
+	void FinishBrokerRead(bool bSuccess);
+	void OnLampsDiscovered(const TArray<FHueLightRecord>& Lights);
+	void TickEffects();
+	void TickDmx();
+	void ResolveDmxPatch();
+	void TickSensors();
+	void StartEventStream();
+	void BroadcastSensorChanges();
+	void UpdateLamps(const TArray<FHueLightRecord>& Lights, bool bSpawnMissing);
+	FHueConfigStore& GetConfigStore();
+	void ApplyLightUse(AHueLamp* Lamp);
+	void RefreshTransport();
+	void ReadLights(EHueBridgeOperation Operation, bool bReadConnectivity = true);
+	int32 HashSceneDefinition(const FHueSceneDefinition& Definition) const;
+	FHueSceneConfig* FindSceneConfig(const FString& SceneName);
+	FHueScheduleConfig* FindScheduleConfig(const FString& ProgramName);
+	int32 HashAmbientProgram(const FHueAmbientProgram& Program) const;
+	void StartAmbientSchedules(const FString& ProgramName);
+	void FinishAmbientInstall(const FString& ProgramName);
+	void DeleteFromBridge(const FHueScheduleConfig& Schedule);
+	void FinishSceneSwitch();
+	bool NoteSwitchSent(AHueLamp* Lamp, const FHueLampState& State, int32 Requests);
+	void NoteSwitchAcknowledged(AHueLamp* Lamp);
+	void CommitFrame(bool bForce);
+	bool CanSendFrameAsGroup(const TArray<int32>& Slots);
+	void FinishFrameTransaction(int32 Index);
+	void OnEndFrame();
+	void BuildSnapshot(const TArray<FHueLightRecord>& Lights, FHueRoomSnapshot& SnapshotOut) const;
+	void FinishRestoreRequest(int32 Id);
+	void SendScheduled(double Now);
+	void WaitForRestore(float Budget);
 public:
 	
 	UPROPERTY(BlueprintAssignable,Category = "Hue Bridge || Warnings" )
@@ -122,12 +688,42 @@ public:
 	UPROPERTY(BlueprintAssignable,Category = "Hue Bridge || Warnings" )
 		FFoundLights FoundDiscoverableLights;
 	
+	UPROPERTY(BlueprintAssignable,Category = "Hue Bridge || Warnings" )
+		FBridgeDiscovered BridgeDiscovered;
+	
+	UPROPERTY(BlueprintAssignable,Category = "Hue Bridge || Scenes" )
+		FSceneSwitched SceneSwitched;
+	
+	UPROPERTY(BlueprintAssignable,Category = "Hue Bridge || Ambient" )
+		FAmbientProgramInstalled AmbientProgramInstalled;
+	
+	UPROPERTY(BlueprintAssignable,Category = "Hue Bridge || Frames" )
+		FFrameCommitted FrameCommitted;
+	
+	UPROPERTY(BlueprintAssignable,Category = "Hue Bridge || Snapshot" )
+		FSnapshotCaptured SnapshotCaptured;
+	
+	UPROPERTY(BlueprintAssignable,Category = "Hue Bridge || Snapshot" )
+		FSnapshotRestored SnapshotRestored;
+	
+	UPROPERTY(BlueprintAssignable,Category = "Hue Bridge || Sensors" )
+		FSensorChanged SensorChanged;
+
+	//Native only, same as SensorChanged for code that doesn't want a dynamic delegate
+	FOnHueSensorChanged OnSensorChanged;
+
+	//Native only, fires when a bridge operation is answered. Async action nodes wait on this
+	FOnHueOperationFinished OperationFinished;
+	
 	
 	virtual void Tick(float DeltaTime) override;
 	
 	UFUNCTION(BlueprintCallable, Category = "Hue Bridge")
 		virtual void DiscoverLamps();
 	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge")
+		virtual void AutoDiscoverBridge();
+	
 	UFUNCTION(BlueprintCallable, Category = "Hue Bridge")
 		virtual void HueBridgeSetupTimer();
 	
@@ -141,17 +737,58 @@ public:
 		virtual void LoadConfig();
 	
 	UFUNCTION(BlueprintCallable, Category = "Hue Bridge")
-		virtual void SetHostName(const FString &Host)  { HueBridgeConfig.HostName = Host;}
+		virtual void SetHostName(const FString &Host);
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge")
+		virtual void SetApiVersion(EHueApiVersion Version);
+	
+	UFUNCTION(BlueprintPure, Category = "Hue Bridge")
+		virtual EHueApiVersion GetApiVersion() {return HueBridgeConfig.ApiVersion;}
 	
 	UFUNCTION(BlueprintCallable, Category = "Hue Bridge")
 		virtual AHueLamp* GetLamp(const FString &LampName);
 	
 	UFUNCTION(BlueprintCallable, Category = "Hue Bridge")
+		virtual void CheckHueUser();
+	
+	//Starts a user check and returns the result of the last one, the new result arrives through HasUserBeenConfigured
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge", meta = (DeprecatedFunction, DeprecationMessage = "Use CheckHueUser or the Check User async node, the result arrives after the bridge answers"))
 		virtual bool DoesHueUserExist();
 	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge")
+		virtual void StartOperation(EHueBridgeOperation Operation);
+	
+	UFUNCTION(BlueprintPure, Category = "Hue Bridge")
+		virtual bool IsOperationRunning(EHueBridgeOperation Operation) {return ActiveOperations.Contains(Operation) || QueuedOperations.Contains(Operation);}
+	
+	//Result of the last user check or user creation
+	UFUNCTION(BlueprintPure, Category = "Hue Bridge")
+		virtual bool IsUserConfigured() {return bUserExist;}
+	
 	UFUNCTION(BlueprintCallable, Category = "Hue Bridge")
 		virtual void ClearOutLights();
 	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge")
+		virtual void RefreshLampStates();
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge")
+		virtual void SetStateRefreshInterval(float Interval);
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || Scenes")
+		virtual void CompileScene(const FString &SceneName);
+	
+	UFUNCTION(BlueprintCallable, CallInEditor, Category = "Hue Bridge || Scenes")
+		virtual void CompileAllScenes();
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || Scenes")
+		virtual bool RecallScene(const FString &SceneName);
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || Scenes")
+		virtual void ApplySceneLampByLamp(const FString &SceneName);
+	
+	UFUNCTION(BlueprintPure, Category = "Hue Bridge || Scenes")
+		virtual bool IsSceneCompiled(const FString &SceneName);
+	
 	UFUNCTION(BlueprintCallable, Category = "Hue Bridge")
 		virtual TArray<FString> GetAllLampNames(){  TArray<FString> Names; HueLamps.GetKeys(Names); return Names;  }
 	
@@ -159,7 +796,119 @@ public:
 		virtual bool DoesLampExist(const FString &LampName) {return HueLamps.Contains(LampName);}
 	
 	UFUNCTION(BlueprintPure, Category = "Hue Bridge")
-		virtual bool BridgeInUse(){return bInUse;}
+		virtual bool BridgeInUse(){return ActiveOperations.Num() > 0;}
+	
+	UFUNCTION(BlueprintPure, Category = "Hue Bridge")
+		virtual FHueBridgeMetrics GetMetrics();
+	
+	//Seconds from sending a lamp state to the bridge answering, Sequencer Hue tracks shift their cues by half of it
+	UFUNCTION(BlueprintPure, Category = "Hue Bridge")
+		virtual float GetStateLatency();
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || Scheduler")
+		virtual void SetSendRate(float Rate);
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || Scheduler")
+		virtual void StartCommandBroker();
+	
+	UFUNCTION(BlueprintPure, Category = "Hue Bridge || Scheduler")
+		virtual bool OwnsBridgeConnection();
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || Scheduler")
+		virtual void SetSchedulePolicy(EHueSchedulePolicy Policy);
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || Scheduler")
+		virtual void StartScheduleTrace();
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || Scheduler")
+		virtual TArray<FHueTraceEvent> StopScheduleTrace();
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || Scheduler")
+		virtual void CompareSchedulePolicies(const TArray<FHueTraceEvent> &Trace, float &FifoError, float &PerceptualError);
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || DMX")
+		virtual bool StartDmxInput();
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || DMX")
+		virtual void StopDmxInput();
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || DMX")
+		virtual void SetDmxPatch(const TArray<FHueDmxPatch> &Patch);
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || DMX")
+		virtual void StartDmxLoopback(int32 UniverseCount = 4, float Rate = 44.0f, bool bArtNet = false);
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || DMX")
+		virtual void StopDmxLoopback();
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || Sensors")
+		virtual void StartSensors();
+
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || Sensors")
+		virtual void StopSensors();
+
+	UFUNCTION(BlueprintPure, Category = "Hue Bridge || Sensors")
+		virtual TArray<FHueSensorState> GetSensors();
+
+	UFUNCTION(BlueprintPure, Category = "Hue Bridge || Sensors")
+		virtual bool GetSensor(const FString &SensorName, FHueSensorState &SensorOut);
+
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || Ambient")
+		virtual bool InstallAmbientProgram(const FString &ProgramName);
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || Ambient")
+		virtual void CancelAmbientProgram(const FString &ProgramName);
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || Ambient")
+		virtual void CancelAllAmbientPrograms();
+	
+	UFUNCTION(BlueprintPure, Category = "Hue Bridge || Ambient")
+		virtual bool IsAmbientProgramInstalled(const FString &ProgramName);
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || Frames")
+		virtual void BeginHueFrame();
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || Frames")
+		virtual void CommitHueFrame();
+	
+	UFUNCTION(BlueprintPure, Category = "Hue Bridge || Frames")
+		virtual bool IsHueFrameOpen(){return FrameDepth > 0;}
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || Snapshot")
+		virtual void CaptureSnapshot();
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || Snapshot")
+		virtual int32 RestoreSnapshot(const FHueRoomSnapshot &Snapshot);
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || Snapshot")
+		virtual int32 RestoreSessionSnapshot();
+	
+	UFUNCTION(BlueprintPure, Category = "Hue Bridge || Snapshot")
+		virtual FHueRoomSnapshot GetSessionSnapshot(){return SessionSnapshot;}
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || Effects")
+		virtual int32 PlayEffect(const TArray<FString> &LampNames, const TArray<FHueEffectLayer> &Layers, float Duration = 0.0f);
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || Effects")
+		virtual int32 PlayEffectPreset(const TArray<FString> &LampNames, EHueEffectPreset Preset, float Duration = 0.0f);
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || Effects")
+		virtual void StopEffect(int32 Handle);
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || Effects")
+		virtual void StopAllEffects();
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || Effects")
+		virtual void SetEffectRate(float Rate);
+	
+	UFUNCTION(BlueprintPure, Category = "Hue Bridge || Effects")
+		virtual TArray<FHueEffectLayer> GetEffectPreset(EHueEffectPreset Preset);
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || Effects")
+		virtual float MeasureEffectCost(const TArray<FHueEffectLayer> &Layers, int32 NumLamps = 1000);
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge")
+		virtual FHueConfigBenchmark BenchmarkConfigStore(int32 NumLamps = 5000, int32 Cycles = 20);
 	
 	UFUNCTION(BlueprintNativeEvent, Category = "Hue Bridge")
 		void HueBringTimerStarted(float timer);
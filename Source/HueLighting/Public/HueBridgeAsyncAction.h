@@ -0,0 +1,60 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintAsyncActionBase.h"
+#include "HueBridge.h"
+#include "HueBridgeAsyncAction.generated.h"
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE(FHueAsyncActionResult);
+
+/**
+ * Latent Blueprint nodes for bridge operations. Each node waits on its own operation, so discovering lamps while a
+ * user check is out no longer fails with RequestsBusy. Starting an operation that is already running waits on that
+ * one instead of sending it again.
+ */
+UCLASS()
+class HUELIGHTING_API UHueBridgeAsyncAction : public UBlueprintAsyncActionBase
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY(BlueprintAssignable)
+		FHueAsyncActionResult Completed;
+
+	//The bridge answered and refused, for Check User the user isn't known to the bridge
+	UPROPERTY(BlueprintAssignable)
+		FHueAsyncActionResult Failed;
+
+	//The bridge never answered, nothing was learned
+	UPROPERTY(BlueprintAssignable)
+		FHueAsyncActionResult Unreachable;
+
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || Async", meta = (BlueprintInternalUseOnly = "true"))
+		static UHueBridgeAsyncAction* DiscoverLampsAsync(AHueBridge* Bridge);
+
+	//Press the link button on the bridge before starting this
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || Async", meta = (BlueprintInternalUseOnly = "true"))
+		static UHueBridgeAsyncAction* CreateUserAsync(AHueBridge* Bridge);
+
+	//Completed if the configured user is known to the bridge, Failed if it isn't, Unreachable if the bridge didn't answer
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || Async", meta = (BlueprintInternalUseOnly = "true"))
+		static UHueBridgeAsyncAction* CheckUserAsync(AHueBridge* Bridge);
+
+	UFUNCTION(BlueprintCallable, Category = "Hue Bridge || Async", meta = (BlueprintInternalUseOnly = "true"))
+		static UHueBridgeAsyncAction* RefreshStateAsync(AHueBridge* Bridge);
+
+	virtual void Activate() override;
+
+private:
+	static UHueBridgeAsyncAction* CreateAction(AHueBridge* Bridge, EHueBridgeOperation Operation);
+	void OnOperationFinished(EHueBridgeOperation FinishedOperation, EHueOperationResult Result);
+
+	TWeakObjectPtr<AHueBridge> Bridge;
+	EHueBridgeOperation Operation = EHueBridgeOperation::Discover;
+	FDelegateHandle FinishedHandle;
+};
@@ -0,0 +1,83 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Ticker.h"
+#include "Interfaces/IHttpRequest.h"
+#include "HueBridgeDiscovery.generated.h"
+
+USTRUCT(BlueprintType)
+struct HUELIGHTING_API FHueDiscoverySettings
+{
+	GENERATED_USTRUCT_BODY()
+public:
+	//Total time allowed before discovery gives up, seconds
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Discovery")
+		float TimeBudget = 3.0f;
+	//Time allowed for a single /api/config probe, seconds
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Discovery")
+		float ProbeTimeout = 0.75f;
+	//A whole /24 takes 254 / MaxParallelProbes rounds of ProbeTimeout, keep that inside the TimeBudget
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Discovery")
+		int32 MaxParallelProbes = 96;
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Discovery")
+		bool bUseMulticast = true;
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Discovery")
+		bool bProbeSubnet = true;
+	//First three octets to probe instead of the local subnet, e.g. 127.0.0 for emulated bridges
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Discovery")
+		FString SubnetOverride;
+	//Port to probe, 0 for the default http port
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Discovery")
+		int32 ProbePort = 0;
+};
+
+DECLARE_DELEGATE_TwoParams(FOnHueBridgeDiscoveryFinished, bool /*bFound*/, const FString& /*Host*/);
+
+/**
+ * Finds a Hue bridge without blocking the game thread. The cached host is tried first, then SSDP / mDNS
+ * answers and a bounded parallel /api/config probe of the subnet race each other, first valid bridge wins.
+ * Network waits run on the thread pool, HTTP probes go through the http manager, results land on the game thread.
+ */
+class HUELIGHTING_API FHueBridgeDiscovery : public TSharedFromThis<FHueBridgeDiscovery>
+{
+public:
+	FHueBridgeDiscovery(const FHueDiscoverySettings& InSettings);
+	~FHueBridgeDiscovery();
+
+	void Start(const FString& CachedHost, FOnHueBridgeDiscoveryFinished InOnFinished);
+	void Cancel();
+	bool IsRunning() const { return bRunning; }
+	const FString& GetBridgeId() const { return BridgeId; }
+
+	//Seconds a probe of the whole /24 takes with these settings when nothing answers
+	static float GetSubnetProbeTime(const FHueDiscoverySettings& Settings);
+	//Last octets of the /24 in probe order, the ones closest to ours first
+	static void GetSubnetOrder(int32 LocalOctet, TArray<int32>& OctetsOut);
+	//Read the bridge id from an /api/config answer, false if it isn't a Hue bridge
+	static bool ParseConfig(const FString& Json, FString& BridgeIdOut);
+
+private:
+	bool Tick(float DeltaTime);
+	void QueueCandidate(const FString& Host, bool bPriority);
+	void PumpProbes();
+	void OnProbeResponse(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful, FString Host);
+	void StartMulticastSearch();
+	void QueueSubnet();
+	void Finish(bool bFound, const FString& Host);
+
+	FHueDiscoverySettings Settings;
+	FOnHueBridgeDiscoveryFinished OnFinished;
+	TArray<FString> ProbeQueue;
+	TSet<FString> SeenHosts;
+	TArray<FHttpRequestPtr> ActiveProbes;
+	TSharedPtr<FThreadSafeBool, ESPMode::ThreadSafe> StopFlag;
+	FTSTicker::FDelegateHandle TickerHandle;
+	FString BridgeId;
+	double StartTime = 0.0;
+	bool bRunning = false;
+};
@@ -0,0 +1,137 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HueTypes.h"
+#include "HueTransport.h"
+
+class FSocket;
+class FInternetAddr;
+
+//A lamp state handed from a client process to the process that owns the bridge connection
+struct FHueBrokerCommand
+{
+	FString LightId;
+	FHueLampState State;
+	//Client that submitted it, the owner confirms to it
+	TSharedPtr<FInternetAddr> Sender;
+};
+
+//A state a client handed to the owner and the owner hasn't confirmed yet
+struct FHueBrokerSubmit
+{
+	FHueLampState State;
+	double SentTime = 0.0;
+};
+
+//A sensor the owner relayed, changes are broadcast by clients, table entries are only recorded
+struct FHueBrokerSensor
+{
+	FHueSensorState State;
+	bool bChanged = false;
+};
+
+/**
+ * Lets several processes on one machine share a bridge. The first process to bind the bridge's loopback broker port
+ * owns the bridge connection, every other process sends its lamp states to the owner as datagrams and the owner
+ * merges them into its own send scheduler so the bridge sees a single rate budget. The owner confirms every state it
+ * took, clients keep a state until it is confirmed. Clients don't read the bridge either, they ask the owner and the
+ * owner sends every client the lights from its own bulk reads. Sensors work the same way, only the owner polls and
+ * streams them and sends every change on.
+ * Each bridge hashes to a port above the base port. A client greets whoever holds that port and is told the full
+ * bridge key back, if another bridge hashed to the same port it moves on to the next one. Clients greet their owner
+ * every FailoverInterval, when the owner goes quiet they walk the ports again from the first and the first to bind
+ * the free port takes over. An owner that had to move up checks the ports below it and hands over to an owner of
+ * the same bridge it finds there.
+ */
+class HUELIGHTING_API FHueCommandBroker
+{
+public:
+	FHueCommandBroker(int32 BasePort, const FString& InBridgeKey);
+	~FHueCommandBroker();
+
+	//Try to take ownership, returns true if this process owns the bridge
+	bool Start();
+	void Stop();
+
+	//Game thread, retries ownership and collects lights on clients, drains submitted commands on the owner
+	void Tick(double Now, TArray<FHueBrokerCommand>& CommandsOut);
+
+	//Client only, send a lamp state to the owner. Fails until the owner of this bridge has answered
+	bool Submit(const FString& LightId, const FHueLampState& State);
+	//Client only, ask the owner for a bulk light read, held until the owner of this bridge has answered
+	bool RequestRead();
+	//Client only, true once a whole light list from the owner has arrived
+	bool ConsumeLights(TArray<FHueLightRecord>& LightsOut);
+	//Client only, states the owner confirmed taking since the last call
+	bool ConsumeConfirmed(TArray<FHueBrokerCommand>& ConfirmedOut);
+	//Client only, sensors the owner sent since the last call
+	bool ConsumeSensors(TArray<FHueBrokerSensor>& SensorsOut);
+
+	//Owner only, true if a client asked for a read since the last call
+	bool ConsumeReadRequest();
+	//Owner only, send the lights of a bulk read to every client heard from lately
+	void Publish(const TArray<FHueLightRecord>& Lights);
+	//Owner only, tell the client that submitted a command it was taken
+	void Confirm(const FHueBrokerCommand& Command);
+	//Owner only, send sensors to every client heard from lately
+	void PublishSensors(const TArray<FHueSensorState>& Sensors, bool bChanged);
+
+	bool IsOwner() const { return bOwner; }
+	//Client only, true while the owner of this bridge answers
+	bool IsConnected() const { return !bOwner && bWelcomed; }
+	bool IsRunning() const { return Socket != nullptr; }
+	const FString& GetBridgeKey() const { return BridgeKey; }
+	int32 GetPort() const { return Port; }
+	int32 GetSubmittedCount() const { return SubmittedCount; }
+	int32 GetReceivedCount() const { return ReceivedCount; }
+
+	//Seconds between greetings on a client, an owner that misses a few in a row is taken over
+	float FailoverInterval = 0.25f;
+
+private:
+	struct FClient
+	{
+		TSharedRef<FInternetAddr> Addr;
+		double LastSeen;
+	};
+
+	bool Connect(double Now);
+	bool TryBind();
+	void Demote(int32 Index, double Now);
+	int32 GetProbePort(int32 Index) const;
+	bool SendPacket(const TArray<uint8>& Packet, const FInternetAddr& Addr);
+	void SendHello(const FInternetAddr& Addr);
+	void ReceiveOwner(double Now, TArray<FHueBrokerCommand>& CommandsOut);
+	void ReceiveClient(double Now);
+	void CheckLowerPorts(double Now);
+	void AddClient(const TSharedRef<FInternetAddr>& Addr, double Now);
+
+	FSocket* Socket = nullptr;
+	TSharedPtr<FInternetAddr> OwnerAddr;
+	FString BridgeKey;
+	uint32 BridgeHash;
+	int32 BasePort;
+	//How many ports past the bridge's own this process had to move because other bridges hold them
+	int32 ProbeIndex = 0;
+	int32 Port;
+	double LastBindAttempt = 0.0;
+	double LastWelcomeTime = 0.0;
+	double LastLowerCheck = 0.0;
+	bool bWelcomed = false;
+	bool bReadQueued = false;
+	TArray<FHueBrokerCommand> Confirmed;
+	TArray<FHueBrokerSensor> ReceivedSensors;
+	int32 SubmittedCount = 0;
+	int32 ReceivedCount = 0;
+	bool bOwner = false;
+	bool bReadRequested = false;
+	TArray<FClient> Clients;
+	TArray<FHueLightRecord> IncomingLights;
+	TArray<FHueLightRecord> ReceivedLights;
+	bool bLightsReady = false;
+};
@@ -0,0 +1,67 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/Future.h"
+
+struct FHueBridgeConfig;
+struct FHueConfigBenchmark;
+struct FLightUse;
+
+/**
+ * Reads and writes the bridge config file. A save copies the config on the game thread and does the rest on a
+ * worker: JSON to a temp file, moved over the real one so a crash never leaves half a file, then an optional
+ * binary cache next to it. The move isn't atomic everywhere, on some platforms it deletes the old file before the
+ * rename, a crash between the two leaves only the temp file and Load reads that. The cache carries the time stamp
+ * of the JSON it was made from and loads only take it while that matches the JSON's stamp exactly, so a hand edit or
+ * a JSON copied back from elsewhere, older or newer, is read instead. Saves asked for while one is running are
+ * folded into one save of the newest config, a load while a save is out takes that config without waiting for the
+ * disk.
+ * Knows nothing about actors.
+ */
+class HUELIGHTING_API FHueConfigStore
+{
+public:
+	FHueConfigStore(const FString& InPath);
+	~FHueConfigStore();
+
+	//Game thread, snapshots the config and writes it in the background
+	void Save(const FHueBridgeConfig& Config, bool bWriteCache);
+	//Game thread, starts the folded save once the running one is done
+	void Tick();
+	//Wait for every save asked for so far
+	void Flush();
+	bool Load(FHueBridgeConfig& ConfigOut, bool bUseCache) const;
+
+	bool IsSaving() const { return Running.IsValid() && !Running.IsReady(); }
+	//True while a save is being written or waits to be
+	bool HasUnsavedConfig() const { return IsSaving() || Pending.IsValid(); }
+	int32 GetSaveCount() const { return SaveCount; }
+	const FString& GetPath() const { return Path; }
+	FString GetCachePath() const;
+
+	static bool WriteJson(const FHueBridgeConfig& Config, const FString& JsonPath);
+	static bool WriteCache(const FHueBridgeConfig& Config, const FString& CachePath, const FDateTime& JsonStamp);
+	static bool ReadJson(const FString& JsonPath, FHueBridgeConfig& ConfigOut);
+	static bool ReadCache(const FString& CachePath, const FDateTime& JsonStamp, FHueBridgeConfig& ConfigOut);
+	//One entry per lamp, keyed by id and by name for entries saved before ids were, later entries win
+	static void DedupeLights(TArray<FLightUse>& Lights);
+	//Save and load a generated config with NumLamps lamps Cycles times in a scratch folder
+	static FHueConfigBenchmark Benchmark(int32 NumLamps, int32 Cycles);
+
+private:
+	void StartSave(TSharedRef<FHueBridgeConfig, ESPMode::ThreadSafe> Snapshot, bool bWriteCache);
+	static bool WriteFiles(const FHueBridgeConfig& Config, const FString& JsonPath, const FString& CachePath, bool bWriteCache);
+
+	FString Path;
+	TFuture<bool> Running;
+	TSharedPtr<FHueBridgeConfig, ESPMode::ThreadSafe> Pending;
+	//Newest config handed to Save, what the file will hold once the saves are done
+	TSharedPtr<FHueBridgeConfig, ESPMode::ThreadSafe> Latest;
+	bool bPendingCache = false;
+	int32 SaveCount = 0;
+};
@@ -0,0 +1,187 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HueTypes.h"
+#include <atomic>
+#include "HueDmxReceiver.generated.h"
+
+class FSocket;
+class FInternetAddr;
+class FRunnableThread;
+class FHueDmxReceiveWorker;
+
+UENUM(BlueprintType)
+enum class EHueDmxMode : uint8
+{
+	// Red, green, blue
+	RGB,
+	// Red, green, blue, dimmer
+	RGBDimmer,
+	// Dimmer only, white
+	Dimmer,
+	// Dimmer, color temperature from warm to cool
+	DimmerCT
+};
+
+/**
+ * Where a lamp sits in a DMX universe. Art-Net port address 0 is universe 1, the same numbering consoles use
+ * when they send a show over both protocols.
+ */
+USTRUCT(BlueprintType)
+struct HUELIGHTING_API FHueDmxPatch
+{
+	GENERATED_USTRUCT_BODY()
+public:
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue DMX")
+		FString LampName;
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue DMX", meta = (ClampMin = "1", ClampMax = "63999"))
+		int32 Universe = 1;
+	//First channel of the lamp, 1 based like on the console
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue DMX", meta = (ClampMin = "1", ClampMax = "512"))
+		int32 StartChannel = 1;
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue DMX")
+		EHueDmxMode Mode = EHueDmxMode::RGB;
+	//Kelvin at CT channel 0 and 255 for DimmerCT
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue DMX")
+		float WarmKelvin = 2200.0f;
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue DMX")
+		float CoolKelvin = 6500.0f;
+
+	static int32 GetChannelCount(EHueDmxMode InMode);
+	//Read the lamp's channels out of a 512 slot universe
+	FHueLampState Evaluate(const uint8* UniverseData) const;
+};
+
+/**
+ * Listens for sACN (E1.31) and Art-Net, each protocol on its own worker thread that sleeps in its socket's wait.
+ * Datagrams are received straight into a fixed ring of packet slots per protocol and their headers are checked in
+ * place, the game thread only copies the DMX data of each packet into its universe when it ticks. Universes follow sACN priority, a higher priority source takes a universe and
+ * keeps it until it goes quiet.
+ * Knows nothing about actors, the bridge reads universes and runs the patch.
+ */
+class HUELIGHTING_API FHueDmxReceiver
+{
+public:
+	FHueDmxReceiver();
+	~FHueDmxReceiver();
+
+	//Open the sockets and start the worker. sACN joins the multicast group of every universe in SacnUniverses
+	bool Start(bool bSacn, bool bArtNet, const TArray<int32>& SacnUniverses);
+	void Stop();
+
+	//Game thread, merges every received packet into its universe and lists the universes that changed
+	void Tick(double Now, TArray<int32>& ChangedUniversesOut);
+
+	//512 slots of the universe or nullptr if nothing has been received for it
+	const uint8* GetUniverse(int32 Universe) const;
+
+	bool IsRunning() const { return Sacn.Thread != nullptr || ArtNet.Thread != nullptr; }
+	int32 GetReceivedCount() const { return ReceivedCount; }
+	int32 GetDroppedCount() const { return static_cast<int32>(DroppedCount.load(std::memory_order_relaxed)); }
+	int32 GetUniverseCount() const { return Universes.Num(); }
+
+	//Build packets for the loopback generator
+	static void BuildSacnPacket(int32 Universe, TConstArrayView<uint8> Data, uint8 Sequence, uint8 Priority, TArray<uint8>& PacketOut);
+	static void BuildArtNetPacket(int32 Universe, TConstArrayView<uint8> Data, uint8 Sequence, TArray<uint8>& PacketOut);
+
+	//Seconds without packets before a source loses its universe, 2.5 is the E1.31 data loss timeout
+	float SourceTimeout = 2.5f;
+
+	static const int32 SacnPort = 5568;
+	static const int32 ArtNetPort = 6454;
+
+private:
+	friend class FHueDmxReceiveWorker;
+
+	static const int32 MaxPacket = 638;
+	static const int32 RingSize = 512;
+
+	//A received datagram and where its DMX data starts, filled in by the worker
+	struct FPacketSlot
+	{
+		uint8 Raw[MaxPacket];
+		int32 Universe = 0;
+		int32 DataOffset = 0;
+		int32 DataLength = 0;
+		uint32 SourceId = 0;
+		uint8 Priority = 0;
+		uint8 Sequence = 0;
+		bool bHasSequence = false;
+		bool bTerminated = false;
+	};
+
+	struct FUniverse
+	{
+		uint8 Data[512];
+		uint32 SourceId = 0;
+		uint8 Priority = 0;
+		uint8 Sequence = 0;
+		bool bHasSequence = false;
+		double LastTime = 0.0;
+	};
+
+	//One protocol's socket, drained by its own worker into its own ring
+	struct FListener
+	{
+		FSocket* Socket = nullptr;
+		bool bSacn = false;
+		//Single producer single consumer, the worker writes Head and the game thread writes Tail
+		TArray<FPacketSlot> Ring;
+		std::atomic<uint32> Head{0};
+		std::atomic<uint32> Tail{0};
+		uint8 Scratch[MaxPacket];
+		TSharedPtr<FInternetAddr> FromAddr;
+		TUniquePtr<FHueDmxReceiveWorker> Worker;
+		FRunnableThread* Thread = nullptr;
+	};
+
+	//Worker thread loop
+	uint32 Receive(FListener& Listener);
+	static bool ParseSacn(FPacketSlot& Slot, int32 Size);
+	static bool ParseArtNet(FPacketSlot& Slot, int32 Size, uint32 SenderIp);
+	bool ReceiveFrom(FListener& Listener);
+	bool StartListener(FListener& Listener, const TCHAR* ThreadName);
+	void StopListener(FListener& Listener);
+	void MergeRing(FListener& Listener, double Now, TArray<int32>& ChangedUniversesOut);
+	void MergeSlot(const FPacketSlot& Slot, double Now, TArray<int32>& ChangedUniversesOut);
+	FSocket* CreateListenSocket(int32 Port, const TCHAR* Description);
+
+	FListener Sacn;
+	FListener ArtNet;
+	std::atomic<uint32> DroppedCount{0};
+	std::atomic<bool> bStopping{false};
+
+	TMap<int32, FUniverse> Universes;
+	int32 ReceivedCount = 0;
+};
+
+/**
+ * Sends a moving color chase to the receiver over loopback so a patch can be checked without a console
+ */
+class HUELIGHTING_API FHueDmxLoopbackGenerator
+{
+public:
+	FHueDmxLoopbackGenerator(int32 InUniverseCount, float InRate, bool bInArtNet);
+	~FHueDmxLoopbackGenerator();
+
+	//Send one frame for every universe when one is due
+	void Tick(double Now);
+	int32 GetSentCount() const { return SentCount; }
+
+private:
+	FSocket* Socket = nullptr;
+	TSharedPtr<FInternetAddr> Target;
+	TArray<uint8> Data;
+	TArray<uint8> Packet;
+	int32 UniverseCount;
+	float Rate;
+	bool bArtNet;
+	uint8 Sequence = 0;
+	double LastSendTime = -1.0;
+	int32 SentCount = 0;
+};
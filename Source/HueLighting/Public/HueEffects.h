@@ -0,0 +1,184 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/Future.h"
+#include "HueEffects.generated.h"
+
+UENUM(BlueprintType)
+enum class EHueEffectType : uint8
+{
+	// Smooth value noise, different for every lamp
+	Noise,
+	// Repeating waveform
+	Periodic,
+	// Attack, hold, release, one shot or repeating
+	Envelope,
+	// Wanders around the middle of the range, keeps its state between evaluations
+	RandomWalk
+};
+
+UENUM(BlueprintType)
+enum class EHueEffectWaveform : uint8
+{
+	Sine,
+	Square,
+	Triangle,
+	Saw
+};
+
+UENUM(BlueprintType)
+enum class EHueEffectBlend : uint8
+{
+	// Fade from the layers below to this one by opacity
+	Replace,
+	Multiply,
+	Add,
+	Max
+};
+
+UENUM(BlueprintType)
+enum class EHueEffectPreset : uint8
+{
+	Fire,
+	Candle,
+	Strobe,
+	Police,
+	Lightning
+};
+
+/**
+ * One evaluator in an effect. It makes a 0-1 value per lamp, scales it into Min-Max, tints it with Color and blends
+ * it over the layers below it.
+ */
+USTRUCT(BlueprintType)
+struct HUELIGHTING_API FHueEffectLayer
+{
+	GENERATED_USTRUCT_BODY()
+public:
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Effect")
+		EHueEffectType Type = EHueEffectType::Noise;
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Effect")
+		EHueEffectBlend Blend = EHueEffectBlend::Replace;
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Effect")
+		FLinearColor Color = FLinearColor::White;
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Effect")
+		float Min = 0.0f;
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Effect")
+		float Max = 1.0f;
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Effect", meta = (ClampMin = "0.0", ClampMax = "1.0"))
+		float Opacity = 1.0f;
+	//Cycles per second for noise and periodic layers
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Effect")
+		float Frequency = 1.0f;
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Effect")
+		EHueEffectWaveform Waveform = EHueEffectWaveform::Sine;
+	//Fraction of a square wave cycle that is on
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Effect", meta = (ClampMin = "0.0", ClampMax = "1.0"))
+		float DutyCycle = 0.5f;
+	//Phase of the whole layer in cycles
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Effect")
+		float PhaseOffset = 0.0f;
+	//Phase added per lamp in cycles, 0.5 makes neighbouring lamps alternate
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Effect")
+		float PhaseStep = 0.0f;
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Effect")
+		float Attack = 0.1f;
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Effect")
+		float Hold = 0.0f;
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Effect")
+		float Release = 0.5f;
+	//Seconds between envelope triggers, 0 fires once
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Effect")
+		float Period = 0.0f;
+	//Random walk movement per square root second
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Effect")
+		float StepSize = 1.0f;
+	//How hard the random walk is pulled back to the middle, per second
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Effect")
+		float MeanReversion = 1.0f;
+};
+
+//Color an effect wants a scheduler slot to show
+struct FHueEffectOutput
+{
+	int32 Slot = INDEX_NONE;
+	FLinearColor Color;
+};
+
+/**
+ * Runs every playing effect for every lamp in one batch on a worker thread. Layers are evaluated four lamps at a
+ * time with vector registers, the game thread only kicks the batch at the effect rate and picks up the colors
+ * when it has finished, so effects never wait on the bridge and never go through bInUse.
+ * Knows nothing about actors, lamps are scheduler slots.
+ */
+class HUELIGHTING_API FHueEffectRunner
+{
+public:
+	FHueEffectRunner(float InRate = 30.0f);
+	~FHueEffectRunner();
+
+	//Start an effect on some slots, returns a handle for Stop. Duration 0 plays until stopped
+	int32 Play(const TArray<int32>& Slots, const TArray<FHueEffectLayer>& Layers, float Duration, double Now);
+	void Stop(int32 Handle);
+	void StopAll();
+
+	//Game thread, picks up a finished batch and kicks the next one when it is due
+	void Tick(double Now, TArray<FHueEffectOutput>& OutputsOut);
+
+	void SetRate(float InRate) { Rate = FMath::Max(InRate, 1.0f); }
+	bool IsPlaying() const { return Batch->Instances.Num() > 0 || Added.Num() > 0; }
+	float GetLastEvaluateMs() const { return LastEvaluateMs; }
+	int32 GetLastEvaluatedLamps() const { return LastEvaluatedLamps; }
+
+	static void GetPreset(EHueEffectPreset Preset, TArray<FHueEffectLayer>& LayersOut);
+	//Microseconds to evaluate the layers for a thousand lamps, averaged over Iterations batches
+	static double MeasureCost(const TArray<FHueEffectLayer>& Layers, int32 NumLamps, int32 Iterations = 100);
+
+private:
+	struct FInstance
+	{
+		int32 Handle = 0;
+		double StartTime = 0.0;
+		float Duration = 0.0f;
+		float LastTime = 0.0f;
+		bool bFinished = false;
+		TArray<FHueEffectLayer> Layers;
+		TArray<int32> Slots;
+		//Structure of arrays padded to a multiple of 4 lamps
+		TArray<float> R;
+		TArray<float> G;
+		TArray<float> B;
+		TArray<TArray<float>> WalkState;
+
+		void Init(const TArray<int32>& InSlots, const TArray<FHueEffectLayer>& InLayers);
+	};
+
+	struct FBatch
+	{
+		TArray<FInstance> Instances;
+		TArray<FHueEffectOutput> Outputs;
+		double Now = 0.0;
+		double EvaluateSeconds = 0.0;
+		int32 EvaluatedLamps = 0;
+	};
+
+	static void Evaluate(FBatch& Batch);
+	static void EvaluateInstance(FInstance& Instance, float Time, float DeltaTime);
+
+	//Instances live in the batch, the game thread only touches them while no batch is running
+	TSharedRef<FBatch, ESPMode::ThreadSafe> Batch;
+	TFuture<void> Running;
+	TArray<FInstance> Added;
+	TArray<int32> Removed;
+	bool bStopAll = false;
+	int32 NextHandle = 1;
+	float Rate;
+	double LastKickTime = -1.0;
+	float LastEvaluateMs = 0.0f;
+	int32 LastEvaluatedLamps = 0;
+};
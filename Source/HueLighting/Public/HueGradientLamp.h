@@ -0,0 +1,97 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HueLamp.h"
+#include "HueGradientLamp.generated.h"
+
+class UCurveLinearColor;
+class USplineComponent;
+
+/**
+ * Gradient lightstrips and play bars, one lamp with several color points. Every point goes out in a single request
+ * and the whole gradient is dirty checked and coalesced the same way a single color lamp is.
+ * Bridges on the v1 api can't set gradients, they get the average color of the points instead.
+ */
+UCLASS()
+class HUELIGHTING_API AHueGradientLamp : public AHueLamp
+{
+	GENERATED_BODY()
+
+public:
+	AHueGradientLamp();
+
+protected:
+	virtual void BeginPlay() override;
+
+	//Gradient to show. Sampled over its own time range, or in spline input key space when a spline is set
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Hue Gradient")
+		TObjectPtr<UCurveLinearColor> GradientCurve;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Gradient")
+		TObjectPtr<USplineComponent> Spline;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Hue Gradient", meta = (ClampMin = "0.0", ClampMax = "1.0"))
+		float Intensity = 1.0f;
+
+	//Samples per second of the curve or spline
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Hue Gradient", meta = (ClampMin = "0.1"))
+		float SampleRate = 10.0f;
+
+	//Color points the strip shows, set from the bridge on discovery
+	UPROPERTY(EditAnywhere, BlueprintGetter = GetPointCount, Category = "Hue Gradient", meta = (ClampMin = "1"))
+		int32 PointCount = 5;
+
+	TArray<FHueLampState> LastSentGradient;
+	TArray<FHueLampState> DesiredGradient;
+	TArray<FHueLampState> PendingGradient;
+	TArray<FHueLampState> ReconnectGradient;
+	bool bHasPendingGradient = false;
+	bool bHasReconnectGradient = false;
+	TArray<FLinearColor> SampleBuffer;
+
+	bool ApplyGradientStates(const TArray<FHueLampState> &Gradient, int32 TransitionTime = -1);
+	void QuantizeGradient(TConstArrayView<FLinearColor> Colors, float InIntensity, TArray<FHueLampState> &GradientOut) const;
+	void MakeUniformGradient(const FHueLampState &State, TArray<FHueLampState> &GradientOut) const;
+	void UpdateSampling();
+	virtual void CreateRequestGradient(const TArray<FHueLampState> &Gradient, int32 TransitionTime);
+	virtual void OnResponseReceivedState( FHttpRequestPtr Request,  FHttpResponsePtr Response, bool bWasSuccessful) override;
+
+public:
+	virtual void Tick(float DeltaTime) override;
+	virtual bool ApplyState(const FHueLampState &State, int32 TransitionTime = -1) override;
+	virtual void SendDesiredState() override;
+	virtual void HoldForReconnect() override;
+	virtual void MarkStateFromBridge(const FHueLampState &State) override;
+	virtual void ApplyBridgeState(const FHueLampState &State, bool bIsReachable) override;
+
+	static FHueLampState AverageState(TConstArrayView<FHueLampState> Gradient);
+	static float GradientDistance(TConstArrayView<FHueLampState> A, TConstArrayView<FHueLampState> B);
+	static void SampleCurve(const UCurveLinearColor* Curve, int32 Count, TArray<FLinearColor> &ColorsOut);
+	static void SampleSpline(const USplineComponent* InSpline, const UCurveLinearColor* Curve, int32 Count, TArray<FLinearColor> &ColorsOut);
+
+	UFUNCTION(BlueprintCallable, Category = "Hue Gradient")
+		virtual bool ApplyGradient(const TArray<FLinearColor> &Colors, float GradientIntensity = 1.0f);
+
+	UFUNCTION(BlueprintCallable, Category = "Hue Gradient")
+		virtual void SetGradientCurve(UCurveLinearColor* Curve);
+
+	UFUNCTION(BlueprintCallable, Category = "Hue Gradient")
+		virtual void SetSplineSource(USplineComponent* InSpline, UCurveLinearColor* Curve);
+
+	UFUNCTION(BlueprintCallable, Category = "Hue Gradient")
+		virtual void ClearGradientSource();
+
+	UFUNCTION(BlueprintCallable, Category = "Hue Gradient")
+		virtual void SetPointCount(int32 Count);
+
+	UFUNCTION(BlueprintPure, Category = "Hue Gradient")
+		virtual int32 GetPointCount(){return PointCount;}
+
+	UFUNCTION(BlueprintPure, Category = "Hue Gradient")
+		virtual TArray<FHueLampState> GetLastSentGradient(){return LastSentGradient;}
+};
@@ -9,10 +9,18 @@ Copyright (c) 2022 Scott Tongue all rights reversed
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
 #include "Interfaces/IHttpRequest.h"
+#include "HueTypes.h"
 #include "HueLamp.generated.h"
 
 
 class FHttpModule;
+class FHueSendScheduler;
+class IHueTransport;
+class AHueLamp;
+
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnHueLampStateAcknowledged, AHueLamp*);
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnHueLampStateSent, AHueLamp*);
+
 UCLASS()
 class HUELIGHTING_API AHueLamp : public AActor
 {
@@ -40,26 +48,78 @@ protected:
 	UPROPERTY(BlueprintGetter = GetLampName, Category = "Hue Light")
 		FString LampName;
 	
-	FString DevicePath;
+	UPROPERTY(BlueprintGetter = IsReachable, Category = "Hue Light")
+		bool bReachable = true;
+	
+	//How much this lamp's error counts when the bridge picks what to send next
+	UPROPERTY(EditAnywhere, BlueprintGetter = GetImportance, Category = "Hue Light")
+		float Importance = 1.0f;
+	
+	TSharedPtr<IHueTransport> Transport;
 	FString DeviceKey;
 	FColor LampColor;
 	FColor StartColor;
+	FHueLampState StartState;
+	FHueLampState BridgeState;
+	bool bHasStartState = false;
+
+	//Native state path, only ever one request in flight with the newest state waiting behind it
+	FHueLampState LastSentState;
+	FHueLampState PendingState;
+	int32 PendingTransition = -1;
+	bool bHasSentState = false;
+	bool bHasPendingState = false;
+	bool bStateRequestInFlight = false;
+
+	//Send budget shared by every lamp on the bridge, lamps without one send straight away
+	TSharedPtr<FHueSendScheduler> Scheduler;
+	int32 ScheduleSlot = INDEX_NONE;
+
+	//Newest state asked for while the lamp was unreachable, sent once when it comes back
+	FHueLampState ReconnectState;
+	bool bHasReconnectState = false;
+	int32 SuppressedCommandCount = 0;
+	int32 ReconnectFlushCount = 0;
+
+	//Request to answer time of state requests, averaged
+	double StateSentTime = 0.0;
+	float StateLatencyMs = 0.0f;
 	
 	FVector CovertRGBToHSV(const FColor &RGB);
 	FColor ConvertHSVToRGB( int32 Hue,  int32 Saturation,  int32 Brightness);
-	virtual void CreateRequestBrightness(int32 Bri);
-	virtual void CreateRequestColor(const FVector &HSV);
-	virtual void CreateRequestTurnLightOnOff(bool bTurnOn);
+	static FHueLampState HSVToState(const FVector &HSV);
+	virtual void CreateRequestState(const FHueLampState &State, int32 TransitionTime);
+	void SuppressUntilReachable(const FHueLampState &State);
+	virtual void HoldForReconnect();
+	FHueLampState GetCommandBaseState() const;
 
 	virtual void OnResponseTest( FHttpRequestPtr Request,  FHttpResponsePtr Response, bool bWasSuccessful);
 	virtual void OnResponseReceivedGetLightColor( FHttpRequestPtr Request,  FHttpResponsePtr Response, bool bWasSuccessful);
+	virtual void OnResponseReceivedState( FHttpRequestPtr Request,  FHttpResponsePtr Response, bool bWasSuccessful);
 public:
 	
 	// Called every frame
 	virtual void Tick(float DeltaTime) override;
 	
-	virtual void SetupLamp(const FString &Path, const FString &Key, const FString &Name);
+	virtual void SetupLamp(const TSharedPtr<IHueTransport> &InTransport, const FString &Key, const FString &Name);
+	void SetTransport(const TSharedPtr<IHueTransport> &InTransport) {Transport = InTransport;}
 	virtual void Delete(){Destroy();}
+	virtual bool ApplyState(const FHueLampState &State, int32 TransitionTime = -1);
+	virtual void SendDesiredState();
+	void SetScheduler(const TSharedPtr<FHueSendScheduler> &InScheduler, int32 Slot);
+	virtual void MarkStateFromBridge(const FHueLampState &State);
+	virtual void ApplyBridgeState(const FHueLampState &State, bool bIsReachable);
+	const FString& GetDeviceKey() const {return DeviceKey;}
+	int32 GetSuppressedCommandCount() const {return SuppressedCommandCount;}
+	int32 GetReconnectFlushCount() const {return ReconnectFlushCount;}
+	bool HasHeldReconnectState() const {return bHasReconnectState;}
+	float GetStateLatencyMs() const {return StateLatencyMs;}
+	FHueLampState GetDesiredState() const;
+
+	//Native only, fires every time the bridge answers a state request sent through ApplyState
+	FOnHueLampStateAcknowledged OnStateAcknowledged;
+	//Native only, fires every time a state request leaves for the bridge, GetLastSentState holds what it carries
+	FOnHueLampStateSent OnStateSent;
 
 	UFUNCTION(BlueprintCallable, Category = "Hue Light" )
 		virtual	void GetLightColor();
@@ -90,4 +150,22 @@ public:
 	
 	UFUNCTION(BlueprintPure, Category = "Hue Light")
 		virtual FColor GetLampColor(){return LampColor;}
+	
+	UFUNCTION(BlueprintPure, Category = "Hue Light")
+		virtual FHueLampState GetLastSentState(){return LastSentState;}
+	
+	UFUNCTION(BlueprintPure, Category = "Hue Light")
+		virtual FHueLampState GetBridgeState(){return BridgeState;}
+	
+	UFUNCTION(BlueprintPure, Category = "Hue Light")
+		virtual FColor GetStartColor(){return StartColor;}
+	
+	UFUNCTION(BlueprintPure, Category = "Hue Light")
+		virtual bool IsReachable(){return bReachable;}
+	
+	UFUNCTION(BlueprintPure, Category = "Hue Light")
+		virtual float GetImportance(){return Importance;}
+	
+	UFUNCTION(BlueprintCallable, Category = "Hue Light")
+		virtual void SetImportance(float NewImportance);
 };
@@ -0,0 +1,94 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "HueTypes.h"
+#include "HueLampBinding.generated.h"
+
+class AHueBridge;
+class AHueLamp;
+class ULightComponent;
+class UMaterialParameterCollection;
+
+UENUM(BlueprintType)
+enum class EHueBindingSource : uint8
+{
+	LightComponent,
+	MaterialParameter
+};
+
+/**
+ * Mirrors an in game light component or material parameter collection value onto a physical Hue lamp.
+ * Sampling, conversion and dirty checking all happen natively, the lamp only sees a request when the
+ * quantized Hue state changes.
+ */
+UCLASS(ClassGroup = (HueLighting), meta = (BlueprintSpawnableComponent))
+class HUELIGHTING_API UHueLampBindingComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	UHueLampBindingComponent();
+
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Hue Binding")
+		TObjectPtr<AHueBridge> Bridge;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Hue Binding")
+		FString LampName;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Hue Binding")
+		EHueBindingSource Source = EHueBindingSource::LightComponent;
+
+	// Actor to take the light component from, uses the owning actor when empty
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Hue Binding")
+		TObjectPtr<AActor> SourceActor;
+
+	// Light intensity that maps to full lamp brightness
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Hue Binding", meta = (ClampMin = "0.001"))
+		float MaxIntensity = 5000.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Hue Binding")
+		TObjectPtr<UMaterialParameterCollection> ParameterCollection;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Hue Binding")
+		FName ColorParameterName;
+
+	// Optional 0-1 scalar parameter used as brightness, ignored when None
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Hue Binding")
+		FName IntensityParameterName;
+
+	// Samples per second, the Hue bridge can not show much more than 10 changes a second per lamp
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Hue Binding", meta = (ClampMin = "0.1"))
+		float SampleRate = 10.0f;
+
+	UFUNCTION(BlueprintCallable, Category = "Hue Binding")
+		void SetSourceLight(ULightComponent* Light);
+
+	UFUNCTION(BlueprintCallable, Category = "Hue Binding")
+		void SetSampleRate(float Rate);
+
+	// Bind straight to a lamp instead of looking it up on the bridge by name
+	UFUNCTION(BlueprintCallable, Category = "Hue Binding")
+		void SetLamp(AHueLamp* Lamp);
+
+	// One sample, what every tick does. True if the lamp took a new state
+	bool UpdateLamp();
+
+protected:
+	virtual void BeginPlay() override;
+
+	bool SampleSource(FHueLampState& StateOut) const;
+	AHueLamp* ResolveLamp();
+
+	TWeakObjectPtr<ULightComponent> SourceLight;
+	TWeakObjectPtr<AHueLamp> BoundLamp;
+	FHueLampState LastState;
+	bool bHasLastState = false;
+};
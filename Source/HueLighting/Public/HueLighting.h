@@ -3,6 +3,9 @@
 #pragma once
 #include "CoreMinimal.h"
 #include "Modules/ModuleManager.h"
+#include "Stats/Stats.h"
+
+DECLARE_STATS_GROUP(TEXT("HueLighting"), STATGROUP_HueLighting, STATCAT_Advanced);
 
 class FHueLightingModule : public IModuleInterface
 {
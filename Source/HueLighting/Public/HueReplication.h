@@ -0,0 +1,169 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "Net/Serialization/FastArraySerializer.h"
+#include "HueTypes.h"
+#include "HueReplication.generated.h"
+
+class AHueBridge;
+class AHueLamp;
+class UHueLightingReplicationComponent;
+struct FHueReplicatedLightArray;
+
+/**
+ * One logical light as the server wants it. The state is already quantized to what a bridge stores and goes over
+ * the wire packed, about six bytes a change.
+ */
+USTRUCT(BlueprintType)
+struct HUELIGHTING_API FHueReplicatedLight : public FFastArraySerializerItem
+{
+	GENERATED_USTRUCT_BODY()
+public:
+	//0 or more, negative ids are turned away
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Replication")
+		int32 LightId = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Replication")
+		FHueLampState State;
+	//Fade time in 100ms steps, negative leaves the bridge default
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Replication")
+		int32 TransitionTime = -1;
+
+	void PostReplicatedAdd(const FHueReplicatedLightArray& InArraySerializer);
+	void PostReplicatedChange(const FHueReplicatedLightArray& InArraySerializer);
+	bool NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess);
+};
+
+template<>
+struct TStructOpsTypeTraits<FHueReplicatedLight> : public TStructOpsTypeTraitsBase2<FHueReplicatedLight>
+{
+	enum
+	{
+		WithNetSerializer = true,
+	};
+};
+
+USTRUCT()
+struct HUELIGHTING_API FHueReplicatedLightArray : public FFastArraySerializer
+{
+	GENERATED_USTRUCT_BODY()
+public:
+	UPROPERTY()
+		TArray<FHueReplicatedLight> Lights;
+
+	UPROPERTY(NotReplicated)
+		TObjectPtr<UHueLightingReplicationComponent> Owner;
+
+	bool NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms);
+};
+
+template<>
+struct TStructOpsTypeTraits<FHueReplicatedLightArray> : public TStructOpsTypeTraitsBase2<FHueReplicatedLightArray>
+{
+	enum
+	{
+		WithNetDeltaSerializer = true,
+	};
+};
+
+//Which physical lamp on this machine shows a logical light
+USTRUCT(BlueprintType)
+struct HUELIGHTING_API FHueLightMapping
+{
+	GENERATED_USTRUCT_BODY()
+public:
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Hue Replication", meta = (ClampMin = "0"))
+		int32 LightId = 0;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Hue Replication")
+		FString LampName;
+};
+
+USTRUCT(BlueprintType)
+struct HUELIGHTING_API FHueReplicationStats
+{
+	GENERATED_USTRUCT_BODY()
+public:
+	//Bytes the lighting array has written for every connection together since play started
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Replication")
+		int32 BytesSent = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Replication")
+		int32 BytesReceived = 0;
+	//Sent plus received over the last whole second
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Replication")
+		float BytesPerSecond = 0.0f;
+	//Light changes the server marked or a client applied
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Replication")
+		int32 LightChanges = 0;
+};
+
+/**
+ * Carries the server's lighting to every client. The server sets logical lights, only lights whose quantized state
+ * changed are marked dirty and the fast array sends just those. Each machine shows the logical lights on its own
+ * lamps through LightMap and its own bridge, nothing about a bridge or lamp is replicated.
+ */
+UCLASS(ClassGroup = (HueLighting), meta = (BlueprintSpawnableComponent))
+class HUELIGHTING_API UHueLightingReplicationComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	UHueLightingReplicationComponent();
+
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	//Bridge the lamps are on, the first bridge in the world when empty
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Hue Replication")
+		TObjectPtr<AHueBridge> Bridge;
+
+	//Logical light to lamp name on this machine, lights that aren't mapped are ignored
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Hue Replication")
+		TArray<FHueLightMapping> LightMap;
+
+	//Listen servers show the lights on their own lamps too
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Hue Replication")
+		bool bApplyOnServer = true;
+
+	UFUNCTION(BlueprintCallable, BlueprintAuthorityOnly, Category = "Hue Replication")
+		void SetLightState(int32 LightId, const FHueLampState &State, int32 TransitionTime = -1);
+
+	UFUNCTION(BlueprintCallable, BlueprintAuthorityOnly, Category = "Hue Replication")
+		void SetLightColor(int32 LightId, const FLinearColor &Color, float Intensity = 1.0f, int32 TransitionTime = -1);
+
+	UFUNCTION(BlueprintCallable, BlueprintAuthorityOnly, Category = "Hue Replication")
+		void RemoveLight(int32 LightId);
+
+	UFUNCTION(BlueprintCallable, Category = "Hue Replication")
+		void SetLightMap(const TArray<FHueLightMapping> &Map);
+
+	UFUNCTION(BlueprintPure, Category = "Hue Replication")
+		TArray<FHueReplicatedLight> GetLights() const {return ReplicatedLights.Lights;}
+
+	UFUNCTION(BlueprintPure, Category = "Hue Replication")
+		FHueReplicationStats GetReplicationStats() const {return Stats;}
+
+	//Called by the replicated array
+	void OnLightReplicated(const FHueReplicatedLight& Light);
+	void CountBits(int64 Bits, bool bSent);
+
+protected:
+	virtual void BeginPlay() override;
+
+	void ApplyLight(const FHueReplicatedLight& Light, bool bFade = true);
+	AHueLamp* ResolveLamp(int32 LightId);
+
+	UPROPERTY(Replicated)
+		FHueReplicatedLightArray ReplicatedLights;
+
+	TMap<int32, TWeakObjectPtr<AHueLamp>> MappedLamps;
+	//Mapped lights whose lamp the bridge hasn't discovered yet
+	TSet<int32> UnresolvedLights;
+	FHueReplicationStats Stats;
+	int64 WindowBits = 0;
+	double WindowStart = 0.0;
+};
@@ -0,0 +1,114 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HueTypes.h"
+#include "HueSendScheduler.generated.h"
+
+UENUM(BlueprintType)
+enum class EHueSchedulePolicy : uint8
+{
+	// Send in the order lamps changed, what the bridge got before the scheduler
+	Fifo,
+	// Send the lamp that looks the most wrong, weighted by wait time and importance
+	PerceptualError
+};
+
+//One desired state change, used to record and replay gameplay for comparing policies
+USTRUCT(BlueprintType)
+struct HUELIGHTING_API FHueTraceEvent
+{
+	GENERATED_USTRUCT_BODY()
+public:
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Scheduler")
+		float Time = 0.0f;
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Scheduler")
+		int32 Slot = 0;
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Scheduler")
+		FHueLampState State;
+};
+
+/**
+ * Per bridge send budget. Every lamp keeps its desired state next to the state last sent, each free send slot
+ * goes to the lamp with the largest visible error weighted by how long it has waited and its importance.
+ * Knows nothing about actors or http so recorded traces can be replayed through it offline.
+ */
+class HUELIGHTING_API FHueSendScheduler
+{
+public:
+	FHueSendScheduler(float InSendRate = 10.0f, EHueSchedulePolicy InPolicy = EHueSchedulePolicy::PerceptualError);
+
+	int32 AddSlot(float Importance = 1.0f);
+	void Reset();
+
+	//TransitionTime belongs to this state only, in 100ms steps, negative leaves the bridge default
+	void SetDesired(int32 Slot, const FHueLampState& State, double Now, int32 TransitionTime = -1);
+	void SetDesiredError(int32 Slot, float Error, double Now);
+	void SetImportance(int32 Slot, float Importance);
+	void SetBusy(int32 Slot, bool bBusy);
+	void MarkSent(int32 Slot, double Now);
+	void SyncSent(int32 Slot, const FHueLampState& State);
+
+	//Refill the budget and pick the slots to send this tick, best first
+	void Tick(double Now, TArray<int32>& SlotsOut);
+	//Every dirty slot at once for a frame commit, best first. Borrows up to a second of sends from the budget,
+	//without bForce nothing goes out until the budget is back in credit
+	void Burst(double Now, bool bForce, TArray<int32>& SlotsOut);
+	//Requests sent outside the slots, e.g. scene writes, still come out of the budget
+	void Spend(double Now, int32 Requests);
+
+	//Visible error across every slot right now, the quantity the scheduler keeps small
+	float GetTotalError() const;
+	double GetIntegratedError() const { return IntegratedError; }
+	bool HasDirtySlots() const;
+
+	void SetSendRate(float Rate) { SendRate = FMath::Max(Rate, 0.1f); }
+	void SetPolicy(EHueSchedulePolicy InPolicy) { Policy = InPolicy; }
+	void SetAgeWeight(float Weight) { AgeWeight = Weight; }
+	const FHueLampState& GetDesired(int32 Slot) const { return Slots[Slot].Desired; }
+	int32 GetDesiredTransition(int32 Slot) const { return Slots[Slot].Transition; }
+	bool IsDirty(int32 Slot) const { return Slots[Slot].bDirty; }
+	bool IsBusy(int32 Slot) const { return Slots[Slot].bBusy; }
+
+	void StartRecording(double Now);
+	void StopRecording(TArray<FHueTraceEvent>& TraceOut);
+	int32 Num() const { return Slots.Num(); }
+
+	//Replay a trace through a scheduler and return the error integrated over the trace, lower is better
+	static double SimulateTrace(const TArray<FHueTraceEvent>& Trace, int32 NumSlots, float SendRate, EHueSchedulePolicy Policy, float TickRate = 60.0f);
+
+private:
+	struct FSlot
+	{
+		FHueLampState Desired;
+		FHueLampState Sent;
+		int32 Transition = -1;
+		float Error = 0.0f;
+		float Importance = 1.0f;
+		double LastSendTime = 0.0;
+		double DirtySince = 0.0;
+		bool bDirty = false;
+		bool bBusy = false;
+	};
+
+	float GetPriority(const FSlot& Slot, double Now) const;
+	float GetMinTokens() const;
+	void Refill(double Now);
+
+	TArray<FSlot> Slots;
+	EHueSchedulePolicy Policy;
+	float SendRate;
+	float AgeWeight = 1.0f;
+	//Token bucket, one token per request with room for a small burst
+	float Tokens = 1.0f;
+	float MaxTokens = 2.0f;
+	double LastTickTime = -1.0;
+	double IntegratedError = 0.0;
+	TArray<FHueTraceEvent> Recording;
+	double RecordStartTime = 0.0;
+	bool bRecording = false;
+};
@@ -0,0 +1,70 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HueTypes.h"
+
+/**
+ * Keeps the last known state of every bridge sensor and decides when the next bulk /sensors read is due. A change is
+ * spotted by the sensor's lastupdated stamp together with its reading, the bridge moves the stamp on every change,
+ * repeated presses of the same button included. Stamps are whole seconds, a switch press seen on the stream and
+ * again in a read has the same button event and stamp and is broadcast once. Polls run fast right after activity and back off towards the slow interval while nothing
+ * happens. While an event stream is open polls drop to the slow interval and only catch what the stream missed.
+ * A broker client neither polls nor streams, it merges what the owner relays.
+ * Knows nothing about actors or requests, the bridge sends the reads and broadcasts the changes.
+ */
+class HUELIGHTING_API FHueSensorPoller
+{
+public:
+	FHueSensorPoller(float InFastInterval, float InSlowInterval, float InActiveHold);
+
+	bool IsPollDue(double Now) const { return !bPollInFlight && Now >= NextPollTime; }
+	void MarkPollSent(double Now) { bPollInFlight = true; PollSentTime = Now; }
+	void MarkPollFailed(double Now);
+	//Poll on the next tick, used when the stream can't say everything about a change
+	void PollNow() { NextPollTime = 0.0; }
+
+	//Bulk read answered, the first read only records every sensor
+	void MergePoll(const TArray<FHueSensorState>& Polled, double Now, TArray<FHueSensorState>& ChangedOut);
+	//Event stream changes for sensors already known from a poll
+	void MergeEvents(const TArray<FHueSensorState>& Events, double Now, TArray<FHueSensorState>& ChangedOut);
+	//Broker clients only, sensors the owner relayed. Changes are taken as the owner saw them
+	void MergeRelayed(const TArray<FHueSensorState>& Relayed, bool bChanged, double Now, TArray<FHueSensorState>& ChangedOut);
+
+	void SetStreaming(bool bInStreaming) { bStreaming = bInStreaming; }
+	bool IsStreaming() const { return bStreaming; }
+
+	const TMap<FString, FHueSensorState>& GetSensors() const { return Sensors; }
+	float GetInterval() const { return Interval; }
+	//Round trip of the reads, measured here. A change is seen at most one interval plus this after it happened
+	float GetAverageLatencyMs() const { return AverageLatencyMs; }
+	float GetMaxLatencyMs() const { return MaxLatencyMs; }
+	int32 GetChangeCount() const { return ChangeCount; }
+
+	float FastInterval;
+	float SlowInterval;
+	//Seconds polls stay fast after the last change
+	float ActiveHold;
+
+private:
+	void NoteChange(double Now);
+	float NoteRoundTrip(double Now);
+	void UpdateInterval(double Now);
+	static bool SameReading(const FHueSensorState& A, const FHueSensorState& B);
+
+	TMap<FString, FHueSensorState> Sensors;
+	double NextPollTime = 0.0;
+	double LastActivityTime = -1.0e9;
+	float Interval;
+	double PollSentTime = 0.0;
+	bool bPollInFlight = false;
+	bool bStreaming = false;
+	float AverageLatencyMs = 0.0f;
+	float MaxLatencyMs = 0.0f;
+	int32 ChangeCount = 0;
+	int32 RoundTrips = 0;
+};
@@ -0,0 +1,208 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MovieSceneNameableTrack.h"
+#include "MovieSceneSection.h"
+#include "Channels/MovieSceneFloatChannel.h"
+#include "Compilation/IMovieSceneTrackTemplateProducer.h"
+#include "HueTypes.h"
+#include "HueEffects.h"
+#include "HueSequencerTrack.generated.h"
+
+UENUM()
+enum class EHueCueType : uint8
+{
+	// Whole lamp state
+	State,
+	// Only brightness and on, color is left as it is
+	Brightness,
+	// Starts an effect on the lamp
+	Effect
+};
+
+USTRUCT()
+struct HUELIGHTING_API FHueCue
+{
+	GENERATED_USTRUCT_BODY()
+public:
+	//Sequence seconds the cue is sent at, already moved earlier by the baked latency
+	UPROPERTY()
+		float Time = 0.0f;
+	//State the lamp fades to
+	UPROPERTY()
+		FHueLampState State;
+	//Fade time in 100ms steps
+	UPROPERTY()
+		int32 TransitionTime = 0;
+};
+
+/**
+ * A section's keys baked down to the bridge requests that reproduce them. Each cue fades to a state with a bridge
+ * transition, so a linear stretch of curve is a single request. Cues are sorted by time, playback only moves a
+ * cursor over them.
+ */
+USTRUCT()
+struct HUELIGHTING_API FHueCueBuffer
+{
+	GENERATED_USTRUCT_BODY()
+public:
+	UPROPERTY()
+		EHueCueType Type = EHueCueType::State;
+	UPROPERTY()
+		TArray<FHueCue> Cues;
+	//Seconds the cues were moved earlier by
+	UPROPERTY()
+		float BakedLatency = 0.0f;
+	//Effect sections only
+	UPROPERTY()
+		TArray<FHueEffectLayer> EffectLayers;
+	UPROPERTY()
+		float EffectDuration = 0.0f;
+
+	//Last cue sent at or before Time, INDEX_NONE before the first cue
+	int32 FindCue(float Time) const;
+	//State the lamp shows at Time when every cue up to it was sent on time
+	FHueLampState StateAt(float Time) const;
+	static FHueLampState LerpState(const FHueLampState& A, const FHueLampState& B, float Alpha);
+};
+
+/**
+ * Base of every Hue light section. Sections are only authoring data, they bake into a cue buffer when the sequence
+ * is compiled, which happens on cook and on the first play of a loaded sequence.
+ */
+UCLASS(Abstract)
+class HUELIGHTING_API UMovieSceneHueSection : public UMovieSceneSection
+{
+	GENERATED_BODY()
+
+public:
+	UMovieSceneHueSection(const FObjectInitializer& ObjectInitializer);
+
+	virtual void BakeCues(float Latency, float Tolerance, FHueCueBuffer& BufferOut) const;
+
+protected:
+	//Lamp state the section's curves ask for at a frame, sections with curves override it
+	virtual FHueLampState SampleState(FFrameTime Time) const { return FHueLampState(); }
+	virtual void GetKeyTimes(TArray<FFrameNumber>& TimesOut) const {}
+	bool GetBakeRange(double& StartOut, double& EndOut) const;
+};
+
+UCLASS(meta = (DisplayName = "Hue Color"))
+class HUELIGHTING_API UMovieSceneHueColorSection : public UMovieSceneHueSection
+{
+	GENERATED_BODY()
+
+public:
+	UMovieSceneHueColorSection(const FObjectInitializer& ObjectInitializer);
+
+	UPROPERTY()
+		FMovieSceneFloatChannel Red;
+	UPROPERTY()
+		FMovieSceneFloatChannel Green;
+	UPROPERTY()
+		FMovieSceneFloatChannel Blue;
+	// 0-1
+	UPROPERTY()
+		FMovieSceneFloatChannel Brightness;
+
+protected:
+	virtual FHueLampState SampleState(FFrameTime Time) const override;
+	virtual void GetKeyTimes(TArray<FFrameNumber>& TimesOut) const override;
+};
+
+UCLASS(meta = (DisplayName = "Hue Brightness"))
+class HUELIGHTING_API UMovieSceneHueBrightnessSection : public UMovieSceneHueSection
+{
+	GENERATED_BODY()
+
+public:
+	UMovieSceneHueBrightnessSection(const FObjectInitializer& ObjectInitializer);
+
+	virtual void BakeCues(float Latency, float Tolerance, FHueCueBuffer& BufferOut) const override;
+
+	// 0-1, 0 turns the lamp off
+	UPROPERTY()
+		FMovieSceneFloatChannel Brightness;
+
+protected:
+	virtual FHueLampState SampleState(FFrameTime Time) const override;
+	virtual void GetKeyTimes(TArray<FFrameNumber>& TimesOut) const override;
+};
+
+UCLASS(meta = (DisplayName = "Hue Effect"))
+class HUELIGHTING_API UMovieSceneHueEffectSection : public UMovieSceneHueSection
+{
+	GENERATED_BODY()
+
+public:
+	UMovieSceneHueEffectSection(const FObjectInitializer& ObjectInitializer);
+
+	virtual void BakeCues(float Latency, float Tolerance, FHueCueBuffer& BufferOut) const override;
+
+	UPROPERTY(EditAnywhere, Category = "Hue Effect")
+		bool bUsePreset = true;
+	UPROPERTY(EditAnywhere, Category = "Hue Effect", meta = (EditCondition = "bUsePreset"))
+		EHueEffectPreset Preset = EHueEffectPreset::Fire;
+	UPROPERTY(EditAnywhere, Category = "Hue Effect", meta = (EditCondition = "!bUsePreset"))
+		TArray<FHueEffectLayer> Layers;
+};
+
+/**
+ * Sequencer track driving one Hue lamp by name. Cues go out ahead of the sequence by LatencyCompensation so the
+ * light changes on the frame it was keyed on, or by half the bridge's measured round trip when that is known. Cues
+ * share the bridge's send budget with every other lamp, the wait for a send slot isn't compensated, so a lamp that
+ * has to be on time wants a high Importance or a bridge that isn't sending at its rate limit.
+ */
+UCLASS(meta = (DisplayName = "Hue Light"))
+class HUELIGHTING_API UMovieSceneHueTrack : public UMovieSceneNameableTrack, public IMovieSceneTrackTemplateProducer
+{
+	GENERATED_BODY()
+
+public:
+	UMovieSceneHueTrack(const FObjectInitializer& ObjectInitializer);
+
+	UPROPERTY(EditAnywhere, Category = "Hue Light")
+		FString LampName;
+
+	//Seconds cues are baked ahead of their keys
+	UPROPERTY(EditAnywhere, Category = "Hue Light", meta = (ClampMin = "0.0"))
+		float LatencyCompensation = 0.1f;
+
+	//Move cues at runtime by the difference between half the bridge's measured round trip and the baked latency
+	UPROPERTY(EditAnywhere, Category = "Hue Light")
+		bool bUseMeasuredLatency = true;
+
+	//Largest color difference, delta E, a fade may leave between baked cues
+	UPROPERTY(EditAnywhere, Category = "Hue Light", meta = (ClampMin = "0.1"))
+		float BakeTolerance = 2.0f;
+
+	virtual bool SupportsType(TSubclassOf<UMovieSceneSection> SectionClass) const override;
+	virtual UMovieSceneSection* CreateNewSection() override;
+	virtual void AddSection(UMovieSceneSection& Section) override;
+	virtual void RemoveSection(UMovieSceneSection& Section) override;
+	virtual void RemoveSectionAt(int32 SectionIndex) override;
+	virtual void RemoveAllAnimationData() override;
+	virtual bool HasSection(const UMovieSceneSection& Section) const override;
+	virtual bool IsEmpty() const override;
+	virtual const TArray<UMovieSceneSection*>& GetAllSections() const override;
+	virtual bool SupportsMultipleRows() const override { return true; }
+	virtual FMovieSceneEvalTemplatePtr CreateTemplateForSection(const UMovieSceneSection& InSection) const override;
+
+#if WITH_EDITOR
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+#endif
+#if WITH_EDITORONLY_DATA
+	virtual FText GetDefaultDisplayName() const override;
+#endif
+
+private:
+	void UpdatePreRoll(UMovieSceneSection& Section) const;
+
+	UPROPERTY()
+		TArray<TObjectPtr<UMovieSceneSection>> Sections;
+};
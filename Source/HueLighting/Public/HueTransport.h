@@ -0,0 +1,120 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HueTypes.h"
+#include "Interfaces/IHttpRequest.h"
+#include "HueTransport.generated.h"
+
+UENUM(BlueprintType)
+enum class EHueApiVersion : uint8
+{
+	// Legacy REST api, http://host/api/user/...
+	V1,
+	// CLIP v2, https://host/clip/v2/resource/... with the hue-application-key header
+	ClipV2
+};
+
+//Partial light change, only the fields that are set get sent
+struct HUELIGHTING_API FHueLightCommand
+{
+	TOptional<bool> bOn;
+	TOptional<int32> Hue;
+	TOptional<int32> Saturation;
+	TOptional<int32> Brightness;
+	//Fade time in 100ms steps
+	TOptional<int32> TransitionTime;
+	//CIE xy per gradient point from strip start to end, only gradient capable lights on CLIP v2 use it.
+	//v1 ignores it and shows Hue and Saturation instead
+	TArray<FVector2D> GradientPoints;
+
+	static FHueLightCommand FromState(const FHueLampState& State, int32 TransitionTime = -1);
+};
+
+//A light as the bridge reports it, the same shape for every api version
+struct HUELIGHTING_API FHueLightRecord
+{
+	//v1 light number or v2 resource id, whatever the transport addresses the light with
+	FString ResourceId;
+	FString Name;
+	FHueLampState State;
+	bool bReachable = true;
+	bool bHasState = false;
+	//Color points the light can show, 0 for lights that are a single color
+	int32 GradientPoints = 0;
+};
+
+//What a bridge schedule does when it fires, recall a scene or enable another schedule
+struct FHueScheduleCommand
+{
+	FString SceneId;
+	FString EnableScheduleId;
+};
+
+/**
+ * Builds bridge requests and reads bridge responses for one api version. Callers bind their own completion
+ * delegate and process the request, so lamps and the bridge never build urls or bodies themselves.
+ */
+class HUELIGHTING_API IHueTransport
+{
+public:
+	virtual ~IHueTransport() = default;
+
+	static TSharedRef<IHueTransport> Create(EHueApiVersion Version, const FString& Host, const FString& Key);
+
+	virtual EHueApiVersion GetApiVersion() const = 0;
+
+	virtual TSharedRef<IHttpRequest> CreateGetLights() = 0;
+	virtual TSharedRef<IHttpRequest> CreateGetLight(const FString& ResourceId) = 0;
+	virtual TSharedRef<IHttpRequest> CreateSetLight(const FString& ResourceId, const FHueLightCommand& Command) = 0;
+	//One command for every light on the bridge in a single request
+	virtual TSharedRef<IHttpRequest> CreateSetAllLights(const FHueLightCommand& Command) = 0;
+	//Recycled scenes may be cleaned up by the bridge, used for scenes we might not get to delete ourselves
+	virtual TSharedRef<IHttpRequest> CreateCreateScene(const FString& Name, const TMap<FString, FHueLampState>& States, int32 TransitionTime, bool bRecycle = false) = 0;
+	virtual TSharedRef<IHttpRequest> CreateDeleteScene(const FString& SceneId) = 0;
+	virtual TSharedRef<IHttpRequest> CreateRecallScene(const FString& SceneId) = 0;
+	//LocalTime is a bridge timer pattern, PThh:mm:ss fires once and R/PThh:mm:ss repeats
+	virtual TSharedRef<IHttpRequest> CreateCreateSchedule(const FString& Name, const FHueScheduleCommand& Command, const FString& LocalTime, bool bEnabled, bool bAutoDelete) = 0;
+	virtual TSharedRef<IHttpRequest> CreateDeleteSchedule(const FString& ScheduleId) = 0;
+	virtual TSharedRef<IHttpRequest> CreateGetSensors() = 0;
+	//Ask the bridge for a user, only answered while the link button is pressed
+	virtual TSharedRef<IHttpRequest> CreateCreateUser(const FString& AppName) = 0;
+	//Radio link state of every light, nullptr if the light read already reports reachability
+	virtual TSharedPtr<IHttpRequest> CreateGetConnectivity() { return nullptr; }
+	//Server sent events for every change on the bridge, nullptr if the api has no event stream
+	virtual TSharedPtr<IHttpRequest> CreateEventStream() { return nullptr; }
+
+	virtual bool ParseLights(const FString& Data, TArray<FHueLightRecord>& LightsOut) const = 0;
+	virtual bool ParseLight(const FString& ResourceId, const FString& Data, FHueLightRecord& LightOut) const = 0;
+	virtual bool ParseCreatedId(const FString& Data, FString& IdOut) const = 0;
+	virtual bool ParseSensors(const FString& Data, TArray<FHueSensorState>& SensorsOut) const = 0;
+	virtual bool ParseCreatedUser(const FString& Data, FString& UserOut) const = 0;
+	//True if every change of a group action was taken
+	virtual bool ParseActionSucceeded(const FString& Data) const = 0;
+	//Keeps the link state for the light reads that follow
+	virtual bool ParseConnectivity(const FString& Data) const { return false; }
+	//Sensor changes out of complete event stream lines
+	virtual bool ParseEvents(const FString& Lines, TArray<FHueSensorState>& EventsOut) const { return false; }
+	//True if the bridge refused a light change because it can't reach the light
+	virtual bool IsUnreachableError(const FHttpResponsePtr& Response) const = 0;
+
+	const FString& GetHost() const { return Host; }
+	const FString& GetKey() const { return Key; }
+	int32 GetRequestCount() const { return RequestCount; }
+	//Bridges only serve CLIP v2 over https, stand-in bridges and emulators on this machine may serve plain http
+	void SetUseTls(bool bInUseTls) { bUseTls = bInUseTls; }
+
+protected:
+	IHueTransport(const FString& InHost, const FString& InKey) : Host(InHost), Key(InKey) {}
+
+	TSharedRef<IHttpRequest> NewRequest(const FString& URL, const FString& Verb, const FString& Body = FString());
+
+	FString Host;
+	FString Key;
+	int32 RequestCount = 0;
+	bool bUseTls = true;
+};
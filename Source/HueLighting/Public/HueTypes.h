@@ -0,0 +1,100 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HueTypes.generated.h"
+
+class FJsonObject;
+
+/**
+ * Lamp state quantized to the values the Hue bridge actually stores.
+ * Two states that compare equal produce the same light, so this is what we dirty check against
+ * before sending anything to the bridge.
+ */
+USTRUCT(BlueprintType)
+struct HUELIGHTING_API FHueLampState
+{
+	GENERATED_USTRUCT_BODY()
+public:
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Lamp")
+		bool bOn = false;
+	// Hue bridge max value 65535
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Lamp")
+		int32 Hue = 0;
+	// Hue bridge max value 254
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Lamp")
+		int32 Saturation = 0;
+	// Hue bridge max value 254
+	UPROPERTY(EditAnywhere,BlueprintReadWrite, Category = "Hue Lamp")
+		int32 Brightness = 0;
+
+	static FHueLampState FromLinearColor(const FLinearColor& Color, float Intensity = 1.0f);
+	static void FromBridgeJson(const TSharedPtr<FJsonObject>& StateObj, FHueLampState& StateOut, bool& bReachableOut);
+	FLinearColor ToLinearColor() const;
+	FVector ToLab() const;
+	FVector2D ToXY() const;
+	static void ToXYBatch(TConstArrayView<FHueLampState> States, TArray<FVector2D>& XYOut);
+	void SetColorFromXY(double X, double Y);
+	static float PerceptualDistance(const FHueLampState& A, const FHueLampState& B);
+	FColor ToColor() const { return ToLinearColor().ToFColor(true); }
+
+	bool operator==(const FHueLampState& Other) const
+	{
+		//Every off lamp looks the same no matter what color it was left on
+		if(bOn != Other.bOn)
+		{
+			return false;
+		}
+		return !bOn || (Hue == Other.Hue && Saturation == Other.Saturation && Brightness == Other.Brightness);
+	}
+	bool operator!=(const FHueLampState& Other) const { return !(*this == Other); }
+};
+
+UENUM(BlueprintType)
+enum class EHueSensorType : uint8
+{
+	Unknown,
+	// Dimmer switch, tap and smart button
+	Switch,
+	Presence,
+	LightLevel,
+	Temperature
+};
+
+/**
+ * A sensor as the bridge reports it. Only the field that belongs to the sensor's type means anything.
+ */
+USTRUCT(BlueprintType)
+struct HUELIGHTING_API FHueSensorState
+{
+	GENERATED_USTRUCT_BODY()
+public:
+	//v1 sensor number, v2 events are mapped back to it
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Sensor")
+		FString SensorId;
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Sensor")
+		FString Name;
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Sensor")
+		EHueSensorType Type = EHueSensorType::Unknown;
+	//Button number times 1000 plus 0 press, 1 hold, 2 short release, 3 long release
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Sensor")
+		int32 ButtonEvent = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Sensor")
+		bool bPresence = false;
+	//10000 log10(lux) + 1
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Sensor")
+		int32 LightLevel = 0;
+	//Degrees celsius
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Sensor")
+		float Temperature = 0.0f;
+	//Bridge time of the last change, UTC cut to whole seconds so v1 reads and v2 events of one change match
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Sensor")
+		FDateTime LastUpdated;
+	//Round trip of the read that brought the change in, zero for changes from the event stream
+	UPROPERTY(BlueprintReadOnly, Category = "Hue Sensor")
+		float LatencyMs = 0.0f;
+};
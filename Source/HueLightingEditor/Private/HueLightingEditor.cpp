@@ -0,0 +1,25 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "HueLightingEditor.h"
+#include "HueTrackEditor.h"
+#include "ISequencerModule.h"
+
+#define LOCTEXT_NAMESPACE "FHueLightingEditorModule"
+
+void FHueLightingEditorModule::StartupModule()
+{
+	ISequencerModule& SequencerModule = FModuleManager::LoadModuleChecked<ISequencerModule>(TEXT("Sequencer"));
+	TrackEditorHandle = SequencerModule.RegisterTrackEditor(FOnCreateTrackEditor::CreateStatic(&FHueTrackEditor::CreateTrackEditor));
+}
+
+void FHueLightingEditorModule::ShutdownModule()
+{
+	if(ISequencerModule* SequencerModule = FModuleManager::GetModulePtr<ISequencerModule>(TEXT("Sequencer")))
+	{
+		SequencerModule->UnRegisterTrackEditor(TrackEditorHandle);
+	}
+}
+
+#undef LOCTEXT_NAMESPACE
+	
+IMPLEMENT_MODULE(FHueLightingEditorModule, HueLightingEditor)
@@ -0,0 +1,107 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#include "HueTrackEditor.h"
+#include "HueSequencerTrack.h"
+#include "ISequencerSection.h"
+#include "MovieScene.h"
+#include "ScopedTransaction.h"
+#include "SequencerUtilities.h"
+#include "Framework/MultiBox/MultiBoxBuilder.h"
+
+#define LOCTEXT_NAMESPACE "HueTrackEditor"
+
+FHueTrackEditor::FHueTrackEditor(TSharedRef<ISequencer> InSequencer)
+	: FMovieSceneTrackEditor(InSequencer)
+{
+}
+
+TSharedRef<ISequencerTrackEditor> FHueTrackEditor::CreateTrackEditor(TSharedRef<ISequencer> OwningSequencer)
+{
+	return MakeShareable(new FHueTrackEditor(OwningSequencer));
+}
+
+void FHueTrackEditor::BuildAddTrackMenu(FMenuBuilder& MenuBuilder)
+{
+	MenuBuilder.AddMenuEntry(
+		LOCTEXT("AddTrack", "Hue Light"),
+		LOCTEXT("AddTrackTooltip", "Adds a track that drives a Hue lamp with baked, latency compensated cues."),
+		FSlateIcon(),
+		FUIAction(FExecuteAction::CreateRaw(this, &FHueTrackEditor::AddTrack)));
+}
+
+TSharedPtr<SWidget> FHueTrackEditor::BuildOutlinerEditWidget(const FGuid& ObjectBinding, UMovieSceneTrack* Track, const FBuildEditWidgetParams& Params)
+{
+	UMovieSceneHueTrack* HueTrack = Cast<UMovieSceneHueTrack>(Track);
+	if(!HueTrack)
+	{
+		return TSharedPtr<SWidget>();
+	}
+	return FSequencerUtilities::MakeAddButton(LOCTEXT("AddSection", "Section"), FOnGetContent::CreateSP(this, &FHueTrackEditor::BuildAddSectionMenu, HueTrack), Params.NodeIsHovered, GetSequencer());
+}
+
+TSharedRef<ISequencerSection> FHueTrackEditor::MakeSectionInterface(UMovieSceneSection& SectionObject, UMovieSceneTrack& Track, FGuid ObjectBinding)
+{
+	return MakeShareable(new FSequencerSection(SectionObject));
+}
+
+bool FHueTrackEditor::SupportsType(TSubclassOf<UMovieSceneTrack> Type) const
+{
+	return Type == UMovieSceneHueTrack::StaticClass();
+}
+
+void FHueTrackEditor::AddTrack()
+{
+	UMovieScene* FocusedMovieScene = GetFocusedMovieScene();
+	if(!FocusedMovieScene || FocusedMovieScene->IsReadOnly())
+	{
+		return;
+	}
+	const FScopedTransaction Transaction(LOCTEXT("AddTrackTransaction", "Add Hue Light Track"));
+	FocusedMovieScene->Modify();
+	UMovieSceneHueTrack* NewTrack = FocusedMovieScene->AddTrack<UMovieSceneHueTrack>();
+	UMovieSceneSection* NewSection = NewTrack->CreateNewSection();
+	NewSection->SetRange(FocusedMovieScene->GetPlaybackRange());
+	NewTrack->AddSection(*NewSection);
+	if(GetSequencer().IsValid())
+	{
+		GetSequencer()->OnAddTrack(NewTrack, FGuid());
+	}
+}
+
+TSharedRef<SWidget> FHueTrackEditor::BuildAddSectionMenu(UMovieSceneHueTrack* Track)
+{
+	FMenuBuilder MenuBuilder(true, nullptr);
+	MenuBuilder.AddMenuEntry(LOCTEXT("AddColor", "Color"), LOCTEXT("AddColorTooltip", "Keys red, green, blue and brightness."), FSlateIcon(),
+		FUIAction(FExecuteAction::CreateSP(this, &FHueTrackEditor::AddSection, Track, UMovieSceneHueColorSection::StaticClass())));
+	MenuBuilder.AddMenuEntry(LOCTEXT("AddBrightness", "Brightness"), LOCTEXT("AddBrightnessTooltip", "Keys brightness only, the lamp keeps its color."), FSlateIcon(),
+		FUIAction(FExecuteAction::CreateSP(this, &FHueTrackEditor::AddSection, Track, UMovieSceneHueBrightnessSection::StaticClass())));
+	MenuBuilder.AddMenuEntry(LOCTEXT("AddEffect", "Effect"), LOCTEXT("AddEffectTooltip", "Plays a Hue effect for the length of the section."), FSlateIcon(),
+		FUIAction(FExecuteAction::CreateSP(this, &FHueTrackEditor::AddSection, Track, UMovieSceneHueEffectSection::StaticClass())));
+	return MenuBuilder.MakeWidget();
+}
+
+/**
+ * @brief Add a section at the play head on a new row, five seconds long
+ */
+void FHueTrackEditor::AddSection(UMovieSceneHueTrack* Track, UClass* SectionClass)
+{
+	UMovieScene* FocusedMovieScene = GetFocusedMovieScene();
+	if(!FocusedMovieScene || FocusedMovieScene->IsReadOnly())
+	{
+		return;
+	}
+	const FScopedTransaction Transaction(LOCTEXT("AddSectionTransaction", "Add Hue Section"));
+	Track->Modify();
+	const FFrameNumber Start = GetSequencer()->GetLocalTime().Time.FrameNumber;
+	const FFrameNumber Length = (FocusedMovieScene->GetTickResolution().AsFrameTime(5.0)).FrameNumber;
+	UMovieSceneSection* NewSection = NewObject<UMovieSceneSection>(Track, SectionClass, NAME_None, RF_Transactional);
+	NewSection->SetRange(TRange<FFrameNumber>(Start, Start + Length));
+	NewSection->SetRowIndex(Track->GetMaxRowIndex() + 1);
+	Track->AddSection(*NewSection);
+	GetSequencer()->NotifyMovieSceneDataChanged(EMovieSceneDataChangeType::MovieSceneStructureItemAdded);
+}
+
+#undef LOCTEXT_NAMESPACE
@@ -0,0 +1,33 @@
+/*
+MIT License Modified See LICENSE Files for more details
+Copyright (c) 2022 Scott Tongue all rights reversed
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MovieSceneTrackEditor.h"
+
+class UMovieSceneHueTrack;
+
+/**
+ * Adds Hue Light tracks to level sequences. Sections use the default section UI, color and brightness keys are
+ * plain float channels.
+ */
+class FHueTrackEditor : public FMovieSceneTrackEditor
+{
+public:
+	FHueTrackEditor(TSharedRef<ISequencer> InSequencer);
+
+	static TSharedRef<ISequencerTrackEditor> CreateTrackEditor(TSharedRef<ISequencer> OwningSequencer);
+
+	virtual void BuildAddTrackMenu(FMenuBuilder& MenuBuilder) override;
+	virtual TSharedPtr<SWidget> BuildOutlinerEditWidget(const FGuid& ObjectBinding, UMovieSceneTrack* Track, const FBuildEditWidgetParams& Params) override;
+	virtual TSharedRef<ISequencerSection> MakeSectionInterface(UMovieSceneSection& SectionObject, UMovieSceneTrack& Track, FGuid ObjectBinding) override;
+	virtual bool SupportsType(TSubclassOf<UMovieSceneTrack> Type) const override;
+
+private:
+	void AddTrack();
+	TSharedRef<SWidget> BuildAddSectionMenu(UMovieSceneHueTrack* Track);
+	void AddSection(UMovieSceneHueTrack* Track, UClass* SectionClass);
+};